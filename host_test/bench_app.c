@@ -0,0 +1,99 @@
+// Benchmark de la aplicación completa (main/main.c) con cámara y MQTT simulados
+//
+// Arranca app_main() tal cual, pero con los timers forzados a
+// BENCH_TRIGGER_US: el pipeline trabaja saturado y los frames/s medidos son
+// el techo del camino captura -> codificación -> publicación en el host.
+// Con HOST_MQTT_RECORD=<fichero> se graban los mensajes publicados.
+//
+//   bench_app [frames]
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "host_mock.h"
+
+#define BENCH_DEFAULT_FRAMES    200
+#define BENCH_WARMUP_FRAMES     5
+#define BENCH_TRIGGER_US        50      // Periodo del timer de captura
+#define BENCH_STALL_MS          10000   // Sin frames nuevos durante este tiempo = fallo
+
+void app_main(void);
+
+/**
+ * @brief Espera a que MQTT haya recibido al menos frames frames completos
+ */
+static bool wait_frames(uint32_t frames, host_mqtt_stats_t *st)
+{
+    uint32_t last = 0;
+    int64_t last_us = esp_timer_get_time();
+
+    while (1)
+    {
+        host_mqtt_get_stats(st);
+        if (st->frames >= frames)
+        {
+            return true;
+        }
+        int64_t now = esp_timer_get_time();
+        if (st->frames != last)
+        {
+            last = st->frames;
+            last_us = now;
+        }
+        else if (now - last_us > (int64_t)BENCH_STALL_MS * 1000)
+        {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t frames = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_FRAMES;
+    if (frames == 0)
+    {
+        fprintf(stderr, "uso: %s [frames]\n", argv[0]);
+        return 2;
+    }
+
+    host_timers_set_period_us(BENCH_TRIGGER_US);
+    app_main();
+    size_t boot_heap = host_heap_used();
+
+    host_mqtt_stats_t m0, m1;
+    host_camera_stats_t c0, c1;
+    if (!wait_frames(BENCH_WARMUP_FRAMES, &m0))
+    {
+        fprintf(stderr, "bench_app: la aplicación no publica frames\n");
+        return 1;
+    }
+    host_camera_get_stats(&c0);
+    host_heap_reset_peak();
+    unsigned long allocs0 = host_heap_allocs();
+    int64_t t0 = esp_timer_get_time();
+
+    if (!wait_frames(m0.frames + frames, &m1))
+    {
+        fprintf(stderr, "bench_app: pipeline detenido tras %u frames\n", (unsigned)(m1.frames - m0.frames));
+        return 1;
+    }
+    int64_t elapsed_us = esp_timer_get_time() - t0;
+    host_camera_get_stats(&c1);
+    unsigned long allocs = host_heap_allocs() - allocs0;
+
+    uint32_t n = m1.frames - m0.frames;
+    uint32_t captured = c1.frames - c0.frames;
+    double secs = (double)elapsed_us / 1e6;
+    printf("bench_app: %u frames en %.3f s (%d imágenes de prueba)\n", (unsigned)n, secs, c1.pictures);
+    printf("  frames/s:          %.1f\n", n / secs);
+    printf("  bytes/frame MQTT:  %.0f (%.2f mensajes/frame, mayor mensaje %d bytes)\n",
+           (double)(m1.bytes - m0.bytes) / n, (double)(m1.messages - m0.messages) / n, m1.max_len);
+    printf("  bytes/frame JPEG:  %.0f\n", captured ? (double)(c1.bytes - c0.bytes) / captured : 0.0);
+    printf("  heap tras arrancar: %zu bytes\n", boot_heap);
+    printf("  heap pico:          %zu bytes (+%zu sobre el arranque)\n", host_heap_peak(),
+           host_heap_peak() > boot_heap ? host_heap_peak() - boot_heap : 0);
+    printf("  reservas/frame:     %.2f\n", (double)allocs / n);
+    return 0;
+}
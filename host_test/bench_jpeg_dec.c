@@ -0,0 +1,417 @@
+// Benchmark del decodificador esp_jpeg (tjpgd) sobre las imágenes de prueba
+//
+// Decodifica cada imagen de la cámara simulada en cada formato de salida, con y sin
+// swap_color_bytes, a escala 1:1 y 1:2: ms por imagen y Mpix/s de salida en la mejor vuelta.
+// Después, una secuencia de frames del mismo tamaño y calidad (como el MJPEG de un sensor)
+// con esp_jpeg_decode frente al decodificador que reutiliza las tablas. Por último, regiones
+// de interés frente a la imagen completa, sin y con intervalos de reinicio (fmt2jpg_parallel),
+// y esos mismos intervalos repartidos entre tareas con esp_jpeg_decode_parallel.
+//
+//   bench_jpeg_dec [repeticiones]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "img_converters.h"
+#include "jpeg_decoder.h"
+#include "host_mock.h"
+
+#define BENCH_DEFAULT_ROUNDS    20
+#define BENCH_SEQUENCE_FRAMES   8
+#define BENCH_SEQUENCE_QUALITY  60
+
+static const struct {
+    const char *name;
+    esp_jpeg_image_format_t format;
+    bool swap;
+} outputs[] = {
+    { "RGB888", JPEG_IMAGE_FORMAT_RGB888, false },
+    { "BGR888", JPEG_IMAGE_FORMAT_RGB888, true },
+    { "RGB565", JPEG_IMAGE_FORMAT_RGB565, false },
+    { "565swap", JPEG_IMAGE_FORMAT_RGB565, true },
+};
+
+static const struct {
+    const char *name;
+    esp_jpeg_image_scale_t scale;
+} scales[] = {
+    { "1:1", JPEG_IMAGE_SCALE_0 },
+    { "1:2", JPEG_IMAGE_SCALE_1_2 },
+};
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+} frame_t;
+
+// Mejor vuelta en µs de decodificar toda la secuencia, con el decodificador reutilizable si se da
+static int64_t time_sequence(const frame_t *seq, int count, esp_jpeg_image_scale_t scale, uint8_t *outbuf, size_t outbuf_size,
+                             uint8_t *work, size_t work_size, esp_jpeg_decoder_handle_t decoder, int rounds)
+{
+    int64_t best_us = INT64_MAX;
+    for (int r = 0; r < rounds; r++)
+    {
+        int64_t t0 = esp_timer_get_time();
+        for (int f = 0; f < count; f++)
+        {
+            esp_jpeg_image_cfg_t cfg = {
+                .indata = seq[f].buf,
+                .indata_size = seq[f].len,
+                .outbuf = outbuf,
+                .outbuf_size = outbuf_size,
+                .out_format = JPEG_IMAGE_FORMAT_RGB565,
+                .out_scale = scale,
+                .advanced = { .working_buffer = work, .working_buffer_size = work_size },
+            };
+            esp_jpeg_image_output_t info;
+            esp_err_t err = decoder ? esp_jpeg_decoder_decode(decoder, &cfg, &info) : esp_jpeg_decode(&cfg, &info);
+            if (err != ESP_OK)
+            {
+                return -1;
+            }
+        }
+        int64_t us = esp_timer_get_time() - t0;
+        best_us = us < best_us ? us : best_us;
+    }
+    return best_us;
+}
+
+// Secuencia de la imagen desplazada 8 píxeles por frame: mismas cabeceras, distinto contenido
+static int bench_sequence(const frame_t *frame, uint8_t *work, size_t work_size, int rounds)
+{
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = frame->buf,
+        .indata_size = frame->len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .advanced = { .working_buffer = work, .working_buffer_size = work_size },
+    };
+    esp_jpeg_image_output_t info;
+    if (esp_jpeg_get_image_info(&cfg, &info) != ESP_OK)
+    {
+        return -1;
+    }
+    const size_t len = info.output_len;
+    uint8_t *rgb = malloc(len);
+    uint8_t *panned = malloc(len);
+    cfg.outbuf = rgb;
+    cfg.outbuf_size = len;
+    if (esp_jpeg_decode(&cfg, &info) != ESP_OK)
+    {
+        return -1;
+    }
+    frame_t seq[BENCH_SEQUENCE_FRAMES];
+    const size_t row = (size_t)info.width * 3;
+    for (int f = 0; f < BENCH_SEQUENCE_FRAMES; f++)
+    {
+        const size_t shift = (size_t)(f * 8 % info.width) * 3;
+        for (int y = 0; y < info.height; y++)
+        {
+            memcpy(panned + y * row, rgb + y * row + shift, row - shift);
+            memcpy(panned + y * row + row - shift, rgb + y * row, shift);
+        }
+        if (!fmt2jpg(panned, len, info.width, info.height, PIXFORMAT_RGB888, BENCH_SEQUENCE_QUALITY, &seq[f].buf, &seq[f].len))
+        {
+            return -1;
+        }
+    }
+
+    esp_jpeg_decoder_handle_t decoder;
+    if (esp_jpeg_decoder_create(work_size, &decoder) != ESP_OK)
+    {
+        return -1;
+    }
+    printf("  %ux%u x %d frames", info.width, info.height, BENCH_SEQUENCE_FRAMES);
+    static const esp_jpeg_image_scale_t seq_scales[] = { JPEG_IMAGE_SCALE_0, JPEG_IMAGE_SCALE_1_8 };
+    static const char *seq_names[] = { "1:1", "1:8" };
+    for (size_t s = 0; s < sizeof(seq_scales) / sizeof(seq_scales[0]); s++)
+    {
+        int64_t plain_us = time_sequence(seq, BENCH_SEQUENCE_FRAMES, seq_scales[s], rgb, len, work, work_size, NULL, rounds);
+        int64_t cached_us = time_sequence(seq, BENCH_SEQUENCE_FRAMES, seq_scales[s], rgb, len, work, work_size, decoder, rounds);
+        if (plain_us < 0 || cached_us < 0)
+        {
+            return -1;
+        }
+        printf(" | %s %6.3f -> %6.3f ms/frame x%.2f", seq_names[s], plain_us / 1000.0 / BENCH_SEQUENCE_FRAMES,
+               cached_us / 1000.0 / BENCH_SEQUENCE_FRAMES, cached_us > 0 ? (double)plain_us / cached_us : 0);
+    }
+    esp_jpeg_decoder_stats_t stats;
+    esp_jpeg_decoder_get_stats(decoder, &stats);
+    printf(" | %u preparaciones en %u\n", (unsigned)stats.prepares, (unsigned)stats.decodes);
+
+    esp_jpeg_decoder_delete(decoder);
+    for (int f = 0; f < BENCH_SEQUENCE_FRAMES; f++)
+    {
+        free(seq[f].buf);
+    }
+    free(panned);
+    free(rgb);
+    return 0;
+}
+
+// Mejor vuelta en µs de decodificar la región (ancho 0: imagen completa)
+static int64_t time_roi(const frame_t *frame, uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t *outbuf,
+                        uint8_t *work, size_t work_size, int rounds)
+{
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = frame->buf,
+        .indata_size = frame->len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB565,
+        .advanced = { .working_buffer = work, .working_buffer_size = work_size },
+        .roi = { .x = x, .y = y, .width = width, .height = height },
+    };
+    esp_jpeg_image_output_t info;
+    if (esp_jpeg_get_image_info(&cfg, &info) != ESP_OK)
+    {
+        return -1;
+    }
+    cfg.outbuf = outbuf;
+    cfg.outbuf_size = info.output_len;
+    int64_t best_us = INT64_MAX;
+    for (int r = 0; r < rounds; r++)
+    {
+        int64_t t0 = esp_timer_get_time();
+        if (esp_jpeg_decode(&cfg, &info) != ESP_OK)
+        {
+            return -1;
+        }
+        int64_t us = esp_timer_get_time() - t0;
+        best_us = us < best_us ? us : best_us;
+    }
+    return best_us;
+}
+
+// Imagen completa, cuarto central y dieciseisavo de abajo a la derecha
+static int bench_roi(const frame_t *frame, const char *name, uint8_t *work, size_t work_size, int rounds)
+{
+    esp_jpeg_image_cfg_t cfg = { .indata = frame->buf, .indata_size = frame->len, .out_format = JPEG_IMAGE_FORMAT_RGB565 };
+    esp_jpeg_image_output_t info;
+    if (esp_jpeg_get_image_info(&cfg, &info) != ESP_OK)
+    {
+        return -1;
+    }
+    const uint16_t w = info.width, h = info.height;
+    uint8_t *outbuf = malloc(info.output_len);
+    int64_t full_us = time_roi(frame, 0, 0, 0, 0, outbuf, work, work_size, rounds);
+    int64_t center_us = time_roi(frame, w / 4, h / 4, w / 2, h / 2, outbuf, work, work_size, rounds);
+    int64_t corner_us = time_roi(frame, w - w / 4, h - h / 4, w / 4, h / 4, outbuf, work, work_size, rounds);
+    free(outbuf);
+    if (full_us < 0 || center_us < 0 || corner_us < 0)
+    {
+        return -1;
+    }
+    printf("  %ux%u %-6s | completa %6.3f ms | centro 1/4 %6.3f ms x%.2f | esquina 1/16 %6.3f ms x%.2f\n", w, h, name,
+           full_us / 1000.0, center_us / 1000.0, center_us > 0 ? (double)full_us / center_us : 0,
+           corner_us / 1000.0, corner_us > 0 ? (double)full_us / corner_us : 0);
+    return 0;
+}
+
+// La misma imagen recodificada en 4 franjas con DRI/RSTn
+static int reencode_with_restarts(const frame_t *frame, frame_t *out, uint8_t *work, size_t work_size)
+{
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = frame->buf,
+        .indata_size = frame->len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .advanced = { .working_buffer = work, .working_buffer_size = work_size },
+    };
+    esp_jpeg_image_output_t info;
+    if (esp_jpeg_get_image_info(&cfg, &info) != ESP_OK)
+    {
+        return -1;
+    }
+    cfg.outbuf = malloc(info.output_len);
+    cfg.outbuf_size = info.output_len;
+    bool ok = esp_jpeg_decode(&cfg, &info) == ESP_OK &&
+              fmt2jpg_parallel(cfg.outbuf, info.output_len, info.width, info.height, PIXFORMAT_RGB888, BENCH_SEQUENCE_QUALITY,
+                               &out->buf, &out->len, 4);
+    free(cfg.outbuf);
+    return ok ? 0 : -1;
+}
+
+// Mejor vuelta en µs de la imagen completa con tasks tareas (1: esp_jpeg_decode)
+static int64_t time_parallel(const frame_t *frame, int tasks, uint8_t *outbuf, size_t outbuf_size, uint8_t *work,
+                             size_t work_size, int rounds)
+{
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = frame->buf,
+        .indata_size = frame->len,
+        .outbuf = outbuf,
+        .outbuf_size = outbuf_size,
+        .out_format = JPEG_IMAGE_FORMAT_RGB565,
+        .advanced = { .working_buffer = work, .working_buffer_size = work_size },
+    };
+    esp_jpeg_image_output_t info;
+    int64_t best_us = INT64_MAX;
+    for (int r = 0; r < rounds; r++)
+    {
+        int64_t t0 = esp_timer_get_time();
+        esp_err_t err = tasks == 1 ? esp_jpeg_decode(&cfg, &info) : esp_jpeg_decode_parallel(&cfg, &info, tasks);
+        if (err != ESP_OK)
+        {
+            return -1;
+        }
+        int64_t us = esp_timer_get_time() - t0;
+        best_us = us < best_us ? us : best_us;
+    }
+    return best_us;
+}
+
+// Una tarea frente a dos y una por núcleo (en un host de un solo núcleo no se espera ganancia)
+static int bench_parallel(const frame_t *frame, uint8_t *work, size_t work_size, int rounds)
+{
+    esp_jpeg_image_cfg_t cfg = { .indata = frame->buf, .indata_size = frame->len, .out_format = JPEG_IMAGE_FORMAT_RGB565 };
+    esp_jpeg_image_output_t info;
+    if (esp_jpeg_get_image_info(&cfg, &info) != ESP_OK)
+    {
+        return -1;
+    }
+    uint8_t *outbuf = malloc(info.output_len);
+    int64_t serial_us = time_parallel(frame, 1, outbuf, info.output_len, work, work_size, rounds);
+    int64_t two_us = time_parallel(frame, 2, outbuf, info.output_len, work, work_size, rounds);
+    int64_t cores_us = time_parallel(frame, 0, outbuf, info.output_len, work, work_size, rounds);
+    free(outbuf);
+    if (serial_us < 0 || two_us < 0 || cores_us < 0)
+    {
+        return -1;
+    }
+    printf("  %ux%u | 1 tarea %6.3f ms | 2 tareas %6.3f ms x%.2f | %d núcleos %6.3f ms x%.2f\n", info.width,
+           info.height, serial_us / 1000.0, two_us / 1000.0, two_us > 0 ? (double)serial_us / two_us : 0,
+           (int)portNUM_PROCESSORS, cores_us / 1000.0, cores_us > 0 ? (double)serial_us / cores_us : 0);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_ROUNDS;
+    if (rounds <= 0)
+    {
+        fprintf(stderr, "uso: %s [repeticiones]\n", argv[0]);
+        return 2;
+    }
+
+    camera_config_t config = {
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_SVGA,
+        .fb_count = 1,
+    };
+    if (esp_camera_init(&config) != ESP_OK)
+    {
+        fprintf(stderr, "bench_jpeg_dec: sin imágenes de prueba\n");
+        return 1;
+    }
+    host_camera_stats_t cs;
+    host_camera_get_stats(&cs);
+    frame_t *frames = calloc((size_t)cs.pictures, sizeof(frame_t));
+    for (int i = 0; i < cs.pictures; i++)
+    {
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (!fb)
+        {
+            fprintf(stderr, "bench_jpeg_dec: sin frame %d\n", i);
+            return 1;
+        }
+        frames[i].buf = malloc(fb->len);
+        frames[i].len = fb->len;
+        memcpy(frames[i].buf, fb->buf, fb->len);
+        esp_camera_fb_return(fb);
+    }
+
+    // Los 3100 bytes por defecto no bastan para un H2V2 con dos tablas de cuantización
+    static uint8_t work[8192];
+    printf("bench_jpeg_dec: %d imágenes x %d repeticiones\n", cs.pictures, rounds);
+    for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++)
+    {
+        for (size_t o = 0; o < sizeof(outputs) / sizeof(outputs[0]); o++)
+        {
+            int64_t total_best_us = 0;
+            size_t total_pixels = 0;
+            printf("  %-7s %s", outputs[o].name, scales[s].name);
+            for (int i = 0; i < cs.pictures; i++)
+            {
+                esp_jpeg_image_cfg_t cfg = {
+                    .indata = frames[i].buf,
+                    .indata_size = frames[i].len,
+                    .out_format = outputs[o].format,
+                    .out_scale = scales[s].scale,
+                    .flags = { .swap_color_bytes = outputs[o].swap },
+                    .advanced = { .working_buffer = work, .working_buffer_size = sizeof(work) },
+                };
+                esp_jpeg_image_output_t info;
+                if (esp_jpeg_get_image_info(&cfg, &info) != ESP_OK)
+                {
+                    fprintf(stderr, "bench_jpeg_dec: cabecera no válida en la imagen %d\n", i);
+                    return 1;
+                }
+                cfg.outbuf = malloc(info.output_len);
+                cfg.outbuf_size = info.output_len;
+                int64_t best_us = INT64_MAX;
+                for (int r = 0; r < rounds; r++)
+                {
+                    int64_t t0 = esp_timer_get_time();
+                    esp_err_t err = esp_jpeg_decode(&cfg, &info);
+                    int64_t us = esp_timer_get_time() - t0;
+                    if (err != ESP_OK)
+                    {
+                        fprintf(stderr, "bench_jpeg_dec: esp_jpeg_decode falló (%s, imagen %d)\n", outputs[o].name, i);
+                        return 1;
+                    }
+                    best_us = us < best_us ? us : best_us;
+                }
+                free(cfg.outbuf);
+                const size_t pixels = (size_t)info.width * info.height;
+                total_best_us += best_us;
+                total_pixels += pixels;
+                printf(" | %4ux%-4u %6.2f ms %6.1f Mpix/s", info.width, info.height, best_us / 1000.0,
+                       best_us > 0 ? (double)pixels / best_us : 0);
+            }
+            printf(" | total %6.1f Mpix/s\n", total_best_us > 0 ? (double)total_pixels / total_best_us : 0);
+        }
+    }
+
+    printf("secuencia de cámara (RGB565, esp_jpeg_decode -> decodificador reutilizable):\n");
+    for (int i = 0; i < cs.pictures; i++)
+    {
+        if (bench_sequence(&frames[i], work, sizeof(work), rounds) != 0)
+        {
+            fprintf(stderr, "bench_jpeg_dec: secuencia de la imagen %d falló\n", i);
+            return 1;
+        }
+    }
+
+    printf("regiones de interés (RGB565, 1:1):\n");
+    for (int i = 0; i < cs.pictures; i++)
+    {
+        frame_t restarts;
+        if (bench_roi(&frames[i], "", work, sizeof(work), rounds) != 0 ||
+                reencode_with_restarts(&frames[i], &restarts, work, sizeof(work)) != 0 ||
+                bench_roi(&restarts, "RSTn", work, sizeof(work), rounds) != 0)
+        {
+            fprintf(stderr, "bench_jpeg_dec: regiones de la imagen %d fallaron\n", i);
+            return 1;
+        }
+        free(restarts.buf);
+    }
+
+    printf("decodificación paralela por intervalos de reinicio (RGB565, 1:1, RSTn):\n");
+    for (int i = 0; i < cs.pictures; i++)
+    {
+        frame_t restarts;
+        if (reencode_with_restarts(&frames[i], &restarts, work, sizeof(work)) != 0 ||
+                bench_parallel(&restarts, work, sizeof(work), rounds) != 0)
+        {
+            fprintf(stderr, "bench_jpeg_dec: decodificación paralela de la imagen %d falló\n", i);
+            return 1;
+        }
+        free(restarts.buf);
+    }
+
+    for (int i = 0; i < cs.pictures; i++)
+    {
+        free(frames[i].buf);
+    }
+    free(frames);
+    esp_camera_deinit();
+    return 0;
+}
@@ -0,0 +1,367 @@
+// Benchmark del codificador JPEG (fmt2jpg) sobre las imágenes de prueba
+//
+// Las imágenes de la cámara simulada se decodifican con esp_jpeg y se pasan a
+// cada formato crudo del sensor. Después se mide cuánto tarda fmt2jpg en
+// comprimir cada frame en cada formato, de una pasada y por bandas con
+// fmt2jpg_parallel() repartidas entre varias tareas, y cuánto una miniatura
+// reducida al codificar con fmt2jpg_scaled() (1/2, 1/4 y una proporción cualquiera).
+// Por último fmt2jpg_target() con un presupuesto fijo y con la mitad de lo que ocupa el
+// frame a la calidad pedida: calidad elegida, tamaño previsto y real, y coste frente a fmt2jpg.
+// Y fmt2jpg_optimized(): ms de más por la segunda pasada frente a bytes ahorrados con las
+// tablas Huffman de cada imagen, con el total de todas las imágenes.
+//
+//   bench_jpge [repeticiones] [calidad] [tareas]
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "img_converters.h"
+#include "jpeg_decoder.h"
+#include "host_mock.h"
+
+#define BENCH_DEFAULT_ROUNDS    10
+#define BENCH_DEFAULT_QUALITY   80
+#define BENCH_DEFAULT_TASKS     2
+#define BENCH_TARGET_BYTES      (30 * 1024)
+
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    uint8_t *bgr;       // RGB888 como lo entrega la cámara (B, G, R)
+    uint8_t *rgb565;
+    uint8_t *yuyv;
+    uint8_t *gray;
+} picture_t;
+
+static const struct {
+    const char *name;
+    pixformat_t format;
+    int bpp;
+} formats[] = {
+    { "YUV422", PIXFORMAT_YUV422, 2 },
+    { "RGB565", PIXFORMAT_RGB565, 2 },
+    { "RGB888", PIXFORMAT_RGB888, 3 },
+    { "GRAY", PIXFORMAT_GRAYSCALE, 1 },
+};
+
+#define N_FORMATS (sizeof(formats) / sizeof(formats[0]))
+
+// Factores de reducción: ancho y alto por num / den
+static const struct {
+    const char *name;
+    int num;
+    int den;
+} scales[] = {
+    { "1/2", 1, 2 },
+    { "1/4", 1, 4 },
+    { "3/10", 3, 10 },
+};
+
+#define N_SCALES (sizeof(scales) / sizeof(scales[0]))
+
+static uint8_t clamp_u8(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+/**
+ * @brief Decodifica el JPEG y genera los formatos crudos del sensor
+ */
+static bool load_picture(const camera_fb_t *fb, picture_t *pic)
+{
+    // Los 3100 bytes por defecto no bastan para un H2V2 con dos tablas de cuantización
+    static uint8_t work[8192];
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = fb->buf,
+        .indata_size = fb->len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .advanced = { .working_buffer = work, .working_buffer_size = sizeof(work) },
+    };
+    esp_jpeg_image_output_t info;
+    if (esp_jpeg_get_image_info(&cfg, &info) != ESP_OK)
+    {
+        return false;
+    }
+    size_t n = (size_t)info.width * info.height;
+    uint8_t *rgb = malloc(n * 3);
+    cfg.outbuf = rgb;
+    cfg.outbuf_size = n * 3;
+    if (!rgb || esp_jpeg_decode(&cfg, &info) != ESP_OK)
+    {
+        free(rgb);
+        return false;
+    }
+
+    pic->width = info.width;
+    pic->height = info.height;
+    pic->bgr = malloc(n * 3);
+    pic->rgb565 = malloc(n * 2);
+    pic->yuyv = malloc(n * 2);
+    pic->gray = malloc(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        const uint8_t *p = rgb + i * 3;
+        uint16_t c = ((p[0] & 0xf8) << 8) | ((p[1] & 0xfc) << 3) | (p[2] >> 3);
+        pic->bgr[i * 3 + 0] = p[2];
+        pic->bgr[i * 3 + 1] = p[1];
+        pic->bgr[i * 3 + 2] = p[0];
+        pic->rgb565[i * 2 + 0] = c >> 8;
+        pic->rgb565[i * 2 + 1] = c & 0xff;
+        pic->gray[i] = (uint8_t)((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+    }
+    // YUYV BT.601 rango reducido, crominancia del primer píxel de cada pareja
+    for (size_t i = 0; i + 1 < n; i += 2)
+    {
+        const uint8_t *p = rgb + i * 3;
+        uint8_t *o = pic->yuyv + i * 2;
+        for (int k = 0; k < 2; k++)
+        {
+            const uint8_t *q = p + k * 3;
+            o[k * 2] = clamp_u8(16 + ((66 * q[0] + 129 * q[1] + 25 * q[2] + 128) >> 8));
+        }
+        o[1] = clamp_u8(128 + ((-38 * p[0] - 74 * p[1] + 112 * p[2] + 128) >> 8));
+        o[3] = clamp_u8(128 + ((112 * p[0] - 94 * p[1] - 18 * p[2] + 128) >> 8));
+    }
+    free(rgb);
+    return true;
+}
+
+static uint8_t *picture_data(const picture_t *pic, pixformat_t format)
+{
+    switch (format)
+    {
+        case PIXFORMAT_YUV422: return pic->yuyv;
+        case PIXFORMAT_RGB565: return pic->rgb565;
+        case PIXFORMAT_RGB888: return pic->bgr;
+        default: return pic->gray;
+    }
+}
+
+typedef struct {
+    double mean_ms;
+    double best_ms;
+    size_t out_len;
+} timing_t;
+
+// tasks == 0: fmt2jpg de una pasada; scale >= 0: fmt2jpg_scaled con ese factor
+static bool time_encode(const picture_t *pic, int f, int quality, int tasks, int scale, int rounds, timing_t *t)
+{
+    size_t in_len = (size_t)pic->width * pic->height * formats[f].bpp;
+    int64_t best_us = INT64_MAX, total_us = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        uint8_t *out = NULL;
+        uint8_t *src = picture_data(pic, formats[f].format);
+        int64_t t0 = esp_timer_get_time();
+        bool ok;
+        if (scale >= 0)
+        {
+            uint16_t w = (uint16_t)(pic->width * scales[scale].num / scales[scale].den);
+            uint16_t h = (uint16_t)(pic->height * scales[scale].num / scales[scale].den);
+            ok = fmt2jpg_scaled(src, in_len, pic->width, pic->height, formats[f].format, (uint8_t)quality,
+                                w, h, &out, &t->out_len);
+        }
+        else
+        {
+            ok = tasks ? fmt2jpg_parallel(src, in_len, pic->width, pic->height, formats[f].format, (uint8_t)quality,
+                                          &out, &t->out_len, tasks)
+                       : fmt2jpg(src, in_len, pic->width, pic->height, formats[f].format, (uint8_t)quality,
+                                 &out, &t->out_len);
+        }
+        int64_t us = esp_timer_get_time() - t0;
+        free(out);
+        if (!ok)
+        {
+            return false;
+        }
+        total_us += us;
+        best_us = us < best_us ? us : best_us;
+    }
+    t->mean_ms = total_us / 1000.0 / rounds;
+    t->best_ms = best_us / 1000.0;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_ROUNDS;
+    int quality = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_QUALITY;
+    int tasks = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_TASKS;
+    if (rounds <= 0 || quality <= 0 || quality > 100 || tasks <= 0)
+    {
+        fprintf(stderr, "uso: %s [repeticiones] [calidad] [tareas]\n", argv[0]);
+        return 2;
+    }
+
+    camera_config_t config = {
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_SVGA,
+        .fb_count = 1,
+    };
+    if (esp_camera_init(&config) != ESP_OK)
+    {
+        fprintf(stderr, "bench_jpge: sin imágenes de prueba\n");
+        return 1;
+    }
+    host_camera_stats_t cs;
+    host_camera_get_stats(&cs);
+
+    picture_t *pics = calloc((size_t)cs.pictures, sizeof(picture_t));
+    for (int i = 0; i < cs.pictures; i++)
+    {
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (!fb || !load_picture(fb, &pics[i]))
+        {
+            fprintf(stderr, "bench_jpge: no se pudo decodificar la imagen %d\n", i);
+            return 1;
+        }
+        esp_camera_fb_return(fb);
+    }
+
+    printf("bench_jpge: %d imágenes x %d repeticiones, calidad %d, %d tareas por bandas\n",
+           cs.pictures, rounds, quality, tasks);
+    for (size_t f = 0; f < N_FORMATS; f++)
+    {
+        for (int i = 0; i < cs.pictures; i++)
+        {
+            const picture_t *pic = &pics[i];
+            timing_t seq, par;
+            if (!time_encode(pic, (int)f, quality, 0, -1, rounds, &seq) || !time_encode(pic, (int)f, quality, tasks, -1, rounds, &par))
+            {
+                fprintf(stderr, "bench_jpge: fmt2jpg falló (%s)\n", formats[f].name);
+                return 1;
+            }
+            // MB/s de JPEG producido en la mejor vuelta: lo que rinde el codificador entrópico a calidad alta
+            printf("  %-6s %4ux%-4u  media %7.2f ms  mejor %7.2f ms  %7zu bytes %6.1f MB/s"
+                   " | bandas media %7.2f ms  mejor %7.2f ms  %7zu bytes  x%.2f\n",
+                   formats[f].name, pic->width, pic->height, seq.mean_ms, seq.best_ms, seq.out_len,
+                   seq.best_ms > 0 ? seq.out_len / 1000.0 / seq.best_ms : 0,
+                   par.mean_ms, par.best_ms, par.out_len, par.best_ms > 0 ? seq.best_ms / par.best_ms : 0);
+        }
+    }
+
+    // Miniaturas: tiempo frente a codificar el frame entero (x = veces más rápido)
+    printf("reducción al codificar (fmt2jpg_scaled):\n");
+    for (size_t f = 0; f < N_FORMATS; f++)
+    {
+        for (int i = 0; i < cs.pictures; i++)
+        {
+            const picture_t *pic = &pics[i];
+            timing_t full;
+            if (!time_encode(pic, (int)f, quality, 0, -1, rounds, &full))
+            {
+                fprintf(stderr, "bench_jpge: fmt2jpg falló (%s)\n", formats[f].name);
+                return 1;
+            }
+            printf("  %-6s %4ux%-4u  entera %7.2f ms", formats[f].name, pic->width, pic->height, full.best_ms);
+            for (size_t k = 0; k < N_SCALES; k++)
+            {
+                timing_t sc;
+                if (!time_encode(pic, (int)f, quality, 0, (int)k, rounds, &sc))
+                {
+                    fprintf(stderr, "bench_jpge: fmt2jpg_scaled falló (%s %s)\n", formats[f].name, scales[k].name);
+                    return 1;
+                }
+                printf(" | %-4s %6.2f ms %6zu bytes x%5.1f", scales[k].name, sc.best_ms, sc.out_len,
+                       sc.best_ms > 0 ? full.best_ms / sc.best_ms : 0);
+            }
+            printf("\n");
+        }
+    }
+
+    printf("presupuesto de bytes (fmt2jpg_target):\n");
+    for (size_t f = 0; f < N_FORMATS; f++)
+    {
+        for (int i = 0; i < cs.pictures; i++)
+        {
+            const picture_t *pic = &pics[i];
+            timing_t full;
+            if (!time_encode(pic, (int)f, quality, 0, -1, rounds, &full))
+            {
+                fprintf(stderr, "bench_jpge: fmt2jpg falló (%s)\n", formats[f].name);
+                return 1;
+            }
+            printf("  %-6s %4ux%-4u  fmt2jpg %6.2f ms", formats[f].name, pic->width, pic->height, full.best_ms);
+            const size_t budgets[] = { BENCH_TARGET_BYTES, full.out_len / 2 };
+            for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++)
+            {
+                size_t in_len = (size_t)pic->width * pic->height * formats[f].bpp;
+                int64_t best_us = INT64_MAX;
+                jpg_target_info_t info = { 0 };
+                bool ok = false;
+                for (int r = 0; r < rounds; r++)
+                {
+                    uint8_t *out = NULL;
+                    size_t out_len;
+                    int64_t t0 = esp_timer_get_time();
+                    ok = fmt2jpg_target(picture_data(pic, formats[f].format), in_len, pic->width, pic->height,
+                                        formats[f].format, budgets[b], &out, &out_len, &info);
+                    int64_t us = esp_timer_get_time() - t0;
+                    free(out);
+                    best_us = us < best_us ? us : best_us;
+                }
+                printf(" | %6zu B: %s q%-3d previsto %6zu real %6zu %dx %6.2f ms (%.2f fmt2jpg)", budgets[b], ok ? "ok" : "NO",
+                       info.quality, info.predicted_len, info.actual_len, info.encodes, best_us / 1000.0,
+                       full.best_ms > 0 ? best_us / 1000.0 / full.best_ms : 0);
+            }
+            printf("\n");
+        }
+    }
+
+    printf("tablas Huffman optimizadas (fmt2jpg_optimized):\n");
+    double extra_ms = 0;
+    size_t std_bytes = 0, saved_bytes = 0;
+    for (size_t f = 0; f < N_FORMATS; f++)
+    {
+        for (int i = 0; i < cs.pictures; i++)
+        {
+            const picture_t *pic = &pics[i];
+            timing_t full;
+            if (!time_encode(pic, (int)f, quality, 0, -1, rounds, &full))
+            {
+                fprintf(stderr, "bench_jpge: fmt2jpg falló (%s)\n", formats[f].name);
+                return 1;
+            }
+            size_t in_len = (size_t)pic->width * pic->height * formats[f].bpp;
+            int64_t best_us = INT64_MAX;
+            size_t opt_len = 0;
+            for (int r = 0; r < rounds; r++)
+            {
+                uint8_t *out = NULL;
+                int64_t t0 = esp_timer_get_time();
+                bool ok = fmt2jpg_optimized(picture_data(pic, formats[f].format), in_len, pic->width, pic->height,
+                                            formats[f].format, (uint8_t)quality, &out, &opt_len);
+                int64_t us = esp_timer_get_time() - t0;
+                free(out);
+                if (!ok)
+                {
+                    fprintf(stderr, "bench_jpge: fmt2jpg_optimized falló (%s)\n", formats[f].name);
+                    return 1;
+                }
+                best_us = us < best_us ? us : best_us;
+            }
+            const double opt_ms = best_us / 1000.0;
+            const size_t saved = full.out_len > opt_len ? full.out_len - opt_len : 0;
+            extra_ms += opt_ms - full.best_ms;
+            std_bytes += full.out_len;
+            saved_bytes += saved;
+            printf("  %-6s %4ux%-4u  fmt2jpg %6.2f ms %7zu bytes | optimizada %6.2f ms %7zu bytes"
+                   " | +%5.2f ms  -%6zu bytes (-%4.1f%%)\n",
+                   formats[f].name, pic->width, pic->height, full.best_ms, full.out_len, opt_ms, opt_len,
+                   opt_ms - full.best_ms, saved, 100.0 * saved / full.out_len);
+        }
+    }
+    printf("  total: +%.2f ms, -%zu de %zu bytes (-%.1f%%), %.0f bytes ahorrados por ms\n", extra_ms, saved_bytes,
+           std_bytes, std_bytes ? 100.0 * saved_bytes / std_bytes : 0, extra_ms > 0 ? saved_bytes / extra_ms : 0);
+
+    for (int i = 0; i < cs.pictures; i++)
+    {
+        free(pics[i].bgr);
+        free(pics[i].rgb565);
+        free(pics[i].yuyv);
+        free(pics[i].gray);
+    }
+    free(pics);
+    esp_camera_deinit();
+    return 0;
+}
@@ -0,0 +1,404 @@
+// Cámara simulada: reproduce en bucle los JPEG de un directorio
+//
+// El directorio se toma de HOST_CAMERA_PICTURES o, por defecto, de
+// HOST_CAMERA_PICTURES_DIR (test/pictures de esp32-camera). Cada frame se
+// copia en uno de los fb_count buffers, como haría el DMA del driver.
+// host_camera_inject_fault() simula un fallo de cam_take que solo se corrige
+// con un nivel mínimo de esp_camera_recover().
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "cam_recover.h"
+#include "host_mock.h"
+
+#define HOST_CAMERA_MAX_PICTURES    16
+#define HOST_CAMERA_MAX_FB          4
+#define HOST_CAMERA_FB_TIMEOUT_MS   4000    // Igual que FB_GET_TIMEOUT del driver
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+} picture_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t fb_free;
+    picture_t pictures[HOST_CAMERA_MAX_PICTURES];
+    int picture_count;
+    int next_picture;
+    camera_fb_t fbs[HOST_CAMERA_MAX_FB];
+    bool in_use[HOST_CAMERA_MAX_FB];
+    size_t fb_count;
+    sensor_t sensor;
+    bool initialized;
+    bool fault;
+    camera_recover_tier_t fault_tier;
+    camera_recover_stats_t recover_stats;
+    camera_recover_quiesce_cb_t quiesce;
+    void *quiesce_arg;
+    host_camera_stats_t stats;
+} cam = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .fb_free = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * @brief Lee ancho y alto del marcador SOF del JPEG (0 si no lo encuentra)
+ */
+static void jpeg_dimensions(const uint8_t *p, size_t len, uint16_t *width, uint16_t *height)
+{
+    *width = *height = 0;
+    size_t i = 2;
+    while (i + 9 < len && p[i] == 0xff)
+    {
+        uint8_t marker = p[i + 1];
+        size_t seg_len = ((size_t)p[i + 2] << 8) | p[i + 3];
+        if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+        {
+            *height = (uint16_t)((p[i + 5] << 8) | p[i + 6]);
+            *width = (uint16_t)((p[i + 7] << 8) | p[i + 8]);
+            return;
+        }
+        i += 2 + seg_len;
+    }
+}
+
+static bool is_jpeg_name(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    return ext && (strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0);
+}
+
+static int name_cmp(const void *a, const void *b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+static esp_err_t load_pictures(const char *dir_path)
+{
+    static char names[HOST_CAMERA_MAX_PICTURES][256];
+    int count = 0;
+
+    DIR *dir = opendir(dir_path);
+    if (!dir)
+    {
+        fprintf(stderr, "camera_shim: no se puede abrir %s\n", dir_path);
+        return ESP_ERR_NOT_FOUND;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL && count < HOST_CAMERA_MAX_PICTURES)
+    {
+        if (is_jpeg_name(ent->d_name))
+        {
+            snprintf(names[count++], sizeof(names[0]), "%s", ent->d_name);
+        }
+    }
+    closedir(dir);
+    qsort(names, count, sizeof(names[0]), name_cmp);
+
+    for (int i = 0; i < count; i++)
+    {
+        char path[1024];
+        int n = snprintf(path, sizeof(path), "%s/%s", dir_path, names[i]);
+        if (n < 0 || (size_t)n >= sizeof(path))
+        {
+            fprintf(stderr, "camera_shim: ruta demasiado larga: %s/%s\n", dir_path, names[i]);
+            continue;
+        }
+        FILE *f = fopen(path, "rb");
+        if (!f)
+        {
+            continue;
+        }
+        fseek(f, 0, SEEK_END);
+        long len = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        picture_t *pic = &cam.pictures[cam.picture_count];
+        pic->data = len > 0 ? malloc((size_t)len) : NULL;
+        if (pic->data && fread(pic->data, 1, (size_t)len, f) == (size_t)len)
+        {
+            pic->len = (size_t)len;
+            jpeg_dimensions(pic->data, pic->len, &pic->width, &pic->height);
+            cam.picture_count++;
+        }
+        else
+        {
+            free(pic->data);
+        }
+        fclose(f);
+    }
+    return cam.picture_count > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+static int sensor_set_int(sensor_t *s, int value)
+{
+    return 0;
+}
+
+static int sensor_set_quality(sensor_t *s, int quality)
+{
+    s->status.quality = (uint8_t)quality;
+    return 0;
+}
+
+static int sensor_set_framesize(sensor_t *s, framesize_t framesize)
+{
+    s->status.framesize = framesize;
+    return 0;
+}
+
+static void sensor_setup(sensor_t *s, const camera_config_t *config)
+{
+    memset(s, 0, sizeof(*s));
+    s->id.PID = OV3660_PID;
+    s->pixformat = config->pixel_format;
+    s->status.framesize = config->frame_size;
+    s->status.quality = (uint8_t)config->jpeg_quality;
+    s->set_framesize = sensor_set_framesize;
+    s->set_quality = sensor_set_quality;
+    s->set_contrast = sensor_set_int;
+    s->set_brightness = sensor_set_int;
+    s->set_saturation = sensor_set_int;
+    s->set_sharpness = sensor_set_int;
+    s->set_denoise = sensor_set_int;
+    s->set_colorbar = sensor_set_int;
+    s->set_whitebal = sensor_set_int;
+    s->set_gain_ctrl = sensor_set_int;
+    s->set_exposure_ctrl = sensor_set_int;
+    s->set_hmirror = sensor_set_int;
+    s->set_vflip = sensor_set_int;
+    s->set_aec2 = sensor_set_int;
+    s->set_awb_gain = sensor_set_int;
+    s->set_agc_gain = sensor_set_int;
+    s->set_aec_value = sensor_set_int;
+    s->set_special_effect = sensor_set_int;
+    s->set_wb_mode = sensor_set_int;
+    s->set_ae_level = sensor_set_int;
+    s->set_dcw = sensor_set_int;
+    s->set_bpc = sensor_set_int;
+    s->set_wpc = sensor_set_int;
+    s->set_raw_gma = sensor_set_int;
+    s->set_lenc = sensor_set_int;
+}
+
+esp_err_t esp_camera_init(const camera_config_t *config)
+{
+    if (cam.initialized)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (config->pixel_format != PIXFORMAT_JPEG)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (cam.picture_count == 0)
+    {
+        const char *dir = getenv("HOST_CAMERA_PICTURES");
+        esp_err_t err = load_pictures(dir ? dir : HOST_CAMERA_PICTURES_DIR);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+
+    size_t max_len = 0;
+    for (int i = 0; i < cam.picture_count; i++)
+    {
+        if (cam.pictures[i].len > max_len)
+        {
+            max_len = cam.pictures[i].len;
+        }
+    }
+
+    cam.fb_count = config->fb_count < 1 ? 1 : config->fb_count;
+    if (cam.fb_count > HOST_CAMERA_MAX_FB)
+    {
+        cam.fb_count = HOST_CAMERA_MAX_FB;
+    }
+    for (size_t i = 0; i < cam.fb_count; i++)
+    {
+        cam.fbs[i].buf = malloc(max_len);
+        if (!cam.fbs[i].buf)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        cam.fbs[i].format = PIXFORMAT_JPEG;
+        cam.in_use[i] = false;
+    }
+
+    sensor_setup(&cam.sensor, config);
+    cam.fault = false;  // Un arranque nuevo no arrastra el fallo inyectado
+    cam.stats.pictures = cam.picture_count;
+    cam.initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit(void)
+{
+    if (!cam.initialized)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pthread_mutex_lock(&cam.lock);
+    for (size_t i = 0; i < cam.fb_count; i++)
+    {
+        free(cam.fbs[i].buf);
+        cam.fbs[i].buf = NULL;
+    }
+    cam.initialized = false;
+    pthread_cond_broadcast(&cam.fb_free);
+    pthread_mutex_unlock(&cam.lock);
+    return ESP_OK;
+}
+
+camera_fb_t *esp_camera_fb_get(void)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += HOST_CAMERA_FB_TIMEOUT_MS / 1000;
+
+    pthread_mutex_lock(&cam.lock);
+    camera_fb_t *fb = NULL;
+    if (cam.fault)
+    {
+        // El driver real agotaría FB_GET_TIMEOUT; aquí se falla al instante
+        cam.stats.failed++;
+        pthread_mutex_unlock(&cam.lock);
+        return NULL;
+    }
+    while (cam.initialized && !fb)
+    {
+        for (size_t i = 0; i < cam.fb_count; i++)
+        {
+            if (!cam.in_use[i])
+            {
+                cam.in_use[i] = true;
+                fb = &cam.fbs[i];
+                break;
+            }
+        }
+        // Sin buffers libres el driver espera a que se devuelva uno
+        if (!fb && pthread_cond_timedwait(&cam.fb_free, &cam.lock, &deadline) != 0)
+        {
+            break;
+        }
+    }
+    if (!fb)
+    {
+        pthread_mutex_unlock(&cam.lock);
+        return NULL;
+    }
+
+    const picture_t *pic = &cam.pictures[cam.next_picture];
+    cam.next_picture = (cam.next_picture + 1) % cam.picture_count;
+    cam.stats.frames++;
+    cam.stats.bytes += pic->len;
+    pthread_mutex_unlock(&cam.lock);
+
+    memcpy(fb->buf, pic->data, pic->len);
+    fb->len = pic->len;
+    fb->width = pic->width;
+    fb->height = pic->height;
+    int64_t now = esp_timer_get_time();
+    fb->timestamp.tv_sec = now / 1000000;
+    fb->timestamp.tv_usec = now % 1000000;
+    return fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb)
+{
+    pthread_mutex_lock(&cam.lock);
+    cam.in_use[fb - cam.fbs] = false;
+    pthread_cond_signal(&cam.fb_free);
+    pthread_mutex_unlock(&cam.lock);
+}
+
+sensor_t *esp_camera_sensor_get(void)
+{
+    return cam.initialized ? &cam.sensor : NULL;
+}
+
+static esp_err_t recover_tier(void *ctx, camera_recover_tier_t tier)
+{
+    pthread_mutex_lock(&cam.lock);
+    esp_err_t err = cam.initialized ? ESP_OK : ESP_ERR_INVALID_STATE;
+    if (err == ESP_OK && cam.fault && tier >= cam.fault_tier)
+    {
+        cam.fault = false;
+    }
+    pthread_mutex_unlock(&cam.lock);
+    return err;
+}
+
+// Como el driver: la reinicialización libera los buffers, ninguno puede estar fuera
+static bool recover_quiesce(void *ctx)
+{
+    if (cam.quiesce && !cam.quiesce(cam.quiesce_arg))
+    {
+        return false;
+    }
+    pthread_mutex_lock(&cam.lock);
+    int taken = 0;
+    for (size_t i = 0; i < cam.fb_count; i++)
+    {
+        taken += cam.in_use[i];
+    }
+    cam.stats.reinit_blocked += taken > 0;
+    pthread_mutex_unlock(&cam.lock);
+    return taken == 0;
+}
+
+static camera_fb_t *recover_probe(void *ctx)
+{
+    return esp_camera_fb_get();
+}
+
+static void recover_release(void *ctx, camera_fb_t *fb)
+{
+    esp_camera_fb_return(fb);
+}
+
+esp_err_t esp_camera_recover(camera_fb_t **fb, camera_recover_tier_t *tier)
+{
+    const cam_recover_ops_t ops = {
+        .run_tier = recover_tier,
+        .probe = recover_probe,
+        .release = recover_release,
+        .quiesce = recover_quiesce,
+    };
+    return cam_recover_run(&ops, &cam.recover_stats, fb, tier);
+}
+
+void esp_camera_set_recover_quiesce(camera_recover_quiesce_cb_t cb, void *arg)
+{
+    cam.quiesce_arg = arg;
+    cam.quiesce = cb;
+}
+
+void esp_camera_get_recover_stats(camera_recover_stats_t *stats)
+{
+    *stats = cam.recover_stats;
+}
+
+void host_camera_inject_fault(int cleared_by)
+{
+    pthread_mutex_lock(&cam.lock);
+    cam.fault = true;
+    cam.fault_tier = (camera_recover_tier_t)cleared_by;
+    pthread_mutex_unlock(&cam.lock);
+}
+
+void host_camera_get_stats(host_camera_stats_t *stats)
+{
+    pthread_mutex_lock(&cam.lock);
+    *stats = cam.stats;
+    pthread_mutex_unlock(&cam.lock);
+}
@@ -0,0 +1,96 @@
+// Sustitutos de esp_err, esp_log, esp_random, esp_rom_crc y mbedtls_base64 para el build de host
+#include <stdlib.h>
+#include <sys/random.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "mbedtls/base64.h"
+
+int host_log_enabled;
+
+__attribute__((constructor)) static void host_log_init(void)
+{
+    const char *env = getenv("HOST_LOG_VERBOSE");
+    host_log_enabled = env && env[0] == '1';
+}
+
+uint32_t esp_random(void)
+{
+    uint32_t v = 0;
+    if (getrandom(&v, sizeof(v), 0) != sizeof(v))
+    {
+        abort();
+    }
+    return v;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+        case ESP_OK:                return "ESP_OK";
+        case ESP_FAIL:              return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:        return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:   return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:  return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:     return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:       return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_CRC:   return "ESP_ERR_INVALID_CRC";
+        default:                    return "UNKNOWN ERROR";
+    }
+}
+
+// Igual que la ROM: CRC32 IEEE 802.3, compatible con zlib/binascii.crc32 partiendo de 0
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc = (crc >> 4) ^ table[(crc ^ buf[i]) & 0x0f];
+        crc = (crc >> 4) ^ table[(crc ^ (buf[i] >> 4)) & 0x0f];
+    }
+    return ~crc;
+}
+
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen,
+                          const unsigned char *src, size_t slen)
+{
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t n = ((slen + 2) / 3) * 4;
+
+    if (dst == NULL || dlen < n + 1)
+    {
+        *olen = n + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+
+    unsigned char *p = dst;
+    for (size_t i = 0; i < slen; i += 3)
+    {
+        uint32_t v = (uint32_t)src[i] << 16;
+        if (i + 1 < slen)
+        {
+            v |= (uint32_t)src[i + 1] << 8;
+        }
+        if (i + 2 < slen)
+        {
+            v |= src[i + 2];
+        }
+        *p++ = alphabet[(v >> 18) & 63];
+        *p++ = alphabet[(v >> 12) & 63];
+        *p++ = (i + 1 < slen) ? alphabet[(v >> 6) & 63] : '=';
+        *p++ = (i + 2 < slen) ? alphabet[v & 63] : '=';
+    }
+    *p = '\0';
+    *olen = n;
+    return 0;
+}
@@ -0,0 +1,414 @@
+// FreeRTOS mínimo sobre pthreads: tareas, notificaciones, colas y timers
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/timers.h"
+#include "esp_timer.h"
+#include "host_mock.h"
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    UBaseType_t priority;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+struct host_timer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    TimerCallbackFunction_t callback;
+    void *timer_id;
+    TickType_t period;
+    bool auto_reload;
+    bool running;
+    bool started;
+    struct timespec next;       // Próximo vencimiento (CLOCK_REALTIME)
+};
+
+static __thread struct host_task *current_task;
+static uint32_t timer_period_us;    // Periodo forzado de todos los timers (0 = el suyo)
+static int task_fail_after = -1;
+static int tasks_alive;             // Tareas creadas que aún no han terminado    // Creaciones que aún tienen éxito antes del fallo inyectado
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void timespec_add_ticks(struct timespec *ts, TickType_t ticks)
+{
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+// Convierte un timeout en ticks a un instante absoluto para pthread_cond_timedwait
+static struct timespec deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    timespec_add_ticks(&ts, ticks);
+    return ts;
+}
+
+// Espera en cond hasta que pred sea cierto o venza el timeout; devuelve pdTRUE si pred
+#define WAIT_UNTIL(cond, lock, ticks, pred)                                        \
+    ({                                                                             \
+        struct timespec _ts = deadline(ticks);                                     \
+        int _rc = 0;                                                               \
+        while (!(pred) && _rc != ETIMEDOUT)                                        \
+        {                                                                          \
+            if ((ticks) == portMAX_DELAY)                                          \
+                pthread_cond_wait(cond, lock);                                     \
+            else if ((ticks) == 0)                                                 \
+                _rc = ETIMEDOUT;                                                   \
+            else                                                                   \
+                _rc = pthread_cond_timedwait(cond, lock, &_ts);                    \
+        }                                                                          \
+        (pred) ? pdTRUE : pdFALSE;                                                 \
+    })
+
+static void *task_trampoline(void *arg)
+{
+    struct host_task *task = arg;
+    current_task = task;
+    task->fn(task->arg);
+    __atomic_sub_fetch(&tasks_alive, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                                   void *arg, UBaseType_t priority, TaskHandle_t *out_handle,
+                                   BaseType_t core_id)
+{
+    (void)name;
+    (void)stack_depth;
+    (void)core_id;
+
+    if (__atomic_load_n(&task_fail_after, __ATOMIC_SEQ_CST) >= 0 &&
+            __atomic_fetch_sub(&task_fail_after, 1, __ATOMIC_SEQ_CST) == 0)
+    {
+        return pdFAIL;
+    }
+
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (!task)
+    {
+        return pdFAIL;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    task->priority = priority;
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->cond, NULL);
+    if (out_handle)
+    {
+        *out_handle = task;
+    }
+    __atomic_add_fetch(&tasks_alive, 1, __ATOMIC_SEQ_CST);
+    if (pthread_create(&task->thread, NULL, task_trampoline, task) != 0)
+    {
+        __atomic_sub_fetch(&tasks_alive, 1, __ATOMIC_SEQ_CST);
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *out_handle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, out_handle, tskNO_AFFINITY);
+}
+
+void host_tasks_fail_after(int created)
+{
+    __atomic_store_n(&task_fail_after, created, __ATOMIC_SEQ_CST);
+}
+
+int host_tasks_alive(void)
+{
+    return __atomic_load_n(&tasks_alive, __ATOMIC_SEQ_CST);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    // Solo se soporta el borrado de la propia tarea; el handle se mantiene
+    // vivo porque otras tareas pueden seguir notificándolo
+    if (task == NULL || task == current_task)
+    {
+        __atomic_sub_fetch(&tasks_alive, 1, __ATOMIC_SEQ_CST);
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {
+        .tv_sec = ticks / 1000,
+        .tv_nsec = (long)(ticks % 1000) * 1000000L,
+    };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current_task;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    // El hilo principal no es una tarea del shim: prioridad 1, como app_main
+    if (task == NULL)
+    {
+        task = current_task;
+    }
+    return task ? task->priority : 1;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct host_task *task = current_task;
+    uint32_t value = 0;
+
+    pthread_mutex_lock(&task->lock);
+    if (WAIT_UNTIL(&task->cond, &task->lock, ticks, task->notify > 0))
+    {
+        value = task->notify;
+        task->notify = clear_on_exit ? 0 : task->notify - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *q = calloc(1, sizeof(*q));
+    if (!q)
+    {
+        return NULL;
+    }
+    q->items = calloc(length, item_size);
+    if (!q->items)
+    {
+        free(q);
+        return NULL;
+    }
+    q->length = length;
+    q->item_size = item_size;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->items);
+    free(q);
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&q->lock);
+    BaseType_t ok = WAIT_UNTIL(&q->not_full, &q->lock, ticks, q->count < q->length);
+    if (ok)
+    {
+        UBaseType_t tail = (q->head + q->count) % q->length;
+        memcpy(q->items + tail * q->item_size, item, q->item_size);
+        q->count++;
+        pthread_cond_signal(&q->not_empty);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&q->lock);
+    BaseType_t ok = WAIT_UNTIL(&q->not_empty, &q->lock, ticks, q->count > 0);
+    if (ok)
+    {
+        memcpy(item, q->items + q->head * q->item_size, q->item_size);
+        q->head = (q->head + 1) % q->length;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t count = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return count;
+}
+
+// Programa el siguiente vencimiento de un timer
+static void timer_advance(struct host_timer *t)
+{
+    if (timer_period_us == 0)
+    {
+        timespec_add_ticks(&t->next, t->period);
+        return;
+    }
+    t->next.tv_nsec += (long)timer_period_us * 1000L;
+    while (t->next.tv_nsec >= 1000000000L)
+    {
+        t->next.tv_sec++;
+        t->next.tv_nsec -= 1000000000L;
+    }
+}
+
+void host_timers_set_period_us(uint32_t period_us)
+{
+    timer_period_us = period_us;
+}
+
+/**
+ * @brief Hilo de un timer: llama al callback en cada vencimiento
+ *
+ * Los vencimientos se encadenan desde el anterior (no desde el fin del
+ * callback), igual que la tarea de timers de FreeRTOS.
+ */
+static void *timer_thread(void *arg)
+{
+    struct host_timer *t = arg;
+
+    pthread_mutex_lock(&t->lock);
+    while (1)
+    {
+        if (!t->running)
+        {
+            pthread_cond_wait(&t->cond, &t->lock);
+            continue;
+        }
+        if (pthread_cond_timedwait(&t->cond, &t->lock, &t->next) != ETIMEDOUT || !t->running)
+        {
+            continue;
+        }
+        if (t->auto_reload)
+        {
+            timer_advance(t);
+        }
+        else
+        {
+            t->running = false;
+        }
+        pthread_mutex_unlock(&t->lock);
+        t->callback(t);
+        pthread_mutex_lock(&t->lock);
+    }
+    return NULL;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *timer_id, TimerCallbackFunction_t callback)
+{
+    (void)name;
+
+    if (period == 0 || !callback)
+    {
+        return NULL;
+    }
+    struct host_timer *t = calloc(1, sizeof(*t));
+    if (!t)
+    {
+        return NULL;
+    }
+    t->callback = callback;
+    t->timer_id = timer_id;
+    t->period = period;
+    t->auto_reload = auto_reload != pdFALSE;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    return t;
+}
+
+BaseType_t xTimerStart(TimerHandle_t t, TickType_t ticks)
+{
+    (void)ticks;
+
+    pthread_mutex_lock(&t->lock);
+    clock_gettime(CLOCK_REALTIME, &t->next);
+    timer_advance(t);
+    t->running = true;
+    if (!t->started)
+    {
+        if (pthread_create(&t->thread, NULL, timer_thread, t) != 0)
+        {
+            t->running = false;
+            pthread_mutex_unlock(&t->lock);
+            return pdFAIL;
+        }
+        pthread_detach(t->thread);
+        t->started = true;
+    }
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t t, TickType_t ticks)
+{
+    (void)ticks;
+
+    pthread_mutex_lock(&t->lock);
+    t->running = false;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return pdPASS;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t t)
+{
+    return t->timer_id;
+}
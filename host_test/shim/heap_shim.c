@@ -0,0 +1,129 @@
+// Heap de ESP-IDF sobre malloc del host, con contabilidad de uso y pico
+//
+// La contabilidad funciona enlazando con --wrap=malloc/calloc/realloc/free:
+// cada bloque suma su malloc_usable_size() mientras está vivo.
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "host_mock.h"
+
+// Tamaños simulados de un ESP32-S3 con PSRAM de 8 MB
+#define HOST_HEAP_INTERNAL  (320 * 1024)
+#define HOST_HEAP_SPIRAM    (8 * 1024 * 1024)
+
+static atomic_long heap_used;
+static atomic_long heap_peak;
+static atomic_ulong heap_allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static void heap_account(long delta)
+{
+    if (delta > 0)
+    {
+        atomic_fetch_add(&heap_allocs, 1);
+    }
+    long used = atomic_fetch_add(&heap_used, delta) + delta;
+    long peak = atomic_load(&heap_peak);
+    while (used > peak && !atomic_compare_exchange_weak(&heap_peak, &peak, used))
+    {
+    }
+}
+
+void *__wrap_malloc(size_t size)
+{
+    void *p = __real_malloc(size);
+    if (p)
+    {
+        heap_account((long)malloc_usable_size(p));
+    }
+    return p;
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    void *p = __real_calloc(n, size);
+    if (p)
+    {
+        heap_account((long)malloc_usable_size(p));
+    }
+    return p;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    long old = ptr ? (long)malloc_usable_size(ptr) : 0;
+    void *p = __real_realloc(ptr, size);
+    if (p)
+    {
+        heap_account((long)malloc_usable_size(p) - old);
+    }
+    return p;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr)
+    {
+        heap_account(-(long)malloc_usable_size(ptr));
+    }
+    __real_free(ptr);
+}
+
+size_t host_heap_used(void)
+{
+    long used = atomic_load(&heap_used);
+    return used > 0 ? (size_t)used : 0;
+}
+
+size_t host_heap_peak(void)
+{
+    return (size_t)atomic_load(&heap_peak);
+}
+
+unsigned long host_heap_allocs(void)
+{
+    return atomic_load(&heap_allocs);
+}
+
+void host_heap_reset_peak(void)
+{
+    atomic_store(&heap_peak, atomic_load(&heap_used));
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    return calloc(n, size);
+}
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps)
+{
+    return realloc(ptr, size);
+}
+
+void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    size_t total = (caps & MALLOC_CAP_SPIRAM) ? HOST_HEAP_SPIRAM : HOST_HEAP_INTERNAL;
+    size_t used = host_heap_used();
+    return used < total ? total - used : 0;
+}
+
+unsigned long esp_get_free_heap_size(void)
+{
+    return heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+}
@@ -0,0 +1,7 @@
+#pragma once
+// Atributos de sección de ESP-IDF: sin efecto en el host
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define EXT_RAM_BSS_ATTR
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdio.h>
+
+// Los logs del build de host solo salen con HOST_LOG_VERBOSE=1 para no
+// distorsionar los benchmarks
+#ifdef __cplusplus
+extern "C" int host_log_enabled;
+#else
+extern int host_log_enabled;
+#endif
+
+#define HOST_LOG(level, tag, fmt, ...) \
+    do { if (host_log_enabled) printf(level " (%s) " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+
+#define ESP_LOGE(tag, fmt, ...) HOST_LOG("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) HOST_LOG("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) HOST_LOG("I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { } while (0)
+#define ESP_LOGV(tag, fmt, ...) do { } while (0)
@@ -0,0 +1,2 @@
+#pragma once
+// Capacidades de la ROM: en el host no hay tjpgd en ROM
@@ -0,0 +1,5 @@
+#pragma once
+// Sustituto de esp_rom_crc.h para el build de host (solo CRC32 little-endian)
+#include <stdint.h>
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
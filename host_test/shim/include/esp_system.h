@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// En xtensa uint32_t es unsigned long; se mantiene para que los %lu de main.c
+// compilen sin avisos en el host
+unsigned long esp_get_free_heap_size(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+// Como en ESP-IDF, FreeRTOS.h arrastra assert() y heap_caps_*
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_heap_caps.h"
+
+// FreeRTOS sobre pthreads para el build de host (tick = 1 ms)
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE          1
+#define pdFALSE         0
+#define pdPASS          pdTRUE
+#define pdFAIL          pdFALSE
+#define portMAX_DELAY   ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define configTICK_RATE_HZ 1000
+#define tskNO_AFFINITY  0x7fffffff
+#define portNUM_PROCESSORS 2    // Como el ESP32-S3
+
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+// Secciones críticas de portmacro.h: en el host, un mutex por spinlock
+typedef struct {
+    pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { PTHREAD_MUTEX_INITIALIZER }
+#define portMUX_INITIALIZE(mux)     pthread_mutex_init(&(mux)->mutex, NULL)
+#define portENTER_CRITICAL(mux)     pthread_mutex_lock(&(mux)->mutex)
+#define portEXIT_CRITICAL(mux)      pthread_mutex_unlock(&(mux)->mutex)
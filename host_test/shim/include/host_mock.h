@@ -0,0 +1,70 @@
+#pragma once
+// Controles y consultas de los mocks de timers, cámara, MQTT y heap (solo build de host)
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t messages;      /*!< Publicaciones aceptadas */
+    uint32_t frames;        /*!< Frames completos (último trozo o mensaje entero) */
+    uint64_t bytes;         /*!< Bytes de payload publicados, cabeceras de trozo incluidas */
+    int max_len;            /*!< Mayor mensaje publicado */
+} host_mqtt_stats_t;
+
+typedef struct {
+    uint32_t frames;        /*!< Frames entregados por esp_camera_fb_get */
+    uint64_t bytes;         /*!< Bytes JPEG entregados */
+    uint32_t failed;        /*!< Capturas fallidas por un fallo inyectado */
+    uint32_t reinit_blocked; /*!< Reinicializaciones evitadas con frames aún fuera */
+    int pictures;           /*!< Imágenes cargadas para reproducir */
+} host_camera_stats_t;
+
+/**
+ * @brief Fuerza el periodo de todos los timers por debajo de un tick
+ *
+ * Permite disparar el pipeline más rápido que el tick de 1 ms para medir su
+ * techo. Debe llamarse antes de xTimerStart; 0 restaura los periodos propios.
+ */
+void host_timers_set_period_us(uint32_t period_us);
+
+/**
+ * @brief Hace fallar una creación de tarea
+ *
+ * @param created Creaciones que aún tienen éxito antes de la que falla; a partir
+ *                de ahí vuelven a funcionar. Negativo desactiva el fallo.
+ */
+void host_tasks_fail_after(int created);
+
+/**
+ * @brief Tareas creadas con xTaskCreate* que aún no han terminado
+ */
+int host_tasks_alive(void);
+
+void host_mqtt_get_stats(host_mqtt_stats_t *stats);
+void host_camera_get_stats(host_camera_stats_t *stats);
+
+/**
+ * @brief Hace fallar esp_camera_fb_get hasta que se aplique un nivel de recuperación
+ *
+ * @param cleared_by Nivel mínimo de esp_camera_recover que corrige el fallo;
+ *                   CAMERA_RECOVER_TIER_MAX simula una cámara irrecuperable
+ */
+void host_camera_inject_fault(int cleared_by);
+
+/**
+ * @brief Bytes en uso, pico y número de reservas del heap del proceso
+ *
+ * Solo se contabilizan si el ejecutable se enlaza con
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free.
+ */
+size_t host_heap_used(void);
+size_t host_heap_peak(void);
+unsigned long host_heap_allocs(void);
+void host_heap_reset_peak(void);
+
+#ifdef __cplusplus
+}
+#endif
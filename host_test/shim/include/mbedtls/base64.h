@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+
+// Misma semántica que mbedtls: con dst NULL o dlen corto devuelve el
+// tamaño necesario (incluido el '\0') en olen
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen,
+                          const unsigned char *src, size_t slen);
+
+#ifdef __cplusplus
+}
+#endif
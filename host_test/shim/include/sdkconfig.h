@@ -0,0 +1,2 @@
+#pragma once
+// sdkconfig mínimo para compilar los componentes en el host
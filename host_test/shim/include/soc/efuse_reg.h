@@ -0,0 +1,2 @@
+#pragma once
+// Registros de eFuse: to_jpg.cpp solo necesita que la cabecera exista
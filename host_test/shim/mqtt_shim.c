@@ -0,0 +1,184 @@
+// Cliente MQTT simulado: contabiliza las publicaciones y opcionalmente las graba
+//
+// Con HOST_MQTT_RECORD=<fichero> cada publicación se añade al fichero como
+//   u16 LE longitud del topic, topic, u32 LE longitud del payload, payload
+// para inspeccionarla o reenviarla a un broker real después.
+#define _GNU_SOURCE  // memmem
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "mqtt_client.h"
+#include "photo_stream.h"
+#include "host_mock.h"
+
+struct host_mqtt_client {
+    pthread_mutex_t lock;
+    esp_event_handler_t handler;
+    void *handler_args;
+    FILE *record;
+    int next_msg_id;
+    QueueHandle_t acks;         // msg_id pendientes de MQTT_EVENT_PUBLISHED
+};
+
+#define HOST_MQTT_ACK_QUEUE_LEN 64
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static host_mqtt_stats_t stats;
+
+static void dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t id, int msg_id)
+{
+    if (!client->handler)
+    {
+        return;
+    }
+    esp_mqtt_error_codes_t error = { 0 };
+    esp_mqtt_event_t event = {
+        .event_id = id,
+        .client = client,
+        .msg_id = msg_id,
+        .error_handle = &error,
+    };
+    client->handler(client->handler_args, "MQTT_EVENTS", id, &event);
+}
+
+/**
+ * @brief Indica si el mensaje cierra un frame
+ *
+ * Se reconoce por el contenido: último trozo "TC", mensaje binario "TP"
+ * o JSON con campo "img". El resto (p.ej. estadísticas) no cuenta.
+ */
+static bool completes_frame(const uint8_t *data, size_t len)
+{
+    if (len >= PHOTO_CHUNK_HEADER_LEN && data[0] == PHOTO_CHUNK_MAGIC0 && data[1] == PHOTO_CHUNK_MAGIC1)
+    {
+        uint16_t index = (uint16_t)(data[12] | (data[13] << 8));
+        uint16_t count = (uint16_t)(data[14] | (data[15] << 8));
+        return index + 1 == count;
+    }
+    if (len >= PHOTO_BIN_HEADER_LEN && data[0] == PHOTO_BIN_MAGIC0 && data[1] == PHOTO_BIN_MAGIC1)
+    {
+        return true;
+    }
+    static const char img_key[] = "\"img\":";
+    return len > 0 && data[0] == '{' && memmem(data, len, img_key, sizeof(img_key) - 1) != NULL;
+}
+
+static void record_le(FILE *f, uint32_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        fputc((v >> (8 * i)) & 0xff, f);
+    }
+}
+
+/**
+ * @brief Tarea del cliente: conecta y entrega las confirmaciones QoS > 0
+ */
+static void mqtt_task(void *arg)
+{
+    esp_mqtt_client_handle_t client = arg;
+    int msg_id;
+
+    dispatch(client, MQTT_EVENT_BEFORE_CONNECT, 0);
+    dispatch(client, MQTT_EVENT_CONNECTED, 0);
+    while (xQueueReceive(client->acks, &msg_id, portMAX_DELAY) == pdTRUE)
+    {
+        dispatch(client, MQTT_EVENT_PUBLISHED, msg_id);
+    }
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    esp_mqtt_client_handle_t client = calloc(1, sizeof(*client));
+    if (!client)
+    {
+        return NULL;
+    }
+    client->acks = xQueueCreate(HOST_MQTT_ACK_QUEUE_LEN, sizeof(int));
+    if (!client->acks)
+    {
+        free(client);
+        return NULL;
+    }
+    pthread_mutex_init(&client->lock, NULL);
+    client->next_msg_id = 1;
+
+    const char *path = getenv("HOST_MQTT_RECORD");
+    if (path && path[0])
+    {
+        client->record = fopen(path, "wb");
+        if (!client->record)
+        {
+            fprintf(stderr, "mqtt_shim: no se puede crear %s\n", path);
+        }
+    }
+    return client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *handler_args)
+{
+    client->handler = handler;
+    client->handler_args = handler_args;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    return xTaskCreate(mqtt_task, "mqtt_task", 4096, client, 5, NULL) == pdPASS ? ESP_OK : ESP_FAIL;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain)
+{
+    if (!client || !topic || len < 0)
+    {
+        return -1;
+    }
+    if (len == 0 && data)
+    {
+        len = (int)strlen(data);
+    }
+
+    pthread_mutex_lock(&client->lock);
+    int msg_id = qos > 0 ? client->next_msg_id++ : 0;
+    if (client->record)
+    {
+        size_t topic_len = strlen(topic);
+        record_le(client->record, (uint32_t)topic_len, 2);
+        fwrite(topic, 1, topic_len, client->record);
+        record_le(client->record, (uint32_t)len, 4);
+        fwrite(data, 1, (size_t)len, client->record);
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    pthread_mutex_lock(&stats_lock);
+    stats.messages++;
+    stats.bytes += (uint64_t)len;
+    if (len > stats.max_len)
+    {
+        stats.max_len = len;
+    }
+    if (completes_frame((const uint8_t *)data, (size_t)len))
+    {
+        stats.frames++;
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    if (qos > 0)
+    {
+        xQueueSend(client->acks, &msg_id, portMAX_DELAY);
+    }
+    return msg_id;
+}
+
+void host_mqtt_get_stats(host_mqtt_stats_t *out)
+{
+    pthread_mutex_lock(&stats_lock);
+    *out = stats;
+    pthread_mutex_unlock(&stats_lock);
+}
@@ -0,0 +1,126 @@
+// Sustitutos de NVS, eventos, netif, WiFi y particiones para compilar main.c en el host
+#include <stddef.h>
+#include "nvs_flash.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "esp_partition.h"
+
+#define HOST_MAX_HANDLERS 8
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} host_handler_t;
+
+static host_handler_t handlers[HOST_MAX_HANDLERS];
+static int handler_count;
+
+static void event_post(esp_event_base_t base, int32_t id, void *data)
+{
+    for (int i = 0; i < handler_count; i++)
+    {
+        host_handler_t *h = &handlers[i];
+        if (h->base == base && (h->id == ESP_EVENT_ANY_ID || h->id == id))
+        {
+            h->handler(h->arg, base, id, data);
+        }
+    }
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id,
+                                              esp_event_handler_t handler, void *arg,
+                                              esp_event_handler_instance_t *instance)
+{
+    if (handler_count == HOST_MAX_HANDLERS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    handlers[handler_count++] = (host_handler_t){ base, id, handler, arg };
+    if (instance)
+    {
+        *instance = &handlers[handler_count - 1];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+    return NULL;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    ip_event_got_ip_t got_ip = {
+        .ip_info.ip.addr = 0x0100007f,  // 127.0.0.1
+    };
+    event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip);
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
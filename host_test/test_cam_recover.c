@@ -0,0 +1,282 @@
+// Pruebas de la recuperación escalonada de la cámara con fallos inyectados
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_camera.h"
+#include "cam_recover.h"
+#include "host_mock.h"
+
+// Hardware simulado: cada fallo de cam_take solo se corrige con un nivel mínimo
+typedef enum {
+    FAULT_NONE,
+    FAULT_DMA_STALL,    // La cola entrega entradas NULL (GDMA congelado)
+    FAULT_NO_EOI,       // El sensor entrega JPEG truncados
+    FAULT_SCCB_LOST,    // El sensor no responde por SCCB
+    FAULT_DEAD,         // Nada lo arregla
+} fault_t;
+
+typedef struct {
+    fault_t fault;
+    esp_err_t tier_err[CAMERA_RECOVER_TIER_MAX];    // Error forzado de cada nivel
+    useconds_t tier_delay_us[CAMERA_RECOVER_TIER_MAX];
+    int runs[CAMERA_RECOVER_TIER_MAX];
+    int probes;
+    int released;
+    camera_fb_t frame;
+} fake_cam_t;
+
+static bool tier_fixes(camera_recover_tier_t tier, fault_t fault)
+{
+    switch (fault)
+    {
+        case FAULT_NONE: return true;
+        case FAULT_DMA_STALL: return tier >= CAMERA_RECOVER_DMA_RESET;
+        case FAULT_NO_EOI: return tier >= CAMERA_RECOVER_SENSOR_RESET;
+        case FAULT_SCCB_LOST: return tier >= CAMERA_RECOVER_REINIT;
+        default: return false;
+    }
+}
+
+static esp_err_t fake_run_tier(void *ctx, camera_recover_tier_t tier)
+{
+    fake_cam_t *cam = ctx;
+    cam->runs[tier]++;
+    if (cam->tier_delay_us[tier])
+    {
+        usleep(cam->tier_delay_us[tier]);
+    }
+    if (cam->tier_err[tier] != ESP_OK)
+    {
+        return cam->tier_err[tier];
+    }
+    if (tier_fixes(tier, cam->fault))
+    {
+        cam->fault = FAULT_NONE;
+    }
+    return ESP_OK;
+}
+
+// Equivale a cam_take: NULL mientras el fallo siga presente
+static camera_fb_t *fake_probe(void *ctx)
+{
+    fake_cam_t *cam = ctx;
+    cam->probes++;
+    return cam->fault == FAULT_NONE ? &cam->frame : NULL;
+}
+
+static void fake_release(void *ctx, camera_fb_t *fb)
+{
+    fake_cam_t *cam = ctx;
+    assert(fb == &cam->frame);
+    cam->released++;
+}
+
+static esp_err_t run(fake_cam_t *cam, camera_recover_stats_t *st, camera_fb_t **fb, camera_recover_tier_t *tier)
+{
+    const cam_recover_ops_t ops = {
+        .run_tier = fake_run_tier,
+        .probe = fake_probe,
+        .release = fake_release,
+        .ctx = cam,
+    };
+    return cam_recover_run(&ops, st, fb, tier);
+}
+
+// Cada fallo escala justo hasta el nivel que lo corrige, sin pasar de él
+static void test_escalation(void)
+{
+    static const struct {
+        fault_t fault;
+        camera_recover_tier_t tier;
+    } cases[] = {
+        { FAULT_DMA_STALL, CAMERA_RECOVER_DMA_RESET },
+        { FAULT_NO_EOI, CAMERA_RECOVER_SENSOR_RESET },
+        { FAULT_SCCB_LOST, CAMERA_RECOVER_REINIT },
+    };
+
+    camera_recover_stats_t st = { 0 };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        fake_cam_t cam = { .fault = cases[i].fault };
+        camera_fb_t *fb = NULL;
+        camera_recover_tier_t tier = CAMERA_RECOVER_TIER_MAX;
+        assert(run(&cam, &st, &fb, &tier) == ESP_OK);
+        assert(tier == cases[i].tier);
+        assert(fb == &cam.frame && cam.released == 0);
+        for (int t = 0; t < CAMERA_RECOVER_TIER_MAX; t++)
+        {
+            assert(cam.runs[t] == (t <= (int)cases[i].tier));
+        }
+        assert(cam.probes == (int)cases[i].tier + 1);
+    }
+
+    assert(st.attempts[CAMERA_RECOVER_DMA_RESET] == 3);
+    assert(st.attempts[CAMERA_RECOVER_SENSOR_RESET] == 2);
+    assert(st.attempts[CAMERA_RECOVER_REINIT] == 1);
+    for (int t = 0; t < CAMERA_RECOVER_TIER_MAX; t++)
+    {
+        assert(st.recovered[t] == 1);
+    }
+    assert(st.failures == 0);
+    printf("escalation: intentos dma=%lu sensor=%lu reinit=%lu\n",
+           (unsigned long)st.attempts[0], (unsigned long)st.attempts[1], (unsigned long)st.attempts[2]);
+}
+
+// Sin destino para el frame de prueba, vuelve al driver
+static void test_probe_frame_released(void)
+{
+    camera_recover_stats_t st = { 0 };
+    fake_cam_t cam = { .fault = FAULT_DMA_STALL };
+    assert(run(&cam, &st, NULL, NULL) == ESP_OK);
+    assert(cam.released == 1);
+}
+
+// Un nivel que falla no toma frame de prueba; si todos fallan se cuenta el fallo
+static void test_failures(void)
+{
+    camera_recover_stats_t st = { 0 };
+    fake_cam_t cam = { .fault = FAULT_SCCB_LOST };
+    cam.tier_err[CAMERA_RECOVER_SENSOR_RESET] = ESP_FAIL;
+    camera_fb_t *fb = NULL;
+    assert(run(&cam, &st, &fb, NULL) == ESP_OK);
+    assert(cam.probes == 2);
+    assert(st.recovered[CAMERA_RECOVER_SENSOR_RESET] == 0);
+
+    fake_cam_t dead = { .fault = FAULT_DEAD };
+    dead.tier_err[CAMERA_RECOVER_REINIT] = ESP_ERR_NOT_FOUND;
+    fb = &dead.frame;
+    assert(run(&dead, &st, &fb, NULL) == ESP_FAIL);
+    assert(fb == NULL);
+    assert(dead.probes == 2 && dead.released == 0);
+    assert(st.failures == 1);
+    assert(st.attempts[CAMERA_RECOVER_REINIT] == 2 && st.recovered[CAMERA_RECOVER_REINIT] == 1);
+}
+
+// El tiempo de cada nivel incluye la espera del frame de prueba
+static void test_timing(void)
+{
+    camera_recover_stats_t st = { 0 };
+    fake_cam_t cam = { .fault = FAULT_NO_EOI };
+    cam.tier_delay_us[CAMERA_RECOVER_SENSOR_RESET] = 5000;
+    assert(run(&cam, &st, NULL, NULL) == ESP_OK);
+    assert(st.total_us[CAMERA_RECOVER_SENSOR_RESET] >= 5000);
+    assert(st.max_us[CAMERA_RECOVER_SENSOR_RESET] >= 5000);
+    assert(st.total_us[CAMERA_RECOVER_DMA_RESET] < st.total_us[CAMERA_RECOVER_SENSOR_RESET]);
+
+    cam.fault = FAULT_NO_EOI;
+    cam.tier_delay_us[CAMERA_RECOVER_SENSOR_RESET] = 1000;
+    uint32_t max_before = st.max_us[CAMERA_RECOVER_SENSOR_RESET];
+    assert(run(&cam, &st, NULL, NULL) == ESP_OK);
+    assert(st.max_us[CAMERA_RECOVER_SENSOR_RESET] == max_before);
+    assert(st.total_us[CAMERA_RECOVER_SENSOR_RESET] >= 6000);
+    printf("timing: sensor-reset máx %lu us\n", (unsigned long)st.max_us[CAMERA_RECOVER_SENSOR_RESET]);
+}
+
+// Recorrido completo por la API pública con la cámara simulada
+static void test_camera_api(void)
+{
+    camera_config_t config = {
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_QVGA,
+        .jpeg_quality = 12,
+        .fb_count = 2,
+    };
+    assert(esp_camera_init(&config) == ESP_OK);
+
+    camera_fb_t *fb = esp_camera_fb_get();
+    assert(fb);
+    esp_camera_fb_return(fb);
+
+    host_camera_inject_fault(CAMERA_RECOVER_SENSOR_RESET);
+    assert(esp_camera_fb_get() == NULL);
+    camera_recover_tier_t tier;
+    assert(esp_camera_recover(&fb, &tier) == ESP_OK);
+    assert(fb && fb->len > 0 && tier == CAMERA_RECOVER_SENSOR_RESET);
+    esp_camera_fb_return(fb);
+
+    host_camera_inject_fault(CAMERA_RECOVER_TIER_MAX);
+    assert(esp_camera_recover(&fb, &tier) == ESP_FAIL && fb == NULL);
+
+    camera_recover_stats_t st;
+    esp_camera_get_recover_stats(&st);
+    assert(st.attempts[CAMERA_RECOVER_DMA_RESET] == 2);
+    assert(st.attempts[CAMERA_RECOVER_REINIT] == 1);
+    assert(st.recovered[CAMERA_RECOVER_SENSOR_RESET] == 1 && st.failures == 1);
+
+    host_camera_stats_t cs;
+    host_camera_get_stats(&cs);
+    assert(cs.failed == 5);
+    assert(esp_camera_deinit() == ESP_OK);
+}
+
+// Con frames prestados la reinicialización no se ejecuta: el gancho los recupera o se salta
+static bool quiesce_calls_ok;
+static int quiesce_calls;
+static camera_fb_t *quiesce_held;
+
+static bool return_held(void *arg)
+{
+    quiesce_calls++;
+    if (quiesce_calls_ok && quiesce_held)
+    {
+        esp_camera_fb_return(quiesce_held);
+        quiesce_held = NULL;
+    }
+    return quiesce_calls_ok;
+}
+
+static void test_reinit_quiesce(void)
+{
+    camera_config_t config = {
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_QVGA,
+        .jpeg_quality = 12,
+        .fb_count = 2,
+    };
+    assert(esp_camera_init(&config) == ESP_OK);
+    camera_recover_stats_t before;
+    esp_camera_get_recover_stats(&before);
+
+    // Sin gancho y con un frame fuera: solo los dos primeros niveles
+    camera_fb_t *held = esp_camera_fb_get();
+    assert(held);
+    host_camera_inject_fault(CAMERA_RECOVER_REINIT);
+    camera_fb_t *fb;
+    camera_recover_tier_t tier;
+    assert(esp_camera_recover(&fb, &tier) == ESP_FAIL && fb == NULL);
+    host_camera_stats_t cs;
+    host_camera_get_stats(&cs);
+    assert(cs.reinit_blocked == 1);
+
+    // El gancho no consigue los frames: tampoco
+    quiesce_held = held;
+    esp_camera_set_recover_quiesce(return_held, NULL);
+    assert(esp_camera_recover(&fb, &tier) == ESP_FAIL);
+    assert(quiesce_calls == 1 && quiesce_held == held);
+
+    // El gancho devuelve el frame: la reinicialización sí corre
+    quiesce_calls_ok = true;
+    assert(esp_camera_recover(&fb, &tier) == ESP_OK);
+    assert(fb && tier == CAMERA_RECOVER_REINIT && quiesce_held == NULL);
+    esp_camera_fb_return(fb);
+    esp_camera_set_recover_quiesce(NULL, NULL);
+
+    camera_recover_stats_t st;
+    esp_camera_get_recover_stats(&st);
+    assert(st.attempts[CAMERA_RECOVER_REINIT] - before.attempts[CAMERA_RECOVER_REINIT] == 3);
+    assert(st.recovered[CAMERA_RECOVER_REINIT] - before.recovered[CAMERA_RECOVER_REINIT] == 1);
+    assert(esp_camera_deinit() == ESP_OK);
+}
+
+int main(void)
+{
+    test_escalation();
+    test_probe_frame_released();
+    test_failures();
+    test_timing();
+    test_camera_api();
+    test_reinit_quiesce();
+    printf("test_cam_recover: OK\n");
+    return 0;
+}
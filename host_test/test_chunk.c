@@ -0,0 +1,176 @@
+// Pruebas de la transferencia por trozos: troceado en streaming y reensamblado
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_rom_crc.h"
+#include "photo_stream.h"
+
+#define CHUNK_BYTES 3072
+#define MAX_MSGS    64
+#define BOOT_ID     0xC0FFEE01u
+
+typedef struct {
+    uint8_t *msgs[MAX_MSGS];
+    size_t lens[MAX_MSGS];
+    int count;
+    int fail_at;                // Índice del trozo que falla (-1 = ninguno)
+} recorder_t;
+
+static int record_publish(void *ctx, const uint8_t *msg, size_t len)
+{
+    recorder_t *r = ctx;
+    if (r->count == r->fail_at)
+    {
+        return -1;
+    }
+    assert(r->count < MAX_MSGS);
+    r->msgs[r->count] = malloc(len);
+    memcpy(r->msgs[r->count], msg, len);
+    r->lens[r->count] = len;
+    return ++r->count;
+}
+
+static void recorder_free(recorder_t *r)
+{
+    for (int i = 0; i < r->count; i++)
+    {
+        free(r->msgs[i]);
+    }
+    memset(r, 0, sizeof(*r));
+    r->fail_at = -1;
+}
+
+static uint32_t get_le(const uint8_t *p, int n)
+{
+    uint32_t v = 0;
+    for (int i = n - 1; i >= 0; i--)
+    {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// Reensambla como lo hace el servidor y comprueba cada cabecera
+static size_t reassemble(const recorder_t *r, uint32_t frame_id, uint8_t content, uint8_t *out, size_t cap)
+{
+    size_t frame_len = 0;
+    for (int i = 0; i < r->count; i++)
+    {
+        const uint8_t *m = r->msgs[i];
+        size_t data_len = r->lens[i] - PHOTO_CHUNK_HEADER_LEN;
+        assert(r->lens[i] >= PHOTO_CHUNK_HEADER_LEN);
+        assert(data_len <= CHUNK_BYTES);
+        assert(m[0] == PHOTO_CHUNK_MAGIC0 && m[1] == PHOTO_CHUNK_MAGIC1);
+        assert(m[2] == PHOTO_CHUNK_VERSION && m[3] == content);
+        assert(get_le(m + 4, 4) == BOOT_ID);
+        assert(get_le(m + 8, 4) == frame_id);
+        assert(get_le(m + 12, 2) == (uint32_t)i);
+        assert(get_le(m + 14, 2) == (uint32_t)r->count);
+        frame_len = get_le(m + 16, 4);
+        uint32_t offset = get_le(m + 20, 4);
+        assert(offset + data_len <= cap);
+        assert(get_le(m + 24, 4) == esp_rom_crc32_le(0, m + PHOTO_CHUNK_HEADER_LEN, (uint32_t)data_len));
+        memcpy(out + offset, m + PHOTO_CHUNK_HEADER_LEN, data_len);
+    }
+    return frame_len;
+}
+
+// El payload binario se trocea directamente desde el buffer del frame
+static void test_stream_from_frame(void)
+{
+    static uint8_t frame[20000];
+    static uint8_t expected[PHOTO_BIN_HEADER_LEN + sizeof(frame)];
+    static uint8_t out[sizeof(expected)];
+    uint8_t buf[PHOTO_CHUNK_HEADER_LEN + CHUNK_BYTES];
+    for (size_t i = 0; i < sizeof(frame); i++)
+    {
+        frame[i] = (uint8_t)(i * 13 + 7);
+    }
+    photo_meta_t meta = { .seq = 42, .timestamp_us = 123456, .width = 640, .height = 480, .format = 4 };
+
+    photo_buf_sink_t buf_sink = { .buf = expected, .cap = sizeof(expected) };
+    photo_sink_t sink = { .write = photo_buf_sink_write, .ctx = &buf_sink };
+    assert(photo_stream_binary(frame, sizeof(frame), "cam", &meta, &sink) == ESP_OK);
+
+    recorder_t r = { .fail_at = -1 };
+    photo_chunker_t c;
+    assert(photo_chunker_init(&c, buf, sizeof(buf), BOOT_ID, record_publish, &r) == ESP_OK);
+    size_t len = photo_stream_binary_len(sizeof(frame));
+    assert(photo_chunker_begin(&c, 42, PHOTO_CHUNK_CONTENT_BINARY, len) == ESP_OK);
+    photo_sink_t chunk_sink = { .write = photo_chunker_write, .ctx = &c };
+    assert(photo_stream_binary(frame, sizeof(frame), "cam", &meta, &chunk_sink) == ESP_OK);
+    assert(photo_chunker_end(&c) == ESP_OK);
+
+    assert((size_t)r.count == photo_chunk_count(len, CHUNK_BYTES));
+    assert(r.count == 7);
+    assert(c.msg_id == r.count);
+    assert(reassemble(&r, 42, PHOTO_CHUNK_CONTENT_BINARY, out, sizeof(out)) == len);
+    assert(memcmp(out, expected, len) == 0);
+    printf("troceado: %zu bytes en %d mensajes de como máximo %d bytes\n",
+           len, r.count, PHOTO_CHUNK_HEADER_LEN + CHUNK_BYTES);
+    recorder_free(&r);
+}
+
+// Múltiplo exacto del tamaño de trozo y frame vacío
+static void test_boundaries(void)
+{
+    static uint8_t data[2 * CHUNK_BYTES];
+    static uint8_t out[sizeof(data)];
+    uint8_t buf[PHOTO_CHUNK_HEADER_LEN + CHUNK_BYTES];
+    memset(data, 0xA5, sizeof(data));
+
+    recorder_t r = { .fail_at = -1 };
+    photo_chunker_t c;
+    assert(photo_chunker_init(&c, buf, sizeof(buf), BOOT_ID, record_publish, &r) == ESP_OK);
+
+    assert(photo_chunker_begin(&c, 1, PHOTO_CHUNK_CONTENT_JSON, sizeof(data)) == ESP_OK);
+    // Escrituras de tamaños irregulares, como las del stream JSON
+    for (size_t off = 0; off < sizeof(data); off += 512)
+    {
+        assert(photo_chunker_write(&c, data + off, 512) == ESP_OK);
+    }
+    assert(photo_chunker_end(&c) == ESP_OK);
+    assert(r.count == 2);
+    assert(reassemble(&r, 1, PHOTO_CHUNK_CONTENT_JSON, out, sizeof(out)) == sizeof(data));
+    assert(memcmp(out, data, sizeof(data)) == 0);
+    recorder_free(&r);
+
+    assert(photo_chunker_begin(&c, 2, PHOTO_CHUNK_CONTENT_JSON, 0) == ESP_OK);
+    assert(photo_chunker_end(&c) == ESP_OK);
+    assert(r.count == 1 && r.lens[0] == PHOTO_CHUNK_HEADER_LEN);
+    recorder_free(&r);
+}
+
+// Errores: publicación rechazada a mitad de frame y tamaños incoherentes
+static void test_errors(void)
+{
+    static uint8_t data[10000];
+    uint8_t buf[PHOTO_CHUNK_HEADER_LEN + CHUNK_BYTES];
+    recorder_t r = { .fail_at = 2 };
+    photo_chunker_t c;
+    assert(photo_chunker_init(&c, buf, PHOTO_CHUNK_HEADER_LEN, BOOT_ID, record_publish, &r) == ESP_ERR_INVALID_ARG);
+    assert(photo_chunker_init(&c, buf, sizeof(buf), BOOT_ID, record_publish, &r) == ESP_OK);
+
+    assert(photo_chunker_begin(&c, 3, PHOTO_CHUNK_CONTENT_JSON, sizeof(data)) == ESP_OK);
+    assert(photo_chunker_write(&c, data, sizeof(data)) == ESP_FAIL);
+    assert(r.count == 2);
+    recorder_free(&r);
+
+    assert(photo_chunker_begin(&c, 4, PHOTO_CHUNK_CONTENT_JSON, 100) == ESP_OK);
+    assert(photo_chunker_write(&c, data, 101) == ESP_ERR_INVALID_SIZE);
+    assert(photo_chunker_write(&c, data, 50) == ESP_OK);
+    assert(photo_chunker_end(&c) == ESP_ERR_INVALID_SIZE);
+    assert(r.count == 0);
+
+    assert(photo_chunker_begin(&c, 5, PHOTO_CHUNK_CONTENT_JSON, (size_t)CHUNK_BYTES * 70000) == ESP_ERR_INVALID_SIZE);
+}
+
+int main(void)
+{
+    test_stream_from_frame();
+    test_boundaries();
+    test_errors();
+    printf("test_chunk: OK\n");
+    return 0;
+}
@@ -0,0 +1,447 @@
+// Pruebas del diario de frames sobre un almacenamiento en fichero que imita la flash
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frame_journal.h"
+#include "host_mock.h"
+
+#define FLASH_SIZE      (64 * 1024)
+#define FLASH_BLOCK     4096
+
+// Fichero con semántica de flash: escribir solo puede bajar bits (0xFF borrado)
+typedef struct {
+    FILE *f;
+    uint32_t erases;
+} file_flash_t;
+
+static esp_err_t file_read(void *ctx, size_t offset, void *buf, size_t len)
+{
+    file_flash_t *fl = (file_flash_t *)ctx;
+    fseek(fl->f, (long)offset, SEEK_SET);
+    return fread(buf, 1, len, fl->f) == len ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t file_write(void *ctx, size_t offset, const void *buf, size_t len)
+{
+    file_flash_t *fl = (file_flash_t *)ctx;
+    const uint8_t *src = buf;
+    uint8_t cur[512];
+    for (size_t done = 0; done < len; done += sizeof(cur))
+    {
+        size_t n = len - done < sizeof(cur) ? len - done : sizeof(cur);
+        assert(file_read(ctx, offset + done, cur, n) == ESP_OK);
+        for (size_t i = 0; i < n; i++)
+        {
+            assert((cur[i] & src[done + i]) == src[done + i]);
+        }
+    }
+    fseek(fl->f, (long)offset, SEEK_SET);
+    return fwrite(buf, 1, len, fl->f) == len ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t file_erase(void *ctx, size_t offset, size_t len)
+{
+    file_flash_t *fl = (file_flash_t *)ctx;
+    assert(offset % FLASH_BLOCK == 0 && len % FLASH_BLOCK == 0);
+    uint8_t ff[FLASH_BLOCK];
+    memset(ff, 0xFF, sizeof(ff));
+    fseek(fl->f, (long)offset, SEEK_SET);
+    for (size_t done = 0; done < len; done += FLASH_BLOCK)
+    {
+        fwrite(ff, 1, FLASH_BLOCK, fl->f);
+    }
+    fl->erases++;
+    return ESP_OK;
+}
+
+static void file_flash_open(file_flash_t *fl, frame_journal_storage_t *storage)
+{
+    memset(fl, 0, sizeof(*fl));
+    fl->f = tmpfile();
+    assert(fl->f);
+    // Partición recién creada: contenido arbitrario hasta que se borre
+    uint8_t junk[FLASH_BLOCK];
+    memset(junk, 0x5A, sizeof(junk));
+    for (size_t i = 0; i < FLASH_SIZE; i += FLASH_BLOCK)
+    {
+        fwrite(junk, 1, sizeof(junk), fl->f);
+    }
+
+    storage->read = file_read;
+    storage->write = file_write;
+    storage->erase = file_erase;
+    storage->size = FLASH_SIZE;
+    storage->erase_size = FLASH_BLOCK;
+    storage->ctx = fl;
+}
+
+// Payload determinista a partir de la secuencia para verificar el contenido
+static size_t make_frame(uint32_t seq, uint8_t *buf, size_t max)
+{
+    size_t len = 1000 + (seq * 7919) % (max - 1000);
+    for (size_t i = 0; i < len; i++)
+    {
+        buf[i] = (uint8_t)(seq * 31 + i);
+    }
+    return len;
+}
+
+static void check_frame(uint32_t seq, const uint8_t *buf, size_t len)
+{
+    uint8_t expected[8192];
+    assert(make_frame(seq, expected, sizeof(expected)) == len);
+    assert(memcmp(expected, buf, len) == 0);
+}
+
+// Los registros salen en orden, intactos y con su timestamp original
+static void test_fifo_and_wrap(void)
+{
+    file_flash_t fl;
+    frame_journal_storage_t storage;
+    file_flash_open(&fl, &storage);
+    frame_journal_t j;
+    assert(frame_journal_init(&j, &storage) == ESP_OK);
+
+    uint8_t buf[8192];
+    uint32_t next_out = 0;
+    // Productor más rápido que el consumidor durante varias vueltas del anillo
+    for (uint32_t seq = 0; seq < 400; seq++)
+    {
+        size_t len = make_frame(seq, buf, sizeof(buf));
+        assert(frame_journal_append(&j, (uint16_t)(seq & 1), seq, 1000000ULL + seq, buf, len) == ESP_OK);
+
+        if (seq % 3 == 0)
+        {
+            frame_journal_entry_t e;
+            assert(frame_journal_peek(&j, &e));
+            assert(e.seq >= next_out);
+            assert(e.timestamp_us == 1000000ULL + e.seq);
+            assert(e.tag == (e.seq & 1));
+            assert(frame_journal_read(&j, &e, buf) == ESP_OK);
+            check_frame(e.seq, buf, e.len);
+            next_out = e.seq + 1;
+            frame_journal_pop(&j);
+        }
+    }
+
+    frame_journal_stats_t st;
+    frame_journal_get_stats(&j, &st);
+    printf("fifo: %u añadidos, %u extraídos, %u descartados, %u borrados de bloque, pico %zu/%zu bytes\n",
+           (unsigned)st.appended, (unsigned)st.drained, (unsigned)st.dropped, (unsigned)fl.erases,
+           st.high_water_bytes, st.capacity_bytes);
+    assert(st.appended == 400);
+    assert(st.dropped > 0);
+    assert(st.appended == st.drained + st.dropped + st.entries);
+    assert(st.high_water_bytes <= st.capacity_bytes);
+    assert(st.high_water_bytes > st.capacity_bytes / 2);
+    assert(fl.erases > FLASH_SIZE / FLASH_BLOCK);
+
+    // Lo que queda es un bloque contiguo con los más recientes
+    frame_journal_entry_t e;
+    uint32_t prev = 0;
+    bool first = true;
+    while (frame_journal_peek(&j, &e))
+    {
+        assert(first || e.seq == prev + 1);
+        assert(frame_journal_read(&j, &e, buf) == ESP_OK);
+        check_frame(e.seq, buf, e.len);
+        prev = e.seq;
+        first = false;
+        frame_journal_pop(&j);
+    }
+    assert(prev == 399);
+    frame_journal_get_stats(&j, &st);
+    assert(st.entries == 0 && st.used_bytes == 0);
+    fclose(fl.f);
+}
+
+// Con el índice lleno se descarta el más antiguo aunque sobre espacio
+static void test_index_full(void)
+{
+    static uint8_t ram_buf[256 * 1024];
+    frame_journal_ram_t ram;
+    frame_journal_storage_t storage;
+    frame_journal_storage_ram(&storage, &ram, ram_buf, sizeof(ram_buf));
+    frame_journal_t j;
+    assert(frame_journal_init(&j, &storage) == ESP_OK);
+
+    uint8_t small[16] = { 0 };
+    for (uint32_t seq = 0; seq < FRAME_JOURNAL_MAX_ENTRIES + 10; seq++)
+    {
+        assert(frame_journal_append(&j, 0, seq, seq, small, sizeof(small)) == ESP_OK);
+    }
+    frame_journal_entry_t e;
+    assert(frame_journal_peek(&j, &e));
+    assert(e.seq == 10);
+    frame_journal_stats_t st;
+    frame_journal_get_stats(&j, &st);
+    assert(st.entries == FRAME_JOURNAL_MAX_ENTRIES);
+    assert(st.dropped == 10);
+    assert(frame_journal_append(&j, 0, 0, 0, small, sizeof(ram_buf)) == ESP_ERR_INVALID_SIZE);
+}
+
+typedef struct {
+    uint32_t expected_seq;
+    uint32_t published;
+    bool fail;
+    frame_journal_entry_t entry;
+    uint8_t data[8192];
+    size_t len;
+    size_t max_write;
+} drain_ctx_t;
+
+static esp_err_t drain_begin(void *ctx, const frame_journal_entry_t *entry)
+{
+    drain_ctx_t *d = (drain_ctx_t *)ctx;
+    d->entry = *entry;
+    d->len = 0;
+    return ESP_OK;
+}
+
+static esp_err_t drain_write(void *ctx, const uint8_t *data, size_t len)
+{
+    drain_ctx_t *d = (drain_ctx_t *)ctx;
+    assert(d->len + len <= sizeof(d->data));
+    memcpy(d->data + d->len, data, len);
+    d->len += len;
+    d->max_write = len > d->max_write ? len : d->max_write;
+    return ESP_OK;
+}
+
+static int drain_end(void *ctx)
+{
+    drain_ctx_t *d = (drain_ctx_t *)ctx;
+    if (d->fail)
+    {
+        return -1;
+    }
+    assert(d->entry.seq == d->expected_seq);
+    assert(d->len == d->entry.len);
+    check_frame(d->entry.seq, d->data, d->len);
+    d->expected_seq++;
+    d->published++;
+    return (int)d->published;
+}
+
+static frame_journal_publisher_t drain_publisher(drain_ctx_t *d)
+{
+    frame_journal_publisher_t p = {
+        .begin = drain_begin,
+        .write = drain_write,
+        .end = drain_end,
+        .ctx = d,
+    };
+    return p;
+}
+
+// PSRAM pequeña que desborda a la partición: no se pierde nada y se vacía en orden
+static void test_spill_and_drain(void)
+{
+    static uint8_t ram_buf[32 * 1024];
+    frame_journal_ram_t ram;
+    frame_journal_storage_t ram_storage;
+    frame_journal_storage_ram(&ram_storage, &ram, ram_buf, sizeof(ram_buf));
+    frame_journal_t j;
+    assert(frame_journal_init(&j, &ram_storage) == ESP_OK);
+
+    file_flash_t fl;
+    frame_journal_storage_t flash_storage;
+    file_flash_open(&fl, &flash_storage);
+    frame_journal_t spill;
+    assert(frame_journal_init(&spill, &flash_storage) == ESP_OK);
+    frame_journal_set_spill(&j, &spill);
+
+    // Corte de conexión: 20 frames (~90 KB) no caben en 32 KB de PSRAM
+    uint8_t buf[8192];
+    unsigned long allocs = host_heap_allocs();
+    for (uint32_t seq = 0; seq < 20; seq++)
+    {
+        size_t len = make_frame(seq, buf, sizeof(buf));
+        assert(frame_journal_append(&j, 0, seq, seq, buf, len) == ESP_OK);
+    }
+    frame_journal_stats_t st;
+    frame_journal_get_stats(&j, &st);
+    frame_journal_stats_t sst;
+    frame_journal_get_stats(&spill, &sst);
+    assert(st.spilled > 0);
+    assert(st.dropped == 0);
+    assert(sst.entries == st.spilled);
+    assert(st.entries + sst.entries == 20);
+
+    // Publicación rechazada: el registro se conserva
+    static drain_ctx_t d;
+    d.fail = true;
+    frame_journal_publisher_t pub = drain_publisher(&d);
+    assert(frame_journal_drain_one(&j, &pub) == ESP_FAIL);
+    frame_journal_get_stats(&spill, &sst);
+    assert(sst.entries == st.spilled);
+
+    // Reconexión: sale todo, primero lo desbordado, en orden de captura
+    d.fail = false;
+    esp_err_t err;
+    while ((err = frame_journal_drain_one(&j, &pub)) == ESP_OK)
+    {
+    }
+    assert(err == ESP_ERR_NOT_FOUND);
+    assert(d.published == 20);
+    assert(d.max_write <= FRAME_JOURNAL_COPY_CHUNK);
+    // Desbordar y reenviar no reservan memoria
+    assert(host_heap_allocs() == allocs);
+    printf("desbordamiento: %u frames en PSRAM, %u en flash, todos reenviados en orden\n",
+           (unsigned)st.entries, (unsigned)st.spilled);
+    fclose(fl.f);
+}
+
+// Un registro dañado en flash se detecta, se cuenta y se salta
+static void test_corruption(void)
+{
+    file_flash_t fl;
+    frame_journal_storage_t storage;
+    file_flash_open(&fl, &storage);
+    frame_journal_t j;
+    assert(frame_journal_init(&j, &storage) == ESP_OK);
+
+    uint8_t buf[8192];
+    for (uint32_t seq = 0; seq < 3; seq++)
+    {
+        size_t len = make_frame(seq, buf, sizeof(buf));
+        assert(frame_journal_append(&j, 0, seq, seq, buf, len) == ESP_OK);
+    }
+
+    // Bit a 0 en mitad del payload del primer registro (la flash solo puede bajar bits)
+    frame_journal_entry_t e;
+    assert(frame_journal_peek(&j, &e));
+    size_t at = e.offset + FRAME_JOURNAL_HEADER_LEN + e.len / 2;
+    uint8_t byte;
+    fseek(fl.f, (long)at, SEEK_SET);
+    assert(fread(&byte, 1, 1, fl.f) == 1);
+    byte ^= byte ? (byte & -byte) : 0x01;
+    fseek(fl.f, (long)at, SEEK_SET);
+    fwrite(&byte, 1, 1, fl.f);
+
+    static drain_ctx_t d;
+    d.expected_seq = 1;
+    frame_journal_publisher_t pub = drain_publisher(&d);
+    assert(frame_journal_drain_one(&j, &pub) == ESP_ERR_INVALID_CRC);
+    assert(d.len == 0);     // Nada del registro dañado llega a publicarse
+    assert(frame_journal_drain_one(&j, &pub) == ESP_OK);
+    assert(frame_journal_drain_one(&j, &pub) == ESP_OK);
+    assert(frame_journal_drain_one(&j, &pub) == ESP_ERR_NOT_FOUND);
+
+    frame_journal_stats_t st;
+    frame_journal_get_stats(&j, &st);
+    assert(st.corrupt == 1);
+    assert(d.published == 2);
+    fclose(fl.f);
+}
+
+// Secuencias de los registros vivos, del más antiguo al más reciente
+static int live_seqs(const frame_journal_t *j, uint32_t *seqs)
+{
+    for (int i = 0; i < j->count; i++)
+    {
+        seqs[i] = j->index[(j->first + i) % FRAME_JOURNAL_MAX_ENTRIES].seq;
+    }
+    return j->count;
+}
+
+// Tras un reinicio el índice se reconstruye desde la flash y el diario sigue donde estaba
+static void test_recover(void)
+{
+    file_flash_t fl;
+    frame_journal_storage_t storage;
+    file_flash_open(&fl, &storage);
+
+    // Partición sin estrenar: nada que recuperar
+    frame_journal_t j;
+    assert(frame_journal_recover(&j, &storage) == ESP_OK);
+    assert(j.count == 0);
+
+    uint8_t buf[8192];
+    uint32_t seq = 0;
+    uint32_t next_out = 0;
+    int reboots = 0;
+    for (int round = 0; round < 6; round++)
+    {
+        // Varias vueltas del anillo con extracciones intercaladas
+        for (int i = 0; i < 70; i++, seq++)
+        {
+            size_t len = make_frame(seq, buf, sizeof(buf));
+            assert(frame_journal_append(&j, (uint16_t)(seq & 1), seq, 1000000ULL + seq, buf, len) == ESP_OK);
+            if (seq % 4 == 0)
+            {
+                frame_journal_entry_t e;
+                assert(frame_journal_peek(&j, &e));
+                assert(e.seq >= next_out);
+                assert(frame_journal_read(&j, &e, buf) == ESP_OK);
+                check_frame(e.seq, buf, e.len);
+                next_out = e.seq + 1;
+                frame_journal_pop(&j);
+            }
+        }
+
+        // Corte de alimentación a mitad de un registro: payload escrito sin cabecera
+        if (round % 2 == 1)
+        {
+            size_t pos = j.write_pos + FRAME_JOURNAL_HEADER_LEN;
+            if (pos + 100 <= FLASH_SIZE && pos % FLASH_BLOCK != 0)
+            {
+                uint8_t partial[100];
+                memset(partial, 0x11, sizeof(partial));
+                assert(file_write(&fl, pos, partial, sizeof(partial)) == ESP_OK);
+            }
+        }
+
+        uint32_t before[FRAME_JOURNAL_MAX_ENTRIES];
+        uint32_t after[FRAME_JOURNAL_MAX_ENTRIES];
+        int n = live_seqs(&j, before);
+        assert(frame_journal_recover(&j, &storage) == ESP_OK);
+        reboots++;
+        assert(live_seqs(&j, after) == n);
+        assert(memcmp(before, after, n * sizeof(uint32_t)) == 0);
+        frame_journal_stats_t st;
+        frame_journal_get_stats(&j, &st);
+        assert(st.recovered == (uint32_t)n);
+        for (int i = 0; i < n; i++)
+        {
+            frame_journal_entry_t e = j.index[(j.first + i) % FRAME_JOURNAL_MAX_ENTRIES];
+            assert(e.timestamp_us == 1000000ULL + e.seq);
+            assert(e.tag == (e.seq & 1));
+        }
+    }
+
+    // Lo recuperado sale en orden, contiguo hasta el último escrito
+    frame_journal_entry_t e;
+    uint32_t prev = 0;
+    bool first = true;
+    int left = j.count;
+    while (frame_journal_peek(&j, &e))
+    {
+        assert(first || e.seq == prev + 1);
+        assert(frame_journal_read(&j, &e, buf) == ESP_OK);
+        check_frame(e.seq, buf, e.len);
+        prev = e.seq;
+        first = false;
+        frame_journal_pop(&j);
+    }
+    assert(prev == seq - 1);
+
+    // Lo extraído no vuelve tras otro reinicio
+    assert(frame_journal_recover(&j, &storage) == ESP_OK);
+    assert(j.count == 0);
+    printf("recuperación: %u frames escritos, %d reinicios, %d pendientes al final, %u borrados de bloque\n",
+           (unsigned)seq, reboots, left, (unsigned)fl.erases);
+    fclose(fl.f);
+}
+
+int main(void)
+{
+    test_fifo_and_wrap();
+    test_index_full();
+    test_spill_and_drain();
+    test_corruption();
+    test_recover();
+    printf("test_journal: OK\n");
+    return 0;
+}
@@ -0,0 +1,537 @@
+// Pruebas del decodificador esp_jpeg (tjpgd) en el host: las imágenes de test_apps dan sus
+// RGB888 de referencia, y cada combinación de formato de salida, swap_color_bytes y escala
+// escribe exactamente lo que el bucle original byte a byte sobre el RGB888 decodificado
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_camera.h"
+#include "img_converters.h"
+#include "jpeg_decoder.h"
+#include "host_mock.h"
+#include "test_logo_rgb888.h"
+#include "test_usb_camera_2_rgb888.h"
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+} jpg_file_t;
+
+static jpg_file_t load_jpg(const char *name)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", ESP_JPEG_TEST_DIR, name);
+    FILE *f = fopen(path, "rb");
+    assert(f);
+    jpg_file_t jpg = { 0 };
+    fseek(f, 0, SEEK_END);
+    jpg.len = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    jpg.data = malloc(jpg.len);
+    assert(fread(jpg.data, 1, jpg.len, f) == jpg.len);
+    fclose(f);
+    return jpg;
+}
+
+static uint8_t *decode(const uint8_t *jpg, size_t len, esp_jpeg_image_format_t format, bool swap,
+                       esp_jpeg_image_scale_t scale, esp_jpeg_image_output_t *out)
+{
+    static uint8_t work[8192];
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = (uint8_t *)jpg,
+        .indata_size = len,
+        .out_format = format,
+        .out_scale = scale,
+        .flags = { .swap_color_bytes = swap },
+        .advanced = { .working_buffer = work, .working_buffer_size = sizeof(work) },
+    };
+    assert(esp_jpeg_get_image_info(&cfg, out) == ESP_OK);
+    cfg.outbuf = malloc(out->output_len);
+    cfg.outbuf_size = out->output_len;
+    // Relleno que no sale de ningún decodificado, para ver píxeles sin escribir
+    memset(cfg.outbuf, 0xa5, out->output_len);
+    assert(esp_jpeg_decode(&cfg, out) == ESP_OK);
+    return cfg.outbuf;
+}
+
+// Lo que escribía el bucle original para un píxel RGB888 de tjpgd
+static void reference_pixel(uint8_t *dst, const uint8_t *in, esp_jpeg_image_format_t format, bool swap)
+{
+    if (format == JPEG_IMAGE_FORMAT_RGB888)
+    {
+        for (int b = 0; b < 3; b++)
+        {
+            dst[b] = swap ? in[3 - b - 1] : in[b];
+        }
+        return;
+    }
+    uint16_t color = ((in[0] & 0xF8) << 8);
+    color |= ((in[1] & 0xFC) << 3);
+    color |= (in[2] >> 3);
+    dst[swap ? 0 : 1] = (uint8_t)(color >> 8);
+    dst[swap ? 1 : 0] = (uint8_t)(color & 0xff);
+}
+
+// Todas las salidas frente a la referencia calculada desde RGB888 sin swap
+static int check_writers(const uint8_t *jpg, size_t len)
+{
+    static const esp_jpeg_image_scale_t scales[] = { JPEG_IMAGE_SCALE_0, JPEG_IMAGE_SCALE_1_2, JPEG_IMAGE_SCALE_1_4, JPEG_IMAGE_SCALE_1_8 };
+    int checked = 0;
+    for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++)
+    {
+        esp_jpeg_image_output_t base_info;
+        uint8_t *base = decode(jpg, len, JPEG_IMAGE_FORMAT_RGB888, false, scales[s], &base_info);
+        const size_t pixels = (size_t)base_info.width * base_info.height;
+        for (int f = JPEG_IMAGE_FORMAT_RGB888; f <= JPEG_IMAGE_FORMAT_RGB565; f++)
+        {
+            for (int swap = 0; swap <= 1; swap++)
+            {
+                esp_jpeg_image_output_t info;
+                uint8_t *out = decode(jpg, len, (esp_jpeg_image_format_t)f, swap, scales[s], &info);
+                const int bpp = f == JPEG_IMAGE_FORMAT_RGB888 ? 3 : 2;
+                assert(info.width == base_info.width && info.height == base_info.height);
+                assert(info.output_len == pixels * bpp);
+                uint8_t *ref = malloc(info.output_len);
+                for (size_t i = 0; i < pixels; i++)
+                {
+                    reference_pixel(ref + i * bpp, base + i * 3, (esp_jpeg_image_format_t)f, swap);
+                }
+                assert(memcmp(ref, out, info.output_len) == 0);
+                free(ref);
+                free(out);
+                checked++;
+            }
+        }
+        free(base);
+    }
+    return checked;
+}
+
+// Como en test_apps: cada componente a +-2 del RGB888 de referencia
+static void test_golden(void)
+{
+    jpg_file_t logo = load_jpg("logo.jpg");
+    esp_jpeg_image_output_t info;
+    uint8_t *rgb = decode(logo.data, logo.len, JPEG_IMAGE_FORMAT_RGB888, false, JPEG_IMAGE_SCALE_0, &info);
+    assert(info.width == 46 && info.height == 46);
+    for (size_t i = 0; i < (size_t)info.width * info.height * 3; i++)
+    {
+        assert(abs(rgb[i] - logo_rgb888[i]) <= 2);
+    }
+    free(rgb);
+
+    // Marcador 0xFFFF roto; la referencia (0xRRGGBB) viene de otro decodificador, de ahí el margen
+    jpg_file_t cam = load_jpg("usb_camera_2.jpg");
+    rgb = decode(cam.data, cam.len, JPEG_IMAGE_FORMAT_RGB888, false, JPEG_IMAGE_SCALE_0, &info);
+    assert(info.width == 160 && info.height == 120);
+    for (size_t i = 0; i < (size_t)info.width * info.height; i++)
+    {
+        const unsigned int o = usb_camera_2_rgb888[i];
+        assert(abs(rgb[i * 3 + 0] - (int)((o >> 16) & 0xff)) <= 16);
+        assert(abs(rgb[i * 3 + 1] - (int)((o >> 8) & 0xff)) <= 16);
+        assert(abs(rgb[i * 3 + 2] - (int)(o & 0xff)) <= 16);
+    }
+    free(rgb);
+
+    int checked = check_writers(logo.data, logo.len) + check_writers(cam.data, cam.len);
+    free(logo.data);
+    free(cam.data);
+    printf("referencias: logo y usb_camera_2 dentro de margen, %d salidas idénticas a la referencia\n", checked);
+}
+
+// Las imágenes de la cámara simulada: tamaños que no son múltiplo de la MCU
+static void test_pictures(void)
+{
+    camera_config_t config = {
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_SVGA,
+        .fb_count = 1,
+    };
+    assert(esp_camera_init(&config) == ESP_OK);
+    host_camera_stats_t cs;
+    host_camera_get_stats(&cs);
+    int checked = 0;
+    for (int i = 0; i < cs.pictures; i++)
+    {
+        camera_fb_t *fb = esp_camera_fb_get();
+        assert(fb);
+        checked += check_writers(fb->buf, fb->len);
+        esp_camera_fb_return(fb);
+    }
+    esp_camera_deinit();
+    printf("imágenes de prueba: %d salidas idénticas a la referencia en %d imágenes\n", checked, cs.pictures);
+}
+
+static void test_unsupported_format(void)
+{
+    jpg_file_t logo = load_jpg("logo.jpg");
+    uint8_t out[46 * 46 * 3];
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = logo.data,
+        .indata_size = logo.len,
+        .outbuf = out,
+        .outbuf_size = sizeof(out),
+        .out_format = (esp_jpeg_image_format_t)7,
+    };
+    esp_jpeg_image_output_t info;
+    assert(esp_jpeg_decode(&cfg, &info) == ESP_ERR_INVALID_ARG);
+    free(logo.data);
+}
+
+// Frame de "sensor": degradado con ruido distinto por semilla, mismo tamaño y calidad = mismas tablas
+static jpg_file_t make_frame(uint16_t width, uint16_t height, uint8_t quality, unsigned seed, int tasks)
+{
+    const size_t len = (size_t)width * height * 3;
+    uint8_t *rgb = malloc(len);
+    srand(seed);
+    for (size_t i = 0; i < len; i++)
+    {
+        rgb[i] = (uint8_t)((i / 3 % width) * 255 / width + rand() % 48);
+    }
+    jpg_file_t jpg = { 0 };
+    assert(fmt2jpg_parallel(rgb, len, width, height, PIXFORMAT_RGB888, quality, &jpg.data, &jpg.len, tasks));
+    free(rgb);
+    return jpg;
+}
+
+static bool has_marker(const jpg_file_t *jpg, uint8_t marker)
+{
+    for (size_t i = 0; i + 1 < jpg->len; i++)
+    {
+        if (jpg->data[i] == 0xff && jpg->data[i + 1] == marker)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// El decodificador reutilizable escribe lo mismo que esp_jpeg_decode
+static esp_err_t decoder_check(esp_jpeg_decoder_handle_t decoder, const jpg_file_t *jpg, esp_jpeg_image_format_t format,
+                               esp_jpeg_image_scale_t scale)
+{
+    esp_jpeg_image_output_t ref_info;
+    uint8_t *ref = decode(jpg->data, jpg->len, format, false, scale, &ref_info);
+    uint8_t *out = malloc(ref_info.output_len);
+    memset(out, 0xa5, ref_info.output_len);
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = jpg->data,
+        .indata_size = jpg->len,
+        .outbuf = out,
+        .outbuf_size = ref_info.output_len,
+        .out_format = format,
+        .out_scale = scale,
+    };
+    esp_jpeg_image_output_t info;
+    esp_err_t err = esp_jpeg_decoder_decode(decoder, &cfg, &info);
+    if (err == ESP_OK)
+    {
+        assert(info.width == ref_info.width && info.height == ref_info.height);
+        assert(info.output_len == ref_info.output_len);
+        assert(memcmp(ref, out, info.output_len) == 0);
+    }
+    free(ref);
+    free(out);
+    return err;
+}
+
+static uint32_t decoder_prepares(esp_jpeg_decoder_handle_t decoder)
+{
+    esp_jpeg_decoder_stats_t stats;
+    assert(esp_jpeg_decoder_get_stats(decoder, &stats) == ESP_OK);
+    return stats.prepares;
+}
+
+// Frames del mismo sensor: una sola preparación; cambiar tamaño o calidad la repite
+static void test_decoder_reuse(void)
+{
+    esp_jpeg_decoder_handle_t decoder;
+    assert(esp_jpeg_decoder_create(8192, &decoder) == ESP_OK);
+
+    static const esp_jpeg_image_scale_t scales[] = { JPEG_IMAGE_SCALE_0, JPEG_IMAGE_SCALE_1_2, JPEG_IMAGE_SCALE_1_4, JPEG_IMAGE_SCALE_1_8 };
+    for (unsigned i = 0; i < 8; i++)
+    {
+        jpg_file_t jpg = make_frame(160, 120, 60, i, 1);
+        assert(decoder_check(decoder, &jpg, i % 2 ? JPEG_IMAGE_FORMAT_RGB565 : JPEG_IMAGE_FORMAT_RGB888, scales[i % 4]) == ESP_OK);
+        free(jpg.data);
+    }
+    assert(decoder_prepares(decoder) == 1);
+
+    jpg_file_t other_quality = make_frame(160, 120, 80, 8, 1);
+    assert(decoder_check(decoder, &other_quality, JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_SCALE_0) == ESP_OK);
+    assert(decoder_prepares(decoder) == 2);
+    jpg_file_t other_size = make_frame(96, 64, 80, 9, 1);
+    assert(decoder_check(decoder, &other_size, JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_SCALE_0) == ESP_OK);
+    assert(decoder_prepares(decoder) == 3);
+    assert(decoder_check(decoder, &other_quality, JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_SCALE_0) == ESP_OK);
+    assert(decoder_prepares(decoder) == 4);
+
+    // Un COM tras el SOI no cambia las tablas
+    static const uint8_t com[] = { 0xff, 0xfe, 0x00, 0x06, 'h', 'o', 'l', 'a' };
+    jpg_file_t commented = { .len = other_quality.len + sizeof(com) };
+    commented.data = malloc(commented.len);
+    memcpy(commented.data, other_quality.data, 2);
+    memcpy(commented.data + 2, com, sizeof(com));
+    memcpy(commented.data + 2 + sizeof(com), other_quality.data + 2, other_quality.len - 2);
+    assert(decoder_check(decoder, &commented, JPEG_IMAGE_FORMAT_RGB565, JPEG_IMAGE_SCALE_1_2) == ESP_OK);
+    assert(decoder_prepares(decoder) == 4);
+
+    // Un frame cortado falla sin estropear la caché
+    jpg_file_t truncated = { .data = other_quality.data, .len = other_quality.len / 3 };
+    uint8_t out[160 * 120 * 3];
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = truncated.data,
+        .indata_size = truncated.len,
+        .outbuf = out,
+        .outbuf_size = sizeof(out),
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+    };
+    esp_jpeg_image_output_t info;
+    assert(esp_jpeg_decoder_decode(decoder, &cfg, &info) == ESP_FAIL);
+    assert(decoder_check(decoder, &other_quality, JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_SCALE_0) == ESP_OK);
+    assert(decoder_prepares(decoder) == 4);
+
+    // Con DRI/RSTn de fmt2jpg_parallel
+    for (unsigned i = 0; i < 3; i++)
+    {
+        jpg_file_t jpg = make_frame(320, 240, 60, 20 + i, 2);
+        assert(has_marker(&jpg, 0xdd));
+        assert(decoder_check(decoder, &jpg, JPEG_IMAGE_FORMAT_RGB888, scales[i]) == ESP_OK);
+        free(jpg.data);
+    }
+    assert(decoder_prepares(decoder) == 5);
+
+    esp_jpeg_decoder_stats_t stats;
+    assert(esp_jpeg_decoder_get_stats(decoder, &stats) == ESP_OK);
+    assert(stats.decodes == 17);
+    free(commented.data);
+    free(other_quality.data);
+    free(other_size.data);
+    assert(esp_jpeg_decoder_delete(decoder) == ESP_OK);
+    printf("decodificador reutilizable: %u decodificados, %u preparaciones\n", (unsigned)stats.decodes, (unsigned)stats.prepares);
+}
+
+// Una región decodificada es el mismo recorte de la imagen completa
+static void check_roi(const jpg_file_t *jpg, esp_jpeg_image_scale_t scale, const esp_jpeg_image_output_t *full_info,
+                      const uint8_t *full, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+    static uint8_t work[8192];
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = jpg->data,
+        .indata_size = jpg->len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .out_scale = scale,
+        .advanced = { .working_buffer = work, .working_buffer_size = sizeof(work) },
+        .roi = { .x = x, .y = y, .width = width, .height = height },
+    };
+    esp_jpeg_image_output_t info;
+    assert(esp_jpeg_get_image_info(&cfg, &info) == ESP_OK);
+    assert(info.width == width && info.height == height && info.output_len == (size_t)width * height * 3);
+    cfg.outbuf = malloc(info.output_len);
+    cfg.outbuf_size = info.output_len;
+    memset(cfg.outbuf, 0xa5, info.output_len);
+    assert(esp_jpeg_decode(&cfg, &info) == ESP_OK);
+    assert(info.width == width && info.height == height);
+    for (uint16_t row = 0; row < height; row++)
+    {
+        assert(memcmp(cfg.outbuf + (size_t)row * width * 3, full + ((size_t)(y + row) * full_info->width + x) * 3, (size_t)width * 3) == 0);
+    }
+    free(cfg.outbuf);
+}
+
+// Regiones en esquinas, centro, un píxel y franjas, a cada escala
+static int check_rois(const jpg_file_t *jpg)
+{
+    static const esp_jpeg_image_scale_t scales[] = { JPEG_IMAGE_SCALE_0, JPEG_IMAGE_SCALE_1_2, JPEG_IMAGE_SCALE_1_4, JPEG_IMAGE_SCALE_1_8 };
+    int checked = 0;
+    for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++)
+    {
+        esp_jpeg_image_output_t info;
+        uint8_t *full = decode(jpg->data, jpg->len, JPEG_IMAGE_FORMAT_RGB888, false, scales[s], &info);
+        const uint16_t w = info.width, h = info.height;
+        const uint16_t rois[][4] = {
+            { 0, 0, w, h },
+            { 0, 0, w / 3 + 1, h / 3 + 1 },
+            { w - w / 3 - 1, h - h / 3 - 1, w / 3 + 1, h / 3 + 1 },
+            { w / 4, h / 4, w / 2, h / 2 },
+            { w / 2, h / 2, 1, 1 },
+            { w - 1, h - 1, 1, 1 },
+            { 0, h / 2, w, 1 },
+            { w / 2, 0, 1, h },
+            { w / 8, h - h / 5 - 1, w - w / 4, h / 5 + 1 },
+        };
+        for (size_t r = 0; r < sizeof(rois) / sizeof(rois[0]); r++)
+        {
+            check_roi(jpg, scales[s], &info, full, rois[r][0], rois[r][1], rois[r][2], rois[r][3]);
+            checked++;
+        }
+        free(full);
+    }
+    return checked;
+}
+
+static void test_roi(void)
+{
+    jpg_file_t logo = load_jpg("logo.jpg");
+    jpg_file_t cam = load_jpg("usb_camera_2.jpg");
+    int checked = check_rois(&logo) + check_rois(&cam);
+
+    // Con intervalos de reinicio: las franjas fuera de la región se saltan hasta el RSTn
+    for (unsigned i = 0; i < 2; i++)
+    {
+        jpg_file_t jpg = make_frame(i ? 227 : 320, i ? 149 : 240, 60, 30 + i, 4);
+        assert(has_marker(&jpg, 0xdd));
+        checked += check_rois(&jpg);
+        free(jpg.data);
+    }
+
+    camera_config_t config = {
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_SVGA,
+        .fb_count = 1,
+    };
+    assert(esp_camera_init(&config) == ESP_OK);
+    host_camera_stats_t cs;
+    host_camera_get_stats(&cs);
+    for (int i = 0; i < cs.pictures; i++)
+    {
+        camera_fb_t *fb = esp_camera_fb_get();
+        assert(fb);
+        jpg_file_t jpg = { .data = fb->buf, .len = fb->len };
+        checked += check_rois(&jpg);
+        esp_camera_fb_return(fb);
+    }
+    esp_camera_deinit();
+
+    // Región fuera de la imagen
+    uint8_t out[46 * 46 * 3];
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = logo.data,
+        .indata_size = logo.len,
+        .outbuf = out,
+        .outbuf_size = sizeof(out),
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .out_scale = JPEG_IMAGE_SCALE_1_2,
+        .roi = { .x = 10, .y = 0, .width = 14, .height = 4 },
+    };
+    esp_jpeg_image_output_t info;
+    assert(esp_jpeg_get_image_info(&cfg, &info) == ESP_ERR_INVALID_ARG);
+    assert(esp_jpeg_decode(&cfg, &info) == ESP_ERR_INVALID_ARG);
+    cfg.roi.width = 13;
+    assert(esp_jpeg_decode(&cfg, &info) == ESP_OK && info.output_len == 13 * 4 * 3);
+
+    free(logo.data);
+    free(cam.data);
+    printf("regiones: %d recortes idénticos a la imagen completa\n", checked);
+}
+
+// esp_jpeg_decode_parallel escribe lo mismo que esp_jpeg_decode
+static void check_parallel(const jpg_file_t *jpg, esp_jpeg_image_format_t format, esp_jpeg_image_scale_t scale, int tasks,
+                           uint16_t roi_width, uint16_t roi_height)
+{
+    static uint8_t work[8192];
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = jpg->data,
+        .indata_size = jpg->len,
+        .out_format = format,
+        .out_scale = scale,
+        .advanced = { .working_buffer = work, .working_buffer_size = sizeof(work) },
+        .roi = { .x = 1, .y = 2, .width = roi_width, .height = roi_height },
+    };
+    esp_jpeg_image_output_t ref_info;
+    assert(esp_jpeg_get_image_info(&cfg, &ref_info) == ESP_OK);
+    uint8_t *ref = malloc(ref_info.output_len);
+    uint8_t *out = malloc(ref_info.output_len);
+    memset(ref, 0xa5, ref_info.output_len);
+    memset(out, 0x5a, ref_info.output_len);
+    cfg.outbuf = ref;
+    cfg.outbuf_size = ref_info.output_len;
+    assert(esp_jpeg_decode(&cfg, &ref_info) == ESP_OK);
+    esp_jpeg_image_output_t info;
+    cfg.outbuf = out;
+    assert(esp_jpeg_decode_parallel(&cfg, &info, tasks) == ESP_OK);
+    assert(info.width == ref_info.width && info.height == ref_info.height && info.output_len == ref_info.output_len);
+    assert(memcmp(ref, out, info.output_len) == 0);
+    free(ref);
+    free(out);
+}
+
+// Por intervalos de reinicio en varias tareas; sin RSTn, en serie
+static void test_parallel(void)
+{
+    static const esp_jpeg_image_scale_t scales[] = { JPEG_IMAGE_SCALE_0, JPEG_IMAGE_SCALE_1_2, JPEG_IMAGE_SCALE_1_4, JPEG_IMAGE_SCALE_1_8 };
+    static const uint16_t sizes[][2] = { { 320, 240 }, { 227, 149 }, { 640, 480 }, { 64, 32 } };
+    int checked = 0;
+    for (size_t z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++)
+    {
+        for (int encoders = 1; encoders <= 4; encoders *= 2)
+        {
+            jpg_file_t jpg = make_frame(sizes[z][0], sizes[z][1], 60, 40 + z, encoders);
+            for (int tasks = 0; tasks <= 4; tasks++)
+            {
+                const esp_jpeg_image_format_t format = tasks % 2 ? JPEG_IMAGE_FORMAT_RGB565 : JPEG_IMAGE_FORMAT_RGB888;
+                check_parallel(&jpg, format, scales[tasks % 4], tasks, 0, 0);
+                check_parallel(&jpg, format, JPEG_IMAGE_SCALE_0, tasks, sizes[z][0] / 3, sizes[z][1] / 2);
+                checked += 2;
+            }
+            free(jpg.data);
+        }
+    }
+    jpg_file_t cam = load_jpg("usb_camera_2.jpg");
+    check_parallel(&cam, JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_SCALE_0, 2, 0, 0);
+    free(cam.data);
+
+    // Un RSTn cambiado: ni en paralelo ni en serie se puede decodificar
+    jpg_file_t jpg = make_frame(320, 240, 60, 50, 4);
+    size_t i = jpg.len - 3;
+    while (!(jpg.data[i] == 0xff && jpg.data[i + 1] >= 0xd0 && jpg.data[i + 1] <= 0xd7))
+    {
+        i--;
+    }
+    jpg.data[i + 1] = 0xd0 + ((jpg.data[i + 1] + 1) & 7);
+    uint8_t *out = malloc(320 * 240 * 3);
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = jpg.data,
+        .indata_size = jpg.len,
+        .outbuf = out,
+        .outbuf_size = 320 * 240 * 3,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .advanced = { .working_buffer = (uint8_t[8192]){ 0 }, .working_buffer_size = 8192 },
+    };
+    esp_jpeg_image_output_t info;
+    assert(esp_jpeg_decode_parallel(&cfg, &info, 2) == ESP_FAIL);
+    free(out);
+    free(jpg.data);
+    printf("paralelo: %d decodificados idénticos a esp_jpeg_decode\n", checked);
+}
+
+// Los auxiliares comparten las tablas del JDEC preparado y guardan sus buffers entre llamadas:
+// solo la primera llamada con más auxiliares que las anteriores reserva su bloque
+static void test_parallel_scratch(void)
+{
+    jpg_file_t jpg = make_frame(640, 480, 60, 60, 4);
+    unsigned long allocs[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const unsigned long before = host_heap_allocs();
+        check_parallel(&jpg, JPEG_IMAGE_FORMAT_RGB888, JPEG_IMAGE_SCALE_0, 6, 0, 0);
+        allocs[i] = host_heap_allocs() - before;
+    }
+    assert(allocs[0] == allocs[1] + 1);
+    assert(allocs[1] == allocs[2]);
+    free(jpg.data);
+    printf("paralelo: %lu reservas por llamada tras la primera\n", allocs[1]);
+}
+
+int main(void)
+{
+    test_golden();
+    test_pictures();
+    test_unsupported_format();
+    test_decoder_reuse();
+    test_roi();
+    test_parallel();
+    test_parallel_scratch();
+    printf("test_jpeg_dec: OK\n");
+    return 0;
+}
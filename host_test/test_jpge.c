@@ -0,0 +1,721 @@
+// Pruebas del codificador JPEG (jpge): entradas RGB565/YUV422 directas, varios encoders en paralelo
+// codificación por bandas con marcadores de reinicio, buffers de salida, reducción al codificar
+// codificación con presupuesto de bytes y tablas Huffman optimizadas
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "img_converters.h"
+#include "jpeg_decoder.h"
+#include "esp_heap_caps.h"
+#include "host_mock.h"
+#include "yuv.h"
+
+#define IMG_W           160
+#define IMG_H           120
+#define N_THREADS       4
+#define ROUNDS          12
+
+typedef struct {
+    pixformat_t format;
+    int bpp;
+    uint8_t quality;
+    uint8_t *src;
+    uint8_t *ref;
+    size_t ref_len;
+} job_t;
+
+static const pixformat_t formats[] = { PIXFORMAT_RGB888, PIXFORMAT_RGB565, PIXFORMAT_YUV422, PIXFORMAT_GRAYSCALE };
+static const int format_bpp[] = { 3, 2, 2, 1 };
+static const uint8_t qualities[] = { 5, 40, 90 };
+
+#define N_FORMATS   (sizeof(formats) / sizeof(formats[0]))
+#define N_QUALITIES (sizeof(qualities) / sizeof(qualities[0]))
+#define N_JOBS      (N_FORMATS * N_QUALITIES)
+
+static job_t jobs[N_JOBS];
+
+// Degradados con algo de ruido para que haya coeficientes AC de todo tipo
+static uint8_t *make_image(int bpp, unsigned seed)
+{
+    uint8_t *img = malloc(IMG_W * IMG_H * bpp);
+    for (int y = 0; y < IMG_H; y++)
+    {
+        for (int x = 0; x < IMG_W; x++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            uint8_t *p = img + (y * IMG_W + x) * bpp;
+            for (int c = 0; c < bpp; c++)
+            {
+                p[c] = (uint8_t)((x * (c + 1) + y * (3 - c) + ((seed >> 16) & 0x1f)) & 0xff);
+            }
+        }
+    }
+    return img;
+}
+
+static bool encode(const job_t *job, uint8_t **out, size_t *out_len)
+{
+    return fmt2jpg(job->src, IMG_W * IMG_H * job->bpp, IMG_W, IMG_H, job->format, job->quality, out, out_len);
+}
+
+static void *worker(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        for (size_t k = 0; k < N_JOBS; k++)
+        {
+            // Cada hilo recorre los trabajos en otro orden para mezclar calidades
+            const job_t *job = &jobs[(k * (id + 1) + r) % N_JOBS];
+            uint8_t *out = NULL;
+            size_t len = 0;
+            assert(encode(job, &out, &len));
+            assert(len == job->ref_len && memcmp(out, job->ref, len) == 0);
+            free(out);
+        }
+    }
+    return NULL;
+}
+
+static uint8_t *decode_rgb_size(const uint8_t *jpg, size_t len, int w, int h)
+{
+    // Los 3100 bytes por defecto no bastan para un H2V2 con dos tablas de cuantización
+    static uint8_t work[8192];
+    uint8_t *rgb = malloc(w * h * 3);
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = (uint8_t *)jpg,
+        .indata_size = len,
+        .outbuf = rgb,
+        .outbuf_size = w * h * 3,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .advanced = { .working_buffer = work, .working_buffer_size = sizeof(work) },
+    };
+    esp_jpeg_image_output_t info;
+    assert(esp_jpeg_decode(&cfg, &info) == ESP_OK);
+    assert(info.width == w && info.height == h);
+    return rgb;
+}
+
+static uint8_t *decode_rgb(const uint8_t *jpg, size_t len)
+{
+    return decode_rgb_size(jpg, len, IMG_W, IMG_H);
+}
+
+static double psnr(const uint8_t *a, const uint8_t *b, size_t n)
+{
+    double se = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        double d = (double)a[i] - b[i];
+        se += d * d;
+    }
+    return 10.0 * log10(255.0 * 255.0 / (se / n));
+}
+
+// Escena suave con bordes: lo que más se parece a una foto sin cargar ninguna
+static void scene_rgb(int x, int y, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    *r = (uint8_t)(128 + 100 * sin(x * 0.05) * cos(y * 0.07));
+    *g = (uint8_t)((x * 255) / IMG_W);
+    *b = (uint8_t)(((x / 20 + y / 20) & 1) ? 200 : 40);
+}
+
+// RGB565 directo: los mismos bytes que expandiéndolo antes a RGB888 (BGR, como la cámara)
+static void test_rgb565_direct(void)
+{
+    uint8_t *src = make_image(2, 7);
+    uint8_t *bgr = malloc(IMG_W * IMG_H * 3);
+    for (int i = 0; i < IMG_W * IMG_H; i++)
+    {
+        const uint8_t *p = src + i * 2;
+        bgr[i * 3 + 2] = p[0] & 0xf8;
+        bgr[i * 3 + 1] = ((p[0] & 0x07) << 5) | ((p[1] & 0xe0) >> 3);
+        bgr[i * 3 + 0] = (p[1] & 0x1f) << 3;
+    }
+    for (size_t q = 0; q < N_QUALITIES; q++)
+    {
+        uint8_t *a, *b;
+        size_t a_len, b_len;
+        assert(fmt2jpg(src, IMG_W * IMG_H * 2, IMG_W, IMG_H, PIXFORMAT_RGB565, qualities[q], &a, &a_len));
+        assert(fmt2jpg(bgr, IMG_W * IMG_H * 3, IMG_W, IMG_H, PIXFORMAT_RGB888, qualities[q], &b, &b_len));
+        assert(a_len == b_len && memcmp(a, b, a_len) == 0);
+        free(a);
+        free(b);
+    }
+    free(src);
+    free(bgr);
+}
+
+// YUV422 directo frente al camino anterior (yuv2rgb por píxel y vuelta a YCbCr):
+// más fiel a lo que ve la cámara
+static void test_yuv422_direct(void)
+{
+    uint8_t *yuyv = malloc(IMG_W * IMG_H * 2);
+    for (int y = 0; y < IMG_H; y++)
+    {
+        for (int x = 0; x < IMG_W; x += 2)
+        {
+            // BT.601 rango reducido, crominancia promediada por parejas como el sensor
+            int yy[2], u = 0, v = 0;
+            for (int k = 0; k < 2; k++)
+            {
+                uint8_t r, g, b;
+                scene_rgb(x + k, y, &r, &g, &b);
+                yy[k] = 16 + (65 * r + 129 * g + 25 * b + 128) / 256;
+                u += 128 + (-38 * r - 74 * g + 112 * b + 128) / 256;
+                v += 128 + (112 * r - 94 * g - 18 * b + 128) / 256;
+            }
+            uint8_t *p = yuyv + (y * IMG_W + x) * 2;
+            p[0] = (uint8_t)yy[0];
+            p[1] = (uint8_t)(u / 2);
+            p[2] = (uint8_t)yy[1];
+            p[3] = (uint8_t)(v / 2);
+        }
+    }
+
+    // Referencia: la imagen que representa el YUV según BT.601. El camino anterior
+    // pasaba por yuv2rgb(), que usa los coeficientes de verde de U y V cruzados.
+    uint8_t *ref = malloc(IMG_W * IMG_H * 3);
+    uint8_t *bgr = malloc(IMG_W * IMG_H * 3);
+    for (int i = 0; i < IMG_W * IMG_H; i += 2)
+    {
+        const uint8_t *p = yuyv + i * 2;
+        for (int k = 0; k < 2; k++)
+        {
+            double yy = 1.164 * (p[k * 2] - 16), u = p[1] - 128.0, v = p[3] - 128.0;
+            double rgb[3] = { yy + 1.596 * v, yy - 0.392 * u - 0.813 * v, yy + 2.017 * u };
+            uint8_t *o = ref + (i + k) * 3;
+            for (int c = 0; c < 3; c++)
+            {
+                o[c] = (uint8_t)(rgb[c] < 0 ? 0 : rgb[c] > 255 ? 255 : rgb[c] + 0.5);
+            }
+            uint8_t r, g, b;
+            yuv2rgb(p[k * 2], p[1], p[3], &r, &g, &b);
+            bgr[(i + k) * 3 + 0] = b;
+            bgr[(i + k) * 3 + 1] = g;
+            bgr[(i + k) * 3 + 2] = r;
+        }
+    }
+
+    for (size_t q = 0; q < N_QUALITIES; q++)
+    {
+        uint8_t *direct, *legacy;
+        size_t direct_len, legacy_len;
+        assert(fmt2jpg(yuyv, IMG_W * IMG_H * 2, IMG_W, IMG_H, PIXFORMAT_YUV422, qualities[q], &direct, &direct_len));
+        assert(fmt2jpg(bgr, IMG_W * IMG_H * 3, IMG_W, IMG_H, PIXFORMAT_RGB888, qualities[q], &legacy, &legacy_len));
+
+        uint8_t *d = decode_rgb(direct, direct_len);
+        uint8_t *l = decode_rgb(legacy, legacy_len);
+        double p_direct = psnr(d, ref, IMG_W * IMG_H * 3);
+        double p_legacy = psnr(l, ref, IMG_W * IMG_H * 3);
+        printf("yuv422 q=%-2u: directo %5.2f dB %5zu bytes, vía RGB %5.2f dB %5zu bytes\n",
+               qualities[q], p_direct, direct_len, p_legacy, legacy_len);
+        assert(p_direct > p_legacy);
+        assert(qualities[q] < 90 || p_direct > 35.0);
+        free(d);
+        free(l);
+        free(direct);
+        free(legacy);
+    }
+    free(yuyv);
+    free(ref);
+    free(bgr);
+}
+
+static bool has_marker(const uint8_t *jpg, size_t len, uint8_t marker)
+{
+    for (size_t i = 0; i + 1 < len; i++)
+    {
+        if (jpg[i] == 0xff && jpg[i + 1] == marker)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Por bandas: los reinicios no tocan los coeficientes, así que se decodifica exactamente
+// la misma imagen que sin ellos, y el resultado no depende del número de tareas
+static void test_parallel_bands(void)
+{
+    for (size_t f = 0; f < N_FORMATS; f++)
+    {
+        uint8_t *src = make_image(format_bpp[f], (unsigned)f + 11);
+        size_t src_len = IMG_W * IMG_H * format_bpp[f];
+        for (size_t q = 0; q < N_QUALITIES; q++)
+        {
+            uint8_t *seq, *two, *three;
+            size_t seq_len, two_len, three_len;
+            assert(fmt2jpg(src, src_len, IMG_W, IMG_H, formats[f], qualities[q], &seq, &seq_len));
+            assert(fmt2jpg_parallel(src, src_len, IMG_W, IMG_H, formats[f], qualities[q], &two, &two_len, 2));
+            assert(fmt2jpg_parallel(src, src_len, IMG_W, IMG_H, formats[f], qualities[q], &three, &three_len, 3));
+            assert(two_len == three_len && memcmp(two, three, two_len) == 0);
+            assert(has_marker(two, two_len, 0xdd) && has_marker(two, two_len, 0xd0));
+            assert(!has_marker(seq, seq_len, 0xdd));
+            assert(two[two_len - 2] == 0xff && two[two_len - 1] == 0xd9);
+
+            uint8_t *a = decode_rgb(seq, seq_len);
+            uint8_t *b = decode_rgb(two, two_len);
+            assert(memcmp(a, b, IMG_W * IMG_H * 3) == 0);
+            free(a);
+            free(b);
+            free(seq);
+            free(two);
+            free(three);
+        }
+        free(src);
+    }
+
+    // Una sola tarea es fmt2jpg, sin reinicios
+    uint8_t *src = make_image(3, 5);
+    uint8_t *a, *b;
+    size_t a_len, b_len;
+    assert(fmt2jpg(src, IMG_W * IMG_H * 3, IMG_W, IMG_H, PIXFORMAT_RGB888, 80, &a, &a_len));
+    assert(fmt2jpg_parallel(src, IMG_W * IMG_H * 3, IMG_W, IMG_H, PIXFORMAT_RGB888, 80, &b, &b_len, 1));
+    assert(a_len == b_len && memcmp(a, b, a_len) == 0);
+    free(a);
+    free(b);
+    free(src);
+    printf("bandas: misma imagen decodificada con 2 y 3 tareas\n");
+}
+
+static uint32_t fnv1a(const uint8_t *p, size_t n)
+{
+    uint32_t h = 2166136261u;
+    while (n--)
+    {
+        h = (h ^ *p++) * 16777619u;
+    }
+    return h;
+}
+
+// Salidas de referencia del codificador (las de antes del escritor de bits de 64 bits):
+// cualquier cambio en el flujo de bits cambia el hash
+static const struct {
+    int format;     // índice en formats[]
+    uint8_t quality;
+    int tasks;      // 0: fmt2jpg, si no fmt2jpg_parallel
+    size_t len;
+    uint32_t hash;
+} golden[] = {
+    { 0,   1, 0,  1176, 0x168d756f },
+    { 0,   5, 0,  1310, 0x96db4335 },
+    { 0,  40, 0,  3859, 0xe4c9e076 },
+    { 0,  90, 0, 11678, 0xf170005e },
+    { 0, 100, 0, 26458, 0xd44b663c },
+    { 0,  90, 2, 11703, 0x20bc6410 },
+    { 1,   1, 0,  1353, 0xd72250eb },
+    { 1,   5, 0,  1722, 0xd3308b37 },
+    { 1,  40, 0,  7140, 0x8dd3820e },
+    { 1,  90, 0, 17757, 0x4bd61e0e },
+    { 1, 100, 0, 38509, 0x107cb2c0 },
+    { 1,  90, 2, 17785, 0x64f6a57f },
+    { 2,   1, 0,  1867, 0x300ae476 },
+    { 2,   5, 0,  2090, 0x38d5d030 },
+    { 2,  40, 0,  5369, 0x7a6591d1 },
+    { 2,  90, 0, 17401, 0x4a135e02 },
+    { 2, 100, 0, 40615, 0x59e3f556 },
+    { 2,  90, 2, 17442, 0xef596a6e },
+    { 3,   1, 0,   904, 0x1e07e1a7 },
+    { 3,   5, 0,  1039, 0xdb98dea3 },
+    { 3,  40, 0,  2857, 0x54554118 },
+    { 3,  90, 0,  8722, 0xf8e1841f },
+    { 3, 100, 0, 18513, 0x49d45642 },
+    { 3,  90, 2,  8767, 0xa3da7f79 },
+};
+
+static void test_golden(void)
+{
+    for (size_t g = 0; g < sizeof(golden) / sizeof(golden[0]); g++)
+    {
+        int f = golden[g].format;
+        uint8_t *src = make_image(format_bpp[f], 1000 + f);
+        uint8_t *out;
+        size_t len;
+        size_t src_len = IMG_W * IMG_H * format_bpp[f];
+        if (golden[g].tasks)
+        {
+            assert(fmt2jpg_parallel(src, src_len, IMG_W, IMG_H, formats[f], golden[g].quality, &out, &len, golden[g].tasks));
+        }
+        else
+        {
+            assert(fmt2jpg(src, src_len, IMG_W, IMG_H, formats[f], golden[g].quality, &out, &len));
+        }
+        assert(len == golden[g].len && fnv1a(out, len) == golden[g].hash);
+        free(out);
+        free(src);
+    }
+    printf("golden: %d codificaciones idénticas a la referencia\n", (int)(sizeof(golden) / sizeof(golden[0])));
+}
+
+// Más de los 128 KB fijos de antes: el JPEG sale entero y el buffer queda a su medida
+static void test_output_buffers(void)
+{
+    const int w = 640, h = 480;
+    unsigned seed = 99;
+    uint8_t *src = malloc(w * h * 3);
+    for (int i = 0; i < w * h * 3; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        src[i] = (uint8_t)(seed >> 16);
+    }
+
+    uint8_t *jpg;
+    size_t len;
+    size_t used = host_heap_used();
+    assert(fmt2jpg(src, w * h * 3, w, h, PIXFORMAT_RGB888, 100, &jpg, &len));
+    size_t grown = host_heap_used() - used;
+    assert(len > 128 * 1024);
+    assert(jpg[len - 2] == 0xff && jpg[len - 1] == 0xd9);
+    // Bloque grande: glibc lo redondea a páginas
+    assert(grown >= len && grown < len + 4096);
+
+    static uint8_t work[8192];
+    uint8_t *rgb = malloc(w * h * 3);
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = jpg,
+        .indata_size = len,
+        .outbuf = rgb,
+        .outbuf_size = w * h * 3,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .advanced = { .working_buffer = work, .working_buffer_size = sizeof(work) },
+    };
+    esp_jpeg_image_output_t info;
+    assert(esp_jpeg_decode(&cfg, &info) == ESP_OK);
+    assert(info.width == w && info.height == h);
+    free(rgb);
+
+    // Misma imagen en otra región y en un buffer del llamador: justo cabe, un byte menos no
+    uint8_t *spiram;
+    size_t spiram_len;
+    assert(fmt2jpg_caps(src, w * h * 3, w, h, PIXFORMAT_RGB888, 100, &spiram, &spiram_len, MALLOC_CAP_SPIRAM));
+    assert(spiram_len == len && memcmp(spiram, jpg, len) == 0);
+    free(spiram);
+
+    uint8_t *buf = malloc(len);
+    size_t buf_len = 0;
+    assert(fmt2jpg_buf(src, w * h * 3, w, h, PIXFORMAT_RGB888, 100, buf, len, &buf_len));
+    assert(buf_len == len && memcmp(buf, jpg, len) == 0);
+    assert(!fmt2jpg_buf(src, w * h * 3, w, h, PIXFORMAT_RGB888, 100, buf, len - 1, &buf_len));
+    free(buf);
+
+    printf("salida: %zu bytes (más de 128 KB), buffer de %zu bytes tras recortar\n", len, grown);
+    free(jpg);
+    free(src);
+}
+
+// Imagen pequeña ampliada k x k (en YUV422 cada par grande repite U y V del par pequeño):
+// reducirla 1/k debe dar exactamente los bytes de codificar la pequeña
+static uint8_t *upscale_blocks(const uint8_t *small, int sw, int sh, int bpp, pixformat_t format, int k)
+{
+    const int w = sw * k;
+    uint8_t *big = malloc(w * sh * k * bpp);
+    for (int y = 0; y < sh * k; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            const uint8_t *s = small + ((y / k) * sw + x / k) * bpp;
+            uint8_t *d = big + (y * w + x) * bpp;
+            if (format == PIXFORMAT_YUV422)
+            {
+                const uint8_t *pair = small + ((y / k) * sw + ((x / k) & ~1)) * 2;
+                d[0] = s[0];
+                d[1] = (x & 1) ? pair[3] : pair[1];
+            }
+            else
+            {
+                memcpy(d, s, bpp);
+            }
+        }
+    }
+    return big;
+}
+
+// Media de área con los mismos bordes enteros que el escalador, en RGB
+static uint8_t *area_reference(const uint8_t *rgb, int w, int h, int ow, int oh)
+{
+    uint8_t *out = malloc(ow * oh * 3);
+    for (int oy = 0; oy < oh; oy++)
+    {
+        for (int ox = 0; ox < ow; ox++)
+        {
+            int y0 = oy * h / oh, y1 = (oy + 1) * h / oh, x0 = ox * w / ow, x1 = (ox + 1) * w / ow;
+            for (int c = 0; c < 3; c++)
+            {
+                int sum = 0;
+                for (int y = y0; y < y1; y++)
+                {
+                    for (int x = x0; x < x1; x++)
+                    {
+                        sum += rgb[(y * w + x) * 3 + c];
+                    }
+                }
+                int n = (y1 - y0) * (x1 - x0);
+                out[(oy * ow + ox) * 3 + c] = (uint8_t)((sum + n / 2) / n);
+            }
+        }
+    }
+    return out;
+}
+
+static void test_scaled(void)
+{
+    // 1/2 y 1/4: idénticos a codificar la imagen pequeña, en los cuatro formatos
+    static const int factors[] = { 2, 4 };
+    for (size_t f = 0; f < N_FORMATS; f++)
+    {
+        for (size_t k = 0; k < 2; k++)
+        {
+            const int sw = IMG_W / factors[k], sh = IMG_H / factors[k], bpp = format_bpp[f];
+            uint8_t *small = malloc(sw * sh * bpp);
+            unsigned seed = 500 + f;
+            for (int i = 0; i < sw * sh * bpp; i++)
+            {
+                seed = seed * 1103515245u + 12345u;
+                small[i] = (uint8_t)(seed >> 16);
+            }
+            uint8_t *big = upscale_blocks(small, sw, sh, bpp, formats[f], factors[k]);
+            uint8_t *a, *b;
+            size_t a_len, b_len;
+            assert(fmt2jpg_scaled(big, IMG_W * IMG_H * bpp, IMG_W, IMG_H, formats[f], 80, sw, sh, &a, &a_len));
+            assert(fmt2jpg(small, sw * sh * bpp, sw, sh, formats[f], 80, &b, &b_len));
+            assert(a_len == b_len && memcmp(a, b, a_len) == 0);
+            free(a);
+            free(b);
+            free(small);
+            free(big);
+        }
+    }
+
+    // Proporción cualquiera y anchos impares: los mismos bytes que codificar la media de
+    // área hecha aquí, y se decodifica al tamaño pedido
+    const int ow = 61, oh = 47;
+    uint8_t *bgr = malloc(IMG_W * IMG_H * 3);
+    uint8_t *rgb = malloc(IMG_W * IMG_H * 3);
+    for (int y = 0; y < IMG_H; y++)
+    {
+        for (int x = 0; x < IMG_W; x++)
+        {
+            uint8_t *p = rgb + (y * IMG_W + x) * 3;
+            scene_rgb(x, y, &p[0], &p[1], &p[2]);
+            bgr[(y * IMG_W + x) * 3 + 0] = p[2];
+            bgr[(y * IMG_W + x) * 3 + 1] = p[1];
+            bgr[(y * IMG_W + x) * 3 + 2] = p[0];
+        }
+    }
+    uint8_t *ref = area_reference(rgb, IMG_W, IMG_H, ow, oh);
+    for (int i = 0; i < ow * oh; i++)
+    {
+        uint8_t t = ref[i * 3];
+        ref[i * 3] = ref[i * 3 + 2];
+        ref[i * 3 + 2] = t;
+    }
+    uint8_t *jpg, *direct;
+    size_t len, direct_len;
+    assert(fmt2jpg_scaled(bgr, IMG_W * IMG_H * 3, IMG_W, IMG_H, PIXFORMAT_RGB888, 95, ow, oh, &jpg, &len));
+    assert(fmt2jpg(ref, ow * oh * 3, ow, oh, PIXFORMAT_RGB888, 95, &direct, &direct_len));
+    assert(len == direct_len && memcmp(jpg, direct, len) == 0);
+    free(decode_rgb_size(jpg, len, ow, oh));
+    free(direct);
+    free(jpg);
+
+    for (size_t f = 0; f < N_FORMATS; f++)
+    {
+        uint8_t *src = make_image(format_bpp[f], 600 + f);
+        assert(fmt2jpg_scaled(src, IMG_W * IMG_H * format_bpp[f], IMG_W, IMG_H, formats[f], 60, ow, oh, &jpg, &len));
+        free(decode_rgb_size(jpg, len, ow, oh));
+        free(jpg);
+
+        // Mismo tamaño: fmt2jpg; ampliar no se admite
+        uint8_t *same;
+        size_t same_len;
+        assert(fmt2jpg_scaled(src, IMG_W * IMG_H * format_bpp[f], IMG_W, IMG_H, formats[f], 60, IMG_W, IMG_H, &jpg, &len));
+        assert(fmt2jpg(src, IMG_W * IMG_H * format_bpp[f], IMG_W, IMG_H, formats[f], 60, &same, &same_len));
+        assert(len == same_len && memcmp(jpg, same, len) == 0);
+        free(jpg);
+        free(same);
+        assert(!fmt2jpg_scaled(src, IMG_W * IMG_H * format_bpp[f], IMG_W, IMG_H, formats[f], 60, IMG_W + 1, IMG_H, &jpg, &len));
+        assert(!fmt2jpg_scaled(src, IMG_W * IMG_H * format_bpp[f], IMG_W, IMG_H, formats[f], 60, 0, IMG_H, &jpg, &len));
+        // Buffer más corto que el frame: se rechaza antes de leerlo, también a tamaño completo
+        assert(!fmt2jpg_scaled(src, IMG_W * IMG_H * format_bpp[f] - 1, IMG_W, IMG_H, formats[f], 60, ow, oh, &jpg, &len));
+        assert(!fmt2jpg_scaled(src, IMG_W * (IMG_H - 1) * format_bpp[f], IMG_W, IMG_H, formats[f], 60, IMG_W, IMG_H, &jpg, &len));
+        free(src);
+    }
+    printf("escalado: 1/2 y 1/4 idénticos a la imagen pequeña, %dx%d idéntico a la media de área\n", ow, oh);
+    free(ref);
+    free(rgb);
+    free(bgr);
+}
+
+// Presupuesto de bytes: nunca se pasa, la calidad elegida es la del JPEG devuelto y hay
+// como mucho una recodificación
+static void test_target(void)
+{
+    static const size_t budgets[] = { 2500, 5000, 9000, 16000 };
+    int retries = 0;
+    for (size_t f = 0; f < N_FORMATS; f++)
+    {
+        uint8_t *src = make_image(format_bpp[f], 700 + f);
+        const size_t src_len = IMG_W * IMG_H * format_bpp[f];
+        for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++)
+        {
+            uint8_t *jpg, *ref;
+            size_t len, ref_len;
+            jpg_target_info_t info;
+            if (!fmt2jpg_target(src, src_len, IMG_W, IMG_H, formats[f], budgets[b], &jpg, &len, &info))
+            {
+                // Solo si ni la peor calidad cabe
+                assert(info.quality == 1 && info.actual_len > budgets[b]);
+                continue;
+            }
+            assert(len <= budgets[b] && len == info.actual_len);
+            assert(info.encodes == 1 || info.encodes == 2);
+            assert(info.quality >= 1 && info.quality <= 100 && info.predicted_len > 0);
+            retries += info.encodes - 1;
+            assert(fmt2jpg(src, src_len, IMG_W, IMG_H, formats[f], info.quality, &ref, &ref_len));
+            assert(ref_len == len && memcmp(ref, jpg, len) == 0);
+            // Sin desperdiciar presupuesto: cinco puntos más de calidad ya lo llenarían casi entero
+            if (info.quality < 100)
+            {
+                free(ref);
+                assert(fmt2jpg(src, src_len, IMG_W, IMG_H, formats[f], info.quality + 5, &ref, &ref_len));
+                assert(ref_len > budgets[b] - budgets[b] / 8);
+            }
+            free(ref);
+            free(jpg);
+        }
+
+        // Sobra presupuesto: calidad 100 a la primera; presupuesto imposible: falla
+        uint8_t *jpg;
+        size_t len;
+        jpg_target_info_t info;
+        assert(fmt2jpg_target(src, src_len, IMG_W, IMG_H, formats[f], 1 << 20, &jpg, &len, &info));
+        assert(info.quality == 100 && info.encodes == 1);
+        free(jpg);
+        assert(!fmt2jpg_target(src, src_len, IMG_W, IMG_H, formats[f], 200, &jpg, &len, &info));
+        assert(info.quality == 1 && info.actual_len > 200);
+        free(src);
+    }
+    printf("presupuesto: %d formatos x %d tamaños sin pasarse, %d recodificaciones\n", (int)N_FORMATS,
+           (int)(sizeof(budgets) / sizeof(budgets[0])), retries);
+}
+
+// Presupuesto imposible en un frame grande: cada intento se corta al llegar al límite. Sin el
+// corte, el buffer crecía hasta el JPEG de calidad 1 entero (pico de ~2.4 veces su tamaño)
+static void test_target_cap(void)
+{
+    const int w = 1600, h = 1200;
+    unsigned seed = 123;
+    uint8_t *src = malloc(w * h * 3);
+    for (int i = 0; i < w * h * 3; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        src[i] = (uint8_t)(seed >> 16);
+    }
+    uint8_t *jpg;
+    size_t q1_len, len;
+    assert(fmt2jpg(src, w * h * 3, w, h, PIXFORMAT_RGB888, 1, &jpg, &q1_len));
+    free(jpg);
+
+    jpg_target_info_t info;
+    const size_t budget = q1_len / 8;
+    host_heap_reset_peak();
+    size_t used = host_heap_used();
+    assert(!fmt2jpg_target(src, w * h * 3, w, h, PIXFORMAT_RGB888, budget, &jpg, &len, &info));
+    size_t peak = host_heap_peak() - used;
+    assert(info.quality == 1 && info.actual_len > budget);
+    assert(peak < q1_len * 3 / 2);
+    printf("presupuesto de %zu bytes: pico de %zu bytes, calidad 1 estimada en %zu (real %zu)\n", budget, peak,
+           info.actual_len, q1_len);
+    free(src);
+}
+
+// Tablas optimizadas: mismos coeficientes, así que se decodifica la misma imagen, en menos bytes
+static void test_optimized(void)
+{
+    size_t std_total = 0, opt_total = 0;
+    for (size_t f = 0; f < N_FORMATS; f++)
+    {
+        uint8_t *src = make_image(format_bpp[f], 900 + f);
+        const size_t src_len = IMG_W * IMG_H * format_bpp[f];
+        for (size_t q = 0; q < N_QUALITIES; q++)
+        {
+            uint8_t *std, *opt;
+            size_t std_len, opt_len;
+            assert(fmt2jpg(src, src_len, IMG_W, IMG_H, formats[f], qualities[q], &std, &std_len));
+            assert(fmt2jpg_optimized(src, src_len, IMG_W, IMG_H, formats[f], qualities[q], &opt, &opt_len));
+            assert(opt_len < std_len);
+            assert(opt[opt_len - 2] == 0xff && opt[opt_len - 1] == 0xd9);
+            std_total += std_len;
+            opt_total += opt_len;
+
+            uint8_t *a = decode_rgb(std, std_len);
+            uint8_t *b = decode_rgb(opt, opt_len);
+            assert(memcmp(a, b, IMG_W * IMG_H * 3) == 0);
+            free(a);
+            free(b);
+            free(std);
+            free(opt);
+        }
+        free(src);
+    }
+    printf("tablas optimizadas: misma imagen, %u bytes frente a %u (-%.1f%%)\n", (unsigned)opt_total,
+           (unsigned)std_total, 100.0 * (std_total - opt_total) / std_total);
+}
+
+int main(void)
+{
+    test_golden();
+    test_output_buffers();
+    test_rgb565_direct();
+    test_yuv422_direct();
+    test_parallel_bands();
+    test_scaled();
+    test_target();
+    test_target_cap();
+    test_optimized();
+
+    for (size_t f = 0; f < N_FORMATS; f++)
+    {
+        uint8_t *src = make_image(format_bpp[f], (unsigned)f + 1);
+        for (size_t q = 0; q < N_QUALITIES; q++)
+        {
+            job_t *job = &jobs[f * N_QUALITIES + q];
+            job->format = formats[f];
+            job->bpp = format_bpp[f];
+            job->quality = qualities[q];
+            job->src = src;
+            assert(encode(job, &job->ref, &job->ref_len));
+            assert(job->ref_len > 4);
+            assert(job->ref[0] == 0xff && job->ref[1] == 0xd8);
+            assert(job->ref[job->ref_len - 2] == 0xff && job->ref[job->ref_len - 1] == 0xd9);
+        }
+        // Más calidad, más bytes
+        assert(jobs[f * N_QUALITIES].ref_len < jobs[f * N_QUALITIES + N_QUALITIES - 1].ref_len);
+    }
+
+    pthread_t threads[N_THREADS];
+    for (int i = 0; i < N_THREADS; i++)
+    {
+        assert(pthread_create(&threads[i], NULL, worker, (void *)(intptr_t)i) == 0);
+    }
+    for (int i = 0; i < N_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    printf("parallel: %d hilos x %d codificaciones idénticas a la serie\n", N_THREADS, (int)(ROUNDS * N_JOBS));
+    for (size_t f = 0; f < N_FORMATS; f++)
+    {
+        free(jobs[f * N_QUALITIES].src);
+    }
+    for (size_t k = 0; k < N_JOBS; k++)
+    {
+        free(jobs[k].ref);
+    }
+    printf("test_jpge: OK\n");
+    return 0;
+}
@@ -0,0 +1,660 @@
+// Pruebas de las piezas internas de jpge: la cuantización por recíprocos da los mismos bits
+// que la división original (también sobre los bloques de las imágenes de prueba a calidades
+// 1-100), los kernels vectoriales dan los mismos bits que los escalares, las bandas con
+// reinicio concatenadas son la codificación de una pasada, el modelo de tamaño predice lo que
+// sale de verdad, las tablas Huffman optimizadas (dos pasadas) dan la misma imagen en menos
+// bytes, y micro-benchmark de bloques/s
+//
+//   test_jpge_kernels [bloques]
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "jpeg_decoder.h"
+#include "host_mock.h"
+#include "jpge_kernels.h"
+
+using namespace jpge;
+
+#define DEFAULT_BLOCKS  20000
+#define RANDOM_BLOCKS   20000
+
+static unsigned s_seed = 1;
+
+static unsigned rnd(void)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return s_seed >> 8;
+}
+
+// Muestras ya desplazadas (-128..127), como las deja load_block_*
+static void random_block(int32 *b, int kind)
+{
+    for (int i = 0; i < 64; i++)
+    {
+        switch (kind)
+        {
+            case 0: b[i] = (int32)(rnd() & 0xff) - 128; break;                  // Ruido
+            case 1: b[i] = (i + (i >> 3)) & 1 ? 127 : -128; break;               // Tablero: máxima energía AC
+            case 2: b[i] = (rnd() & 1) ? 127 : -128; break;                      // Extremos al azar
+            case 3: b[i] = (int32)((i & 7) * 36 + (i >> 3) * 2) - 128; break;   // Degradado suave
+            default: b[i] = (kind & 1) ? 127 : -128; break;                      // Bloques planos
+        }
+    }
+}
+
+// Tablas estándar de jpge (orden zigzag, como las escribe DQT)
+static const int16 s_std_lum_quant[64] = { 16,11,12,14,12,10,16,14,13,14,18,17,16,19,24,40,26,24,22,22,24,49,35,37,29,40,58,51,61,60,57,51,56,55,64,72,92,78,64,68,87,69,55,56,80,109,81,87,95,98,103,104,103,62,77,113,121,112,100,120,92,101,103,99 };
+static const int16 s_std_croma_quant[64] = { 17,18,18,24,21,24,47,26,26,47,99,66,56,66,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99 };
+static const uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
+
+// compute_quant_table de jpge.cpp: base al azar o estándar escalada a una calidad de 1 a 100
+static void quant_table(uint8 *q, int quality, const int16 *base = NULL)
+{
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; i++)
+    {
+        int v = ((base ? base[i] : (int)(rnd() % 120 + 10)) * scale + 50) / 100;
+        q[i] = (uint8)(v < 1 ? 1 : v > 255 ? 255 : v);
+    }
+}
+
+// La cuantización original de jpge, con una división por coeficiente: la referencia
+static void quantize_div(int16 *pDst, const int32 *pBlock, const uint8 *q)
+{
+    for (int i = 0; i < 64; i++)
+    {
+        int32 j = pBlock[s_zag[i]];
+        if (j < 0)
+        {
+            if ((j = -j + (*q >> 1)) < *q)
+                *pDst++ = 0;
+            else
+                *pDst++ = static_cast<int16>(-(j / *q));
+        }
+        else
+        {
+            if ((j = j + (*q >> 1)) < *q)
+                *pDst++ = 0;
+            else
+                *pDst++ = static_cast<int16>((j / *q));
+        }
+        q++;
+    }
+}
+
+struct quant_recip {
+    uint8 q[64];
+    uint32 recip[64];
+    uint16 bias[64];
+
+    void set(const uint8 *src)
+    {
+        memcpy(q, src, sizeof(q));
+        compute_quant_reciprocals(recip, bias, q);
+    }
+};
+
+// Todos los divisores posibles y todo dividendo hasta 2^16, muy por encima de lo que sale de la DCT
+static void test_reciprocals(void)
+{
+    uint8 q[64];
+    uint32 recip[64];
+    uint16 bias[64];
+    for (int base = 1; base < 256; base += 64)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            q[i] = (uint8)(base + i);
+        }
+        compute_quant_reciprocals(recip, bias, q);
+        for (int i = 0; i < 64 && base + i < 256; i++)
+        {
+            assert(bias[i] == q[i] / 2);
+            for (uint32 n = 0; n < (1u << 16); n++)
+            {
+                assert((uint32)(((uint64_t)(n << 1) * recip[i]) >> 32) == n / q[i]);
+            }
+        }
+    }
+
+    // El mayor coeficiente posible: bloques planos y tableros en los extremos
+    int32 max_coeff = 0;
+    for (int kind = 1; kind < 6; kind++)
+    {
+        int32 b[64];
+        random_block(b, kind);
+        fdct(b);
+        for (int i = 0; i < 64; i++)
+        {
+            max_coeff = b[i] > max_coeff ? b[i] : -b[i] > max_coeff ? -b[i] : max_coeff;
+        }
+    }
+    assert(max_coeff < (1 << 12));
+    printf("recíprocos: exactos para 255 divisores y dividendos < 2^16 (coeficiente máximo %d)\n", (int)max_coeff);
+}
+
+// Cuantización y DCT+cuantización de un juego de kernels frente a DCT2D + división
+static void check_block(const kernels &k, const int32 *block, const int32 *ref_dct, const quant_recip &t)
+{
+    int16 ref[64], a[64], b[64];
+    int32 work[64];
+    quantize_div(ref, ref_dct, t.q);
+    k.quantize(a, ref_dct, t.recip, t.bias);
+    memcpy(work, block, sizeof(work));
+    k.fdct_quantize(b, work, t.recip, t.bias);
+    assert(memcmp(ref, a, sizeof(ref)) == 0);
+    assert(memcmp(ref, b, sizeof(ref)) == 0);
+}
+
+static void test_fdct_quantize(const kernels &ref, const kernels *const *sets, int num_sets)
+{
+    for (int n = 0; n < RANDOM_BLOCKS; n++)
+    {
+        int32 src[64], a[64];
+        random_block(src, n < 100 ? n % 6 : 0);
+        memcpy(a, src, sizeof(a));
+        fdct(a);
+
+        uint8 q[64];
+        quant_table(q, 1 + n % 100);
+        quant_recip t;
+        t.set(q);
+        check_block(ref, src, a, t);
+        for (int k = 0; k < num_sets; k++)
+        {
+            check_block(*sets[k], src, a, t);
+        }
+    }
+}
+
+// Siguiente imagen de la cámara simulada, decodificada a RGB888
+static uint8 *next_picture(int *w, int *h)
+{
+    static uint8_t work[8192];
+    camera_fb_t *fb = esp_camera_fb_get();
+    assert(fb);
+    esp_jpeg_image_cfg_t cfg = {};
+    cfg.indata = fb->buf;
+    cfg.indata_size = fb->len;
+    cfg.out_format = JPEG_IMAGE_FORMAT_RGB888;
+    cfg.advanced.working_buffer = work;
+    cfg.advanced.working_buffer_size = sizeof(work);
+    esp_jpeg_image_output_t info;
+    assert(esp_jpeg_get_image_info(&cfg, &info) == ESP_OK);
+    *w = info.width;
+    *h = info.height;
+    uint8 *rgb = (uint8 *)malloc((size_t)*w * *h * 3);
+    cfg.outbuf = rgb;
+    cfg.outbuf_size = (size_t)*w * *h * 3;
+    assert(esp_jpeg_decode(&cfg, &info) == ESP_OK);
+    esp_camera_fb_return(fb);
+    return rgb;
+}
+
+// Cada bloque 8x8 de Y, Cb y Cr de las imágenes de prueba, con las tablas estándar a calidades 1-100
+static void test_pictures(const kernels *const *sets, int num_sets)
+{
+    camera_config_t config = {};
+    config.pixel_format = PIXFORMAT_JPEG;
+    config.frame_size = FRAMESIZE_SVGA;
+    config.fb_count = 1;
+    assert(esp_camera_init(&config) == ESP_OK);
+    host_camera_stats_t cs;
+    host_camera_get_stats(&cs);
+
+    quant_recip tables[100][2];
+    for (int quality = 1; quality <= 100; quality++)
+    {
+        uint8 q[64];
+        quant_table(q, quality, s_std_lum_quant);
+        tables[quality - 1][0].set(q);
+        quant_table(q, quality, s_std_croma_quant);
+        tables[quality - 1][1].set(q);
+    }
+
+    long blocks = 0;
+    for (int p = 0; p < cs.pictures; p++)
+    {
+        int w, h;
+        uint8 *rgb = next_picture(&w, &h);
+        uint8 *ycc = (uint8 *)malloc((size_t)w * h * 3);
+        scalar_kernels().rgb_to_ycc(ycc, rgb, w * h);
+
+        for (int by = 0; by + 8 <= h; by += 8)
+        {
+            for (int bx = 0; bx + 8 <= w; bx += 8)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    int32 src[64], dct[64];
+                    for (int i = 0; i < 64; i++)
+                    {
+                        src[i] = (int32)ycc[((by + i / 8) * w + bx + i % 8) * 3 + c] - 128;
+                    }
+                    memcpy(dct, src, sizeof(dct));
+                    fdct(dct);
+                    for (int quality = 0; quality < 100; quality++)
+                    {
+                        const quant_recip &t = tables[quality][c > 0];
+                        check_block(scalar_kernels(), src, dct, t);
+                        for (int k = 0; k < num_sets; k++)
+                        {
+                            check_block(*sets[k], src, dct, t);
+                        }
+                    }
+                    blocks++;
+                }
+            }
+        }
+        free(rgb);
+        free(ycc);
+    }
+    esp_camera_deinit();
+    printf("imágenes: %ld bloques de %d imágenes x 100 calidades idénticos a la división\n", blocks, cs.pictures);
+}
+
+static void test_rgb_to_ycc(const kernels &ref, const kernels &k)
+{
+    // Todas las combinaciones de extremos y una muestra de colores; longitudes que no son múltiplo de 4
+    uint8 rgb[3 * 259], a[3 * 259], b[3 * 259];
+    for (int n = 0; n < 2000; n++)
+    {
+        for (int i = 0; i < (int)sizeof(rgb); i++)
+        {
+            rgb[i] = n < 8 ? ((n >> (i % 3)) & 1 ? 255 : 0) : (uint8)rnd();
+        }
+        int pixels = 256 + n % 4;
+        memset(a, 0xaa, sizeof(a));
+        memset(b, 0xaa, sizeof(b));
+        ref.rgb_to_ycc(a, rgb, pixels);
+        k.rgb_to_ycc(b, rgb, pixels);
+        assert(memcmp(a, b, sizeof(a)) == 0);
+    }
+}
+
+// Salida en memoria que crece sin límite
+class vector_stream : public output_stream {
+public:
+    uint8 *buf = NULL;
+    size_t len = 0;
+
+    ~vector_stream() { free(buf); }
+
+    bool put_buf(const void *p, int n)
+    {
+        if (!p)
+        {
+            return true;
+        }
+        buf = (uint8 *)realloc(buf, len + n);
+        memcpy(buf + len, p, n);
+        len += n;
+        return true;
+    }
+
+    size_t get_size() const { return len; }
+};
+
+static void encode_rows(jpeg_encoder &enc, const uint8 *img, int w, int bpp, int first, int last)
+{
+    for (int y = first; y < last; y++)
+    {
+        assert(enc.process_scanline(img + (size_t)y * w * bpp));
+    }
+    assert(enc.process_scanline(NULL));
+}
+
+// Alturas que no son múltiplo de la MCU y última banda incompleta, en todos los submuestreos
+static void test_bands(void)
+{
+    static const struct { source_format_t format; int bpp; } sources[] = { { SRC_Y, 1 }, { SRC_RGB, 3 }, { SRC_YUYV, 2 } };
+    const int w = 100, h = 83;
+    uint8 *img = (uint8 *)malloc(w * h * 3);
+    for (int i = 0; i < w * h * 3; i++)
+    {
+        img[i] = (uint8)((i % 97) * 2 + (rnd() & 15));
+    }
+
+    int checked = 0;
+    for (int sub = Y_ONLY; sub <= H2V2; sub++)
+    {
+        for (size_t k = 0; k < sizeof(sources) / sizeof(sources[0]); k++)
+        {
+            for (int rows = 1; rows <= 3; rows++)
+            {
+                params p;
+                p.m_subsampling = (subsampling_t)sub;
+                p.m_quality = 30 + rows * 20;
+                p.m_restart_rows = rows;
+
+                vector_stream whole;
+                jpeg_encoder enc;
+                assert(enc.init(&whole, w, h, sources[k].format, p));
+                encode_rows(enc, img, w, sources[k].bpp, 0, h);
+
+                vector_stream joined;
+                const int lines = jpeg_encoder::band_lines(p);
+                for (int band = 0; band * lines < h; band++)
+                {
+                    vector_stream part;
+                    assert(enc.init_band(&part, w, h, sources[k].format, p, band));
+                    int last = (band + 1) * lines < h ? (band + 1) * lines : h;
+                    encode_rows(enc, img, w, sources[k].bpp, band * lines, last);
+                    joined.put_buf(part.buf, (int)part.len);
+                }
+                assert(!enc.init_band(&joined, w, h, sources[k].format, p, (h + lines - 1) / lines));
+                assert(whole.len == joined.len && memcmp(whole.buf, joined.buf, whole.len) == 0);
+                checked++;
+            }
+        }
+    }
+    free(img);
+    printf("bandas: %d combinaciones idénticas a la codificación de una pasada\n", checked);
+}
+
+static size_t encoded_size(const uint8 *img, int w, int h, source_format_t format, int bpp, const params &p)
+{
+    vector_stream out;
+    jpeg_encoder enc;
+    assert(enc.init(&out, w, h, format, p));
+    encode_rows(enc, img, w, bpp, 0, h);
+    return out.len;
+}
+
+static size_t estimate(size_estimate &e, const uint8 *img, int w, int h, source_format_t format, int bpp, const params &p)
+{
+    jpeg_encoder enc;
+    assert(enc.init_analysis(&e, w, h, format, p));
+    encode_rows(enc, img, w, bpp, 0, h);
+    return e.sampled_blocks;
+}
+
+// Modelo de tamaño: sin muestreo (imagen pequeña) acierta salvo por el relleno y los bytes
+// 0x00 tras 0xFF; en las imágenes de prueba solo mira parte de las MCU y se queda cerca
+static void test_size_model(void)
+{
+    const int w = 48, h = 37;
+    uint8 *img = (uint8 *)malloc(w * h * 3);
+    for (int i = 0; i < w * h * 3; i++)
+    {
+        img[i] = (uint8)((i % 89) * 2 + (rnd() & 31));
+    }
+    for (int sub = Y_ONLY; sub <= H2V2; sub++)
+    {
+        params p;
+        p.m_subsampling = (subsampling_t)sub;
+        size_estimate e;
+        estimate(e, img, w, h, SRC_RGB, 3, p);
+        assert(e.sampled_blocks == e.total_blocks);
+        for (int k = 0; k < size_estimate::NUM_QUALITIES; k++)
+        {
+            p.m_quality = size_estimate::s_qualities[k];
+            const size_t actual = encoded_size(img, w, h, SRC_RGB, 3, p);
+            const size_t predicted = e.predict(p.m_quality);
+            assert(predicted + actual / 16 + 16 >= actual && predicted <= actual + actual / 16 + 16);
+        }
+    }
+    free(img);
+
+    camera_config_t config = {};
+    config.pixel_format = PIXFORMAT_JPEG;
+    config.frame_size = FRAMESIZE_SVGA;
+    config.fb_count = 1;
+    assert(esp_camera_init(&config) == ESP_OK);
+    host_camera_stats_t cs;
+    host_camera_get_stats(&cs);
+    static const int qualities[] = { 10, 30, 50, 70, 80, 90, 95 };
+    double worst = 0;
+    for (int i = 0; i < cs.pictures; i++)
+    {
+        int pw, ph;
+        uint8 *rgb = next_picture(&pw, &ph);
+        params p;
+        size_estimate e;
+        estimate(e, rgb, pw, ph, SRC_RGB, 3, p);
+        assert(e.sampled_blocks < e.total_blocks);
+        for (size_t q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++)
+        {
+            p.m_quality = qualities[q];
+            const double actual = (double)encoded_size(rgb, pw, ph, SRC_RGB, 3, p);
+            const double err = fabs(e.predict(qualities[q]) - actual) / actual;
+            worst = err > worst ? err : worst;
+        }
+        free(rgb);
+    }
+    esp_camera_deinit();
+    assert(worst < 0.08);
+    printf("modelo de tamaño: exacto sin muestreo, peor error %.1f%% en %d imágenes\n", worst * 100, cs.pictures);
+}
+
+static uint8 *decode(const vector_stream &jpg, int w, int h)
+{
+    static uint8_t work[8192];
+    uint8 *rgb = (uint8 *)malloc((size_t)w * h * 3);
+    esp_jpeg_image_cfg_t cfg = {};
+    cfg.indata = jpg.buf;
+    cfg.indata_size = jpg.len;
+    cfg.outbuf = rgb;
+    cfg.outbuf_size = (size_t)w * h * 3;
+    cfg.out_format = JPEG_IMAGE_FORMAT_RGB888;
+    cfg.advanced.working_buffer = work;
+    cfg.advanced.working_buffer_size = sizeof(work);
+    esp_jpeg_image_output_t info;
+    assert(esp_jpeg_decode(&cfg, &info) == ESP_OK);
+    assert(info.width == w && info.height == h);
+    return rgb;
+}
+
+// Dos pasadas: los mismos coeficientes con otras tablas, así que la imagen decodificada es
+// idéntica; también con reinicios y con una imagen plana (tablas de un solo símbolo)
+static void test_two_pass(void)
+{
+    const int w = 100, h = 83;
+    uint8 *noisy = (uint8 *)malloc(w * h * 3);
+    uint8 *flat = (uint8 *)malloc(w * h * 3);
+    for (int i = 0; i < w * h * 3; i++)
+    {
+        noisy[i] = (uint8)((i % 97) * 2 + (rnd() & 15));
+        flat[i] = 77;
+    }
+    const uint8 *images[] = { noisy, flat };
+    size_t one_total = 0, two_total = 0;
+    for (int sub = Y_ONLY; sub <= H2V2; sub++)
+    {
+        for (int rows = 0; rows <= 2; rows += 2)
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                params p;
+                p.m_subsampling = (subsampling_t)sub;
+                p.m_quality = 75;
+                p.m_restart_rows = rows;
+
+                vector_stream one;
+                jpeg_encoder enc;
+                assert(enc.init(&one, w, h, SRC_RGB, p));
+                assert(enc.get_total_passes() == 1);
+                encode_rows(enc, images[i], w, 3, 0, h);
+
+                p.m_two_pass_flag = true;
+                vector_stream two;
+                assert(enc.init(&two, w, h, SRC_RGB, p));
+                assert(enc.get_total_passes() == 2);
+                for (uint pass = 0; pass < enc.get_total_passes(); pass++)
+                {
+                    assert(enc.get_cur_pass() == pass + 1);
+                    encode_rows(enc, images[i], w, 3, 0, h);
+                    // La primera pasada no escribe nada; las cabeceras van con las tablas
+                    assert(pass > 0 || two.len == 0);
+                }
+                assert(!enc.process_scanline(images[i]));
+                assert(two.len < one.len);
+                one_total += one.len;
+                two_total += two.len;
+
+                uint8 *a = decode(one, w, h);
+                uint8 *b = decode(two, w, h);
+                assert(memcmp(a, b, (size_t)w * h * 3) == 0);
+                free(a);
+                free(b);
+
+                // Las bandas se codifican por separado, sin una pasada de estadísticas común
+                vector_stream band;
+                p.m_restart_rows = 1;
+                assert(!enc.init_band(&band, w, h, SRC_RGB, p, 0));
+            }
+        }
+    }
+    free(noisy);
+    free(flat);
+    printf("dos pasadas: misma imagen, %zu bytes frente a %zu con las tablas estándar\n", two_total, one_total);
+}
+
+static double blocks_per_sec(int64_t us, int blocks)
+{
+    return us > 0 ? blocks * 1e6 / us : 0;
+}
+
+// Bloques de 8x8 píxeles por segundo; para la conversión de color, 64 píxeles RGB por bloque
+static void bench(const kernels &k, int blocks)
+{
+    int32 *src = (int32 *)malloc(sizeof(int32) * 64 * 64);
+    uint8 *rgb = (uint8 *)malloc(64 * 3 * 64);
+    uint8 *ycc = (uint8 *)malloc(64 * 3 * 64);
+    for (int i = 0; i < 64; i++)
+    {
+        random_block(src + i * 64, 0);
+    }
+    for (int i = 0; i < 64 * 3 * 64; i++)
+    {
+        rgb[i] = (uint8)rnd();
+    }
+    uint8 q[64];
+    quant_table(q, 80);
+
+    quant_recip t;
+    t.set(q);
+    int32 work[64];
+    int16 coeffs[64];
+    unsigned sink = 0;
+
+    int64_t t0 = esp_timer_get_time();
+    for (int n = 0; n < blocks; n++)
+    {
+        memcpy(work, src + (n & 63) * 64, sizeof(work));
+        fdct(work);
+        sink += (unsigned)work[n & 63];
+    }
+    int64_t t_fdct = esp_timer_get_time() - t0;
+
+    memcpy(work, src, sizeof(work));
+    fdct(work);
+    t0 = esp_timer_get_time();
+    for (int n = 0; n < blocks; n++)
+    {
+        work[0] = n;
+        k.quantize(coeffs, work, t.recip, t.bias);
+        sink += (unsigned)coeffs[n & 63];
+    }
+    int64_t t_quant = esp_timer_get_time() - t0;
+
+    // Referencia: la división por coeficiente de antes
+    t0 = esp_timer_get_time();
+    for (int n = 0; n < blocks; n++)
+    {
+        work[0] = n;
+        quantize_div(coeffs, work, q);
+        sink += (unsigned)coeffs[n & 63];
+    }
+    int64_t t_div = esp_timer_get_time() - t0;
+
+    t0 = esp_timer_get_time();
+    for (int n = 0; n < blocks; n++)
+    {
+        memcpy(work, src + (n & 63) * 64, sizeof(work));
+        k.fdct_quantize(coeffs, work, t.recip, t.bias);
+        sink += (unsigned)coeffs[n & 63];
+    }
+    int64_t t_fused = esp_timer_get_time() - t0;
+
+    t0 = esp_timer_get_time();
+    for (int n = 0; n < blocks; n++)
+    {
+        memcpy(work, src + (n & 63) * 64, sizeof(work));
+        fdct(work);
+        quantize_div(coeffs, work, q);
+        sink += (unsigned)coeffs[n & 63];
+    }
+    int64_t t_fused_div = esp_timer_get_time() - t0;
+
+    t0 = esp_timer_get_time();
+    for (int n = 0; n < blocks; n++)
+    {
+        int o = (n & 63) * 64 * 3;
+        k.rgb_to_ycc(ycc + o, rgb + o, 64);
+        sink += ycc[o];
+    }
+    int64_t t_ycc = esp_timer_get_time() - t0;
+
+    printf("  %-7s fdct %10.0f  quantize %10.0f (división %10.0f)  fdct_quantize %10.0f (fdct+división %10.0f)"
+           "  rgb_to_ycc %10.0f  bloques/s (%u)\n", k.name,
+           blocks_per_sec(t_fdct, blocks), blocks_per_sec(t_quant, blocks), blocks_per_sec(t_div, blocks),
+           blocks_per_sec(t_fused, blocks), blocks_per_sec(t_fused_div, blocks), blocks_per_sec(t_ycc, blocks), sink & 1);
+    free(src);
+    free(rgb);
+    free(ycc);
+}
+
+int main(int argc, char **argv)
+{
+    int blocks = argc > 1 ? atoi(argv[1]) : DEFAULT_BLOCKS;
+    const kernels &ref = scalar_kernels();
+    const kernels *vec = vector_kernels();
+
+    // El juego de esta CPU y, si es otro, el de extensiones vectoriales de GCC, que es el del dispositivo
+    const kernels *sets[2];
+    int num_sets = 0;
+    if (vec)
+    {
+        sets[num_sets++] = vec;
+    }
+    if (gnu_vector_kernels() && gnu_vector_kernels() != vec)
+    {
+        sets[num_sets++] = gnu_vector_kernels();
+    }
+
+    test_reciprocals();
+    test_fdct_quantize(ref, sets, num_sets);
+    test_pictures(sets, num_sets);
+    for (int k = 0; k < num_sets; k++)
+    {
+        test_rgb_to_ycc(ref, *sets[k]);
+        printf("kernels: '%s' idénticos a '%s' en %d bloques\n", sets[k]->name, ref.name, RANDOM_BLOCKS);
+    }
+    if (!num_sets)
+    {
+        printf("kernels: sin kernels vectoriales para esta CPU\n");
+    }
+    // default_kernels() se queda con el más rápido de los que hay
+    const kernels &def = default_kernels();
+    assert(&def == &ref || (num_sets > 0 && &def == sets[0]) || (num_sets > 1 && &def == sets[1]));
+    assert(&default_kernels() == &def);
+    printf("kernels: el codificador usa '%s'\n", def.name);
+
+    test_bands();
+    test_size_model();
+    test_two_pass();
+
+    printf("micro-benchmark: %d bloques\n", blocks);
+    bench(ref, blocks);
+    for (int k = 0; k < num_sets; k++)
+    {
+        bench(*sets[k], blocks);
+    }
+    printf("test_jpge_kernels: OK\n");
+    return 0;
+}
@@ -0,0 +1,365 @@
+// Pruebas del pipeline captura -> codificación -> publicación con cámara y MQTT simulados
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "host_mock.h"
+#include "photo_pipeline.h"
+#include "photo_stream.h"
+
+#define FB_COUNT    2       // Igual que la app con PSRAM
+#define FRAME_LEN   20000
+
+typedef struct {
+    int capture_ms;             // Tiempo simulado de exposición/DMA
+    int publish_ms;             // Tiempo simulado de subida
+    camera_fb_t fbs[FB_COUNT];
+    bool in_use[FB_COUNT];
+    int outstanding;            // Frames entregados y no devueltos
+    uint32_t published_seq[64];
+    int published;
+    bool payload_ok;
+    bool keep_odd;              // Los frames impares se publican desde el fb
+    int kept_published;         // Publicaciones con el fb aún retenido
+    photo_pipeline_handle_t pipeline;
+    bool drain_next;            // La próxima captura espera los frames, como antes de reinicializar
+    bool drain_short;           // Resultado de la espera con un plazo demasiado corto
+    bool drain_ok;              // Resultado de la espera con plazo de sobra
+    int drain_outstanding;      // Frames fuera al terminar la espera
+    pthread_mutex_t lock;
+} mock_t;
+
+static camera_fb_t *mock_capture(void *ctx)
+{
+    mock_t *m = ctx;
+    vTaskDelay(pdMS_TO_TICKS(m->capture_ms));
+    if (m->drain_next)
+    {
+        // Cámara caída: antes de reinicializarla todos los frames deben volver
+        m->drain_next = false;
+        m->drain_short = photo_pipeline_wait_frames(m->pipeline, 1);
+        m->drain_ok = photo_pipeline_wait_frames(m->pipeline, 2000);
+        pthread_mutex_lock(&m->lock);
+        m->drain_outstanding = m->outstanding;
+        pthread_mutex_unlock(&m->lock);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&m->lock);
+    camera_fb_t *fb = NULL;
+    for (int i = 0; i < FB_COUNT; i++)
+    {
+        if (!m->in_use[i])
+        {
+            m->in_use[i] = true;
+            m->outstanding++;
+            fb = &m->fbs[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+    return fb;
+}
+
+static void mock_release(void *ctx, camera_fb_t *fb)
+{
+    mock_t *m = ctx;
+    pthread_mutex_lock(&m->lock);
+    m->in_use[fb - m->fbs] = false;
+    m->outstanding--;
+    pthread_mutex_unlock(&m->lock);
+}
+
+static esp_err_t mock_encode(void *ctx, photo_job_t *job)
+{
+    mock_t *m = ctx;
+    if (m->keep_odd && (job->seq & 1))
+    {
+        job->keep_fb = true;
+        job->topic = "iot/telemetry";
+        return ESP_OK;
+    }
+    size_t len = photo_stream_json_len(job->fb->len, "host", NULL);
+    job->payload = malloc(len);
+    if (!job->payload)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    photo_buf_sink_t buf = { .buf = job->payload, .cap = len };
+    photo_sink_t sink = { .write = photo_buf_sink_write, .ctx = &buf };
+    esp_err_t err = photo_stream_json(job->fb->buf, job->fb->len, "host", NULL, &sink);
+    job->payload_len = buf.len;
+    job->topic = "iot/telemetry";
+    return err;
+}
+
+static int mock_publish(void *ctx, const photo_job_t *job)
+{
+    mock_t *m = ctx;
+    vTaskDelay(pdMS_TO_TICKS(m->publish_ms));
+
+    static const char prefix[] = "{\"device_id\":\"host\",";
+    pthread_mutex_lock(&m->lock);
+    if (job->keep_fb)
+    {
+        // El fb sigue prestado hasta que la publicación termina
+        if (!job->fb || job->payload || !m->in_use[job->fb - m->fbs])
+        {
+            m->payload_ok = false;
+        }
+        m->kept_published++;
+    }
+    else if (job->fb || job->payload_len != photo_stream_json_len(FRAME_LEN, "host", NULL) ||
+        memcmp(job->payload, prefix, sizeof(prefix) - 1) != 0)
+    {
+        m->payload_ok = false;
+    }
+    m->published_seq[m->published++] = job->seq;
+    pthread_mutex_unlock(&m->lock);
+    return m->published;
+}
+
+static void mock_free_payload(void *ctx, photo_job_t *job)
+{
+    free(job->payload);
+}
+
+static void mock_init(mock_t *m, int capture_ms, int publish_ms)
+{
+    static uint8_t jpeg[FRAME_LEN];
+    memset(m, 0, sizeof(*m));
+    pthread_mutex_init(&m->lock, NULL);
+    m->capture_ms = capture_ms;
+    m->publish_ms = publish_ms;
+    m->payload_ok = true;
+    for (int i = 0; i < FB_COUNT; i++)
+    {
+        m->fbs[i].buf = jpeg;
+        m->fbs[i].len = sizeof(jpeg);
+        m->fbs[i].width = 320;
+        m->fbs[i].height = 240;
+        m->fbs[i].format = PIXFORMAT_JPEG;
+    }
+}
+
+static esp_err_t try_start(mock_t *m, photo_trace_t *trace, photo_pipeline_handle_t *p)
+{
+    photo_pipeline_ops_t ops = {
+        .capture = mock_capture,
+        .release = mock_release,
+        .encode = mock_encode,
+        .publish = mock_publish,
+        .free_payload = mock_free_payload,
+        .ctx = m,
+    };
+    photo_pipeline_config_t config = {
+        .queue_len = 2,
+        .stack_size = 4096,
+        .priority = 5,
+        .capture_core = 1,
+        .encode_core = 1,
+        .publish_core = 0,
+        .trace = trace,
+    };
+    return photo_pipeline_start(&config, &ops, p);
+}
+
+static photo_pipeline_handle_t start(mock_t *m, photo_trace_t *trace)
+{
+    photo_pipeline_handle_t p = NULL;
+    assert(try_start(m, trace, &p) == ESP_OK);
+    return p;
+}
+
+static void wait_handled(photo_pipeline_handle_t p, uint32_t triggers)
+{
+    photo_pipeline_stats_t st;
+    do
+    {
+        vTaskDelay(pdMS_TO_TICKS(5));
+        photo_pipeline_get_stats(p, &st);
+    } while (st.captured + st.capture_failed + st.dropped < triggers);
+}
+
+// La captura del frame N+1 debe solaparse con la subida del frame N
+static void test_overlap_and_order(void)
+{
+    const int frames = 10;
+    const int capture_ms = 30;
+    const int publish_ms = 40;
+    mock_t m;
+    mock_init(&m, capture_ms, publish_ms);
+    photo_trace_t trace;
+    photo_trace_init(&trace, false);
+    photo_pipeline_handle_t p = start(&m, &trace);
+
+    int64_t t0 = esp_timer_get_time();
+    for (int i = 0; i < frames; i++)
+    {
+        photo_pipeline_trigger(p);
+        vTaskDelay(pdMS_TO_TICKS(publish_ms + 5));
+    }
+    wait_handled(p, frames);
+    photo_pipeline_stats_t st;
+    photo_pipeline_get_stats(p, &st);
+    photo_pipeline_stop(p);
+    int64_t elapsed_ms = (esp_timer_get_time() - t0) / 1000;
+
+    assert(st.captured == (uint32_t)frames);
+    assert(st.dropped == 0);
+    assert(m.published == frames);
+    for (int i = 0; i < frames; i++)
+    {
+        assert(m.published_seq[i] == (uint32_t)i);
+    }
+    assert(m.payload_ok);
+    assert(m.outstanding == 0);
+
+    // Cada etapa deja su marca y los tiempos simulados aparecen en su intervalo
+    for (int s = 0; s < PHOTO_TRACE_SPANS; s++)
+    {
+        uint32_t expected = s == PHOTO_TRACE_SPAN_ACK ? 0 : (uint32_t)frames;
+        assert(trace.hist[s].count == expected);
+    }
+    assert(trace.hist[PHOTO_TRACE_SPAN_CAPTURE].sum_us >= (uint64_t)frames * capture_ms * 1000);
+    assert(trace.hist[PHOTO_TRACE_SPAN_CAPTURE].buckets[0] == 0);
+    assert(trace.hist[PHOTO_TRACE_SPAN_PUBLISH].max_us >= (uint32_t)publish_ms * 1000);
+
+    // En serie serían frames * (captura + subida)
+    int serial_ms = frames * (capture_ms + publish_ms);
+    printf("overlap: %d frames en %lld ms (serie: %d ms)\n", frames, (long long)elapsed_ms, serial_ms);
+    assert(elapsed_ms < serial_ms * 8 / 10);
+}
+
+// Con la subida saturada se descartan capturas sin perder frames del driver
+static void test_backpressure(void)
+{
+    const int triggers = 30;
+    mock_t m;
+    mock_init(&m, 1, 50);
+    photo_pipeline_handle_t p = start(&m, NULL);
+
+    for (int i = 0; i < triggers; i++)
+    {
+        photo_pipeline_trigger(p);
+        vTaskDelay(pdMS_TO_TICKS(3));
+    }
+    wait_handled(p, 1);
+    vTaskDelay(pdMS_TO_TICKS(50));
+    photo_pipeline_stats_t st;
+    photo_pipeline_get_stats(p, &st);
+    photo_pipeline_stop(p);
+
+    printf("backpressure: capturados %u, descartados %u, publicados %d\n",
+           (unsigned)st.captured, (unsigned)st.dropped, m.published);
+    assert(st.dropped > 0);
+    assert(m.published == (int)st.captured);
+    assert(m.outstanding == 0);
+    for (int i = 1; i < m.published; i++)
+    {
+        assert(m.published_seq[i] > m.published_seq[i - 1]);
+    }
+}
+
+// Si una etapa no se crea, las ya creadas terminan y un reintento arranca de cero
+static void test_start_failure(void)
+{
+    mock_t m;
+    mock_init(&m, 1, 1);
+    const int alive = host_tasks_alive();
+
+    // Fallo en la publicación (0 creadas), codificación (1) y captura (2)
+    for (int created = 0; created < 3; created++)
+    {
+        photo_pipeline_handle_t p = (photo_pipeline_handle_t)&m;
+        host_tasks_fail_after(created);
+        assert(try_start(&m, NULL, &p) == ESP_ERR_NO_MEM);
+        assert(p == NULL);
+        // Cada etapa avisa del fin justo antes de vTaskDelete
+        for (int i = 0; i < 200 && host_tasks_alive() != alive; i++)
+        {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+        assert(host_tasks_alive() == alive);
+    }
+    host_tasks_fail_after(-1);
+
+    photo_pipeline_handle_t p = start(&m, NULL);
+    assert(host_tasks_alive() == alive + 3);
+    photo_pipeline_trigger(p);
+    wait_handled(p, 1);
+    photo_pipeline_stop(p);
+    printf("arranque fallido: etapas deshechas, reintento publica %d\n", m.published);
+    assert(m.published == 1);
+    assert(m.outstanding == 0);
+}
+
+// Con keep_fb el frame sigue prestado hasta la publicación y se devuelve después
+static void test_keep_fb(void)
+{
+    const int triggers = 10;
+    mock_t m;
+    mock_init(&m, 1, 5);
+    m.keep_odd = true;
+    photo_pipeline_handle_t p = start(&m, NULL);
+
+    for (int i = 0; i < triggers; i++)
+    {
+        photo_pipeline_trigger(p);
+        vTaskDelay(pdMS_TO_TICKS(15));
+    }
+    wait_handled(p, triggers);
+    photo_pipeline_stats_t st;
+    photo_pipeline_get_stats(p, &st);
+    photo_pipeline_stop(p);
+
+    printf("keep_fb: %d publicados, %d desde el fb\n", m.published, m.kept_published);
+    assert(m.payload_ok);
+    assert(m.published == (int)st.captured);
+    assert(m.kept_published == m.published / 2);
+    assert(m.outstanding == 0);
+}
+
+// Esperar los frames desde la captura vacía el pipeline, también los retenidos para publicar
+static void test_wait_frames(void)
+{
+    mock_t m;
+    mock_init(&m, 1, 40);
+    m.keep_odd = true;
+    photo_pipeline_handle_t p = start(&m, NULL);
+    m.pipeline = p;
+
+    photo_pipeline_trigger(p);
+    vTaskDelay(pdMS_TO_TICKS(5));
+    photo_pipeline_trigger(p);
+    vTaskDelay(pdMS_TO_TICKS(5));
+    m.drain_next = true;
+    photo_pipeline_trigger(p);
+    wait_handled(p, 3);
+    photo_pipeline_stats_t st;
+    photo_pipeline_get_stats(p, &st);
+    photo_pipeline_stop(p);
+
+    printf("espera de frames: %s con 1 ms, %s con 2 s, %d fuera\n", m.drain_short ? "vacío" : "pendientes",
+           m.drain_ok ? "vacío" : "pendientes", m.drain_outstanding);
+    assert(st.captured == 2 && st.capture_failed == 1);
+    assert(!m.drain_short);
+    assert(m.drain_ok && m.drain_outstanding == 0);
+    assert(m.published == 2 && m.kept_published == 1);
+    assert(photo_pipeline_wait_frames(NULL, 0));
+}
+
+int main(void)
+{
+    test_overlap_and_order();
+    test_backpressure();
+    test_start_failure();
+    test_keep_fb();
+    test_wait_frames();
+    printf("test_pipeline: OK\n");
+    return 0;
+}
@@ -0,0 +1,150 @@
+// Pruebas del pool de buffers de payload por clases de tamaño
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "photo_pool.h"
+
+static const photo_pool_class_t classes[] = {
+    { .size = 1000, .count = 3 },   // Se redondea a 1008
+    { .size = 8000, .count = 1 },
+};
+#define N_CLASSES (sizeof(classes) / sizeof(classes[0]))
+
+static bool in_mem(const photo_pool_t *pool, const uint8_t *p)
+{
+    return p >= pool->mem && p < pool->mem + pool->mem_len;
+}
+
+// Clase más pequeña que cabe, desbordamiento a la clase grande y luego al heap
+static void test_classes_and_misses(void)
+{
+    size_t mem_len = photo_pool_mem_size(classes, N_CLASSES);
+    uint8_t *mem = malloc(mem_len);
+    photo_pool_t pool;
+    assert(photo_pool_init(&pool, classes, N_CLASSES, mem, mem_len) == ESP_OK);
+
+    uint8_t *small[3];
+    for (int i = 0; i < 3; i++)
+    {
+        small[i] = photo_pool_get(&pool, 1000);
+        assert(small[i] && in_mem(&pool, small[i]));
+        assert(((uintptr_t)small[i] % PHOTO_POOL_ALIGN) == 0);
+        memset(small[i], 0xa5, 1000);
+    }
+    assert(small[1] - small[0] >= 1000);
+
+    // Clase pequeña agotada: sale de la grande
+    uint8_t *big = photo_pool_get(&pool, 10);
+    assert(big && in_mem(&pool, big));
+    assert(big >= small[2] + 1000);
+
+    // Todo prestado, y una petición mayor que cualquier clase: heap
+    uint8_t *heap1 = photo_pool_get(&pool, 100);
+    uint8_t *heap2 = photo_pool_get(&pool, 20000);
+    assert(heap1 && !in_mem(&pool, heap1));
+    assert(heap2 && !in_mem(&pool, heap2));
+
+    photo_pool_stats_t st;
+    photo_pool_get_stats(&pool, &st);
+    assert(st.hits == 4 && st.misses == 2);
+    assert(st.in_use == 4 && st.high_water == 4);
+    assert(st.largest_request == 20000);
+
+    photo_pool_put(&pool, heap1);
+    photo_pool_put(&pool, heap2);
+    photo_pool_put(&pool, big);
+    for (int i = 0; i < 3; i++)
+    {
+        photo_pool_put(&pool, small[i]);
+    }
+    photo_pool_put(&pool, NULL);
+
+    // Al devolverlos se reutilizan los mismos buffers
+    uint8_t *again = photo_pool_get(&pool, 5000);
+    assert(again == big);
+    photo_pool_put(&pool, again);
+
+    photo_pool_get_stats(&pool, &st);
+    assert(st.in_use == 0 && st.high_water == 4 && st.hits == 5);
+    printf("classes: %u aciertos, %u fallos, máximo %u prestados\n",
+           (unsigned)st.hits, (unsigned)st.misses, (unsigned)st.high_water);
+    free(mem);
+}
+
+static void test_invalid_config(void)
+{
+    photo_pool_t pool;
+    uint8_t mem[64];
+    const photo_pool_class_t unsorted[] = { { 32, 1 }, { 16, 1 } };
+    size_t need = photo_pool_mem_size(classes, N_CLASSES);
+
+    assert(photo_pool_init(&pool, classes, N_CLASSES, mem, sizeof(mem)) == ESP_ERR_INVALID_SIZE);
+    assert(photo_pool_init(&pool, unsorted, 2, mem, sizeof(mem)) == ESP_ERR_INVALID_ARG);
+    assert(photo_pool_init(&pool, classes, 0, mem, need) == ESP_ERR_INVALID_ARG);
+
+    // Un pool sin inicializar correctamente sirve todo desde el heap
+    uint8_t *p = photo_pool_get(&pool, 10);
+    assert(p != NULL);
+    photo_pool_put(&pool, p);
+}
+
+// Préstamo en una tarea y devolución en otra, como codificación -> publicación
+#define HANDOFF_ROUNDS 20000
+
+typedef struct {
+    photo_pool_t *pool;
+    QueueHandle_t queue;
+} handoff_t;
+
+static void *returner(void *arg)
+{
+    handoff_t *h = arg;
+    uint8_t *buf;
+    for (int n = 0; n < HANDOFF_ROUNDS; n++)
+    {
+        xQueueReceive(h->queue, &buf, portMAX_DELAY);
+        photo_pool_put(h->pool, buf);
+    }
+    return NULL;
+}
+
+static void test_cross_task_handoff(void)
+{
+    size_t mem_len = photo_pool_mem_size(classes, N_CLASSES);
+    uint8_t *mem = malloc(mem_len);
+    photo_pool_t pool;
+    assert(photo_pool_init(&pool, classes, N_CLASSES, mem, mem_len) == ESP_OK);
+
+    // Como mucho cuatro en vuelo (uno por tarea y dos en la cola): caben en el pool
+    handoff_t h = { .pool = &pool, .queue = xQueueCreate(2, sizeof(uint8_t *)) };
+    pthread_t t;
+    pthread_create(&t, NULL, returner, &h);
+
+    for (int n = 0; n < HANDOFF_ROUNDS; n++)
+    {
+        uint8_t *buf = photo_pool_get(&pool, 900);
+        assert(buf);
+        xQueueSend(h.queue, &buf, portMAX_DELAY);
+    }
+    pthread_join(t, NULL);
+
+    photo_pool_stats_t st;
+    photo_pool_get_stats(&pool, &st);
+    assert(st.misses == 0);
+    assert(st.hits == HANDOFF_ROUNDS);
+    assert(st.in_use == 0 && st.high_water <= 4);
+    printf("handoff: %d préstamos entre tareas, máximo %u prestados\n", HANDOFF_ROUNDS, (unsigned)st.high_water);
+    vQueueDelete(h.queue);
+    free(mem);
+}
+
+int main(void)
+{
+    test_classes_and_misses();
+    test_invalid_config();
+    test_cross_task_handoff();
+    printf("test_pool: OK\n");
+    return 0;
+}
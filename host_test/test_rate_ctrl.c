@@ -0,0 +1,176 @@
+// Pruebas del control de tamaño JPEG contra secuencias de tamaños de frame
+#include <assert.h>
+#include <stdio.h>
+#include "sensor.h"
+#include "jpeg_rate_ctrl.h"
+
+#define BUDGET 30000
+
+static jpeg_rc_config_t default_config(void)
+{
+    jpeg_rc_config_t cfg = {
+        .budget_bytes = BUDGET,
+        .target_hit_pct = 90,
+        .quality_min = 10,
+        .quality_max = 63,
+        .initial_quality = 30,
+        .adjust_framesize = false,
+        .framesize_min = FRAMESIZE_QQVGA,
+        .framesize_max = FRAMESIZE_VGA,
+        .initial_framesize = FRAMESIZE_QVGA,
+    };
+    return cfg;
+}
+
+// Modelo aproximado del OV3660 en QVGA: el tamaño cae con la calidad (0-63)
+// y escala con la complejidad de la escena y los píxeles de la resolución
+static size_t plant(int quality, int complexity_pct, int framesize)
+{
+    int pixels_pct;
+    switch (framesize)
+    {
+    case FRAMESIZE_QQVGA:
+        pixels_pct = 25;
+        break;
+    case FRAMESIZE_QVGA:
+        pixels_pct = 100;
+        break;
+    case FRAMESIZE_VGA:
+        pixels_pct = 400;
+        break;
+    default:
+        // Fuera de la escalera 4:3: el controlador nunca debe llegar aquí
+        assert(!"framesize fuera de la escalera");
+        return 0;
+    }
+    return (size_t)complexity_pct * 640 * pixels_pct / (100 + quality * 8);
+}
+
+// Secuencia registrada en el dispositivo: escena que pasa a exterior soleado
+static void test_recorded_overshoot(void)
+{
+    static const size_t recorded[] = {
+        14210, 14530, 14388, 36920, 37410, 37102, 35880, 31950, 30410, 28870,
+        27990, 28120, 27760, 27905, 28011,
+    };
+    jpeg_rc_config_t cfg = default_config();
+    jpeg_rc_t rc;
+    jpeg_rc_init(&rc, &cfg);
+
+    int last_quality = rc.quality;
+    for (size_t i = 0; i < sizeof(recorded) / sizeof(recorded[0]); i++)
+    {
+        jpeg_rc_action_t a = jpeg_rc_update(&rc, recorded[i]);
+        if (recorded[i] > BUDGET && i == 3)
+        {
+            // El primer exceso corrige de inmediato y en proporción (~23% -> 3 pasos)
+            assert(a.quality_changed);
+            assert(rc.quality == last_quality + 3);
+        }
+        assert(!a.framesize_changed);
+        last_quality = rc.quality;
+    }
+    assert(rc.overshoots == 6);
+    assert(rc.frames == 15);
+    assert(rc.quality > cfg.initial_quality);
+    assert(rc.quality <= cfg.quality_max);
+}
+
+// En lazo cerrado se mantiene la tasa de acierto y se recupera calidad
+static void test_closed_loop(void)
+{
+    jpeg_rc_config_t cfg = default_config();
+    jpeg_rc_t rc;
+    jpeg_rc_init(&rc, &cfg);
+
+    // Interior (100%), exterior muy detallado (250%) y de nuevo interior
+    int hits_outdoor = 0;
+    int outdoor_frames = 0;
+    int quality_outdoor = 0;
+    for (int i = 0; i < 300; i++)
+    {
+        int complexity = (i >= 100 && i < 200) ? 250 : 100;
+        size_t size = plant(rc.quality, complexity, rc.framesize);
+        jpeg_rc_update(&rc, size);
+
+        if (i >= 130 && i < 200)
+        {
+            outdoor_frames++;
+            hits_outdoor += size <= BUDGET;
+            quality_outdoor = rc.quality;
+        }
+    }
+
+    int hit_pct = hits_outdoor * 100 / outdoor_frames;
+    printf("lazo cerrado: acierto en exterior %d%%, calidad exterior %d, final %d, excesos %u\n",
+           hit_pct, quality_outdoor, rc.quality, (unsigned)rc.overshoots);
+    assert(hit_pct >= cfg.target_hit_pct);
+    assert(rc.quality < quality_outdoor);
+    assert(plant(rc.quality, 100, rc.framesize) <= BUDGET);
+    assert(rc.quality >= cfg.quality_min);
+}
+
+// Si ni la peor calidad basta se baja la resolución y luego se recupera
+static void test_framesize_fallback(void)
+{
+    jpeg_rc_config_t cfg = default_config();
+    cfg.adjust_framesize = true;
+    jpeg_rc_t rc;
+    jpeg_rc_init(&rc, &cfg);
+
+    for (int i = 0; i < 200; i++)
+    {
+        jpeg_rc_update(&rc, plant(rc.quality, 1000, rc.framesize));
+    }
+    assert(rc.framesize < cfg.initial_framesize);
+    assert(plant(rc.quality, 1000, rc.framesize) <= BUDGET);
+    int reduced = rc.framesize;
+
+    for (int i = 0; i < 600; i++)
+    {
+        jpeg_rc_update(&rc, plant(rc.quality, 50, rc.framesize));
+    }
+    printf("resolución: %d con escena difícil, %d al final (calidad %d)\n", reduced, rc.framesize, rc.quality);
+    assert(rc.framesize > reduced);
+    assert(rc.framesize <= cfg.framesize_max);
+}
+
+// Por la escalera 4:3 y no por el orden de framesize_t: de QVGA se baja a QQVGA, no a 240X240
+static void test_framesize_ladder(void)
+{
+    jpeg_rc_config_t cfg = default_config();
+    cfg.adjust_framesize = true;
+    cfg.initial_quality = cfg.quality_max;
+    jpeg_rc_t rc;
+    jpeg_rc_init(&rc, &cfg);
+
+    jpeg_rc_action_t a = jpeg_rc_update(&rc, 2 * BUDGET);
+    assert(a.framesize_changed);
+    assert(rc.framesize == FRAMESIZE_QQVGA);
+
+    // Ya en framesize_min: no hay peldaño más abajo
+    for (int i = 0; i <= JPEG_RC_HOLDOFF; i++)
+    {
+        a = jpeg_rc_update(&rc, 2 * BUDGET);
+    }
+    assert(!a.framesize_changed && rc.framesize == FRAMESIZE_QQVGA);
+
+    // Un framesize_t fuera de la escalera desactiva el ajuste de resolución
+    cfg.initial_framesize = FRAMESIZE_240X240;
+    jpeg_rc_init(&rc, &cfg);
+    for (int i = 0; i < 20; i++)
+    {
+        assert(!jpeg_rc_update(&rc, 2 * BUDGET).framesize_changed);
+    }
+    assert(rc.framesize == FRAMESIZE_240X240);
+}
+
+int main(void)
+{
+    test_recorded_overshoot();
+    test_closed_loop();
+    test_framesize_fallback();
+    test_framesize_ladder();
+    printf("test_rate_ctrl: OK\n");
+    return 0;
+}
@@ -0,0 +1,205 @@
+// Pruebas de la IDCT reducida de tjpgd (JD_SPARSE_IDCT): los bloques con coeficientes solo
+// en el 4x4 superior izquierdo dan exactamente los mismos píxeles que con la IDCT completa de
+// tjpgd_full.c, en las imágenes de test_apps y de la cámara simulada (también recodificadas a
+// calidad 30 y 80) a cada escala. Después, ms por imagen de las dos versiones en la mejor vuelta.
+//
+//   test_tjpgd_idct [repeticiones]
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "img_converters.h"
+#include "jpeg_decoder.h"
+#include "tjpgd.h"
+#include "host_mock.h"
+
+#define DEFAULT_ROUNDS  20
+#define MAX_IMAGES      16
+
+// Versión con la IDCT completa, de tjpgd_full.c
+JRESULT jd_prepare_full(JDEC *jd, size_t (*infunc)(JDEC *, uint8_t *, size_t), void *pool, size_t sz_pool, void *dev);
+JRESULT jd_decomp_full(JDEC *jd, int (*outfunc)(JDEC *, void *, JRECT *), uint8_t scale);
+
+typedef JRESULT (*prepare_fn)(JDEC *, size_t (*)(JDEC *, uint8_t *, size_t), void *, size_t, void *);
+typedef JRESULT (*decomp_fn)(JDEC *, int (*)(JDEC *, void *, JRECT *), uint8_t);
+
+typedef struct {
+    char name[40];
+    uint8_t *data;
+    size_t len;
+} image_t;
+
+typedef struct {
+    const image_t *img;
+    size_t pos;
+    uint8_t *out;
+    unsigned int stride;
+} io_t;
+
+static size_t in_func(JDEC *jd, uint8_t *buf, size_t n)
+{
+    io_t *io = jd->device;
+    if (n > io->img->len - io->pos)
+    {
+        n = io->img->len - io->pos;
+    }
+    if (buf)
+    {
+        memcpy(buf, io->img->data + io->pos, n);
+    }
+    io->pos += n;
+    return n;
+}
+
+static int out_func(JDEC *jd, void *bitmap, JRECT *rect)
+{
+    io_t *io = jd->device;
+    const unsigned int width = (rect->right - rect->left + 1) * 3;
+    const uint8_t *in = bitmap;
+    for (unsigned int y = rect->top; y <= rect->bottom; y++)
+    {
+        memcpy(io->out + y * io->stride + rect->left * 3, in, width);
+        in += width;
+    }
+    return 1;
+}
+
+// RGB888 de la imagen a la escala dada; *len con el tamaño
+static uint8_t *decode(const image_t *img, prepare_fn prepare, decomp_fn decomp, uint8_t scale, size_t *len)
+{
+    static uint8_t work[8192];
+    JDEC jd;
+    io_t io = { .img = img };
+    assert(prepare(&jd, in_func, work, sizeof(work), &io) == JDR_OK);
+    io.stride = (jd.width >> scale) * 3;
+    *len = (size_t)io.stride * (jd.height >> scale);
+    io.out = malloc(*len);
+    memset(io.out, 0xa5, *len);
+    assert(decomp(&jd, out_func, scale) == JDR_OK);
+    return io.out;
+}
+
+static int64_t time_decode(const image_t *img, prepare_fn prepare, decomp_fn decomp)
+{
+    size_t len;
+    int64_t t0 = esp_timer_get_time();
+    uint8_t *out = decode(img, prepare, decomp, 0, &len);
+    int64_t us = esp_timer_get_time() - t0;
+    free(out);
+    return us;
+}
+
+static void load_file(image_t *img, const char *name)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", ESP_JPEG_TEST_DIR, name);
+    FILE *f = fopen(path, "rb");
+    assert(f);
+    fseek(f, 0, SEEK_END);
+    img->len = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    img->data = malloc(img->len);
+    assert(fread(img->data, 1, img->len, f) == img->len);
+    fclose(f);
+    snprintf(img->name, sizeof(img->name), "%s", name);
+}
+
+// La imagen decodificada y vuelta a codificar con fmt2jpg a otra calidad
+static void reencode(image_t *dst, const image_t *src, uint8_t quality)
+{
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = src->data,
+        .indata_size = src->len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB888,
+        .advanced = { .working_buffer = (uint8_t[8192]){ 0 }, .working_buffer_size = 8192 },
+    };
+    esp_jpeg_image_output_t info;
+    assert(esp_jpeg_get_image_info(&cfg, &info) == ESP_OK);
+    cfg.outbuf = malloc(info.output_len);
+    cfg.outbuf_size = info.output_len;
+    assert(esp_jpeg_decode(&cfg, &info) == ESP_OK);
+    assert(fmt2jpg(cfg.outbuf, info.output_len, info.width, info.height, PIXFORMAT_RGB888, quality, &dst->data, &dst->len));
+    free(cfg.outbuf);
+    snprintf(dst->name, sizeof(dst->name), "%.24s q%u", src->name, quality);
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : DEFAULT_ROUNDS;
+    if (rounds <= 0)
+    {
+        fprintf(stderr, "uso: %s [repeticiones]\n", argv[0]);
+        return 2;
+    }
+
+    image_t images[MAX_IMAGES];
+    int count = 0;
+    load_file(&images[count++], "logo.jpg");
+    load_file(&images[count++], "usb_camera_2.jpg");
+
+    camera_config_t config = {
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_SVGA,
+        .fb_count = 1,
+    };
+    assert(esp_camera_init(&config) == ESP_OK);
+    host_camera_stats_t cs;
+    host_camera_get_stats(&cs);
+    for (int i = 0; i < cs.pictures && count + 3 <= MAX_IMAGES; i++)
+    {
+        camera_fb_t *fb = esp_camera_fb_get();
+        assert(fb);
+        image_t *img = &images[count++];
+        img->len = fb->len;
+        img->data = malloc(fb->len);
+        memcpy(img->data, fb->buf, fb->len);
+        snprintf(img->name, sizeof(img->name), "cámara %d", i);
+        esp_camera_fb_return(fb);
+        reencode(&images[count++], img, 30);
+        reencode(&images[count++], img, 80);
+    }
+    esp_camera_deinit();
+
+    // Mismos bits a cada escala
+    int checked = 0;
+    for (int i = 0; i < count; i++)
+    {
+        for (uint8_t scale = 0; scale <= 3; scale++)
+        {
+            size_t len, ref_len;
+            uint8_t *out = decode(&images[i], jd_prepare, jd_decomp, scale, &len);
+            uint8_t *ref = decode(&images[i], jd_prepare_full, jd_decomp_full, scale, &ref_len);
+            assert(len == ref_len);
+            if (memcmp(out, ref, len) != 0)
+            {
+                fprintf(stderr, "test_tjpgd_idct: %s a escala 1/%d distinta de la IDCT completa\n", images[i].name, 1 << scale);
+                return 1;
+            }
+            free(out);
+            free(ref);
+            checked++;
+        }
+    }
+    printf("%d decodificados idénticos a la IDCT completa en %d imágenes\n", checked, count);
+
+    printf("IDCT completa -> reducida, 1:1, %d repeticiones:\n", rounds);
+    for (int i = 0; i < count; i++)
+    {
+        // Alternadas, para que el ruido de la máquina caiga igual en las dos
+        int64_t full_us = INT64_MAX, sparse_us = INT64_MAX;
+        for (int r = 0; r < rounds; r++)
+        {
+            int64_t us = time_decode(&images[i], jd_prepare_full, jd_decomp_full);
+            full_us = us < full_us ? us : full_us;
+            us = time_decode(&images[i], jd_prepare, jd_decomp);
+            sparse_us = us < sparse_us ? us : sparse_us;
+        }
+        printf("  %-18s %7zu B | %7.3f -> %7.3f ms x%.2f\n", images[i].name, images[i].len, full_us / 1000.0,
+               sparse_us / 1000.0, sparse_us > 0 ? (double)full_us / sparse_us : 0);
+        free(images[i].data);
+    }
+    printf("test_tjpgd_idct: OK\n");
+    return 0;
+}
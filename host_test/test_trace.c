@@ -0,0 +1,222 @@
+// Pruebas de la instrumentación por etapa con instantes sintéticos
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "photo_trace.h"
+
+#define MS(x) ((int64_t)(x) * 1000)
+
+// Un frame completo con confirmación correlada por msg_id
+static void test_frame_with_ack(void)
+{
+    photo_trace_t t;
+    photo_trace_init(&t, true);
+
+    photo_trace_trigger(&t, MS(1000));
+    photo_trace_mark(&t, 7, PHOTO_TRACE_CAPTURED, MS(1003));    // 3 ms -> cubo 2
+    photo_trace_mark(&t, 7, PHOTO_TRACE_ENCODED, MS(1043));     // 40 ms -> cubo 6
+    photo_trace_published(&t, 7, 55, MS(1143));                 // 100 ms -> cubo 7
+    assert(t.hist[PHOTO_TRACE_SPAN_TOTAL].count == 0);
+    photo_trace_acked(&t, 99, MS(1150));                        // msg_id ajeno
+    photo_trace_acked(&t, 55, MS(1200));                        // 57 ms -> cubo 6
+
+    assert(t.hist[PHOTO_TRACE_SPAN_CAPTURE].buckets[2] == 1);
+    assert(t.hist[PHOTO_TRACE_SPAN_ENCODE].buckets[6] == 1);
+    assert(t.hist[PHOTO_TRACE_SPAN_PUBLISH].buckets[7] == 1);
+    assert(t.hist[PHOTO_TRACE_SPAN_ACK].buckets[6] == 1);
+    assert(t.hist[PHOTO_TRACE_SPAN_TOTAL].count == 1);
+    assert(t.hist[PHOTO_TRACE_SPAN_TOTAL].max_us == 200000);
+    assert(t.unmatched_acks == 1);
+
+    // La confirmación repetida ya no encuentra el frame
+    photo_trace_acked(&t, 55, MS(1300));
+    assert(t.hist[PHOTO_TRACE_SPAN_ACK].count == 1);
+}
+
+// MQTT_EVENT_PUBLISHED antes de que esp_mqtt_client_publish retorne
+static void test_ack_before_published(void)
+{
+    photo_trace_t t;
+    photo_trace_init(&t, true);
+
+    photo_trace_trigger(&t, MS(1000));
+    photo_trace_mark(&t, 3, PHOTO_TRACE_CAPTURED, MS(1002));
+    photo_trace_mark(&t, 3, PHOTO_TRACE_ENCODED, MS(1010));
+    photo_trace_acked(&t, 41, MS(1090));                        // Se guarda
+    assert(t.unmatched_acks == 1);
+    photo_trace_published(&t, 3, 41, MS(1095));
+
+    assert(t.unmatched_acks == 0);
+    assert(t.hist[PHOTO_TRACE_SPAN_ACK].buckets[0] == 1);
+    assert(t.hist[PHOTO_TRACE_SPAN_TOTAL].count == 1);
+    assert(t.hist[PHOTO_TRACE_SPAN_TOTAL].max_us == 90000);
+    assert(t.slots[3].msg_id == -1);
+
+    // Ya consumida: no cierra otro frame con el mismo msg_id
+    photo_trace_trigger(&t, MS(2000));
+    photo_trace_mark(&t, 4, PHOTO_TRACE_CAPTURED, MS(2001));
+    photo_trace_published(&t, 4, 41, MS(2005));
+    assert(t.hist[PHOTO_TRACE_SPAN_TOTAL].count == 1);
+    assert(t.slots[4].msg_id == 41);
+
+    // Las guardadas de más pisan a las más antiguas
+    for (int id = 100; id < 100 + 2 * PHOTO_TRACE_EARLY_ACKS; id++)
+    {
+        photo_trace_acked(&t, id, MS(3000));
+    }
+    photo_trace_trigger(&t, MS(3000));
+    photo_trace_mark(&t, 5, PHOTO_TRACE_CAPTURED, MS(3001));
+    photo_trace_published(&t, 5, 100, MS(3002));
+    assert(t.slots[5].msg_id == 100);
+    photo_trace_trigger(&t, MS(3000));
+    photo_trace_mark(&t, 6, PHOTO_TRACE_CAPTURED, MS(3001));
+    photo_trace_published(&t, 6, 100 + 2 * PHOTO_TRACE_EARLY_ACKS - 1, MS(3002));
+    assert(t.slots[6].msg_id == -1);
+    assert(t.hist[PHOTO_TRACE_SPAN_TOTAL].count == 2);
+}
+
+// Sin QoS el total se cierra al publicar; extremos de los cubos
+static void test_no_ack_and_buckets(void)
+{
+    photo_trace_t t;
+    photo_trace_init(&t, false);
+
+    for (uint32_t seq = 0; seq < 3 * PHOTO_TRACE_SLOTS; seq++)
+    {
+        int64_t base = MS(1 + seq * 100000);
+        photo_trace_trigger(&t, base);
+        photo_trace_mark(&t, seq, PHOTO_TRACE_CAPTURED, base + 500);         // <1 ms
+        photo_trace_mark(&t, seq, PHOTO_TRACE_ENCODED, base + MS(60000));     // > 32 s -> último cubo
+        photo_trace_published(&t, seq, 0, base + MS(60001));
+    }
+    uint32_t n = 3 * PHOTO_TRACE_SLOTS;
+    assert(t.hist[PHOTO_TRACE_SPAN_CAPTURE].buckets[0] == n);
+    assert(t.hist[PHOTO_TRACE_SPAN_ENCODE].buckets[PHOTO_TRACE_BUCKETS - 1] == n);
+    assert(t.hist[PHOTO_TRACE_SPAN_PUBLISH].buckets[1] == n);
+    assert(t.hist[PHOTO_TRACE_SPAN_TOTAL].count == n);
+    assert(t.hist[PHOTO_TRACE_SPAN_ACK].count == 0);
+
+    // Marca de un frame cuyo hueco ya se ha reutilizado: se ignora
+    photo_trace_mark(&t, 0, PHOTO_TRACE_ENCODED, MS(1));
+    assert(t.hist[PHOTO_TRACE_SPAN_ENCODE].count == n);
+}
+
+// El informe es JSON y se puede medir antes de escribirlo
+static void test_format(void)
+{
+    photo_trace_t t;
+    photo_trace_init(&t, false);
+    photo_trace_trigger(&t, MS(1));
+    photo_trace_mark(&t, 0, PHOTO_TRACE_CAPTURED, MS(5));
+
+    int need = photo_trace_format_json(&t, NULL, 0);
+    char *buf = malloc(need + 1);
+    assert(photo_trace_format_json(&t, buf, need + 1) == need);
+    assert((int)strlen(buf) == need);
+    assert(strncmp(buf, "{\"capture\":{\"count\":1,\"avg_us\":4000,\"max_us\":4000,\"buckets_ms\":[0,0,0,1,", 68) == 0);
+    assert(strstr(buf, "\"total\":{\"count\":0") != NULL);
+    assert(buf[need - 1] == '}');
+
+    char small[16];
+    assert(photo_trace_format_json(&t, small, sizeof(small)) == need);
+    assert(strlen(small) == sizeof(small) - 1);
+    printf("informe: %d bytes\n", need);
+    free(buf);
+}
+
+// Confirmaciones desde otro hilo mientras se publica, como la tarea de eventos MQTT
+#define RACE_FRAMES 20000
+
+typedef struct {
+    photo_trace_t trace;
+    atomic_int published;   // Último msg_id publicado
+    atomic_int acked;       // Último msg_id procesado por el hilo de confirmaciones
+    atomic_bool done;
+    uint32_t acks;
+} race_t;
+
+static void *race_acker(void *arg)
+{
+    race_t *r = arg;
+    int next = 1;
+    while (!atomic_load(&r->done) || next <= atomic_load(&r->published))
+    {
+        if (next > atomic_load(&r->published))
+        {
+            sched_yield();
+            continue;
+        }
+        // Cada 4.º publish falla (msg_id 0): no hay nada que confirmar
+        if (next % 4)
+        {
+            photo_trace_acked(&r->trace, next, MS(next) + 700);
+            r->acks++;
+        }
+        atomic_store(&r->acked, next++);
+    }
+    return NULL;
+}
+
+static void test_concurrent_ack(void)
+{
+    static race_t r;
+    photo_trace_init(&r.trace, true);
+    atomic_init(&r.published, 0);
+    atomic_init(&r.acked, 0);
+    atomic_init(&r.done, false);
+
+    pthread_t th;
+    assert(pthread_create(&th, NULL, race_acker, &r) == 0);
+    uint32_t failed = 0;
+    for (int id = 1; id <= RACE_FRAMES; id++)
+    {
+        // Sin adelantarse más de medio anillo: casi todas las confirmaciones encuentran su hueco
+        while (id - atomic_load(&r.acked) > PHOTO_TRACE_SLOTS / 2)
+        {
+            sched_yield();
+        }
+        photo_trace_trigger(&r.trace, MS(id));
+        photo_trace_mark(&r.trace, id, PHOTO_TRACE_CAPTURED, MS(id) + 100);
+        photo_trace_mark(&r.trace, id, PHOTO_TRACE_ENCODED, MS(id) + 200);
+        photo_trace_published(&r.trace, id, id % 4 ? id : 0, MS(id) + 300);
+        failed += id % 4 == 0;
+        atomic_store(&r.published, id);
+    }
+    atomic_store(&r.done, true);
+    pthread_join(th, NULL);
+
+    photo_trace_hist_t hist[PHOTO_TRACE_SPANS];
+    uint32_t unmatched;
+    photo_trace_snapshot(&r.trace, hist, &unmatched);
+    for (int s = 0; s < PHOTO_TRACE_SPANS; s++)
+    {
+        uint32_t sum = 0;
+        for (int b = 0; b < PHOTO_TRACE_BUCKETS; b++)
+        {
+            sum += hist[s].buckets[b];
+        }
+        assert(sum == hist[s].count);
+    }
+    assert(hist[PHOTO_TRACE_SPAN_PUBLISH].count == RACE_FRAMES);
+    // Ninguna suma perdida: cada confirmación cae en un frame o en unmatched_acks
+    assert(hist[PHOTO_TRACE_SPAN_ACK].count + unmatched == r.acks);
+    assert(hist[PHOTO_TRACE_SPAN_TOTAL].count == hist[PHOTO_TRACE_SPAN_ACK].count + failed);
+    assert(unmatched == 0);
+    printf("confirmaciones concurrentes: %u correladas, %u sin frame\n",
+           (unsigned)hist[PHOTO_TRACE_SPAN_ACK].count, (unsigned)unmatched);
+}
+
+int main(void)
+{
+    test_frame_with_ack();
+    test_ack_before_published();
+    test_no_ack_and_buckets();
+    test_format();
+    test_concurrent_ack();
+    printf("test_trace: OK\n");
+    return 0;
+}
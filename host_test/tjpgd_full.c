@@ -0,0 +1,12 @@
+// tjpgd con la IDCT completa en todos los bloques, como referencia de test_tjpgd_idct.
+// Mismo tjpgd.c con JD_SPARSE_IDCT a 0 y las funciones públicas renombradas para poder
+// enlazarlo junto a jpeg_dec.
+#undef CONFIG_JD_SPARSE_IDCT
+#define CONFIG_JD_SPARSE_IDCT   0
+#define jd_prepare              jd_prepare_full
+#define jd_prepare_scan         jd_prepare_scan_full
+#define jd_prepare_copy         jd_prepare_copy_full
+#define jd_decomp               jd_decomp_full
+#define jd_decomp_rect          jd_decomp_rect_full
+#define jd_decomp_range         jd_decomp_range_full
+#include "tjpgd.c"
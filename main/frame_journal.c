@@ -0,0 +1,566 @@
+#include <stdint.h>
+#include <string.h>
+#include "esp_rom_crc.h"
+#include "frame_journal.h"
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    put_le16(p, (uint16_t)v);
+    put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void put_le64(uint8_t *p, uint64_t v)
+{
+    put_le32(p, (uint32_t)v);
+    put_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return get_le16(p) | ((uint32_t)get_le16(p + 2) << 16);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+static esp_err_t ram_read(void *ctx, size_t offset, void *buf, size_t len)
+{
+    frame_journal_ram_t *ram = (frame_journal_ram_t *)ctx;
+    memcpy(buf, ram->buf + offset, len);
+    return ESP_OK;
+}
+
+static esp_err_t ram_write(void *ctx, size_t offset, const void *buf, size_t len)
+{
+    frame_journal_ram_t *ram = (frame_journal_ram_t *)ctx;
+    memcpy(ram->buf + offset, buf, len);
+    return ESP_OK;
+}
+
+void frame_journal_storage_ram(frame_journal_storage_t *storage, frame_journal_ram_t *ram,
+                               uint8_t *buf, size_t size)
+{
+    ram->buf = buf;
+    memset(storage, 0, sizeof(*storage));
+    storage->read = ram_read;
+    storage->write = ram_write;
+    storage->size = size;
+    storage->ctx = ram;
+}
+
+esp_err_t frame_journal_init(frame_journal_t *journal, const frame_journal_storage_t *storage)
+{
+    if (!storage || !storage->read || !storage->write || storage->size <= FRAME_JOURNAL_HEADER_LEN ||
+        (storage->erase_size && (!storage->erase || storage->size % storage->erase_size)))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(journal, 0, sizeof(*journal));
+    journal->storage = *storage;
+    journal->stats.capacity_bytes = storage->size;
+    return ESP_OK;
+}
+
+void frame_journal_set_spill(frame_journal_t *journal, frame_journal_t *spill)
+{
+    journal->spill = spill;
+}
+
+static size_t record_len(const frame_journal_entry_t *e)
+{
+    return FRAME_JOURNAL_HEADER_LEN + e->len;
+}
+
+// Bytes entre el registro más antiguo y la posición de escritura (incluye el hueco del final)
+static size_t used_bytes(const frame_journal_t *j)
+{
+    if (j->count == 0)
+    {
+        return 0;
+    }
+    size_t oldest = j->index[j->first].offset;
+    if (j->write_pos > oldest)
+    {
+        return j->write_pos - oldest;
+    }
+    return j->storage.size - oldest + j->write_pos;
+}
+
+static void update_occupancy(frame_journal_t *j)
+{
+    j->stats.entries = j->count;
+    j->stats.used_bytes = used_bytes(j);
+    if (j->stats.used_bytes > j->stats.high_water_bytes)
+    {
+        j->stats.high_water_bytes = j->stats.used_bytes;
+    }
+}
+
+static void drop_oldest(frame_journal_t *j)
+{
+    // Marcar el registro como muerto para que frame_journal_recover no lo resucite.
+    // Si la escritura falla, como mucho se reenvía otra vez tras un reinicio
+    static const uint8_t dead = FRAME_JOURNAL_DEAD;
+    j->storage.write(j->storage.ctx, j->index[j->first].offset, &dead, sizeof(dead));
+
+    j->first = (j->first + 1) % FRAME_JOURNAL_MAX_ENTRIES;
+    j->count--;
+}
+
+/**
+ * @brief Recorre el payload de un registro en trozos del buffer del diario
+ *
+ * Cada trozo se pasa a write (si no es NULL) y se acumula su CRC.
+ */
+static esp_err_t read_chunks(frame_journal_t *j, const frame_journal_entry_t *e,
+                             esp_err_t (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx,
+                             uint32_t *crc)
+{
+    const frame_journal_storage_t *st = &j->storage;
+    *crc = 0;
+    for (size_t off = 0; off < e->len; off += sizeof(j->bounce))
+    {
+        size_t n = e->len - off < sizeof(j->bounce) ? e->len - off : sizeof(j->bounce);
+        esp_err_t err = st->read(st->ctx, e->offset + FRAME_JOURNAL_HEADER_LEN + off, j->bounce, n);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        *crc = esp_rom_crc32_le(*crc, j->bounce, (uint32_t)n);
+        if (write && (err = write(ctx, j->bounce, n)) != ESP_OK)
+        {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+// Comprueba magic y CRC de un registro sin traer el payload entero a memoria
+static esp_err_t verify(frame_journal_t *j, const frame_journal_entry_t *e)
+{
+    uint8_t magic[2];
+    uint32_t crc;
+    esp_err_t err = j->storage.read(j->storage.ctx, e->offset, magic, sizeof(magic));
+    if (err == ESP_OK)
+    {
+        err = read_chunks(j, e, NULL, NULL, &crc);
+    }
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (magic[0] != FRAME_JOURNAL_MAGIC0 || magic[1] != FRAME_JOURNAL_MAGIC1 || crc != e->crc)
+    {
+        j->stats.corrupt++;
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t reserve(frame_journal_t *j, size_t len, size_t *out_pos);
+static esp_err_t commit(frame_journal_t *j, size_t pos, uint16_t tag, uint32_t seq, uint64_t timestamp_us,
+                        size_t len, uint32_t crc);
+
+typedef struct {
+    frame_journal_t *dst;
+    size_t offset;          // Posición del siguiente trozo en dst
+} spill_copy_t;
+
+static esp_err_t spill_write(void *ctx, const uint8_t *data, size_t len)
+{
+    spill_copy_t *c = (spill_copy_t *)ctx;
+    esp_err_t err = c->dst->storage.write(c->dst->storage.ctx, c->offset, data, len);
+    c->offset += len;
+    return err;
+}
+
+// Copia un registro al diario de desbordamiento trozo a trozo
+static esp_err_t spill_record(frame_journal_t *j, const frame_journal_entry_t *e)
+{
+    frame_journal_t *dst = j->spill;
+    size_t pos;
+    uint32_t crc;
+
+    // Verificar antes de reservar: en flash no se puede dejar a medias una zona ya escrita
+    esp_err_t err = verify(j, e);
+    if (err == ESP_OK)
+    {
+        err = reserve(dst, e->len, &pos);
+    }
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    spill_copy_t copy = { .dst = dst, .offset = pos + FRAME_JOURNAL_HEADER_LEN };
+    err = read_chunks(j, e, spill_write, &copy, &crc);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    return commit(dst, pos, e->tag, e->seq, e->timestamp_us, e->len, e->crc);
+}
+
+// Libera el registro más antiguo: al diario de desbordamiento si lo hay, si no se descarta
+static void evict_oldest(frame_journal_t *j)
+{
+    frame_journal_entry_t e = j->index[j->first];
+
+    if (j->spill && spill_record(j, &e) == ESP_OK)
+    {
+        j->stats.spilled++;
+        drop_oldest(j);
+        return;
+    }
+
+    j->stats.dropped++;
+    drop_oldest(j);
+}
+
+/**
+ * @brief Hace sitio para un registro de len bytes de payload
+ *
+ * Descarta (o desborda) los registros más antiguos que estorban y borra los
+ * bloques nuevos. Devuelve la posición de la cabecera en out_pos.
+ */
+static esp_err_t reserve(frame_journal_t *j, size_t len, size_t *out_pos)
+{
+    const frame_journal_storage_t *st = &j->storage;
+    size_t rec = FRAME_JOURNAL_HEADER_LEN + len;
+
+    if (rec > st->size || (uint64_t)len > UINT32_MAX)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Los registros nunca se parten: si no cabe al final, se vuelve al principio.
+    // La zona reclamada llega hasta el final del bloque de borrado, que se pierde entero
+    size_t block = st->erase_size ? st->erase_size : 1;
+    size_t pos;
+    size_t claim_end;
+    for (;;)
+    {
+        pos = j->write_pos;
+        bool wrapped = pos + rec > st->size;
+        if (wrapped)
+        {
+            pos = 0;
+        }
+        claim_end = (pos + rec + block - 1) / block * block;
+        if (j->count == 0)
+        {
+            break;
+        }
+
+        // Al volver al principio, todo lo que queda hasta el final es más antiguo
+        const frame_journal_entry_t *old = &j->index[j->first];
+        bool behind = wrapped && old->offset >= j->write_pos;
+        bool overlaps = old->offset < claim_end && pos < old->offset + record_len(old);
+        if (!behind && !overlaps && j->count < FRAME_JOURNAL_MAX_ENTRIES)
+        {
+            break;
+        }
+        evict_oldest(j);
+    }
+
+    // Borrar los bloques en los que se entra por primera vez en esta vuelta
+    if (st->erase_size)
+    {
+        for (size_t b = (pos + block - 1) / block * block; b < claim_end; b += block)
+        {
+            esp_err_t err = st->erase(st->ctx, b, block);
+            if (err != ESP_OK)
+            {
+                return err;
+            }
+        }
+    }
+
+    *out_pos = pos;
+    return ESP_OK;
+}
+
+/**
+ * @brief Escribe la cabecera de un payload ya escrito en pos e indexa el registro
+ */
+static esp_err_t commit(frame_journal_t *j, size_t pos, uint16_t tag, uint32_t seq, uint64_t timestamp_us,
+                        size_t len, uint32_t crc)
+{
+    const frame_journal_storage_t *st = &j->storage;
+    uint8_t hdr[FRAME_JOURNAL_HEADER_LEN];
+    hdr[0] = FRAME_JOURNAL_MAGIC0;
+    hdr[1] = FRAME_JOURNAL_MAGIC1;
+    put_le16(&hdr[2], tag);
+    put_le32(&hdr[4], (uint32_t)len);
+    put_le32(&hdr[8], seq);
+    put_le32(&hdr[12], crc);
+    put_le64(&hdr[16], timestamp_us);
+    put_le32(&hdr[24], j->next_serial);
+
+    esp_err_t err = st->write(st->ctx, pos, hdr, sizeof(hdr));
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    frame_journal_entry_t *e = &j->index[(j->first + j->count) % FRAME_JOURNAL_MAX_ENTRIES];
+    e->offset = pos;
+    e->len = (uint32_t)len;
+    e->seq = seq;
+    e->crc = crc;
+    e->timestamp_us = timestamp_us;
+    e->tag = tag;
+    j->count++;
+    j->next_serial++;
+    j->write_pos = pos + FRAME_JOURNAL_HEADER_LEN + len;
+    j->stats.appended++;
+    update_occupancy(j);
+    return ESP_OK;
+}
+
+esp_err_t frame_journal_append(frame_journal_t *journal, uint16_t tag, uint32_t seq,
+                               uint64_t timestamp_us, const uint8_t *data, size_t len)
+{
+    frame_journal_t *j = journal;
+    const frame_journal_storage_t *st = &j->storage;
+    size_t pos;
+
+    esp_err_t err = reserve(j, len, &pos);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    // El payload va antes que la cabecera: un corte a medias deja un registro sin magic
+    uint32_t crc = esp_rom_crc32_le(0, data, (uint32_t)len);
+    if (len > 0 && (err = st->write(st->ctx, pos + FRAME_JOURNAL_HEADER_LEN, data, len)) != ESP_OK)
+    {
+        return err;
+    }
+    return commit(j, pos, tag, seq, timestamp_us, len, crc);
+}
+
+// Siguiente posición desde from con un posible comienzo de registro ("FJ" vivo o muerto)
+static size_t find_header(frame_journal_t *j, size_t from)
+{
+    const frame_journal_storage_t *st = &j->storage;
+    const size_t last = st->size - FRAME_JOURNAL_HEADER_LEN;
+
+    while (from <= last)
+    {
+        // Solapar un byte entre lecturas para no perder un magic partido
+        size_t n = last + 2 - from < sizeof(j->bounce) ? last + 2 - from : sizeof(j->bounce);
+        if (st->read(st->ctx, from, j->bounce, n) != ESP_OK)
+        {
+            return SIZE_MAX;
+        }
+        for (size_t i = 0; i + 1 < n; i++)
+        {
+            if ((j->bounce[i] == FRAME_JOURNAL_MAGIC0 || j->bounce[i] == FRAME_JOURNAL_DEAD) &&
+                j->bounce[i + 1] == FRAME_JOURNAL_MAGIC1)
+            {
+                return from + i;
+            }
+        }
+        from += n - 1;
+    }
+    return SIZE_MAX;
+}
+
+esp_err_t frame_journal_recover(frame_journal_t *journal, const frame_journal_storage_t *storage)
+{
+    frame_journal_t *j = journal;
+    esp_err_t err = frame_journal_init(j, storage);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    // Los registros de una vuelta son contiguos, pero tras un borrado de bloque
+    // o en una partición sin estrenar hay huecos: ahí se busca byte a byte
+    uint32_t serials[FRAME_JOURNAL_MAX_ENTRIES];
+    uint32_t max_serial = 0;
+    bool any = false;
+    size_t pos = 0;
+    while ((pos = find_header(j, pos)) != SIZE_MAX)
+    {
+        uint8_t hdr[FRAME_JOURNAL_HEADER_LEN];
+        frame_journal_entry_t e = {
+            .offset = pos,
+        };
+        uint32_t crc;
+        if ((err = storage->read(storage->ctx, pos, hdr, sizeof(hdr))) != ESP_OK)
+        {
+            return err;
+        }
+        e.tag = get_le16(&hdr[2]);
+        e.len = get_le32(&hdr[4]);
+        e.seq = get_le32(&hdr[8]);
+        e.crc = get_le32(&hdr[12]);
+        e.timestamp_us = get_le64(&hdr[16]);
+        uint32_t serial = get_le32(&hdr[24]);
+        if (e.len > storage->size - pos - FRAME_JOURNAL_HEADER_LEN ||
+            read_chunks(j, &e, NULL, NULL, &crc) != ESP_OK || crc != e.crc)
+        {
+            pos++;
+            continue;
+        }
+        pos += record_len(&e);
+
+        // Los muertos solo cuentan para no repetir seriales
+        if (!any || serial > max_serial)
+        {
+            max_serial = serial;
+        }
+        any = true;
+        if (hdr[0] != FRAME_JOURNAL_MAGIC0)
+        {
+            continue;
+        }
+
+        // Con el índice lleno se sustituye el más antiguo si este es más reciente
+        uint16_t slot = j->count;
+        if (j->count == FRAME_JOURNAL_MAX_ENTRIES)
+        {
+            slot = 0;
+            for (uint16_t i = 1; i < j->count; i++)
+            {
+                slot = serials[i] < serials[slot] ? i : slot;
+            }
+            if (serials[slot] > serial)
+            {
+                continue;
+            }
+        }
+        else
+        {
+            j->count++;
+        }
+        j->index[slot] = e;
+        serials[slot] = serial;
+    }
+
+    // Ordenar por serial: el más antiguo en first = 0
+    for (uint16_t i = 1; i < j->count; i++)
+    {
+        frame_journal_entry_t e = j->index[i];
+        uint32_t serial = serials[i];
+        uint16_t k = i;
+        for (; k > 0 && serials[k - 1] > serial; k--)
+        {
+            j->index[k] = j->index[k - 1];
+            serials[k] = serials[k - 1];
+        }
+        j->index[k] = e;
+        serials[k] = serial;
+    }
+
+    // Escribir a partir del siguiente bloque: el resto del bloque del más reciente
+    // puede tener restos de una escritura cortada
+    if (j->count > 0)
+    {
+        const frame_journal_entry_t *newest = &j->index[j->count - 1];
+        size_t block = storage->erase_size ? storage->erase_size : 1;
+        j->write_pos = (newest->offset + record_len(newest) + block - 1) / block * block;
+    }
+    j->next_serial = any ? max_serial + 1 : 0;
+    j->stats.recovered = j->count;
+    update_occupancy(j);
+    return ESP_OK;
+}
+
+bool frame_journal_peek(const frame_journal_t *journal, frame_journal_entry_t *entry)
+{
+    if (journal->count == 0)
+    {
+        return false;
+    }
+    *entry = journal->index[journal->first];
+    return true;
+}
+
+esp_err_t frame_journal_read(frame_journal_t *journal, const frame_journal_entry_t *entry, uint8_t *buf)
+{
+    const frame_journal_storage_t *st = &journal->storage;
+    uint8_t magic[2];
+
+    esp_err_t err = st->read(st->ctx, entry->offset, magic, sizeof(magic));
+    if (err == ESP_OK && entry->len > 0)
+    {
+        err = st->read(st->ctx, entry->offset + FRAME_JOURNAL_HEADER_LEN, buf, entry->len);
+    }
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    if (magic[0] != FRAME_JOURNAL_MAGIC0 || magic[1] != FRAME_JOURNAL_MAGIC1 ||
+        esp_rom_crc32_le(0, buf, entry->len) != entry->crc)
+    {
+        journal->stats.corrupt++;
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+void frame_journal_pop(frame_journal_t *journal)
+{
+    if (journal->count == 0)
+    {
+        return;
+    }
+    drop_oldest(journal);
+    journal->stats.drained++;
+    update_occupancy(journal);
+}
+
+esp_err_t frame_journal_drain_one(frame_journal_t *journal, const frame_journal_publisher_t *publisher)
+{
+    // El diario de desbordamiento guarda siempre los registros más antiguos
+    frame_journal_t *j = journal->spill;
+    frame_journal_entry_t entry;
+    if (!j || !frame_journal_peek(j, &entry))
+    {
+        j = journal;
+        if (!frame_journal_peek(j, &entry))
+        {
+            return ESP_ERR_NOT_FOUND;
+        }
+    }
+
+    // Primera pasada solo para el CRC: no publicar nada de un registro dañado
+    esp_err_t err = verify(j, &entry);
+    if (err != ESP_OK)
+    {
+        frame_journal_pop(j);
+        return err;
+    }
+
+    uint32_t crc;
+    if (publisher->begin(publisher->ctx, &entry) != ESP_OK ||
+        read_chunks(j, &entry, publisher->write, publisher->ctx, &crc) != ESP_OK ||
+        publisher->end(publisher->ctx) == -1)
+    {
+        return ESP_FAIL;
+    }
+    frame_journal_pop(j);
+    return ESP_OK;
+}
+
+void frame_journal_get_stats(const frame_journal_t *journal, frame_journal_stats_t *stats)
+{
+    *stats = journal->stats;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Máximo de registros indexados por diario
+#define FRAME_JOURNAL_MAX_ENTRIES   64
+
+// Bytes que se copian de una vez al desbordar o reenviar un registro
+#define FRAME_JOURNAL_COPY_CHUNK    512
+
+// Formato de cada registro (little-endian), escrito de forma contigua:
+//   0  magic "FJ"   2  tag u16   4  len u32   8  seq u32
+//  12  crc32 u32 del payload     16  timestamp captura en us u64
+//  24  serial u32 (orden de escritura, para recuperar el índice)
+//  28  payload
+// Al extraer o descartar un registro su primer byte pasa a 0x00 (solo baja
+// bits, así que vale en flash sin borrar) y deja de recuperarse.
+#define FRAME_JOURNAL_MAGIC0        'F'
+#define FRAME_JOURNAL_MAGIC1        'J'
+#define FRAME_JOURNAL_DEAD          0x00
+#define FRAME_JOURNAL_HEADER_LEN    28
+
+/**
+ * @brief Almacenamiento subyacente del diario (PSRAM, partición flash, fichero...)
+ */
+typedef struct {
+    esp_err_t (*read)(void *ctx, size_t offset, void *buf, size_t len);
+    esp_err_t (*write)(void *ctx, size_t offset, const void *buf, size_t len);
+    esp_err_t (*erase)(void *ctx, size_t offset, size_t len);  /*!< NULL si no hace falta borrar */
+    size_t size;            /*!< Bytes disponibles */
+    size_t erase_size;      /*!< Tamaño de bloque de borrado (0 = sin borrado) */
+    void *ctx;
+} frame_journal_storage_t;
+
+/**
+ * @brief Registro indexado del diario
+ */
+typedef struct {
+    size_t offset;          /*!< Posición de la cabecera en el almacenamiento */
+    uint32_t len;           /*!< Bytes de payload */
+    uint32_t seq;           /*!< Secuencia original del frame */
+    uint32_t crc;           /*!< CRC32 del payload */
+    uint64_t timestamp_us;  /*!< Instante de captura original */
+    uint16_t tag;           /*!< Valor libre de la aplicación (p.ej. topic) */
+} frame_journal_entry_t;
+
+/**
+ * @brief Métricas de ocupación
+ */
+typedef struct {
+    uint32_t entries;           /*!< Registros almacenados */
+    size_t used_bytes;          /*!< Bytes ocupados (incluye cabeceras y huecos) */
+    size_t capacity_bytes;      /*!< Tamaño del almacenamiento */
+    size_t high_water_bytes;    /*!< Máxima ocupación observada */
+    uint32_t appended;          /*!< Registros añadidos */
+    uint32_t dropped;           /*!< Registros descartados por falta de espacio */
+    uint32_t spilled;           /*!< Registros movidos al diario de desbordamiento */
+    uint32_t drained;           /*!< Registros extraídos */
+    uint32_t corrupt;           /*!< Registros con CRC incorrecto al leer */
+    uint32_t recovered;         /*!< Registros encontrados por frame_journal_recover */
+} frame_journal_stats_t;
+
+typedef struct frame_journal frame_journal_t;
+
+struct frame_journal {
+    frame_journal_storage_t storage;
+    frame_journal_entry_t index[FRAME_JOURNAL_MAX_ENTRIES];
+    uint16_t first;             // Índice del registro más antiguo
+    uint16_t count;
+    size_t write_pos;
+    uint32_t next_serial;
+    frame_journal_t *spill;     // Destino de los registros más antiguos al llenarse
+    frame_journal_stats_t stats;
+    uint8_t bounce[FRAME_JOURNAL_COPY_CHUNK];  // Copias por trozos sin reservar el frame entero
+};
+
+/**
+ * @brief Almacenamiento sobre un buffer en RAM/PSRAM
+ */
+typedef struct {
+    uint8_t *buf;
+} frame_journal_ram_t;
+
+/**
+ * @brief Prepara un almacenamiento sobre un buffer en memoria
+ */
+void frame_journal_storage_ram(frame_journal_storage_t *storage, frame_journal_ram_t *ram,
+                               uint8_t *buf, size_t size);
+
+/**
+ * @brief Inicializa un diario vacío sobre el almacenamiento dado
+ */
+esp_err_t frame_journal_init(frame_journal_t *journal, const frame_journal_storage_t *storage);
+
+/**
+ * @brief Inicializa un diario con los registros vivos que ya contiene el almacenamiento
+ *
+ * Recorre todo el almacenamiento (p.ej. la partición flash tras un reinicio),
+ * indexa los registros con CRC correcto que no se extrajeron ni descartaron y
+ * los ordena por su serial. Si hay más de FRAME_JOURNAL_MAX_ENTRIES se
+ * conservan los más recientes. Sobre un almacenamiento sin registros equivale
+ * a frame_journal_init.
+ */
+esp_err_t frame_journal_recover(frame_journal_t *journal, const frame_journal_storage_t *storage);
+
+/**
+ * @brief Registra un diario al que mover los registros antiguos en lugar de descartarlos
+ */
+void frame_journal_set_spill(frame_journal_t *journal, frame_journal_t *spill);
+
+/**
+ * @brief Añade un registro; si no hay espacio se descartan (o desbordan) los más antiguos
+ */
+esp_err_t frame_journal_append(frame_journal_t *journal, uint16_t tag, uint32_t seq,
+                               uint64_t timestamp_us, const uint8_t *data, size_t len);
+
+/**
+ * @brief Consulta el registro más antiguo sin extraerlo
+ *
+ * @return false si el diario está vacío
+ */
+bool frame_journal_peek(const frame_journal_t *journal, frame_journal_entry_t *entry);
+
+/**
+ * @brief Lee el payload de un registro y verifica su CRC
+ *
+ * @param buf Buffer de al menos entry->len bytes
+ */
+esp_err_t frame_journal_read(frame_journal_t *journal, const frame_journal_entry_t *entry, uint8_t *buf);
+
+/**
+ * @brief Extrae el registro más antiguo tras haberlo enviado
+ */
+void frame_journal_pop(frame_journal_t *journal);
+
+/**
+ * @brief Destino al que se reenvía un registro por trozos
+ *
+ * begin recibe el registro, write su payload en trozos consecutivos de como
+ * mucho FRAME_JOURNAL_COPY_CHUNK bytes y end cierra la publicación. Si begin o
+ * write fallan no se llama a end.
+ */
+typedef struct {
+    esp_err_t (*begin)(void *ctx, const frame_journal_entry_t *entry);
+    esp_err_t (*write)(void *ctx, const uint8_t *data, size_t len);
+    int (*end)(void *ctx);                  /*!< Devuelve msg_id o -1 */
+    void *ctx;
+} frame_journal_publisher_t;
+
+/**
+ * @brief Reenvía el registro más antiguo (primero los del diario de desbordamiento)
+ *
+ * El payload se comprueba y se publica en trozos a través del buffer del
+ * propio diario, sin reservar memoria. Los registros ilegibles se descartan.
+ * Si la publicación falla el registro se conserva para el siguiente intento.
+ *
+ * @return ESP_OK si se publicó uno, ESP_ERR_NOT_FOUND si no queda nada,
+ *         ESP_FAIL si la publicación falló
+ */
+esp_err_t frame_journal_drain_one(frame_journal_t *journal, const frame_journal_publisher_t *publisher);
+
+/**
+ * @brief Copia las métricas de ocupación
+ */
+void frame_journal_get_stats(const frame_journal_t *journal, frame_journal_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
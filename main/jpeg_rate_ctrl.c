@@ -0,0 +1,169 @@
+#include <string.h>
+#include "sensor.h"
+#include "jpeg_rate_ctrl.h"
+
+// Resoluciones 4:3 de menor a mayor: framesize_t no está ordenado por tamaño
+// ni por proporción (tras QVGA-1 va 240X240, tras P_HD-1 FHD)
+static const struct {
+    framesize_t framesize;
+    uint32_t pixels;
+} FRAMESIZE_LADDER[] = {
+    { FRAMESIZE_QQVGA, 160 * 120 },
+    { FRAMESIZE_QVGA, 320 * 240 },
+    { FRAMESIZE_VGA, 640 * 480 },
+    { FRAMESIZE_SVGA, 800 * 600 },
+    { FRAMESIZE_XGA, 1024 * 768 },
+    { FRAMESIZE_UXGA, 1600 * 1200 },
+    { FRAMESIZE_QXGA, 2048 * 1536 },
+    { FRAMESIZE_QSXGA, 2560 * 1920 },
+};
+#define LADDER_STEPS (int)(sizeof(FRAMESIZE_LADDER) / sizeof(FRAMESIZE_LADDER[0]))
+
+// Peldaño de un framesize_t, o -1 si no está en la escalera
+static int ladder_step(int framesize)
+{
+    for (int i = 0; i < LADDER_STEPS; i++)
+    {
+        if ((int)FRAMESIZE_LADDER[i].framesize == framesize)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void jpeg_rc_init(jpeg_rc_t *rc, const jpeg_rc_config_t *cfg)
+{
+    memset(rc, 0, sizeof(*rc));
+    rc->cfg = *cfg;
+    rc->quality = cfg->initial_quality;
+    rc->framesize = cfg->initial_framesize;
+
+    rc->step = ladder_step(cfg->initial_framesize);
+    rc->step_min = ladder_step(cfg->framesize_min);
+    rc->step_max = ladder_step(cfg->framesize_max);
+    if (rc->step < 0 || rc->step_min < 0 || rc->step_max < 0 ||
+        rc->step < rc->step_min || rc->step > rc->step_max)
+    {
+        // Fuera de la escalera no hay a dónde moverse sin cambiar de proporción
+        rc->cfg.adjust_framesize = false;
+    }
+}
+
+uint8_t jpeg_rc_hit_pct(const jpeg_rc_t *rc)
+{
+    if (rc->count == 0)
+    {
+        return 100;
+    }
+
+    unsigned hits = 0;
+    for (unsigned i = 0; i < rc->count; i++)
+    {
+        if (rc->sizes[i] <= rc->cfg.budget_bytes)
+        {
+            hits++;
+        }
+    }
+    return (uint8_t)(hits * 100 / rc->count);
+}
+
+static uint32_t window_max(const jpeg_rc_t *rc)
+{
+    uint32_t max = 0;
+    for (unsigned i = 0; i < rc->count; i++)
+    {
+        if (rc->sizes[i] > max)
+        {
+            max = rc->sizes[i];
+        }
+    }
+    return max;
+}
+
+// Tras cambiar de resolución los tamaños anteriores ya no son comparables
+static void window_reset(jpeg_rc_t *rc)
+{
+    rc->count = 0;
+    rc->head = 0;
+}
+
+jpeg_rc_action_t jpeg_rc_update(jpeg_rc_t *rc, size_t frame_len)
+{
+    jpeg_rc_action_t action = { false, false };
+    const jpeg_rc_config_t *cfg = &rc->cfg;
+    size_t budget = cfg->budget_bytes;
+
+    rc->frames++;
+    if (frame_len > budget)
+    {
+        rc->overshoots++;
+    }
+
+    if (rc->holdoff > 0)
+    {
+        rc->holdoff--;
+        return action;
+    }
+
+    rc->sizes[rc->head] = (uint64_t)frame_len > UINT32_MAX ? UINT32_MAX : (uint32_t)frame_len;
+    rc->head = (rc->head + 1) % JPEG_RC_WINDOW;
+    if (rc->count < JPEG_RC_WINDOW)
+    {
+        rc->count++;
+    }
+
+    if (frame_len > budget)
+    {
+        // Corregir en proporción al exceso: ~JPEG_RC_STEP_GAIN_PCT % por paso
+        size_t excess_pct = (frame_len - budget) * 100 / budget;
+        int step = 1 + (int)(excess_pct / JPEG_RC_STEP_GAIN_PCT);
+        if (step > JPEG_RC_MAX_STEP)
+        {
+            step = JPEG_RC_MAX_STEP;
+        }
+
+        if (rc->quality < cfg->quality_max)
+        {
+            rc->quality += step;
+            if (rc->quality > cfg->quality_max)
+            {
+                rc->quality = cfg->quality_max;
+            }
+            action.quality_changed = true;
+        }
+        else if (cfg->adjust_framesize && rc->step > rc->step_min)
+        {
+            rc->framesize = FRAMESIZE_LADDER[--rc->step].framesize;
+            action.framesize_changed = true;
+            window_reset(rc);
+        }
+    }
+    else if (rc->count == JPEG_RC_WINDOW && jpeg_rc_hit_pct(rc) >= cfg->target_hit_pct)
+    {
+        uint32_t max = window_max(rc);
+
+        if (rc->quality > cfg->quality_min &&
+            (uint64_t)max * (100 + JPEG_RC_STEP_GAIN_PCT) <= (uint64_t)budget * 100)
+        {
+            rc->quality--;
+            action.quality_changed = true;
+        }
+        else if (rc->quality <= cfg->quality_min && cfg->adjust_framesize &&
+                 rc->step < rc->step_max &&
+                 (uint64_t)max * FRAMESIZE_LADDER[rc->step + 1].pixels * (100 + JPEG_RC_STEP_GAIN_PCT) <=
+                 (uint64_t)budget * FRAMESIZE_LADDER[rc->step].pixels * 100)
+        {
+            // Con la mejor calidad, recuperar resolución si el frame escalado a ella cabría con margen
+            rc->framesize = FRAMESIZE_LADDER[++rc->step].framesize;
+            action.framesize_changed = true;
+            window_reset(rc);
+        }
+    }
+
+    if (action.quality_changed || action.framesize_changed)
+    {
+        rc->holdoff = JPEG_RC_HOLDOFF;
+    }
+    return action;
+}
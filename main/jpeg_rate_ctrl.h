@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Frames recientes que se tienen en cuenta para la tasa de acierto
+#define JPEG_RC_WINDOW          8
+// Frames a ignorar tras un cambio (el sensor aplica el ajuste con retraso
+// y puede haber frames ya capturados con la calidad anterior)
+#define JPEG_RC_HOLDOFF         2
+// Variación aproximada del tamaño por cada paso de calidad, en %
+#define JPEG_RC_STEP_GAIN_PCT   8
+// Máximo de pasos de calidad en una sola corrección
+#define JPEG_RC_MAX_STEP        8
+
+/**
+ * @brief Configuración del controlador de tamaño JPEG
+ *
+ * La calidad usa la escala del sensor (0-63, menor = mejor calidad).
+ * La resolución se mueve por la escalera 4:3 de jpeg_rate_ctrl.c (QQVGA,
+ * QVGA, VGA, SVGA, XGA, UXGA, QXGA, QSXGA), no por el orden de framesize_t:
+ * los tres framesize_t deben estar en ella o no se ajusta la resolución.
+ */
+typedef struct {
+    size_t budget_bytes;        /*!< Tamaño máximo deseado por frame */
+    uint8_t target_hit_pct;     /*!< % de frames recientes bajo presupuesto exigido para subir calidad */
+    int quality_min;            /*!< Mejor calidad permitida */
+    int quality_max;            /*!< Peor calidad permitida */
+    int initial_quality;        /*!< Calidad de arranque */
+    bool adjust_framesize;      /*!< Permitir bajar resolución si la calidad no basta */
+    int framesize_min;          /*!< Menor framesize_t permitido (peldaño de la escalera) */
+    int framesize_max;          /*!< Mayor framesize_t permitido (peldaño de la escalera) */
+    int initial_framesize;      /*!< framesize_t de arranque */
+} jpeg_rc_config_t;
+
+/**
+ * @brief Estado del controlador
+ */
+typedef struct {
+    jpeg_rc_config_t cfg;
+    uint32_t sizes[JPEG_RC_WINDOW]; /*!< Tamaños recientes (ventana circular) */
+    uint8_t count;                  /*!< Entradas válidas en sizes */
+    uint8_t head;                   /*!< Próxima posición a escribir */
+    uint8_t holdoff;                /*!< Frames restantes sin decidir */
+    int quality;                    /*!< Calidad actual */
+    int framesize;                  /*!< framesize_t actual */
+    int8_t step;                    /*!< Peldaño de framesize en la escalera */
+    int8_t step_min;                /*!< Peldaño de cfg.framesize_min */
+    int8_t step_max;                /*!< Peldaño de cfg.framesize_max */
+    uint32_t frames;                /*!< Frames observados */
+    uint32_t overshoots;            /*!< Frames por encima del presupuesto */
+} jpeg_rc_t;
+
+/**
+ * @brief Ajustes a aplicar al sensor tras observar un frame
+ */
+typedef struct {
+    bool quality_changed;
+    bool framesize_changed;
+} jpeg_rc_action_t;
+
+/**
+ * @brief Inicializa el controlador
+ */
+void jpeg_rc_init(jpeg_rc_t *rc, const jpeg_rc_config_t *cfg);
+
+/**
+ * @brief Registra el tamaño de un frame y decide la siguiente calidad/resolución
+ *
+ * Un frame por encima del presupuesto empeora la calidad de inmediato, en
+ * proporción al exceso. La calidad solo mejora cuando la ventana reciente
+ * cumple la tasa de acierto y el frame más grande seguiría cabiendo con un
+ * paso más de calidad.
+ */
+jpeg_rc_action_t jpeg_rc_update(jpeg_rc_t *rc, size_t frame_len);
+
+/**
+ * @brief Porcentaje de frames de la ventana que cumplen el presupuesto
+ */
+uint8_t jpeg_rc_hit_pct(const jpeg_rc_t *rc);
+
+#ifdef __cplusplus
+}
+#endif
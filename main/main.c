@@ -5,14 +5,21 @@
 #include "freertos/timers.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_random.h"
 #include "nvs_flash.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "mqtt_client.h"
 #include "esp_camera.h"
 #include "esp_heap_caps.h"
-#include "cJSON.h"
-#include "mbedtls/base64.h"
+#include "esp_timer.h"
+#include "photo_stream.h"
+#include "photo_pipeline.h"
+#include "photo_trace.h"
+#include "jpeg_rate_ctrl.h"
+#include "frame_journal.h"
+#include "photo_pool.h"
+#include "esp_partition.h"
 
 // --- CONFIGURACIÓN ---
 
@@ -29,8 +36,64 @@
 #define WIFI_PASS "DenGra9401"
 #define MQTT_BROKER "mqtt://172.20.10.8:1883"
 #define MQTT_TOPIC_PHOTO "iot/telemetry"
+#define MQTT_TOPIC_PHOTO_BIN "iot/telemetry/bin"
+#define MQTT_TOPIC_PHOTO_CHUNK "iot/telemetry/chunk"
+#define MQTT_TOPIC_STATS "iot/telemetry/stats"
+
+// Formato del payload de la foto
+#define PHOTO_FORMAT_JSON   0  // JSON + base64 (compatible con DeepStack)
+#define PHOTO_FORMAT_BINARY 1  // Cabecera binaria + JPEG crudo (ver tools/photo_bridge.py)
+#define PHOTO_PAYLOAD_FORMAT PHOTO_FORMAT_JSON
 
 #define PHOTO_INTERVAL_MS 10000  // 10 segundos
+#define PHOTO_DEVICE_ID "access_control_camera"
+#define PHOTO_MQTT_QOS 0  // Con QoS 1 se mide también hasta MQTT_EVENT_PUBLISHED
+#define PHOTO_STATS_INTERVAL_MS 60000  // Informe de latencias por etapa
+
+// Transferencia por trozos: el frame viaja en varios mensajes pequeños
+// (ver tools/photo_bridge.py), así el buffer MQTT no depende del tamaño del frame
+#define PHOTO_CHUNKED_TRANSFER  1
+#define PHOTO_CHUNK_BYTES       3072   // Payload por mensaje (cabe en el buffer MQTT)
+
+#if PHOTO_CHUNKED_TRANSFER
+#define MQTT_BUFFER_SIZE        4096
+#define PHOTO_MAX_JPEG_BYTES    (512 * 1024)  // Mayor frame con payload en el pool; los mayores se
+                                              // trocean al publicar directamente desde el fb
+#else
+#define MQTT_BUFFER_SIZE        131072        // El mensaje entero debe caber
+#define PHOTO_MAX_JPEG_BYTES    (96 * 1024)
+#endif
+
+// Control de tamaño JPEG (calidad del sensor 0-63, menor = mejor)
+#define PHOTO_JPEG_BUDGET_BYTES 30000  // Presupuesto por frame
+#define PHOTO_JPEG_HIT_PCT      90     // % de frames bajo presupuesto para mejorar calidad
+#define PHOTO_JPEG_QUALITY      30     // Calidad inicial
+#define PHOTO_JPEG_QUALITY_MIN  10     // Mejor calidad permitida
+#define PHOTO_JPEG_QUALITY_MAX  63     // Peor calidad permitida
+#define PHOTO_ADJUST_FRAMESIZE  false  // Bajar resolución si la calidad no basta
+
+// Pipeline captura -> codificación -> publicación
+#define PIPELINE_QUEUE_LEN      2     // Frames en espera entre etapas
+#define PIPELINE_STACK_SIZE     4096  // Stack de cada etapa
+#define PIPELINE_PRIORITY       5
+#define PIPELINE_CORE_CAPTURE   1
+#define PIPELINE_CORE_ENCODE    1
+#define PIPELINE_CORE_PUBLISH   0     // Junto a la pila WiFi/lwIP
+#define PHOTO_RECOVER_DRAIN_MS  5000  // Espera a que el pipeline devuelva sus frames antes de reinicializar la cámara
+
+// Pool de buffers de payload en PSRAM (sin malloc por frame)
+#define PHOTO_POOL_SMALL_BYTES  (64 * 1024)               // Frames dentro del presupuesto
+#define PHOTO_POOL_SMALL_COUNT  (PIPELINE_QUEUE_LEN + 3)  // Codificación + cola + publicación
+#define PHOTO_POOL_MEDIUM_BYTES (160 * 1024)              // Excesos mientras se corrige la calidad
+#define PHOTO_POOL_MEDIUM_COUNT 2
+#define PHOTO_POOL_LARGE_COUNT  1                         // Hasta PHOTO_MAX_JPEG_BYTES
+
+// Diario de frames para cortes de MQTT
+#define JOURNAL_PSRAM_BYTES     (1024 * 1024)      // Diario principal en PSRAM
+#define JOURNAL_PARTITION_LABEL "frame_journal"    // Partición de desbordamiento (opcional)
+#define JOURNAL_DRAIN_INTERVAL_MS 500              // Un frame reenviado cada 500 ms como máximo
+#define JOURNAL_TAG_JSON        0                  // Tag del registro -> topic
+#define JOURNAL_TAG_BINARY      1
     
 // Tag para logs
 static const char *TAG = "CAMERA_APP";
@@ -40,7 +103,23 @@ static esp_mqtt_client_handle_t mqtt_client = NULL;
 static bool wifi_connected = false;
 static bool mqtt_connected = false;
 static TimerHandle_t photo_timer = NULL;
-static TaskHandle_t photo_task_handle = NULL;
+static photo_pipeline_handle_t photo_pipeline = NULL;
+static jpeg_rc_t jpeg_rc;
+static photo_trace_t photo_trace;
+static int64_t stats_last_us = 0;
+static frame_journal_t journal;             // PSRAM
+static frame_journal_t journal_spill;       // Partición flash
+static frame_journal_ram_t journal_ram;
+static bool journal_enabled = false;
+#if !PHOTO_CHUNKED_TRANSFER
+static photo_buf_sink_t journal_stage;      // Registro reenviado entero (PSRAM)
+static uint16_t journal_stage_tag;
+#endif
+static photo_pool_t payload_pool;
+#if PHOTO_CHUNKED_TRANSFER
+static uint8_t photo_chunk_buf[PHOTO_CHUNK_HEADER_LEN + PHOTO_CHUNK_BYTES];  // Solo desde la etapa de publicación
+static photo_chunker_t photo_chunker;
+#endif
 
 // --- CONFIGURACIÓN DE PINES PARA ESP32-S3 CON XDKJ-OV3660 ---
 // Nota: Ajusta estos pines según tu módulo específico
@@ -65,8 +144,10 @@ static TaskHandle_t photo_task_handle = NULL;
 static void wifi_init(void);
 static void mqtt_init(void);
 static void camera_init(void);
-static void capture_and_send_photo(void);
-static void photo_task(void *pvParameters);
+static void jpeg_rc_setup(void);
+static void journal_init(void);
+static void payload_pool_init(void);
+static void photo_pipeline_init(void);
 static void photo_timer_callback(TimerHandle_t xTimer);
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
@@ -143,8 +224,8 @@ static void mqtt_init(void)
     // Configuración del cliente MQTT
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = MQTT_BROKER,
-        .buffer.size = 131072,  // Buffer de 128KB para mensajes grandes
-        .buffer.out_size = 8192, // Buffer de salida de 8KB
+        .buffer.size = MQTT_BUFFER_SIZE,
+        .buffer.out_size = MQTT_BUFFER_SIZE,
         .network.timeout_ms = 30000, // Timeout de 30 segundos
     };
     
@@ -171,16 +252,10 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
             ESP_LOGI(TAG, "✓ MQTT conectado exitosamente al broker");
             mqtt_connected = true;
             
-            // Crear tarea para captura de fotos (solo una vez)
-            if (photo_task_handle == NULL)
+            // Crear pipeline de captura de fotos (solo una vez)
+            if (photo_pipeline == NULL)
             {
-                xTaskCreate(photo_task, 
-                           "photo_task", 
-                           4096,  // Stack size: 4KB para los logs
-                           NULL, 
-                           5,     // Prioridad
-                           &photo_task_handle);
-                ESP_LOGI(TAG, "Tarea de captura creada");
+                photo_pipeline_init();
             }
             
             // Iniciar timer para captura automática de fotos
@@ -237,7 +312,8 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
             break;
             
         case MQTT_EVENT_PUBLISHED:
-            ESP_LOGI(TAG, "✓ Foto enviada exitosamente por MQTT");
+            photo_trace_acked(&photo_trace, event->msg_id, esp_timer_get_time());
+            ESP_LOGI(TAG, "✓ Foto enviada exitosamente por MQTT (msg_id: %d)", event->msg_id);
             break;
         
         default:
@@ -289,8 +365,8 @@ static void camera_init(void)
         .ledc_channel = LEDC_CHANNEL_0,
         
         .pixel_format = PIXFORMAT_JPEG,      // Formato JPEG para envío eficiente
-        .frame_size = FRAMESIZE_QVGA,        // 320x240 siempre (tamaño pequeño)
-        .jpeg_quality = 30,                  // Calidad JPEG reducida para menor tamaño (0-63, menor = mejor)
+        .frame_size = jpeg_rc.framesize,     // 320x240 al inicio (ajustable por el control de tamaño)
+        .jpeg_quality = jpeg_rc.quality,     // Calidad actual del control de tamaño (0-63, menor = mejor)
         .fb_count = (psram_size > 0) ? 2 : 1,  // 2 buffers con PSRAM, 1 sin PSRAM
         .fb_location = (psram_size > 0) ? CAMERA_FB_IN_PSRAM : CAMERA_FB_IN_DRAM,  // Automático según disponibilidad
         .grab_mode = CAMERA_GRAB_WHEN_EMPTY  // Modo de captura
@@ -362,17 +438,77 @@ static void camera_init(void)
 }
 
 /**
- * @brief Captura una foto y la envía por MQTT
+ * @brief Inicializa el control de tamaño JPEG (antes de camera_init)
  */
-static void capture_and_send_photo(void)
+static void jpeg_rc_setup(void)
 {
-    // Verificar que MQTT esté conectado
-    if (!mqtt_connected)
+    jpeg_rc_config_t cfg = {
+        .budget_bytes = PHOTO_JPEG_BUDGET_BYTES,
+        .target_hit_pct = PHOTO_JPEG_HIT_PCT,
+        .quality_min = PHOTO_JPEG_QUALITY_MIN,
+        .quality_max = PHOTO_JPEG_QUALITY_MAX,
+        .initial_quality = PHOTO_JPEG_QUALITY,
+        .adjust_framesize = PHOTO_ADJUST_FRAMESIZE,
+        .framesize_min = FRAMESIZE_QQVGA,
+        .framesize_max = FRAMESIZE_QVGA,
+        .initial_framesize = FRAMESIZE_QVGA,
+    };
+    jpeg_rc_init(&jpeg_rc, &cfg);
+}
+
+/**
+ * @brief Registra el tamaño del frame y ajusta calidad/resolución del sensor
+ */
+static void jpeg_rc_apply(size_t frame_len)
+{
+    jpeg_rc_action_t action = jpeg_rc_update(&jpeg_rc, frame_len);
+    if (!action.quality_changed && !action.framesize_changed)
     {
-        ESP_LOGW(TAG, "MQTT no conectado. Esperando conexión...");
         return;
     }
     
+    sensor_t *s = esp_camera_sensor_get();
+    if (s == NULL)
+    {
+        return;
+    }
+    if (action.framesize_changed)
+    {
+        s->set_framesize(s, (framesize_t)jpeg_rc.framesize);
+    }
+    if (action.quality_changed)
+    {
+        s->set_quality(s, jpeg_rc.quality);
+    }
+    ESP_LOGI(TAG, "Control de tamaño: calidad %d, resolución %d (excesos: %lu, acierto: %u%%)",
+             jpeg_rc.quality, jpeg_rc.framesize, (unsigned long)jpeg_rc.overshoots,
+             jpeg_rc_hit_pct(&jpeg_rc));
+}
+
+/**
+ * @brief Antes de reinicializar la cámara, espera a que el pipeline devuelva sus frames
+ *
+ * esp_camera_deinit libera los frame buffers: codificación y publicación no
+ * pueden seguir leyendo ninguno. Se llama desde la etapa de captura, que no
+ * captura más mientras espera.
+ */
+static bool photo_recover_quiesce(void *arg)
+{
+    return photo_pipeline_wait_frames(photo_pipeline, PHOTO_RECOVER_DRAIN_MS);
+}
+
+/**
+ * @brief Etapa de captura: obtiene un frame de la cámara
+ */
+static camera_fb_t *photo_capture(void *ctx)
+{
+    // Sin MQTT solo tiene sentido capturar si el frame se puede guardar en el diario
+    if (!mqtt_connected && !journal_enabled)
+    {
+        ESP_LOGW(TAG, "MQTT no conectado. Esperando conexión...");
+        return NULL;
+    }
+    
     ESP_LOGI(TAG, "Capturando foto...");
     
     // Capturar imagen
@@ -381,115 +517,614 @@ static void capture_and_send_photo(void)
     {
         ESP_LOGE(TAG, "✗ Error al capturar foto (memoria libre: %lu bytes)", esp_get_free_heap_size());
         
-        // Intentar reinicializar la cámara
-        ESP_LOGW(TAG, "Reinicializando cámara...");
-        esp_camera_deinit();
-        vTaskDelay(pdMS_TO_TICKS(1000));
-        camera_init();
-        return;
+        // Recuperación escalonada: reset de DMA, reset del sensor y, solo si
+        // ninguno basta, reinicialización completa una vez que photo_recover_quiesce
+        // ha recuperado los frames del pipeline. El frame de prueba se usa.
+        camera_recover_tier_t tier;
+        if (esp_camera_recover(&fb, &tier) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "✗ La cámara no se ha podido recuperar");
+            return NULL;
+        }
+        ESP_LOGW(TAG, "Cámara recuperada (nivel %d)", (int)tier);
     }
     
     ESP_LOGI(TAG, "✓ Foto capturada exitosamente (tamaño: %zu bytes)", fb->len);
     
+    // Corregir calidad para los próximos frames en lugar de descartar este
+    jpeg_rc_apply(fb->len);
+    return fb;
+}
+
+/**
+ * @brief Devuelve el frame al driver de la cámara
+ */
+static void photo_release(void *ctx, camera_fb_t *fb)
+{
+    esp_camera_fb_return(fb);
+}
+
+/**
+ * @brief Etapa de codificación: genera el payload MQTT a partir del frame
+ */
+static esp_err_t photo_encode(void *ctx, photo_job_t *job)
+{
+    camera_fb_t *fb = job->fb;
+    
+#if PHOTO_PAYLOAD_FORMAT == PHOTO_FORMAT_BINARY
+    job->topic = MQTT_TOPIC_PHOTO_BIN;
+#else
+    job->topic = MQTT_TOPIC_PHOTO;
+#endif
+    
     // Verificar tamaño de la imagen
-    if (fb->len > 30000) // Si es mayor a 30KB, es demasiado grande
+    if (fb->len > PHOTO_MAX_JPEG_BYTES)
     {
+#if PHOTO_CHUNKED_TRANSFER
+        // No cabe en el pool: se trocea al publicar directamente desde el frame
+        ESP_LOGW(TAG, "Imagen grande (%zu bytes): se enviará desde el frame sin copiarla", fb->len);
+        job->keep_fb = true;
+        return ESP_OK;
+#else
         ESP_LOGE(TAG, "Imagen demasiado grande (%zu bytes), no se puede enviar", fb->len);
-        esp_camera_fb_return(fb);
-        return;
+        return ESP_ERR_INVALID_SIZE;
+#endif
+    }
+    
+#if PHOTO_PAYLOAD_FORMAT == PHOTO_FORMAT_BINARY
+    size_t payload_len = photo_stream_binary_len(fb->len);
+#else
+    photo_telemetry_t tm = {
+        .timestamp_us = job->timestamp_us,
+        .jpeg_quality = jpeg_rc.quality,
+        .size_overshoots = jpeg_rc.overshoots,
+    };
+    size_t payload_len = photo_stream_json_len(fb->len, PHOTO_DEVICE_ID, &tm);
+#endif
+    
+    // Tomar un buffer del pool con sitio para el payload final
+    uint8_t *payload = photo_pool_get(&payload_pool, payload_len);
+    if (!payload)
+    {
+        ESP_LOGE(TAG, "✗ Error al asignar memoria para el payload (%zu bytes)", payload_len);
+        return ESP_ERR_NO_MEM;
+    }
+    job->payload = payload;
+    
+    // Escribir el payload por trozos mientras se retiene el frame
+    photo_buf_sink_t buf_sink = {
+        .buf = payload,
+        .cap = payload_len,
+        .len = 0,
+    };
+    photo_sink_t sink = {
+        .write = photo_buf_sink_write,
+        .ctx = &buf_sink,
+    };
+#if PHOTO_PAYLOAD_FORMAT == PHOTO_FORMAT_BINARY
+    photo_meta_t meta = {
+        .seq = job->seq,
+        .timestamp_us = job->timestamp_us,
+        .width = fb->width,
+        .height = fb->height,
+        .format = fb->format,
+    };
+    esp_err_t err = photo_stream_binary(fb->buf, fb->len, PHOTO_DEVICE_ID, &meta, &sink);
+#else
+    esp_err_t err = photo_stream_json(fb->buf, fb->len, PHOTO_DEVICE_ID, &tm, &sink);
+#endif
+    
+    // Liberar buffer de la cámara (ya no lo necesitamos)
+    esp_camera_fb_return(fb);
+    job->fb = NULL;
+    
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    
+    job->payload_len = buf_sink.len;
+    ESP_LOGI(TAG, "Payload creado (tamaño: %zu bytes)", buf_sink.len);
+    return ESP_OK;
+}
+
+#if PHOTO_CHUNKED_TRANSFER
+/**
+ * @brief Publica un trozo del frame en el topic de trozos
+ */
+static int photo_chunk_publish(void *ctx, const uint8_t *msg, size_t len)
+{
+    return esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_PHOTO_CHUNK, (const char *)msg, len, PHOTO_MQTT_QOS, 0);
+}
+#endif
+
+/**
+ * @brief Envía un payload completo por MQTT (troceado si PHOTO_CHUNKED_TRANSFER)
+ *
+ * @return msg_id del último mensaje o -1 si falla
+ */
+static int photo_mqtt_send(const char *topic, uint32_t seq, const uint8_t *payload, size_t len)
+{
+#if PHOTO_CHUNKED_TRANSFER
+    uint8_t content = strcmp(topic, MQTT_TOPIC_PHOTO_BIN) == 0 ? PHOTO_CHUNK_CONTENT_BINARY
+                                                               : PHOTO_CHUNK_CONTENT_JSON;
+    esp_err_t err = photo_chunker_begin(&photo_chunker, seq, content, len);
+    if (err == ESP_OK)
+    {
+        err = photo_chunker_write(&photo_chunker, payload, len);
+    }
+    if (err == ESP_OK)
+    {
+        err = photo_chunker_end(&photo_chunker);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "✗ Error en el trozo %u/%u del frame %lu: %s", (unsigned)photo_chunker.index + 1,
+                 (unsigned)photo_chunker.count, (unsigned long)seq, esp_err_to_name(err));
+        return -1;
+    }
+    ESP_LOGI(TAG, "Frame %lu enviado en %u trozos", (unsigned long)seq, (unsigned)photo_chunker.count);
+    return photo_chunker.msg_id;
+#else
+    return esp_mqtt_client_publish(mqtt_client, topic, (const char *)payload,
+                                   len,   // Longitud explícita (el buffer no termina en '\0')
+                                   PHOTO_MQTT_QOS,
+                                   0);    // No retain
+#endif
+}
+
+#if PHOTO_CHUNKED_TRANSFER
+/**
+ * @brief Trocea y publica el payload generándolo directamente desde el frame
+ *
+ * Para los frames que no caben en el pool: no hay copia del payload, así que
+ * su tamaño solo lo limita el frame buffer de la cámara.
+ *
+ * @return msg_id del último trozo o -1 si falla
+ */
+static int photo_mqtt_stream_fb(const photo_job_t *job)
+{
+    const camera_fb_t *fb = job->fb;
+    photo_sink_t sink = {
+        .write = photo_chunker_write,
+        .ctx = &photo_chunker,
+    };
+#if PHOTO_PAYLOAD_FORMAT == PHOTO_FORMAT_BINARY
+    photo_meta_t meta = {
+        .seq = job->seq,
+        .timestamp_us = job->timestamp_us,
+        .width = fb->width,
+        .height = fb->height,
+        .format = fb->format,
+    };
+    esp_err_t err = photo_chunker_begin(&photo_chunker, job->seq, PHOTO_CHUNK_CONTENT_BINARY,
+                                        photo_stream_binary_len(fb->len));
+    if (err == ESP_OK)
+    {
+        err = photo_stream_binary(fb->buf, fb->len, PHOTO_DEVICE_ID, &meta, &sink);
+    }
+#else
+    photo_telemetry_t tm = {
+        .timestamp_us = job->timestamp_us,
+        .jpeg_quality = jpeg_rc.quality,
+        .size_overshoots = jpeg_rc.overshoots,
+    };
+    esp_err_t err = photo_chunker_begin(&photo_chunker, job->seq, PHOTO_CHUNK_CONTENT_JSON,
+                                        photo_stream_json_len(fb->len, PHOTO_DEVICE_ID, &tm));
+    if (err == ESP_OK)
+    {
+        err = photo_stream_json(fb->buf, fb->len, PHOTO_DEVICE_ID, &tm, &sink);
+    }
+#endif
+    if (err == ESP_OK)
+    {
+        err = photo_chunker_end(&photo_chunker);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "✗ Error en el trozo %u/%u del frame %lu: %s", (unsigned)photo_chunker.index + 1,
+                 (unsigned)photo_chunker.count, (unsigned long)job->seq, esp_err_to_name(err));
+        return -1;
+    }
+    ESP_LOGI(TAG, "Frame %lu enviado desde el frame en %u trozos", (unsigned long)job->seq,
+             (unsigned)photo_chunker.count);
+    return photo_chunker.msg_id;
+}
+#endif
+
+/**
+ * @brief Guarda en el diario un frame que no se pudo publicar
+ */
+static int photo_journal_append(const photo_job_t *job)
+{
+    if (!journal_enabled)
+    {
+        return -1;
+    }
+    if (!job->payload)
+    {
+        ESP_LOGE(TAG, "✗ Frame %lu sin payload (enviado desde el frame): no cabe en el diario",
+                 (unsigned long)job->seq);
+        return -1;
+    }
+    
+    uint16_t tag = strcmp(job->topic, MQTT_TOPIC_PHOTO_BIN) == 0 ? JOURNAL_TAG_BINARY : JOURNAL_TAG_JSON;
+    esp_err_t err = frame_journal_append(&journal, tag, job->seq, job->timestamp_us,
+                                         job->payload, job->payload_len);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "✗ Error al guardar frame %lu en el diario: %s",
+                 (unsigned long)job->seq, esp_err_to_name(err));
+        return -1;
     }
     
-    // Calcular tamaño necesario para base64 (4/3 del tamaño original + padding)
-    size_t base64_len = 0;
-    mbedtls_base64_encode(NULL, 0, &base64_len, fb->buf, fb->len);
+    frame_journal_stats_t st;
+    frame_journal_get_stats(&journal, &st);
+    ESP_LOGW(TAG, "Frame %lu guardado en el diario (%lu frames, %zu/%zu bytes, descartados: %lu)",
+             (unsigned long)job->seq, (unsigned long)st.entries, st.used_bytes, st.capacity_bytes,
+             (unsigned long)st.dropped);
+    return 0;
+}
+
+/**
+ * @brief Etapa de publicación: envía el payload por MQTT
+ */
+static int photo_publish(void *ctx, const photo_job_t *job)
+{
+    // Sin conexión, guardar el frame para reenviarlo al reconectar
+    if (!mqtt_connected)
+    {
+        return photo_journal_append(job);
+    }
     
-    // Asignar memoria para base64
-    char *base64_buf = (char *)malloc(base64_len + 1);
-    if (!base64_buf)
+    ESP_LOGI(TAG, "Enviando foto al topic: %s", job->topic);
+    
+#if PHOTO_CHUNKED_TRANSFER
+    int msg_id = job->keep_fb ? photo_mqtt_stream_fb(job)
+                              : photo_mqtt_send(job->topic, job->seq, job->payload, job->payload_len);
+#else
+    int msg_id = photo_mqtt_send(job->topic, job->seq, job->payload, job->payload_len);
+#endif
+    
+    if (msg_id == -1)
+    {
+        ESP_LOGE(TAG, "✗ Error al enviar foto por MQTT");
+        return photo_journal_append(job);
+    }
+    
+    ESP_LOGI(TAG, "Foto en cola para envío (msg_id: %d)", msg_id);
+    return msg_id;
+}
+
+#if PHOTO_CHUNKED_TRANSFER
+/**
+ * @brief Empieza a reenviar un registro del diario: sus trozos salen según se leen
+ */
+static esp_err_t photo_journal_begin(void *ctx, const frame_journal_entry_t *entry)
+{
+    uint8_t content = entry->tag == JOURNAL_TAG_BINARY ? PHOTO_CHUNK_CONTENT_BINARY : PHOTO_CHUNK_CONTENT_JSON;
+    return photo_chunker_begin(&photo_chunker, entry->seq, content, entry->len);
+}
+
+static int photo_journal_end(void *ctx)
+{
+    return photo_chunker_end(&photo_chunker) == ESP_OK ? photo_chunker.msg_id : -1;
+}
+
+static const frame_journal_publisher_t journal_publisher = {
+    .begin = photo_journal_begin,
+    .write = photo_chunker_write,
+    .end = photo_journal_end,
+    .ctx = &photo_chunker,
+};
+#else
+/**
+ * @brief Topic MQTT correspondiente al tag de un registro del diario
+ */
+static const char *journal_tag_topic(uint16_t tag)
+{
+    return tag == JOURNAL_TAG_BINARY ? MQTT_TOPIC_PHOTO_BIN : MQTT_TOPIC_PHOTO;
+}
+
+/**
+ * @brief Empieza a reenviar un registro del diario sobre el buffer de reenvío
+ *
+ * Sin trozos el mensaje MQTT debe ir entero, así que el registro se junta en
+ * journal_stage (reservado una vez en journal_init) antes de publicarlo.
+ */
+static esp_err_t photo_journal_begin(void *ctx, const frame_journal_entry_t *entry)
+{
+    photo_buf_sink_t *stage = (photo_buf_sink_t *)ctx;
+    if (!stage->buf || entry->len > stage->cap)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    stage->len = 0;
+    journal_stage_tag = entry->tag;
+    return ESP_OK;
+}
+
+static int photo_journal_end(void *ctx)
+{
+    photo_buf_sink_t *stage = (photo_buf_sink_t *)ctx;
+    return photo_mqtt_send(journal_tag_topic(journal_stage_tag), 0, stage->buf, stage->len);
+}
+
+static const frame_journal_publisher_t journal_publisher = {
+    .begin = photo_journal_begin,
+    .write = photo_buf_sink_write,
+    .end = photo_journal_end,
+    .ctx = &journal_stage,
+};
+#endif
+
+/**
+ * @brief Reenvía un frame del diario (lo más antiguo primero) si hay conexión
+ *
+ * Se llama desde la etapa de publicación cuando no hay frames en directo,
+ * como mucho una vez cada JOURNAL_DRAIN_INTERVAL_MS.
+ */
+static void photo_journal_drain(void *ctx)
+{
+    if (!mqtt_connected || !journal_enabled)
     {
-        ESP_LOGE(TAG, "✗ Error al asignar memoria para base64");
-        esp_camera_fb_return(fb);
         return;
     }
     
-    // Codificar imagen a base64
-    size_t output_len = 0;
-    int ret = mbedtls_base64_encode((unsigned char *)base64_buf, base64_len, &output_len, fb->buf, fb->len);
-    if (ret != 0)
+    frame_journal_entry_t entry;
+    bool pending = frame_journal_peek(&journal_spill, &entry) || frame_journal_peek(&journal, &entry);
+    if (!pending)
     {
-        ESP_LOGE(TAG, "✗ Error al codificar a base64: %d", ret);
-        free(base64_buf);
-        esp_camera_fb_return(fb);
         return;
     }
-    base64_buf[output_len] = '\0';
     
-    // Liberar buffer de la cámara (ya no lo necesitamos)
-    esp_camera_fb_return(fb);
+    esp_err_t err = frame_journal_drain_one(&journal, &journal_publisher);
+    if (err == ESP_OK)
+    {
+        frame_journal_stats_t st;
+        frame_journal_get_stats(&journal, &st);
+        ESP_LOGI(TAG, "Frame %lu reenviado desde el diario (capturado en %llu us, quedan %lu en PSRAM)",
+                 (unsigned long)entry.seq, (unsigned long long)entry.timestamp_us, (unsigned long)st.entries);
+    }
+    else if (err != ESP_FAIL)
+    {
+        // ESP_FAIL (publicación rechazada) se reintenta en el siguiente turno
+        ESP_LOGE(TAG, "✗ Error al reenviar frame %lu del diario: %s",
+                 (unsigned long)entry.seq, esp_err_to_name(err));
+    }
+}
+
+/**
+ * @brief Publica el informe periódico de latencias y contadores
+ */
+static void photo_stats_publish(void)
+{
+    static char msg[1536];
+    photo_pipeline_stats_t ps;
+    photo_pipeline_get_stats(photo_pipeline, &ps);
+    photo_pool_stats_t pool;
+    photo_pool_get_stats(&payload_pool, &pool);
+    camera_recover_stats_t rec;
+    esp_camera_get_recover_stats(&rec);
     
-    // Crear JSON con la imagen en base64
-    cJSON *root = cJSON_CreateObject();
-    if (!root)
+    int len = snprintf(msg, sizeof(msg),
+                       "{\"device_id\":\"%s\",\"uptime_us\":%lld,\"captured\":%lu,\"dropped\":%lu,"
+                       "\"published\":%lu,\"publish_failed\":%lu,"
+                       "\"pool\":{\"hits\":%lu,\"misses\":%lu,\"high_water\":%lu},"
+                       "\"recover\":{\"dma\":%lu,\"sensor\":%lu,\"reinit\":%lu,\"failed\":%lu},\"latency\":",
+                       PHOTO_DEVICE_ID, (long long)esp_timer_get_time(), (unsigned long)ps.captured,
+                       (unsigned long)ps.dropped, (unsigned long)ps.published, (unsigned long)ps.publish_failed,
+                       (unsigned long)pool.hits, (unsigned long)pool.misses, (unsigned long)pool.high_water,
+                       (unsigned long)rec.attempts[CAMERA_RECOVER_DMA_RESET],
+                       (unsigned long)rec.attempts[CAMERA_RECOVER_SENSOR_RESET],
+                       (unsigned long)rec.attempts[CAMERA_RECOVER_REINIT], (unsigned long)rec.failures);
+    int n = photo_trace_format_json(&photo_trace, msg + len, sizeof(msg) - len - 1);
+    if (n < 0 || len + n + 2 > (int)sizeof(msg))
     {
-        ESP_LOGE(TAG, "✗ Error al crear objeto JSON");
-        free(base64_buf);
+        ESP_LOGE(TAG, "✗ Informe de latencias demasiado grande");
         return;
     }
+    len += n;
+    msg[len++] = '}';
+    msg[len] = '\0';
     
-    cJSON_AddStringToObject(root, "device_id", "access_control_camera");
-    cJSON_AddStringToObject(root, "access_method", "camera");
-    cJSON_AddStringToObject(root, "img", base64_buf);
+    photo_trace_hist_t hist[PHOTO_TRACE_SPANS];
+    photo_trace_snapshot(&photo_trace, hist, NULL);
+    for (int s = 0; s < PHOTO_TRACE_SPANS; s++)
+    {
+        const photo_trace_hist_t *h = &hist[s];
+        ESP_LOGI(TAG, "Latencia %-8s n=%-5lu media=%6llu us  máx=%7lu us", photo_trace_span_name(s),
+                 (unsigned long)h->count, (unsigned long long)(h->count ? h->sum_us / h->count : 0),
+                 (unsigned long)h->max_us);
+    }
+    esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_STATS, msg, len, 0, 0);
+}
+
+/**
+ * @brief Trabajo de la etapa de publicación cuando no hay frames en directo
+ */
+static void photo_idle(void *ctx)
+{
+    photo_journal_drain(ctx);
     
-    // Convertir JSON a string
-    char *json_str = cJSON_PrintUnformatted(root);
-    if (!json_str)
+    int64_t now = esp_timer_get_time();
+    if (mqtt_connected && now - stats_last_us >= (int64_t)PHOTO_STATS_INTERVAL_MS * 1000)
+    {
+        stats_last_us = now;
+        photo_stats_publish();
+    }
+}
+
+/**
+ * @brief Devuelve el payload al pool una vez publicado
+ */
+static void photo_free_payload(void *ctx, photo_job_t *job)
+{
+    photo_pool_put(&payload_pool, job->payload);
+}
+
+static esp_err_t partition_read(void *ctx, size_t offset, void *buf, size_t len)
+{
+    return esp_partition_read((const esp_partition_t *)ctx, offset, buf, len);
+}
+
+static esp_err_t partition_write(void *ctx, size_t offset, const void *buf, size_t len)
+{
+    return esp_partition_write((const esp_partition_t *)ctx, offset, buf, len);
+}
+
+static esp_err_t partition_erase(void *ctx, size_t offset, size_t len)
+{
+    return esp_partition_erase_range((const esp_partition_t *)ctx, offset, len);
+}
+
+/**
+ * @brief Mayor payload (JSON o binario) de un frame de PHOTO_MAX_JPEG_BYTES
+ */
+static size_t photo_payload_max_len(void)
+{
+    // Cota superior del JSON: telemetría con el máximo de dígitos
+    photo_telemetry_t tm_max = {
+        .timestamp_us = UINT64_MAX,
+        .jpeg_quality = PHOTO_JPEG_QUALITY_MAX,
+        .size_overshoots = UINT32_MAX,
+    };
+    size_t len = photo_stream_json_len(PHOTO_MAX_JPEG_BYTES, PHOTO_DEVICE_ID, &tm_max);
+    if (photo_stream_binary_len(PHOTO_MAX_JPEG_BYTES) > len)
     {
-        ESP_LOGE(TAG, "✗ Error al serializar JSON");
-        cJSON_Delete(root);
-        free(base64_buf);
+        len = photo_stream_binary_len(PHOTO_MAX_JPEG_BYTES);
+    }
+    return len;
+}
+
+/**
+ * @brief Crea el diario de frames en PSRAM y, si existe, el de la partición flash
+ */
+static void journal_init(void)
+{
+    uint8_t *buf = heap_caps_malloc(JOURNAL_PSRAM_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buf)
+    {
+        ESP_LOGW(TAG, "⚠️ Sin PSRAM para el diario: los frames se perderán durante cortes de MQTT");
         return;
     }
     
-    ESP_LOGI(TAG, "JSON creado (tamaño: %d bytes)", strlen(json_str));
+    frame_journal_storage_t storage;
+    frame_journal_storage_ram(&storage, &journal_ram, buf, JOURNAL_PSRAM_BYTES);
+    ESP_ERROR_CHECK(frame_journal_init(&journal, &storage));
+    journal_enabled = true;
     
-    // Enviar JSON por MQTT
-    ESP_LOGI(TAG, "Enviando foto en JSON al topic: %s", MQTT_TOPIC_PHOTO);
-    
-    int msg_id = esp_mqtt_client_publish(mqtt_client, 
-                                         MQTT_TOPIC_PHOTO, 
-                                         json_str, 
-                                         0,     // Longitud 0 = calcular automáticamente
-                                         0,     // QoS 0 para entrega sin garantía
-                                         0);    // No retain
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           ESP_PARTITION_SUBTYPE_ANY,
+                                                           JOURNAL_PARTITION_LABEL);
+    if (part != NULL)
+    {
+        frame_journal_storage_t flash = {
+            .read = partition_read,
+            .write = partition_write,
+            .erase = partition_erase,
+            .size = part->size / part->erase_size * part->erase_size,
+            .erase_size = part->erase_size,
+            .ctx = (void *)part,
+        };
+        // Lo desbordado antes de un reinicio sigue en la partición: recuperarlo
+        if (frame_journal_recover(&journal_spill, &flash) == ESP_OK)
+        {
+            frame_journal_stats_t st;
+            frame_journal_get_stats(&journal_spill, &st);
+            frame_journal_set_spill(&journal, &journal_spill);
+            ESP_LOGI(TAG, "Diario con desbordamiento a flash (%lu bytes, %lu frames recuperados)",
+                     (unsigned long)flash.size, (unsigned long)st.recovered);
+        }
+    }
     
-    if (msg_id == -1)
+#if !PHOTO_CHUNKED_TRANSFER
+    journal_stage.cap = photo_payload_max_len();
+    journal_stage.buf = heap_caps_malloc(journal_stage.cap, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!journal_stage.buf)
     {
-        ESP_LOGE(TAG, "✗ Error al enviar foto por MQTT");
+        ESP_LOGW(TAG, "⚠️ Sin PSRAM para reenviar el diario");
     }
-    else
+#endif
+    
+    ESP_LOGI(TAG, "✓ Diario de frames en PSRAM (%d bytes)", JOURNAL_PSRAM_BYTES);
+}
+
+/**
+ * @brief Reserva en PSRAM los buffers de payload del pipeline
+ *
+ * La clase pequeña cubre los frames dentro del presupuesto, la mediana los
+ * excesos hasta que el control de tamaño reacciona y un único buffer grande
+ * el peor caso de PHOTO_MAX_JPEG_BYTES. Sin PSRAM cada payload se reserva
+ * del heap (fallos del pool).
+ */
+static void payload_pool_init(void)
+{
+    size_t large = photo_payload_max_len();
+    const photo_pool_class_t classes[] = {
+        { .size = PHOTO_POOL_SMALL_BYTES, .count = PHOTO_POOL_SMALL_COUNT },
+        { .size = PHOTO_POOL_MEDIUM_BYTES, .count = PHOTO_POOL_MEDIUM_COUNT },
+        { .size = large, .count = PHOTO_POOL_LARGE_COUNT },
+    };
+    size_t n_classes = sizeof(classes) / sizeof(classes[0]);
+    if (large <= PHOTO_POOL_MEDIUM_BYTES)
     {
-        ESP_LOGI(TAG, "Foto en cola para envío (msg_id: %d)", msg_id);
+        n_classes--;  // Sin transferencia por trozos el límite ya cabe en la mediana
     }
     
-    // Liberar memoria
-    cJSON_Delete(root);
-    free(json_str);
-    free(base64_buf);
+    size_t mem_len = photo_pool_mem_size(classes, n_classes);
+    uint8_t *mem = heap_caps_malloc(mem_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!mem)
+    {
+        ESP_LOGW(TAG, "⚠️ Sin PSRAM para el pool de payloads: se usará el heap en cada frame");
+        return;
+    }
+    ESP_ERROR_CHECK(photo_pool_init(&payload_pool, classes, n_classes, mem, mem_len));
+    ESP_LOGI(TAG, "✓ Pool de payloads en PSRAM (%zu bytes en %zu clases, la mayor de %zu bytes)",
+             mem_len, n_classes, classes[n_classes - 1].size);
 }
 
 /**
- * @brief Tarea dedicada para capturar y enviar fotos
+ * @brief Crea el pipeline de captura/codificación/publicación
  */
-static void photo_task(void *pvParameters)
+static void photo_pipeline_init(void)
 {
-    while (1)
+#if PHOTO_CHUNKED_TRANSFER
+    // Nuevo id en cada arranque: el puente no mezcla trozos de antes de un reinicio
+    ESP_ERROR_CHECK(photo_chunker_init(&photo_chunker, photo_chunk_buf, sizeof(photo_chunk_buf), esp_random(),
+                                       photo_chunk_publish, NULL));
+#endif
+    static const photo_pipeline_ops_t ops = {
+        .capture = photo_capture,
+        .release = photo_release,
+        .encode = photo_encode,
+        .publish = photo_publish,
+        .free_payload = photo_free_payload,
+        .idle = photo_idle,
+        .ctx = NULL,
+    };
+    photo_pipeline_config_t config = {
+        .queue_len = PIPELINE_QUEUE_LEN,
+        .stack_size = PIPELINE_STACK_SIZE,
+        .priority = PIPELINE_PRIORITY,
+        .capture_core = PIPELINE_CORE_CAPTURE,
+        .encode_core = PIPELINE_CORE_ENCODE,
+        .publish_core = PIPELINE_CORE_PUBLISH,
+        .idle_ms = JOURNAL_DRAIN_INTERVAL_MS,
+        .trace = &photo_trace,
+    };
+    
+    photo_trace_init(&photo_trace, PHOTO_MQTT_QOS > 0);
+    stats_last_us = esp_timer_get_time();
+    
+    esp_err_t err = photo_pipeline_start(&config, &ops, &photo_pipeline);
+    if (err != ESP_OK)
     {
-        // Esperar notificación del timer
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-        
-        // Ejecutar captura y envío
-        capture_and_send_photo();
+        ESP_LOGE(TAG, "✗ Error al crear el pipeline de fotos: %s", esp_err_to_name(err));
+        return;
     }
+    esp_camera_set_recover_quiesce(photo_recover_quiesce, NULL);
+    ESP_LOGI(TAG, "Pipeline de captura creado");
 }
 
 /**
@@ -497,11 +1132,8 @@ static void photo_task(void *pvParameters)
  */
 static void photo_timer_callback(TimerHandle_t xTimer)
 {
-    // En lugar de ejecutar directamente, notificar a la tarea
-    if (photo_task_handle != NULL)
-    {
-        xTaskNotifyGive(photo_task_handle);
-    }
+    // En lugar de ejecutar directamente, notificar a la etapa de captura
+    photo_pipeline_trigger(photo_pipeline);
 }
 
 /**
@@ -527,7 +1159,10 @@ void app_main(void)
     ESP_LOGI(TAG, "✓ Network stack inicializado");
     
     // 3. Inicializar cámara
+    jpeg_rc_setup();
     camera_init();
+    journal_init();
+    payload_pool_init();
     
     // 4. Inicializar WiFi
     wifi_init();
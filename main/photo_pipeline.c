@@ -0,0 +1,362 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "photo_pipeline.h"
+
+static const char *TAG = "PHOTO_PIPELINE";
+
+// Trabajos en vuelo: uno por hueco de cada cola más uno por etapa
+#define JOB_COUNT(queue_len) ((queue_len) * 2 + 3)
+// Sondeo de photo_pipeline_wait_frames
+#define FRAMES_POLL_MS 10
+
+struct photo_pipeline {
+    photo_pipeline_config_t config;
+    photo_pipeline_ops_t ops;
+    photo_pipeline_stats_t stats;
+    photo_job_t *jobs;
+    QueueHandle_t free_queue;       // Trabajos libres (pool fijo, sin malloc por frame)
+    QueueHandle_t encode_queue;     // Captura -> codificación
+    QueueHandle_t publish_queue;    // Codificación -> publicación
+    QueueHandle_t done_queue;       // Aviso de fin de cada tarea al parar
+    TaskHandle_t capture_task;
+    volatile bool stopping;
+    uint32_t next_seq;
+    int frames_out;                 // Frames obtenidos de ops.capture y aún no devueltos
+};
+
+/**
+ * @brief Devuelve el frame del trabajo al driver y lo descuenta
+ */
+static void job_release_fb(photo_pipeline_handle_t p, photo_job_t *job)
+{
+    p->ops.release(p->ops.ctx, job->fb);
+    job->fb = NULL;
+    __atomic_sub_fetch(&p->frames_out, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Etapa 1: espera el disparo, captura y pasa el frame a codificar
+ */
+static void capture_stage(void *arg)
+{
+    photo_pipeline_handle_t p = (photo_pipeline_handle_t)arg;
+    photo_job_t *job = NULL;
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (p->stopping)
+        {
+            break;
+        }
+
+        // Sin trabajo libre las etapas siguientes van retrasadas: no capturar
+        if (xQueueReceive(p->free_queue, &job, 0) != pdTRUE)
+        {
+            p->stats.dropped++;
+            ESP_LOGW(TAG, "Pipeline lleno, captura omitida");
+            continue;
+        }
+
+        camera_fb_t *fb = p->ops.capture(p->ops.ctx);
+        int64_t captured_us = esp_timer_get_time();
+        if (!fb)
+        {
+            p->stats.capture_failed++;
+            xQueueSend(p->free_queue, &job, portMAX_DELAY);
+            continue;
+        }
+        p->stats.captured++;
+        __atomic_add_fetch(&p->frames_out, 1, __ATOMIC_RELAXED);
+
+        memset(job, 0, sizeof(*job));
+        job->fb = fb;
+        job->seq = p->next_seq++;
+        job->timestamp_us = (uint64_t)fb->timestamp.tv_sec * 1000000ULL + fb->timestamp.tv_usec;
+        if (p->config.trace)
+        {
+            photo_trace_mark(p->config.trace, job->seq, PHOTO_TRACE_CAPTURED, captured_us);
+        }
+
+        if (xQueueSend(p->encode_queue, &job, 0) != pdTRUE)
+        {
+            p->stats.dropped++;
+            job_release_fb(p, job);
+            xQueueSend(p->free_queue, &job, portMAX_DELAY);
+        }
+    }
+
+    // Propagar el fin por el pipeline
+    job = NULL;
+    xQueueSend(p->encode_queue, &job, portMAX_DELAY);
+    xQueueSend(p->done_queue, &job, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Etapa 2: genera el payload y devuelve el frame al driver
+ */
+static void encode_stage(void *arg)
+{
+    photo_pipeline_handle_t p = (photo_pipeline_handle_t)arg;
+    photo_job_t *job = NULL;
+
+    while (xQueueReceive(p->encode_queue, &job, portMAX_DELAY) == pdTRUE && job != NULL)
+    {
+        esp_err_t err = p->ops.encode(p->ops.ctx, job);
+
+        // El encoder puede haber devuelto ya el frame; si no, hacerlo aquí salvo
+        // que la publicación lo necesite para generar el payload
+        if (!job->fb)
+        {
+            __atomic_sub_fetch(&p->frames_out, 1, __ATOMIC_RELEASE);
+        }
+        else if (err != ESP_OK || !job->keep_fb)
+        {
+            job_release_fb(p, job);
+        }
+
+        if (err != ESP_OK)
+        {
+            p->stats.encode_failed++;
+            ESP_LOGE(TAG, "✗ Error al codificar frame %lu: %s", (unsigned long)job->seq, esp_err_to_name(err));
+            if (job->payload)
+            {
+                p->ops.free_payload(p->ops.ctx, job);
+            }
+            xQueueSend(p->free_queue, &job, portMAX_DELAY);
+            continue;
+        }
+
+        if (p->config.trace)
+        {
+            photo_trace_mark(p->config.trace, job->seq, PHOTO_TRACE_ENCODED, esp_timer_get_time());
+        }
+        xQueueSend(p->publish_queue, &job, portMAX_DELAY);
+    }
+
+    job = NULL;
+    xQueueSend(p->publish_queue, &job, portMAX_DELAY);
+    xQueueSend(p->done_queue, &job, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Etapa 3: publica el payload por MQTT y recicla el trabajo
+ *
+ * Sin frames pendientes durante idle_ms cede el turno a ops.idle (p.ej. para
+ * reenviar frames guardados), que así nunca compite con un frame en directo.
+ */
+static void publish_stage(void *arg)
+{
+    photo_pipeline_handle_t p = (photo_pipeline_handle_t)arg;
+    photo_job_t *job = NULL;
+    TickType_t wait = p->ops.idle ? pdMS_TO_TICKS(p->config.idle_ms) : portMAX_DELAY;
+
+    while (1)
+    {
+        if (xQueueReceive(p->publish_queue, &job, wait) != pdTRUE)
+        {
+            p->ops.idle(p->ops.ctx);
+            continue;
+        }
+        if (job == NULL)
+        {
+            break;
+        }
+
+        int msg_id = p->ops.publish(p->ops.ctx, job);
+        if (p->config.trace)
+        {
+            photo_trace_published(p->config.trace, job->seq, msg_id, esp_timer_get_time());
+        }
+        if (msg_id == -1)
+        {
+            p->stats.publish_failed++;
+        }
+        else
+        {
+            p->stats.published++;
+        }
+
+        p->ops.free_payload(p->ops.ctx, job);
+        job->payload = NULL;
+        job->payload_len = 0;
+        if (job->fb)
+        {
+            job_release_fb(p, job);
+        }
+        xQueueSend(p->free_queue, &job, portMAX_DELAY);
+    }
+
+    job = NULL;
+    xQueueSend(p->done_queue, &job, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+static void pipeline_free(photo_pipeline_handle_t p)
+{
+    if (p->free_queue)
+    {
+        vQueueDelete(p->free_queue);
+    }
+    if (p->encode_queue)
+    {
+        vQueueDelete(p->encode_queue);
+    }
+    if (p->publish_queue)
+    {
+        vQueueDelete(p->publish_queue);
+    }
+    if (p->done_queue)
+    {
+        vQueueDelete(p->done_queue);
+    }
+    free(p->jobs);
+    free(p);
+}
+
+/**
+ * @brief Deshace un arranque a medias
+ *
+ * Las etapas se crean de atrás hacia delante, así que las ya creadas son las
+ * últimas: el fin entra por la cola de la primera de ellas (head) y recorre el
+ * resto como en photo_pipeline_stop. Tras sus avisos en done_queue ninguna
+ * tarea toca ya p y se puede liberar.
+ */
+static void pipeline_unwind(photo_pipeline_handle_t p, QueueHandle_t head, int started)
+{
+    photo_job_t *job = NULL;
+
+    if (started > 0)
+    {
+        xQueueSend(head, &job, portMAX_DELAY);
+    }
+    for (int i = 0; i < started; i++)
+    {
+        xQueueReceive(p->done_queue, &job, portMAX_DELAY);
+    }
+    pipeline_free(p);
+}
+
+esp_err_t photo_pipeline_start(const photo_pipeline_config_t *config, const photo_pipeline_ops_t *ops,
+                               photo_pipeline_handle_t *out_handle)
+{
+    if (!config || !ops || !out_handle || config->queue_len == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_handle = NULL;
+
+    photo_pipeline_handle_t p = calloc(1, sizeof(*p));
+    if (!p)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    p->config = *config;
+    p->ops = *ops;
+
+    size_t job_count = JOB_COUNT(config->queue_len);
+    p->jobs = calloc(job_count, sizeof(photo_job_t));
+    p->free_queue = xQueueCreate(job_count, sizeof(photo_job_t *));
+    p->encode_queue = xQueueCreate(config->queue_len + 1, sizeof(photo_job_t *));
+    p->publish_queue = xQueueCreate(config->queue_len + 1, sizeof(photo_job_t *));
+    p->done_queue = xQueueCreate(3, sizeof(photo_job_t *));
+    if (!p->jobs || !p->free_queue || !p->encode_queue || !p->publish_queue || !p->done_queue)
+    {
+        pipeline_free(p);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < job_count; i++)
+    {
+        photo_job_t *job = &p->jobs[i];
+        xQueueSend(p->free_queue, &job, 0);
+    }
+
+    // Crear de atrás hacia delante para que cada etapa tenga consumidor
+    if (xTaskCreatePinnedToCore(publish_stage, "photo_pub", config->stack_size, p,
+                                config->priority, NULL, config->publish_core) != pdPASS)
+    {
+        ESP_LOGE(TAG, "✗ No se pudo crear la etapa de publicación");
+        pipeline_unwind(p, NULL, 0);
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreatePinnedToCore(encode_stage, "photo_enc", config->stack_size, p,
+                                config->priority, NULL, config->encode_core) != pdPASS)
+    {
+        ESP_LOGE(TAG, "✗ No se pudo crear la etapa de codificación");
+        pipeline_unwind(p, p->publish_queue, 1);
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreatePinnedToCore(capture_stage, "photo_cap", config->stack_size, p,
+                                config->priority, &p->capture_task, config->capture_core) != pdPASS)
+    {
+        ESP_LOGE(TAG, "✗ No se pudo crear la etapa de captura");
+        pipeline_unwind(p, p->encode_queue, 2);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Pipeline iniciado (colas de %u, núcleos cap/enc/pub: %d/%d/%d)",
+             (unsigned)config->queue_len, (int)config->capture_core,
+             (int)config->encode_core, (int)config->publish_core);
+    *out_handle = p;
+    return ESP_OK;
+}
+
+void photo_pipeline_trigger(photo_pipeline_handle_t pipeline)
+{
+    if (pipeline && pipeline->capture_task)
+    {
+        if (pipeline->config.trace)
+        {
+            photo_trace_trigger(pipeline->config.trace, esp_timer_get_time());
+        }
+        xTaskNotifyGive(pipeline->capture_task);
+    }
+}
+
+void photo_pipeline_stop(photo_pipeline_handle_t pipeline)
+{
+    photo_job_t *job = NULL;
+
+    pipeline->stopping = true;
+    xTaskNotifyGive(pipeline->capture_task);
+
+    // Esperar a que las tres etapas hayan vaciado sus colas y terminado
+    for (int i = 0; i < 3; i++)
+    {
+        xQueueReceive(pipeline->done_queue, &job, portMAX_DELAY);
+    }
+    pipeline_free(pipeline);
+}
+
+bool photo_pipeline_wait_frames(photo_pipeline_handle_t pipeline, uint32_t timeout_ms)
+{
+    if (!pipeline)
+    {
+        return true;
+    }
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (__atomic_load_n(&pipeline->frames_out, __ATOMIC_ACQUIRE) > 0)
+    {
+        if (esp_timer_get_time() >= deadline_us)
+        {
+            ESP_LOGW(TAG, "%d frame(s) sin devolver tras %lu ms", __atomic_load_n(&pipeline->frames_out, __ATOMIC_RELAXED),
+                     (unsigned long)timeout_ms);
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(FRAMES_POLL_MS));
+    }
+    return true;
+}
+
+void photo_pipeline_get_stats(photo_pipeline_handle_t pipeline, photo_pipeline_stats_t *stats)
+{
+    *stats = pipeline->stats;
+}
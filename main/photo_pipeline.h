@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_camera.h"
+#include "photo_trace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Trabajo que recorre el pipeline captura -> codificación -> publicación
+ *
+ * Por las colas solo viaja el puntero: cada etapa es dueña del trabajo
+ * (y del frame/payload que contiene) mientras lo procesa.
+ */
+typedef struct {
+    camera_fb_t *fb;        /*!< Frame capturado (NULL una vez devuelto al driver) */
+    bool keep_fb;           /*!< encode deja fb sin devolver: el payload se genera al publicar */
+    uint8_t *payload;       /*!< Payload generado por la etapa de codificación */
+    size_t payload_len;     /*!< Bytes válidos en payload */
+    const char *topic;      /*!< Topic MQTT de destino */
+    uint32_t seq;           /*!< Secuencia asignada en la captura */
+    uint64_t timestamp_us;  /*!< Instante de captura (fb->timestamp) */
+} photo_job_t;
+
+/**
+ * @brief Operaciones que el pipeline delega en la aplicación
+ *
+ * Permiten sustituir cámara y MQTT por mocks en el build de host.
+ */
+typedef struct {
+    camera_fb_t *(*capture)(void *ctx);                     /*!< Obtiene un frame o NULL */
+    void (*release)(void *ctx, camera_fb_t *fb);            /*!< Devuelve el frame al driver */
+    esp_err_t (*encode)(void *ctx, photo_job_t *job);       /*!< Rellena payload/topic a partir de fb (o marca keep_fb) */
+    int (*publish)(void *ctx, const photo_job_t *job);      /*!< Publica; devuelve msg_id o -1 */
+    void (*free_payload)(void *ctx, photo_job_t *job);      /*!< Libera el payload tras publicar (fb se devuelve aparte) */
+    void (*idle)(void *ctx);                                /*!< Opcional: publicación ociosa cada idle_ms */
+    void *ctx;
+} photo_pipeline_ops_t;
+
+/**
+ * @brief Configuración de las etapas
+ */
+typedef struct {
+    size_t queue_len;           /*!< Profundidad de cada cola entre etapas */
+    uint32_t stack_size;        /*!< Stack de cada tarea */
+    UBaseType_t priority;       /*!< Prioridad de las tres tareas */
+    BaseType_t capture_core;    /*!< Núcleo de la etapa de captura (o tskNO_AFFINITY) */
+    BaseType_t encode_core;     /*!< Núcleo de la etapa de codificación */
+    BaseType_t publish_core;    /*!< Núcleo de la etapa de publicación */
+    uint32_t idle_ms;           /*!< Periodo de ops.idle sin frames pendientes */
+    photo_trace_t *trace;       /*!< Opcional: marcas de tiempo por etapa */
+} photo_pipeline_config_t;
+
+/**
+ * @brief Contadores del pipeline
+ */
+typedef struct {
+    uint32_t captured;          /*!< Frames obtenidos de la cámara */
+    uint32_t capture_failed;    /*!< Capturas que devolvieron NULL */
+    uint32_t dropped;           /*!< Frames descartados por colas llenas */
+    uint32_t encode_failed;     /*!< Errores de codificación */
+    uint32_t published;         /*!< Publicaciones aceptadas por el cliente MQTT */
+    uint32_t publish_failed;    /*!< Publicaciones rechazadas */
+} photo_pipeline_stats_t;
+
+typedef struct photo_pipeline *photo_pipeline_handle_t;
+
+/**
+ * @brief Crea las colas y arranca las tres tareas del pipeline
+ *
+ * Si no puede crear alguna etapa detiene las que ya arrancaron, libera colas y
+ * trabajos y deja *out_handle a NULL, de modo que se puede reintentar.
+ */
+esp_err_t photo_pipeline_start(const photo_pipeline_config_t *config, const photo_pipeline_ops_t *ops,
+                               photo_pipeline_handle_t *out_handle);
+
+/**
+ * @brief Solicita una captura (llamable desde el callback del timer)
+ */
+void photo_pipeline_trigger(photo_pipeline_handle_t pipeline);
+
+/**
+ * @brief Vacía el pipeline, detiene las tareas y libera los recursos
+ */
+void photo_pipeline_stop(photo_pipeline_handle_t pipeline);
+
+/**
+ * @brief Espera a que las etapas devuelvan todos los frames que tienen
+ *
+ * Pensada para ops.capture (p.ej. antes de reinicializar la cámara): mientras
+ * la etapa de captura espera no entran frames nuevos y las demás etapas
+ * terminan los que ya tienen.
+ *
+ * @return true si no queda ningún frame fuera del driver, false si vence timeout_ms
+ */
+bool photo_pipeline_wait_frames(photo_pipeline_handle_t pipeline, uint32_t timeout_ms);
+
+/**
+ * @brief Copia los contadores actuales
+ */
+void photo_pipeline_get_stats(photo_pipeline_handle_t pipeline, photo_pipeline_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+#include "photo_pool.h"
+
+#define ALIGN_UP(n) (((n) + PHOTO_POOL_ALIGN - 1) & ~(size_t)(PHOTO_POOL_ALIGN - 1))
+
+size_t photo_pool_mem_size(const photo_pool_class_t *classes, size_t n_classes)
+{
+    size_t total = PHOTO_POOL_ALIGN;  // Margen para alinear el inicio
+    for (size_t c = 0; c < n_classes; c++)
+    {
+        total += ALIGN_UP(classes[c].size) * classes[c].count;
+    }
+    return total;
+}
+
+static void pool_free_queues(photo_pool_t *pool)
+{
+    for (size_t c = 0; c < PHOTO_POOL_MAX_CLASSES; c++)
+    {
+        if (pool->free[c])
+        {
+            vQueueDelete(pool->free[c]);
+            pool->free[c] = NULL;
+        }
+    }
+}
+
+esp_err_t photo_pool_init(photo_pool_t *pool, const photo_pool_class_t *classes, size_t n_classes,
+                          uint8_t *mem, size_t mem_len)
+{
+    memset(pool, 0, sizeof(*pool));
+    if (!classes || !mem || n_classes == 0 || n_classes > PHOTO_POOL_MAX_CLASSES)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (mem_len < photo_pool_mem_size(classes, n_classes))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *p = (uint8_t *)ALIGN_UP((uintptr_t)mem);
+    for (size_t c = 0; c < n_classes; c++)
+    {
+        photo_pool_class_t cls = classes[c];
+        if (cls.size == 0 || cls.count == 0 || (c > 0 && cls.size <= classes[c - 1].size))
+        {
+            pool_free_queues(pool);
+            return ESP_ERR_INVALID_ARG;
+        }
+        cls.size = ALIGN_UP(cls.size);
+
+        pool->free[c] = xQueueCreate(cls.count, sizeof(uint8_t *));
+        if (!pool->free[c])
+        {
+            pool_free_queues(pool);
+            return ESP_ERR_NO_MEM;
+        }
+        pool->classes[c] = cls;
+        pool->base[c] = p;
+        for (uint16_t i = 0; i < cls.count; i++)
+        {
+            xQueueSend(pool->free[c], &p, 0);
+            p += cls.size;
+        }
+        pool->total += cls.count;
+    }
+    pool->n_classes = n_classes;
+    pool->mem = mem;
+    pool->mem_len = mem_len;
+    return ESP_OK;
+}
+
+// Clase a la que pertenece buf, o -1 si no es del pool
+static int pool_class_of(const photo_pool_t *pool, const uint8_t *buf)
+{
+    for (size_t c = 0; c < pool->n_classes; c++)
+    {
+        const uint8_t *end = pool->base[c] + pool->classes[c].size * pool->classes[c].count;
+        if (buf >= pool->base[c] && buf < end)
+        {
+            return (int)c;
+        }
+    }
+    return -1;
+}
+
+static uint32_t pool_in_use(const photo_pool_t *pool)
+{
+    uint32_t free_count = 0;
+    for (size_t c = 0; c < pool->n_classes; c++)
+    {
+        free_count += uxQueueMessagesWaiting(pool->free[c]);
+    }
+    return pool->total - free_count;
+}
+
+uint8_t *photo_pool_get(photo_pool_t *pool, size_t len)
+{
+    uint8_t *buf = NULL;
+
+    if (len > pool->stats.largest_request)
+    {
+        pool->stats.largest_request = len;
+    }
+    for (size_t c = 0; c < pool->n_classes && !buf; c++)
+    {
+        if (pool->classes[c].size >= len)
+        {
+            xQueueReceive(pool->free[c], &buf, 0);
+        }
+    }
+
+    if (!buf)
+    {
+        pool->stats.misses++;
+        return malloc(len);
+    }
+
+    pool->stats.hits++;
+    uint32_t in_use = pool_in_use(pool);
+    if (in_use > pool->stats.high_water)
+    {
+        pool->stats.high_water = in_use;
+    }
+    return buf;
+}
+
+void photo_pool_put(photo_pool_t *pool, uint8_t *buf)
+{
+    if (!buf)
+    {
+        return;
+    }
+    int c = pool_class_of(pool, buf);
+    if (c < 0)
+    {
+        free(buf);
+        return;
+    }
+    xQueueSend(pool->free[c], &buf, 0);
+}
+
+void photo_pool_get_stats(const photo_pool_t *pool, photo_pool_stats_t *stats)
+{
+    *stats = pool->stats;
+    stats->in_use = pool_in_use(pool);
+}
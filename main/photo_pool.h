@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Máximo de clases de tamaño por pool
+#define PHOTO_POOL_MAX_CLASSES  4
+// Alineación de cada buffer dentro de la memoria del pool
+#define PHOTO_POOL_ALIGN        16
+
+/**
+ * @brief Clase de tamaño: count buffers de size bytes
+ */
+typedef struct {
+    size_t size;
+    uint16_t count;
+} photo_pool_class_t;
+
+/**
+ * @brief Contadores del pool
+ */
+typedef struct {
+    uint32_t hits;              /*!< Peticiones servidas con un buffer del pool */
+    uint32_t misses;            /*!< Peticiones servidas del heap (sin buffer libre o demasiado grandes) */
+    uint32_t in_use;            /*!< Buffers del pool prestados ahora */
+    uint32_t high_water;        /*!< Máximo de buffers prestados a la vez */
+    size_t largest_request;     /*!< Mayor petición recibida */
+} photo_pool_stats_t;
+
+/**
+ * @brief Pool de buffers de trabajo repartidos en clases de tamaño fijo
+ *
+ * Toda la memoria se reserva una vez al arrancar. Cada clase mantiene sus
+ * buffers libres en una cola, así que prestar (photo_pool_get) y devolver
+ * (photo_pool_put) pueden hacerse desde tareas distintas. Los contadores
+ * solo los escribe photo_pool_get: debe llamarse desde una única tarea.
+ */
+typedef struct {
+    size_t n_classes;
+    photo_pool_class_t classes[PHOTO_POOL_MAX_CLASSES];
+    uint8_t *base[PHOTO_POOL_MAX_CLASSES];          // Primer buffer de cada clase
+    QueueHandle_t free[PHOTO_POOL_MAX_CLASSES];     // Buffers libres de cada clase
+    uint8_t *mem;
+    size_t mem_len;
+    uint32_t total;                                 // Buffers en todas las clases
+    photo_pool_stats_t stats;
+} photo_pool_t;
+
+/**
+ * @brief Bytes de memoria necesarios para las clases dadas (incluida la alineación)
+ */
+size_t photo_pool_mem_size(const photo_pool_class_t *classes, size_t n_classes);
+
+/**
+ * @brief Reparte mem entre las clases, ordenadas de menor a mayor tamaño
+ *
+ * @param mem     Memoria de al menos photo_pool_mem_size() bytes (p.ej. en PSRAM)
+ */
+esp_err_t photo_pool_init(photo_pool_t *pool, const photo_pool_class_t *classes, size_t n_classes,
+                          uint8_t *mem, size_t mem_len);
+
+/**
+ * @brief Presta el buffer libre más pequeño de al menos len bytes
+ *
+ * Si no queda ninguno, lo reserva con malloc y lo cuenta como fallo.
+ *
+ * @return Buffer o NULL si tampoco hay heap
+ */
+uint8_t *photo_pool_get(photo_pool_t *pool, size_t len);
+
+/**
+ * @brief Devuelve un buffer obtenido con photo_pool_get (NULL se ignora)
+ */
+void photo_pool_put(photo_pool_t *pool, uint8_t *buf);
+
+/**
+ * @brief Copia los contadores actuales
+ */
+void photo_pool_get_stats(const photo_pool_t *pool, photo_pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
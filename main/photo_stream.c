@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <string.h>
+#include "photo_stream.h"
+#include "mbedtls/base64.h"
+#include "esp_rom_crc.h"
+
+// Partes fijas del sobre JSON (mismo orden de claves que generaba cJSON)
+static const char JSON_PREFIX_A[] = "{\"device_id\":\"";
+static const char JSON_PREFIX_B[] = "\",\"access_method\":\"camera\"";
+static const char JSON_IMG[] = ",\"img\":\"";
+static const char JSON_SUFFIX[] = "\"}";
+
+#define LIT_LEN(s) (sizeof(s) - 1)
+
+static size_t base64_len(size_t len)
+{
+    return ((len + 2) / 3) * 4;
+}
+
+// Campos de telemetría opcionales; devuelve la longitud escrita (sin '\0')
+static int format_telemetry(char *buf, size_t size, const photo_telemetry_t *tm)
+{
+    if (!tm)
+    {
+        if (size > 0)
+        {
+            buf[0] = '\0';
+        }
+        return 0;
+    }
+    return snprintf(buf, size, ",\"timestamp_us\":%llu,\"jpeg_quality\":%d,\"size_overshoots\":%lu",
+                    (unsigned long long)tm->timestamp_us, tm->jpeg_quality,
+                    (unsigned long)tm->size_overshoots);
+}
+
+size_t photo_stream_json_len(size_t jpeg_len, const char *device_id, const photo_telemetry_t *tm)
+{
+    return LIT_LEN(JSON_PREFIX_A) + strlen(device_id) + LIT_LEN(JSON_PREFIX_B) +
+           format_telemetry(NULL, 0, tm) + LIT_LEN(JSON_IMG) +
+           base64_len(jpeg_len) + LIT_LEN(JSON_SUFFIX);
+}
+
+static esp_err_t sink_put(const photo_sink_t *sink, const void *data, size_t len)
+{
+    return sink->write(sink->ctx, (const uint8_t *)data, len);
+}
+
+esp_err_t photo_stream_json(const uint8_t *jpeg, size_t jpeg_len, const char *device_id,
+                            const photo_telemetry_t *tm, const photo_sink_t *sink)
+{
+    // +1 porque mbedtls siempre añade el terminador nulo
+    unsigned char chunk[PHOTO_STREAM_CHUNK_OUT + 1];
+    char telemetry[96];
+    int telemetry_len = format_telemetry(telemetry, sizeof(telemetry), tm);
+    esp_err_t err;
+
+    if (telemetry_len < 0 || telemetry_len >= (int)sizeof(telemetry))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if ((err = sink_put(sink, JSON_PREFIX_A, LIT_LEN(JSON_PREFIX_A))) != ESP_OK ||
+        (err = sink_put(sink, device_id, strlen(device_id))) != ESP_OK ||
+        (err = sink_put(sink, JSON_PREFIX_B, LIT_LEN(JSON_PREFIX_B))) != ESP_OK ||
+        (err = sink_put(sink, telemetry, telemetry_len)) != ESP_OK ||
+        (err = sink_put(sink, JSON_IMG, LIT_LEN(JSON_IMG))) != ESP_OK)
+    {
+        return err;
+    }
+
+    // Codificar la imagen por trozos; cada trozo es múltiplo de 3 así que
+    // el padding '=' solo puede aparecer en el último
+    for (size_t off = 0; off < jpeg_len; off += PHOTO_STREAM_CHUNK_IN)
+    {
+        size_t in_len = jpeg_len - off;
+        if (in_len > PHOTO_STREAM_CHUNK_IN)
+        {
+            in_len = PHOTO_STREAM_CHUNK_IN;
+        }
+
+        size_t out_len = 0;
+        if (mbedtls_base64_encode(chunk, sizeof(chunk), &out_len, jpeg + off, in_len) != 0)
+        {
+            return ESP_FAIL;
+        }
+        if ((err = sink_put(sink, chunk, out_len)) != ESP_OK)
+        {
+            return err;
+        }
+    }
+
+    return sink_put(sink, JSON_SUFFIX, LIT_LEN(JSON_SUFFIX));
+}
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    put_le16(p, (uint16_t)v);
+    put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void put_le64(uint8_t *p, uint64_t v)
+{
+    put_le32(p, (uint32_t)v);
+    put_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+size_t photo_stream_binary_len(size_t frame_len)
+{
+    return PHOTO_BIN_HEADER_LEN + frame_len;
+}
+
+esp_err_t photo_stream_binary(const uint8_t *frame, size_t frame_len, const char *device_id,
+                              const photo_meta_t *meta, const photo_sink_t *sink)
+{
+    if ((uint64_t)frame_len > UINT32_MAX)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t hdr[PHOTO_BIN_HEADER_LEN] = {0};
+    hdr[0] = PHOTO_BIN_MAGIC0;
+    hdr[1] = PHOTO_BIN_MAGIC1;
+    hdr[2] = PHOTO_BIN_VERSION;
+    hdr[3] = meta->format;
+    put_le16(&hdr[4], PHOTO_BIN_HEADER_LEN);
+    put_le16(&hdr[6], meta->width);
+    put_le16(&hdr[8], meta->height);
+    put_le32(&hdr[12], meta->seq);
+    put_le64(&hdr[16], meta->timestamp_us);
+    put_le32(&hdr[24], (uint32_t)frame_len);
+    memcpy(&hdr[28], device_id, strnlen(device_id, PHOTO_BIN_DEVICE_ID_LEN));
+
+    esp_err_t err = sink_put(sink, hdr, sizeof(hdr));
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    return sink_put(sink, frame, frame_len);
+}
+
+esp_err_t photo_buf_sink_write(void *ctx, const uint8_t *data, size_t len)
+{
+    photo_buf_sink_t *s = (photo_buf_sink_t *)ctx;
+    if (len > s->cap - s->len)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(s->buf + s->len, data, len);
+    s->len += len;
+    return ESP_OK;
+}
+
+size_t photo_chunk_count(size_t frame_len, size_t chunk_size)
+{
+    return frame_len == 0 ? 1 : (frame_len + chunk_size - 1) / chunk_size;
+}
+
+esp_err_t photo_chunker_init(photo_chunker_t *chunker, uint8_t *buf, size_t buf_len, uint32_t boot_id,
+                             photo_chunk_publish_t publish, void *ctx)
+{
+    if (!buf || !publish || buf_len <= PHOTO_CHUNK_HEADER_LEN)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(chunker, 0, sizeof(*chunker));
+    chunker->buf = buf;
+    chunker->chunk_size = buf_len - PHOTO_CHUNK_HEADER_LEN;
+    chunker->publish = publish;
+    chunker->ctx = ctx;
+    chunker->boot_id = boot_id;
+    return ESP_OK;
+}
+
+esp_err_t photo_chunker_begin(photo_chunker_t *chunker, uint32_t frame_id, uint8_t content, size_t frame_len)
+{
+    size_t count = photo_chunk_count(frame_len, chunker->chunk_size);
+    if ((uint64_t)frame_len > UINT32_MAX || count > UINT16_MAX)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    chunker->frame_id = frame_id;
+    chunker->frame_len = (uint32_t)frame_len;
+    chunker->content = content;
+    chunker->offset = 0;
+    chunker->index = 0;
+    chunker->count = (uint16_t)count;
+    chunker->fill = 0;
+    chunker->msg_id = -1;
+    return ESP_OK;
+}
+
+// Completa la cabecera de la porción en curso y la publica
+static esp_err_t chunker_flush(photo_chunker_t *c)
+{
+    uint8_t *hdr = c->buf;
+    hdr[0] = PHOTO_CHUNK_MAGIC0;
+    hdr[1] = PHOTO_CHUNK_MAGIC1;
+    hdr[2] = PHOTO_CHUNK_VERSION;
+    hdr[3] = c->content;
+    put_le32(&hdr[4], c->boot_id);
+    put_le32(&hdr[8], c->frame_id);
+    put_le16(&hdr[12], c->index);
+    put_le16(&hdr[14], c->count);
+    put_le32(&hdr[16], c->frame_len);
+    put_le32(&hdr[20], c->offset);
+    put_le32(&hdr[24], esp_rom_crc32_le(0, hdr + PHOTO_CHUNK_HEADER_LEN, (uint32_t)c->fill));
+
+    int msg_id = c->publish(c->ctx, c->buf, PHOTO_CHUNK_HEADER_LEN + c->fill);
+    if (msg_id == -1)
+    {
+        return ESP_FAIL;
+    }
+    c->msg_id = msg_id;
+    c->offset += c->fill;
+    c->index++;
+    c->fill = 0;
+    return ESP_OK;
+}
+
+esp_err_t photo_chunker_write(void *ctx, const uint8_t *data, size_t len)
+{
+    photo_chunker_t *c = (photo_chunker_t *)ctx;
+    if (len > c->frame_len - c->offset - c->fill)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    while (len > 0)
+    {
+        size_t n = c->chunk_size - c->fill;
+        if (n > len)
+        {
+            n = len;
+        }
+        memcpy(c->buf + PHOTO_CHUNK_HEADER_LEN + c->fill, data, n);
+        c->fill += n;
+        data += n;
+        len -= n;
+
+        if (c->fill == c->chunk_size)
+        {
+            esp_err_t err = chunker_flush(c);
+            if (err != ESP_OK)
+            {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t photo_chunker_end(photo_chunker_t *chunker)
+{
+    if (chunker->offset + chunker->fill != chunker->frame_len)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // Porción final incompleta (o el único trozo de un frame vacío)
+    if (chunker->index < chunker->count)
+    {
+        return chunker_flush(chunker);
+    }
+    return ESP_OK;
+}
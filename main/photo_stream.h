@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bytes de JPEG codificados por cada trozo base64 (múltiplo de 3)
+#define PHOTO_STREAM_CHUNK_IN   384
+// Bytes base64 producidos por cada trozo completo
+#define PHOTO_STREAM_CHUNK_OUT  ((PHOTO_STREAM_CHUNK_IN / 3) * 4)
+
+// --- Formato binario (iot/telemetry/bin) ---
+// Cabecera fija little-endian seguida de los bytes crudos del frame:
+//   0  magic "TP"          2  versión (u8)       3  formato pixformat_t (u8)
+//   4  tamaño cabecera u16 6  ancho u16          8  alto u16
+//  10  flags u16 (0)      12  secuencia u32     16  timestamp captura en us u64
+//  24  tamaño payload u32 28  device_id char[32] (relleno con '\0')
+#define PHOTO_BIN_MAGIC0        'T'
+#define PHOTO_BIN_MAGIC1        'P'
+#define PHOTO_BIN_VERSION       1
+#define PHOTO_BIN_DEVICE_ID_LEN 32
+#define PHOTO_BIN_HEADER_LEN    (28 + PHOTO_BIN_DEVICE_ID_LEN)
+
+// --- Transferencia por trozos (iot/telemetry/chunk) ---
+// Cada mensaje lleva una cabecera fija little-endian y una porción del payload:
+//   0  magic "TC"          2  versión (u8)       3  contenido (u8, PHOTO_CHUNK_CONTENT_*)
+//   4  id de arranque u32  8  id de frame u32   12  índice u16        14  total de trozos u16
+//  16  tamaño frame u32   20  offset u32        24  crc32 de esta porción u32
+// El id de arranque es aleatorio en cada arranque: el receptor reensambla por
+// (id de arranque, id de frame), así que ni varios dispositivos en el mismo
+// topic ni un reinicio (que vuelve a numerar los frames) mezclan trozos.
+#define PHOTO_CHUNK_MAGIC0      'T'
+#define PHOTO_CHUNK_MAGIC1      'C'
+#define PHOTO_CHUNK_VERSION     2
+#define PHOTO_CHUNK_HEADER_LEN  28
+#define PHOTO_CHUNK_CONTENT_JSON    0   // Payload JSON completo
+#define PHOTO_CHUNK_CONTENT_BINARY  1   // Payload binario "TP" completo
+
+/**
+ * @brief Metadatos del frame que viajan en la cabecera binaria
+ */
+typedef struct {
+    uint32_t seq;           /*!< Número de secuencia del frame */
+    uint64_t timestamp_us;  /*!< Instante de captura (fb->timestamp) en microsegundos */
+    uint16_t width;         /*!< Ancho en píxeles */
+    uint16_t height;        /*!< Alto en píxeles */
+    uint8_t format;         /*!< pixformat_t del frame */
+} photo_meta_t;
+
+/**
+ * @brief Telemetría del frame incluida en el JSON
+ */
+typedef struct {
+    uint64_t timestamp_us;      /*!< Instante de captura original (se conserva al reenviar) */
+    int jpeg_quality;           /*!< Calidad actual del sensor (0-63) */
+    uint32_t size_overshoots;   /*!< Frames que superaron el presupuesto */
+} photo_telemetry_t;
+
+/**
+ * @brief Función de escritura del destino del stream
+ *
+ * Recibe trozos consecutivos del payload. Devolver algo distinto de
+ * ESP_OK aborta la escritura.
+ */
+typedef esp_err_t (*photo_sink_write_t)(void *ctx, const uint8_t *data, size_t len);
+
+/**
+ * @brief Destino genérico al que se vuelca el payload por trozos
+ */
+typedef struct {
+    photo_sink_write_t write;
+    void *ctx;
+} photo_sink_t;
+
+/**
+ * @brief Destino que escribe sobre un buffer de tamaño fijo ya reservado
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+} photo_buf_sink_t;
+
+/**
+ * @brief Publica un mensaje ya troceado; devuelve msg_id o -1
+ */
+typedef int (*photo_chunk_publish_t)(void *ctx, const uint8_t *msg, size_t len);
+
+/**
+ * @brief Trocea un payload en mensajes de tamaño acotado
+ *
+ * Se usa como photo_sink_t (con photo_chunker_write) entre begin y end:
+ * cada vez que se llena un trozo se publica y el buffer se reutiliza.
+ */
+typedef struct {
+    uint8_t *buf;                   /*!< Cabecera + porción en curso */
+    size_t chunk_size;              /*!< Bytes de payload por mensaje */
+    photo_chunk_publish_t publish;
+    void *ctx;
+    uint32_t boot_id;
+    uint32_t frame_id;
+    uint32_t frame_len;
+    uint32_t offset;                /*!< Bytes del frame ya publicados */
+    uint16_t index;                 /*!< Próximo trozo a publicar */
+    uint16_t count;                 /*!< Total de trozos del frame */
+    uint8_t content;
+    size_t fill;                    /*!< Bytes en la porción en curso */
+    int msg_id;                     /*!< msg_id del último trozo publicado */
+} photo_chunker_t;
+
+/**
+ * @brief Calcula el tamaño exacto del JSON que generará photo_stream_json()
+ *
+ * @param jpeg_len  Tamaño del JPEG en bytes
+ * @param device_id Identificador del dispositivo (sin caracteres a escapar)
+ * @param tm        Telemetría a incluir, o NULL para omitirla
+ */
+size_t photo_stream_json_len(size_t jpeg_len, const char *device_id, const photo_telemetry_t *tm);
+
+/**
+ * @brief Escribe el JSON {"device_id","access_method",[telemetría],"img"} por trozos
+ *
+ * La imagen se codifica en base64 de PHOTO_STREAM_CHUNK_IN en
+ * PHOTO_STREAM_CHUNK_IN bytes sobre un buffer de pila, sin copias
+ * intermedias del tamaño de la foto.
+ */
+esp_err_t photo_stream_json(const uint8_t *jpeg, size_t jpeg_len, const char *device_id,
+                            const photo_telemetry_t *tm, const photo_sink_t *sink);
+
+/**
+ * @brief Tamaño total del mensaje binario (cabecera + frame)
+ */
+size_t photo_stream_binary_len(size_t frame_len);
+
+/**
+ * @brief Escribe la cabecera binaria y a continuación el frame sin codificar
+ *
+ * Los bytes del frame se pasan directamente desde el buffer de origen.
+ */
+esp_err_t photo_stream_binary(const uint8_t *frame, size_t frame_len, const char *device_id,
+                              const photo_meta_t *meta, const photo_sink_t *sink);
+
+/**
+ * @brief Función de escritura para photo_buf_sink_t
+ */
+esp_err_t photo_buf_sink_write(void *ctx, const uint8_t *data, size_t len);
+
+/**
+ * @brief Número de trozos en que se divide un payload (al menos uno)
+ */
+size_t photo_chunk_count(size_t frame_len, size_t chunk_size);
+
+/**
+ * @brief Prepara el troceador sobre un buffer de PHOTO_CHUNK_HEADER_LEN + chunk_size bytes
+ *
+ * @param boot_id Identificador de este arranque (p.ej. esp_random()), igual en todos los trozos
+ */
+esp_err_t photo_chunker_init(photo_chunker_t *chunker, uint8_t *buf, size_t buf_len, uint32_t boot_id,
+                             photo_chunk_publish_t publish, void *ctx);
+
+/**
+ * @brief Empieza un frame nuevo del que se escribirán exactamente frame_len bytes
+ */
+esp_err_t photo_chunker_begin(photo_chunker_t *chunker, uint32_t frame_id, uint8_t content, size_t frame_len);
+
+/**
+ * @brief Función de escritura para photo_chunker_t
+ *
+ * Devuelve ESP_FAIL si la publicación de un trozo falla.
+ */
+esp_err_t photo_chunker_write(void *ctx, const uint8_t *data, size_t len);
+
+/**
+ * @brief Publica la última porción y comprueba que el frame se escribió entero
+ */
+esp_err_t photo_chunker_end(photo_chunker_t *chunker);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <string.h>
+#include "photo_trace.h"
+
+static const char *const SPAN_NAMES[PHOTO_TRACE_SPANS] = {
+    "capture", "encode", "publish", "ack", "total",
+};
+
+void photo_trace_init(photo_trace_t *trace, bool wait_ack)
+{
+    memset(trace, 0, sizeof(*trace));
+    portMUX_INITIALIZE(&trace->lock);
+    trace->wait_ack = wait_ack;
+    for (int i = 0; i < PHOTO_TRACE_SLOTS; i++)
+    {
+        trace->slots[i].msg_id = -1;
+    }
+    for (int i = 0; i < PHOTO_TRACE_EARLY_ACKS; i++)
+    {
+        trace->early_acks[i].msg_id = -1;
+    }
+}
+
+static void hist_add(photo_trace_hist_t *h, int64_t from_us, int64_t to_us)
+{
+    // Marca ausente (p.ej. frame del diario sin disparo propio)
+    if (from_us == 0 || to_us < from_us)
+    {
+        return;
+    }
+    uint64_t us = (uint64_t)(to_us - from_us);
+    uint32_t ms = (uint32_t)(us / 1000);
+    int bucket = ms ? 32 - __builtin_clz(ms) : 0;
+    if (bucket >= PHOTO_TRACE_BUCKETS)
+    {
+        bucket = PHOTO_TRACE_BUCKETS - 1;
+    }
+
+    h->buckets[bucket]++;
+    h->count++;
+    h->sum_us += us;
+    if (us > h->max_us)
+    {
+        h->max_us = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+    }
+}
+
+void photo_trace_trigger(photo_trace_t *trace, int64_t now_us)
+{
+    // int64_t no se escribe de forma atómica en Xtensa
+    portENTER_CRITICAL(&trace->lock);
+    trace->trigger_us = now_us;
+    portEXIT_CRITICAL(&trace->lock);
+}
+
+void photo_trace_mark(photo_trace_t *trace, uint32_t seq, photo_trace_point_t point, int64_t now_us)
+{
+    photo_trace_slot_t *slot = &trace->slots[seq % PHOTO_TRACE_SLOTS];
+
+    portENTER_CRITICAL(&trace->lock);
+    if (point == PHOTO_TRACE_CAPTURED)
+    {
+        // Primer instante del frame: el hueco pasa a ser suyo
+        memset(slot->t, 0, sizeof(slot->t));
+        slot->seq = seq;
+        slot->msg_id = -1;
+        slot->t[PHOTO_TRACE_TRIGGER] = trace->trigger_us;
+        slot->t[PHOTO_TRACE_CAPTURED] = now_us;
+        hist_add(&trace->hist[PHOTO_TRACE_SPAN_CAPTURE], slot->t[PHOTO_TRACE_TRIGGER], now_us);
+    }
+    else if (slot->seq == seq && point == PHOTO_TRACE_ENCODED)
+    {
+        slot->t[PHOTO_TRACE_ENCODED] = now_us;
+        hist_add(&trace->hist[PHOTO_TRACE_SPAN_ENCODE], slot->t[PHOTO_TRACE_CAPTURED], now_us);
+    }
+    portEXIT_CRITICAL(&trace->lock);
+}
+
+void photo_trace_published(photo_trace_t *trace, uint32_t seq, int msg_id, int64_t now_us)
+{
+    photo_trace_slot_t *slot = &trace->slots[seq % PHOTO_TRACE_SLOTS];
+
+    portENTER_CRITICAL(&trace->lock);
+    if (slot->seq == seq)
+    {
+        slot->t[PHOTO_TRACE_PUBLISHED] = now_us;
+        hist_add(&trace->hist[PHOTO_TRACE_SPAN_PUBLISH], slot->t[PHOTO_TRACE_ENCODED], now_us);
+
+        if (!trace->wait_ack || msg_id <= 0)
+        {
+            hist_add(&trace->hist[PHOTO_TRACE_SPAN_TOTAL], slot->t[PHOTO_TRACE_TRIGGER], now_us);
+        }
+        else
+        {
+            slot->msg_id = msg_id;
+            // La confirmación pudo llegar antes que el retorno del publish
+            for (int i = 0; i < PHOTO_TRACE_EARLY_ACKS; i++)
+            {
+                photo_trace_ack_t *ack = &trace->early_acks[i];
+                if (ack->msg_id == msg_id)
+                {
+                    ack->msg_id = -1;
+                    trace->unmatched_acks--;
+                    slot->msg_id = -1;
+                    slot->t[PHOTO_TRACE_ACKED] = ack->t_us;
+                    // Confirmado antes de retornar: la espera cuenta como nula
+                    hist_add(&trace->hist[PHOTO_TRACE_SPAN_ACK], now_us, now_us);
+                    hist_add(&trace->hist[PHOTO_TRACE_SPAN_TOTAL], slot->t[PHOTO_TRACE_TRIGGER], ack->t_us);
+                    break;
+                }
+            }
+        }
+    }
+    portEXIT_CRITICAL(&trace->lock);
+}
+
+void photo_trace_acked(photo_trace_t *trace, int msg_id, int64_t now_us)
+{
+    portENTER_CRITICAL(&trace->lock);
+    for (int i = 0; i < PHOTO_TRACE_SLOTS; i++)
+    {
+        photo_trace_slot_t *slot = &trace->slots[i];
+        if (slot->msg_id == msg_id && msg_id > 0)
+        {
+            slot->msg_id = -1;
+            slot->t[PHOTO_TRACE_ACKED] = now_us;
+            hist_add(&trace->hist[PHOTO_TRACE_SPAN_ACK], slot->t[PHOTO_TRACE_PUBLISHED], now_us);
+            hist_add(&trace->hist[PHOTO_TRACE_SPAN_TOTAL], slot->t[PHOTO_TRACE_TRIGGER], now_us);
+            portEXIT_CRITICAL(&trace->lock);
+            return;
+        }
+    }
+    // Se guarda por si su publish aún no ha retornado
+    if (msg_id > 0)
+    {
+        photo_trace_ack_t *ack = &trace->early_acks[trace->early_next++ % PHOTO_TRACE_EARLY_ACKS];
+        ack->msg_id = msg_id;
+        ack->t_us = now_us;
+    }
+    trace->unmatched_acks++;
+    portEXIT_CRITICAL(&trace->lock);
+}
+
+void photo_trace_snapshot(photo_trace_t *trace, photo_trace_hist_t hist[PHOTO_TRACE_SPANS],
+                          uint32_t *unmatched_acks)
+{
+    portENTER_CRITICAL(&trace->lock);
+    memcpy(hist, trace->hist, sizeof(trace->hist));
+    if (unmatched_acks)
+    {
+        *unmatched_acks = trace->unmatched_acks;
+    }
+    portEXIT_CRITICAL(&trace->lock);
+}
+
+const char *photo_trace_span_name(photo_trace_span_t span)
+{
+    return span < PHOTO_TRACE_SPANS ? SPAN_NAMES[span] : "?";
+}
+
+int photo_trace_format_json(photo_trace_t *trace, char *buf, size_t size)
+{
+    int total = 0;
+    photo_trace_hist_t hist[PHOTO_TRACE_SPANS];
+    uint32_t unmatched_acks;
+
+    photo_trace_snapshot(trace, hist, &unmatched_acks);
+
+    char scratch[1];
+    if (!buf)
+    {
+        size = 0;
+    }
+
+// Acumula como snprintf: sigue contando aunque el buffer se haya llenado
+#define APPEND(...)                                                             \
+    do                                                                          \
+    {                                                                           \
+        size_t off = (size_t)total < size ? (size_t)total : size;               \
+        size_t room = size - off;                                               \
+        int n = snprintf(room ? buf + off : scratch, room ? room : 1, __VA_ARGS__); \
+        if (n < 0)                                                              \
+        {                                                                       \
+            return n;                                                           \
+        }                                                                       \
+        total += n;                                                             \
+    } while (0)
+
+    APPEND("{");
+    for (int s = 0; s < PHOTO_TRACE_SPANS; s++)
+    {
+        const photo_trace_hist_t *h = &hist[s];
+        APPEND("%s\"%s\":{\"count\":%lu,\"avg_us\":%llu,\"max_us\":%lu,\"buckets_ms\":[",
+               s ? "," : "", SPAN_NAMES[s], (unsigned long)h->count,
+               (unsigned long long)(h->count ? h->sum_us / h->count : 0), (unsigned long)h->max_us);
+        for (int b = 0; b < PHOTO_TRACE_BUCKETS; b++)
+        {
+            APPEND("%s%lu", b ? "," : "", (unsigned long)h->buckets[b]);
+        }
+        APPEND("]}");
+    }
+    APPEND(",\"unmatched_acks\":%lu}", (unsigned long)unmatched_acks);
+#undef APPEND
+    return total;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Frames en vuelo cuyas marcas se conservan (hasta su confirmación)
+#define PHOTO_TRACE_SLOTS       8
+// Confirmaciones sin frame que se guardan por si llegan antes que el retorno del publish
+#define PHOTO_TRACE_EARLY_ACKS  8
+// Cubos del histograma: 0 = <1 ms, i = [2^(i-1), 2^i) ms, el último sin límite
+#define PHOTO_TRACE_BUCKETS     16
+
+/**
+ * @brief Instantes registrados para cada frame
+ */
+typedef enum {
+    PHOTO_TRACE_TRIGGER = 0,    /*!< Notificación del timer a la etapa de captura */
+    PHOTO_TRACE_CAPTURED,       /*!< Retorno de esp_camera_fb_get */
+    PHOTO_TRACE_ENCODED,        /*!< Payload completo (base64 + JSON, o binario) */
+    PHOTO_TRACE_PUBLISHED,      /*!< Retorno de esp_mqtt_client_publish */
+    PHOTO_TRACE_ACKED,          /*!< MQTT_EVENT_PUBLISHED del msg_id (QoS > 0) */
+    PHOTO_TRACE_POINTS,
+} photo_trace_point_t;
+
+/**
+ * @brief Intervalos medidos entre instantes
+ */
+typedef enum {
+    PHOTO_TRACE_SPAN_CAPTURE = 0,   /*!< TRIGGER -> CAPTURED */
+    PHOTO_TRACE_SPAN_ENCODE,        /*!< CAPTURED -> ENCODED */
+    PHOTO_TRACE_SPAN_PUBLISH,       /*!< ENCODED -> PUBLISHED (incluye la espera en cola) */
+    PHOTO_TRACE_SPAN_ACK,           /*!< PUBLISHED -> ACKED */
+    PHOTO_TRACE_SPAN_TOTAL,         /*!< TRIGGER -> ACKED (o PUBLISHED si no hay confirmación) */
+    PHOTO_TRACE_SPANS,
+} photo_trace_span_t;
+
+/**
+ * @brief Histograma de cubos fijos de un intervalo
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t buckets[PHOTO_TRACE_BUCKETS];
+} photo_trace_hist_t;
+
+/**
+ * @brief Marcas de un frame en vuelo
+ */
+typedef struct {
+    uint32_t seq;
+    int msg_id;                         /*!< Pendiente de confirmación, o -1 */
+    int64_t t[PHOTO_TRACE_POINTS];      /*!< esp_timer_get_time() de cada instante (0 = ausente) */
+} photo_trace_slot_t;
+
+/**
+ * @brief Confirmación que no encontró frame al llegar
+ */
+typedef struct {
+    int msg_id;                         /*!< -1 si el hueco está libre */
+    int64_t t_us;                       /*!< Instante de MQTT_EVENT_PUBLISHED */
+} photo_trace_ack_t;
+
+/**
+ * @brief Estado de la instrumentación
+ *
+ * Los huecos y el total se escriben desde las etapas del pipeline y desde
+ * la tarea de eventos MQTT (confirmaciones), así que todo acceso pasa por
+ * lock. Las secciones críticas son cortas y sin llamadas bloqueantes.
+ */
+typedef struct {
+    portMUX_TYPE lock;
+    bool wait_ack;                  /*!< El total se cierra en ACKED en lugar de PUBLISHED */
+    int64_t trigger_us;             /*!< Último disparo, pendiente de captura */
+    photo_trace_slot_t slots[PHOTO_TRACE_SLOTS];
+    photo_trace_hist_t hist[PHOTO_TRACE_SPANS];
+    photo_trace_ack_t early_acks[PHOTO_TRACE_EARLY_ACKS]; /*!< Anillo; la más antigua se pisa */
+    uint32_t early_next;            /*!< Siguiente hueco del anillo */
+    uint32_t unmatched_acks;        /*!< Confirmaciones sin frame (p.ej. trozos intermedios) */
+} photo_trace_t;
+
+/**
+ * @brief Inicializa la instrumentación
+ *
+ * @param wait_ack true si las publicaciones se confirman (QoS > 0)
+ */
+void photo_trace_init(photo_trace_t *trace, bool wait_ack);
+
+/**
+ * @brief Registra el disparo de una captura
+ */
+void photo_trace_trigger(photo_trace_t *trace, int64_t now_us);
+
+/**
+ * @brief Registra que el frame seq ha alcanzado un instante (CAPTURED o ENCODED)
+ */
+void photo_trace_mark(photo_trace_t *trace, uint32_t seq, photo_trace_point_t point, int64_t now_us);
+
+/**
+ * @brief Registra el retorno de la publicación del frame y su msg_id
+ *
+ * Con QoS 1 la confirmación puede llegar antes de que esp_mqtt_client_publish
+ * retorne: si photo_trace_acked ya la guardó, el frame se cierra aquí con ella.
+ */
+void photo_trace_published(photo_trace_t *trace, uint32_t seq, int msg_id, int64_t now_us);
+
+/**
+ * @brief Registra la confirmación de un msg_id
+ *
+ * Sin frame pendiente con ese msg_id, se guarda en early_acks y cuenta en
+ * unmatched_acks hasta que photo_trace_published la recoja.
+ */
+void photo_trace_acked(photo_trace_t *trace, int msg_id, int64_t now_us);
+
+/**
+ * @brief Copia coherente de los histogramas y del contador de confirmaciones sin frame
+ *
+ * @param hist         Destino de PHOTO_TRACE_SPANS histogramas
+ * @param unmatched_acks Destino del contador, o NULL
+ */
+void photo_trace_snapshot(photo_trace_t *trace, photo_trace_hist_t hist[PHOTO_TRACE_SPANS],
+                          uint32_t *unmatched_acks);
+
+/**
+ * @brief Nombre corto del intervalo (para logs e informes)
+ */
+const char *photo_trace_span_name(photo_trace_span_t span);
+
+/**
+ * @brief Escribe los histogramas como objeto JSON
+ *
+ * Formatea una copia tomada con photo_trace_snapshot, fuera de la sección crítica.
+ *
+ * @return Longitud escrita (sin '\0'), o la necesaria si no cabe como snprintf
+ */
+int photo_trace_format_json(photo_trace_t *trace, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
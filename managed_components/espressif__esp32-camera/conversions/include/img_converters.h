@@ -26,6 +26,16 @@ extern "C" {
 
 typedef size_t (* jpg_out_cb)(void * arg, size_t index, const void* data, size_t len);
 
+/**
+ * @brief How fmt2jpg_target() met its byte budget
+ */
+typedef struct {
+    uint8_t quality;            /*!< JPEG quality of the returned image */
+    size_t predicted_len;       /*!< Size the analysis pass predicted at that quality */
+    size_t actual_len;          /*!< Size of the returned image; over budget, an estimate (the encode stops at max_len) */
+    uint8_t encodes;            /*!< Full encodes: 1, or 2 after a corrective re-encode */
+} jpg_target_info_t;
+
 /**
  * @brief Convert image buffer to JPEG
  *
@@ -57,6 +67,9 @@ bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg);
 /**
  * @brief Convert image buffer to JPEG buffer
  *
+ * The buffer grows as the image is encoded and is trimmed to the JPEG size at the end.
+ * It comes from internal RAM, or PSRAM when that fails.
+ *
  * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
  * @param src_len   Length in bytes of the source buffer
  * @param width     Width in pixels of the source image
@@ -67,10 +80,49 @@ bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg);
  *                  You MUST free the pointer once you are done with it.
  * @param out_len   Pointer to be populated with the length of the output buffer
  *
- * @return true on success
+ * @return true on success, false if encoding fails or the buffer cannot grow
  */
 bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len);
 
+/**
+ * @brief Convert image buffer to JPEG buffer allocated from a given memory region
+ *
+ * Same as fmt2jpg(), with the output buffer grown and trimmed with heap_caps_realloc().
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Pointer to be populated with the address of the resulting buffer.
+ *                  You MUST free the pointer once you are done with it.
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ * @param caps      Memory region of the output (e.g. MALLOC_CAP_SPIRAM); 0 behaves as fmt2jpg()
+ *
+ * @return true on success, false if encoding fails or the buffer cannot grow
+ */
+bool fmt2jpg_caps(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len, uint32_t caps);
+
+/**
+ * @brief Convert image buffer to JPEG in a buffer supplied by the caller
+ *
+ * No memory is allocated for the output. The encoder still allocates its own line buffers.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param quality   JPEG quality of the resulting image
+ * @param buf       Output buffer
+ * @param buf_len   Size in bytes of the output buffer
+ * @param out_len   Pointer to be populated with the length of the JPEG
+ *
+ * @return true on success, false if encoding fails or the JPEG does not fit in buf_len bytes
+ */
+bool fmt2jpg_buf(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t * buf, size_t buf_len, size_t * out_len);
+
 /**
  * @brief Convert camera frame buffer to JPEG buffer
  *
@@ -83,6 +135,155 @@ bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixf
  */
 bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len);
 
+/**
+ * @brief Convert image buffer to a JPEG buffer with Huffman tables optimized for the image
+ *
+ * The image is transformed twice: the first pass counts the symbols, the second one codes
+ * them with tables built from the counts. The output is smaller than fmt2jpg() at the same
+ * quality (same pixels, only the entropy coding changes), at the cost of a second pass.
+ * Only with CONFIG_CAMERA_JPEG_OPTIMIZED_HUFFMAN; otherwise this is fmt2jpg().
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Pointer to be populated with the address of the resulting buffer.
+ *                  You MUST free the pointer once you are done with it.
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool fmt2jpg_optimized(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert camera frame buffer to a JPEG buffer with Huffman tables optimized for the image
+ *
+ * @param fb        Source camera frame buffer
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Pointer to be populated with the address of the resulting buffer.
+ *                  You MUST free the pointer once you are done with it.
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool frame2jpg_optimized(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert image buffer to a JPEG buffer of at most max_len bytes
+ *
+ * A cheap analysis pass transforms a sample of the blocks and predicts the size at every
+ * quality. The best quality predicted to fit is encoded once. When the result is over
+ * the budget, or well under it, the model is scaled by the error and the image is encoded
+ * once more; the best result within the budget is returned. An encode never holds more than
+ * max_len bytes: one that runs over stops at the first write past the budget, and its full
+ * size is extrapolated from how far into the image it got.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param max_len   Byte budget of the JPEG
+ * @param out       Pointer to be populated with the address of the resulting buffer.
+ *                  You MUST free the pointer once you are done with it.
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ * @param info      Optional, populated with the chosen quality and the predicted and actual
+ *                  sizes, also when the budget is not met
+ *
+ * @return true on success, false if encoding fails or not even quality 1 fits in max_len
+ */
+bool fmt2jpg_target(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, size_t max_len, uint8_t ** out, size_t * out_len, jpg_target_info_t * info);
+
+/**
+ * @brief Convert camera frame buffer to a JPEG buffer of at most max_len bytes
+ *
+ * @param fb        Source camera frame buffer
+ * @param max_len   Byte budget of the JPEG
+ * @param out       Pointer to be populated with the address of the resulting buffer
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ * @param info      Optional, populated with the chosen quality and the predicted and actual sizes
+ *
+ * @return true on success
+ */
+bool frame2jpg_target(camera_fb_t * fb, size_t max_len, uint8_t ** out, size_t * out_len, jpg_target_info_t * info);
+
+/**
+ * @brief Convert image buffer to a downscaled JPEG buffer
+ *
+ * Each output pixel is the mean of the source area it covers, computed line by line while
+ * the encoder is fed: no full-size intermediate is allocated and the encoder only sees
+ * the small image. Halves and quarters average exact 2x2 and 4x4 blocks; any other ratio
+ * averages rectangles of the nearest whole pixels.
+ *
+ * @param src        Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len    Length in bytes of the source buffer
+ * @param width      Width in pixels of the source image
+ * @param height     Height in pixels of the source image
+ * @param format     Format of the source image
+ * @param quality    JPEG quality of the resulting image
+ * @param out_width  Width in pixels of the JPEG, 1 to width (e.g. width / 2, width / 4)
+ * @param out_height Height in pixels of the JPEG, 1 to height
+ * @param out        Pointer to be populated with the address of the resulting buffer.
+ *                   You MUST free the pointer once you are done with it.
+ * @param out_len    Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success, false if encoding fails, src_len is shorter than the frame or the output is not a downscale
+ */
+bool fmt2jpg_scaled(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint16_t out_width, uint16_t out_height, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert camera frame buffer to a downscaled JPEG buffer
+ *
+ * @param fb         Source camera frame buffer
+ * @param quality    JPEG quality of the resulting image
+ * @param out_width  Width in pixels of the JPEG, 1 to fb->width
+ * @param out_height Height in pixels of the JPEG, 1 to fb->height
+ * @param out        Pointer to be populated with the address of the resulting buffer
+ * @param out_len    Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool frame2jpg_scaled(camera_fb_t * fb, uint8_t quality, uint16_t out_width, uint16_t out_height, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert image buffer to JPEG buffer, encoding horizontal bands on several tasks
+ *
+ * The image is cut at MCU-row boundaries into bands separated by restart markers (DRI/RSTn).
+ * Every band is entropy coded on its own and the bands are joined into one baseline JPEG.
+ * The calling task encodes bands as well; tasks - 1 helpers are started for the call,
+ * at the caller's priority and on any core.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Pointer to be populated with the address of the resulting buffer.
+ *                  You MUST free the pointer once you are done with it.
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ * @param tasks     Tasks encoding at once, the caller included; 0 for one per core.
+ *                  With 1, or an image too small for two bands, this is fmt2jpg()
+ *
+ * @return true on success
+ */
+bool fmt2jpg_parallel(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len, int tasks);
+
+/**
+ * @brief Convert camera frame buffer to JPEG buffer, encoding horizontal bands on several tasks
+ *
+ * @param fb        Source camera frame buffer
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Pointer to be populated with the address of the resulting buffer
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ * @param tasks     Tasks encoding at once, the caller included; 0 for one per core
+ *
+ * @return true on success
+ */
+bool frame2jpg_parallel(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len, int tasks);
+
 /**
  * @brief Convert image buffer to BMP buffer
  *
@@ -9,6 +9,7 @@
 //                       Code review revealed method load_block_16_8_8() (used for the non-default H2V1 sampling mode to downsample chroma) somehow didn't get the rounding factor fix from v1.02.
 
 #include "jpge.h"
+#include "jpge_kernels.h"
 
 #include <stdint.h>
 #include <stdarg.h>
@@ -39,10 +40,9 @@ namespace jpge {
     static inline void jpge_free(void *p) { free(p); }
 
     // Various JPEG enums and tables.
-    enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_APP0 = 0xE0 };
+    enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_RST0 = 0xD0, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_DRI = 0xDD, M_APP0 = 0xE0 };
     enum { DC_LUM_CODES = 12, AC_LUM_CODES = 256, DC_CHROMA_CODES = 12, AC_CHROMA_CODES = 256, MAX_HUFF_SYMBOLS = 257, MAX_HUFF_CODESIZE = 32 };
 
-    static const uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
     static const int16 s_std_lum_quant[64] = { 16,11,12,14,12,10,16,14,13,14,18,17,16,19,24,40,26,24,22,22,24,49,35,37,29,40,58,51,61,60,57,51,56,55,64,72,92,78,64,68,87,69,55,56,80,109,81,87,95,98,103,104,103,62,77,113,121,112,100,120,92,101,103,99 };
     static const int16 s_std_croma_quant[64] = { 17,18,18,24,21,24,47,26,26,47,99,66,56,66,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99 };
     static const uint8 s_dc_lum_bits[17] = { 0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
@@ -70,15 +70,6 @@ namespace jpge {
 
     const int YR = 19595, YG = 38470, YB = 7471, CB_R = -11059, CB_G = -21709, CB_B = 32768, CR_R = 32768, CR_G = -27439, CR_B = -5329;
 
-    static int32 m_last_quality = 0;
-    static int32 m_quantization_tables[2][64];
-
-    static bool m_huff_initialized = false;
-    static uint m_huff_codes[4][256];
-    static uint8 m_huff_code_sizes[4][256];
-    static uint8 m_huff_bits[4][17];
-    static uint8 m_huff_val[4][256];
-
     static inline uint8 clamp(int i) {
         if (i < 0) {
             i = 0;
@@ -88,15 +79,6 @@ namespace jpge {
         return static_cast<uint8>(i);
     }
 
-    static void RGB_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
-        for ( ; num_pixels; pDst += 3, pSrc += 3, num_pixels--) {
-            const int r = pSrc[0], g = pSrc[1], b = pSrc[2];
-            pDst[0] = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
-            pDst[1] = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
-            pDst[2] = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
-        }
-    }
-
     static void RGB_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
         for ( ; num_pixels; pDst++, pSrc += 3, num_pixels--) {
             pDst[0] = static_cast<uint8>((pSrc[0] * YR + pSrc[1] * YG + pSrc[2] * YB + 32768) >> 16);
@@ -111,76 +93,267 @@ namespace jpge {
         }
     }
 
-    // Forward DCT - DCT derived from jfdctint.
-    enum { CONST_BITS = 13, ROW_BITS = 2 };
-#define DCT_DESCALE(x, n) (((x) + (((int32)1) << ((n) - 1))) >> (n))
-#define DCT_MUL(var, c) (static_cast<int16>(var) * static_cast<int32>(c))
-#define DCT1D(s0, s1, s2, s3, s4, s5, s6, s7) \
-    int32 t0 = s0 + s7, t7 = s0 - s7, t1 = s1 + s6, t6 = s1 - s6, t2 = s2 + s5, t5 = s2 - s5, t3 = s3 + s4, t4 = s3 - s4; \
-    int32 t10 = t0 + t3, t13 = t0 - t3, t11 = t1 + t2, t12 = t1 - t2; \
-    int32 u1 = DCT_MUL(t12 + t13, 4433); \
-    s2 = u1 + DCT_MUL(t13, 6270); \
-    s6 = u1 + DCT_MUL(t12, -15137); \
-    u1 = t4 + t7; \
-    int32 u2 = t5 + t6, u3 = t4 + t6, u4 = t5 + t7; \
-    int32 z5 = DCT_MUL(u3 + u4, 9633); \
-    t4 = DCT_MUL(t4, 2446); t5 = DCT_MUL(t5, 16819); \
-    t6 = DCT_MUL(t6, 25172); t7 = DCT_MUL(t7, 12299); \
-    u1 = DCT_MUL(u1, -7373); u2 = DCT_MUL(u2, -20995); \
-    u3 = DCT_MUL(u3, -16069); u4 = DCT_MUL(u4, -3196); \
-    u3 += z5; u4 += z5; \
-    s0 = t10 + t11; s1 = t7 + u1 + u4; s3 = t6 + u2 + u3; s4 = t10 - t11; s5 = t5 + u2 + u4; s7 = t4 + u1 + u3;
-
-    static void DCT2D(int32 *p) {
-        int32 c, *q = p;
-        for (c = 7; c >= 0; c--, q += 8) {
-            int32 s0 = q[0], s1 = q[1], s2 = q[2], s3 = q[3], s4 = q[4], s5 = q[5], s6 = q[6], s7 = q[7];
-            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
-            q[0] = s0 << ROW_BITS; q[1] = DCT_DESCALE(s1, CONST_BITS-ROW_BITS); q[2] = DCT_DESCALE(s2, CONST_BITS-ROW_BITS); q[3] = DCT_DESCALE(s3, CONST_BITS-ROW_BITS);
-            q[4] = s4 << ROW_BITS; q[5] = DCT_DESCALE(s5, CONST_BITS-ROW_BITS); q[6] = DCT_DESCALE(s6, CONST_BITS-ROW_BITS); q[7] = DCT_DESCALE(s7, CONST_BITS-ROW_BITS);
-        }
-        for (q = p, c = 7; c >= 0; c--, q++) {
-            int32 s0 = q[0*8], s1 = q[1*8], s2 = q[2*8], s3 = q[3*8], s4 = q[4*8], s5 = q[5*8], s6 = q[6*8], s7 = q[7*8];
-            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
-            q[0*8] = DCT_DESCALE(s0, ROW_BITS+3); q[1*8] = DCT_DESCALE(s1, CONST_BITS+ROW_BITS+3); q[2*8] = DCT_DESCALE(s2, CONST_BITS+ROW_BITS+3); q[3*8] = DCT_DESCALE(s3, CONST_BITS+ROW_BITS+3);
-            q[4*8] = DCT_DESCALE(s4, ROW_BITS+3); q[5*8] = DCT_DESCALE(s5, CONST_BITS+ROW_BITS+3); q[6*8] = DCT_DESCALE(s6, CONST_BITS+ROW_BITS+3); q[7*8] = DCT_DESCALE(s7, CONST_BITS+ROW_BITS+3);
+    // RGB565 as delivered by the camera: big-endian, RRRRRGGG GGGBBBBB.
+    static inline void RGB565_unpack(const uint8 *pSrc, int &r, int &g, int &b) {
+        r = pSrc[0] & 0xF8;
+        g = ((pSrc[0] & 0x07) << 5) | ((pSrc[1] & 0xE0) >> 3);
+        b = (pSrc[1] & 0x1F) << 3;
+    }
+
+    static void RGB565_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst += 3, pSrc += 2, num_pixels--) {
+            int r, g, b;
+            RGB565_unpack(pSrc, r, g, b);
+            pDst[0] = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
+            pDst[1] = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
+            pDst[2] = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
+        }
+    }
+
+    static void RGB565_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst++, pSrc += 2, num_pixels--) {
+            int r, g, b;
+            RGB565_unpack(pSrc, r, g, b);
+            pDst[0] = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
+        }
+    }
+
+    // The camera's YUV422 is BT.601 studio range (Y 16..235, CbCr 16..240), JFIF wants full range.
+    // Stretching each channel is a table lookup; no round trip through RGB.
+    struct yuv_range_tables {
+        uint8 y[256];
+        uint8 c[256];
+
+        yuv_range_tables() {
+            for (int i = 0; i < 256; i++) {
+                y[i] = clamp(((i - 16) * 255 + 109) / 219);
+                int d = (i - 128) * 255;
+                c[i] = clamp(128 + (d >= 0 ? (d + 112) / 224 : -((-d + 112) / 224)));
+            }
+        }
+    };
+
+    static const yuv_range_tables &yuv_ranges()
+    {
+        static const yuv_range_tables tables;
+        return tables;
+    }
+
+    // YUYV (Y0 U Y1 V): both pixels of a pair share the chroma sample, so H2V1 averaging gives it back unchanged.
+    static void YUYV_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        const yuv_range_tables &t = yuv_ranges();
+        for ( ; num_pixels >= 2; pDst += 6, pSrc += 4, num_pixels -= 2) {
+            const uint8 cb = t.c[pSrc[1]], cr = t.c[pSrc[3]];
+            pDst[0] = t.y[pSrc[0]]; pDst[1] = cb; pDst[2] = cr;
+            pDst[3] = t.y[pSrc[2]]; pDst[4] = cb; pDst[5] = cr;
+        }
+        if (num_pixels) {
+            pDst[0] = t.y[pSrc[0]]; pDst[1] = t.c[pSrc[1]]; pDst[2] = 128;
+        }
+    }
+
+    static void YUYV_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        const yuv_range_tables &t = yuv_ranges();
+        for ( ; num_pixels; pDst++, pSrc += 2, num_pixels--) {
+            pDst[0] = t.y[pSrc[0]];
+        }
+    }
+
+    static void YUV_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        const yuv_range_tables &t = yuv_ranges();
+        for ( ; num_pixels; pDst += 3, pSrc += 3, num_pixels--) {
+            pDst[0] = t.y[pSrc[0]]; pDst[1] = t.c[pSrc[1]]; pDst[2] = t.c[pSrc[2]];
+        }
+    }
+
+    static void YUV_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        const yuv_range_tables &t = yuv_ranges();
+        for ( ; num_pixels; pDst++, pSrc += 3, num_pixels--) {
+            pDst[0] = t.y[pSrc[0]];
         }
     }
 
     // Compute the actual canonical Huffman codes/code sizes given the JPEG huff bits and val arrays.
-    static void compute_huffman_table(uint *codes, uint8 *code_sizes, uint8 *bits, uint8 *val)
+    static void compute_huffman_table(uint *codes, uint8 *code_sizes, const uint8 *bits, const uint8 *val)
     {
-        int i, l, last_p, si;
-        static uint8 huff_size[257];
-        static uint huff_code[257];
-        uint code;
+        memset(codes, 0, sizeof(codes[0])*256);
+        memset(code_sizes, 0, sizeof(code_sizes[0])*256);
 
+        uint code = 0;
         int p = 0;
-        for (l = 1; l <= 16; l++) {
-            for (i = 1; i <= bits[l]; i++) {
-                huff_size[p++] = (char)l;
+        for (int l = 1; l <= 16; l++) {
+            for (int i = 1; i <= bits[l]; i++, p++) {
+                codes[val[p]]      = code++;
+                code_sizes[val[p]] = static_cast<uint8>(l);
             }
+            code <<= 1;
         }
+    }
 
-        huff_size[p] = 0;
-        last_p = p; // write sentinel
+    // Huffman tables, indexed [0+0] DC luma, [0+1] DC chroma, [2+0] AC luma, [2+1] AC chroma.
+    struct huffman_tables {
+        const uint8 *bits[4];
+        const uint8 *val[4];
+        uint codes[4][256];
+        uint8 code_sizes[4][256];
 
-        code = 0; si = huff_size[0]; p = 0;
+        void compute_codes() {
+            for (int i = 0; i < 4; i++) {
+                compute_huffman_table(codes[i], code_sizes[i], bits[i], val[i]);
+            }
+        }
+    };
 
-        while (huff_size[p]) {
-            while (huff_size[p] == si) {
-                huff_code[p++] = code++;
+    // The standard tables are built once and never written again, so any number of encoders can share them.
+    static const huffman_tables &std_huffman_tables()
+    {
+        struct std_tables : huffman_tables {
+            std_tables() {
+                bits[0+0] = s_dc_lum_bits;    val[0+0] = s_dc_lum_val;
+                bits[2+0] = s_ac_lum_bits;    val[2+0] = s_ac_lum_val;
+                bits[0+1] = s_dc_chroma_bits; val[0+1] = s_dc_chroma_val;
+                bits[2+1] = s_ac_chroma_bits; val[2+1] = s_ac_chroma_val;
+                compute_codes();
             }
-            code <<= 1;
-            si++;
+        };
+        // C++11 guarantees a thread-safe one-time construction
+        static const std_tables tables;
+        return tables;
+    }
+
+    struct sym_freq {
+        uint m_key, m_sym_index;
+    };
+
+    // Tables of a two-pass encode: the first pass fills count, the second codes with tables built from it.
+    // Heap allocated with the encoder, as the sort scratch is too big for a camera task's stack.
+    struct optimized_huffman_tables {
+        uint32 count[4][256];
+        uint8 bits[4][17];
+        uint8 val[4][256];
+        huffman_tables tables;
+        sym_freq syms[2][MAX_HUFF_SYMBOLS];
+    };
+
+    // Radix sorts sym_freq[] array by 32-bit key m_key. Returns ptr to sorted values.
+    // Stable, so ties keep their input order.
+    static sym_freq* radix_sort_syms(uint num_syms, sym_freq* pSyms0, sym_freq* pSyms1)
+    {
+        uint max_key = 0;
+        for (uint i = 0; i < num_syms; i++) {
+            max_key = JPGE_MAX(max_key, pSyms0[i].m_key);
         }
+        sym_freq* pCur_syms = pSyms0, *pNew_syms = pSyms1;
+        for (uint pass_shift = 0; pass_shift < 32 && (max_key >> pass_shift); pass_shift += 8) {
+            uint offsets[256];
+            memset(offsets, 0, sizeof(offsets));
+            for (uint i = 0; i < num_syms; i++) {
+                offsets[(pCur_syms[i].m_key >> pass_shift) & 0xFF]++;
+            }
+            for (uint i = 0, cur_ofs = 0; i < 256; i++) {
+                uint n = offsets[i]; offsets[i] = cur_ofs; cur_ofs += n;
+            }
+            for (uint i = 0; i < num_syms; i++) {
+                pNew_syms[offsets[(pCur_syms[i].m_key >> pass_shift) & 0xFF]++] = pCur_syms[i];
+            }
+            sym_freq* t = pCur_syms; pCur_syms = pNew_syms; pNew_syms = t;
+        }
+        return pCur_syms;
+    }
 
-        memset(codes, 0, sizeof(codes[0])*256);
-        memset(code_sizes, 0, sizeof(code_sizes[0])*256);
-        for (p = 0; p < last_p; p++) {
-            codes[val[p]]      = huff_code[p];
-            code_sizes[val[p]] = huff_size[p];
+    // calculate_minimum_redundancy() originally written by: Alistair Moffat, alistair@cs.mu.oz.au, Jyrki Katajainen, jyrki@diku.dk, November 1996.
+    // In: A[] sorted by ascending frequency. Out: the code length of each symbol in m_key.
+    static void calculate_minimum_redundancy(sym_freq *A, int n)
+    {
+        int root, leaf, next, avbl, used, dpth;
+        if (n == 0) {
+            return;
+        } else if (n == 1) {
+            A[0].m_key = 1;
+            return;
+        }
+        A[0].m_key += A[1].m_key; root = 0; leaf = 2;
+        for (next = 1; next < n - 1; next++)
+        {
+            if (leaf >= n || A[root].m_key < A[leaf].m_key) { A[next].m_key = A[root].m_key; A[root++].m_key = next; } else A[next].m_key = A[leaf++].m_key;
+            if (leaf >= n || (root < next && A[root].m_key < A[leaf].m_key)) { A[next].m_key += A[root].m_key; A[root++].m_key = next; } else A[next].m_key += A[leaf++].m_key;
+        }
+        A[n - 2].m_key = 0;
+        for (next = n - 3; next >= 0; next--) A[next].m_key = A[A[next].m_key].m_key + 1;
+        avbl = 1; used = dpth = 0; root = n - 2; next = n - 1;
+        while (avbl > 0)
+        {
+            while (root >= 0 && (int)A[root].m_key == dpth) { used++; root--; }
+            while (avbl > used) { A[next--].m_key = dpth; avbl--; }
+            avbl = 2 * used; dpth++; used = 0;
+        }
+    }
+
+    // Limits canonical Huffman code table's max code size to max_code_size.
+    static void huffman_enforce_max_code_size(int *pNum_codes, int code_list_len, int max_code_size)
+    {
+        if (code_list_len <= 1) {
+            return;
+        }
+        for (int i = max_code_size + 1; i <= MAX_HUFF_CODESIZE; i++) pNum_codes[max_code_size] += pNum_codes[i];
+        uint32 total = 0;
+        for (int i = max_code_size; i > 0; i--) total += (((uint32)pNum_codes[i]) << (max_code_size - i));
+        while (total != (1UL << max_code_size))
+        {
+            pNum_codes[max_code_size]--;
+            for (int i = max_code_size - 1; i > 0; i--)
+            {
+                if (pNum_codes[i]) { pNum_codes[i]--; pNum_codes[i + 1] += 2; break; }
+            }
+            total--;
+        }
+    }
+
+    // Steps are closer at the top, where the size grows fastest with the quality.
+    const uint8 size_estimate::s_qualities[size_estimate::NUM_QUALITIES] = { 1, 5, 10, 20, 30, 40, 50, 60, 70, 80, 85, 90, 95, 100 };
+
+    // Quantizers of every ladder quality, and the DC predictions of each, for an analysis pass.
+    struct analysis_tables {
+        uint32 recip[size_estimate::NUM_QUALITIES][2][64];
+        uint16 bias[size_estimate::NUM_QUALITIES][2][64];
+        int last_dc[size_estimate::NUM_QUALITIES][3];
+    };
+
+    // At least this many MCUs are sampled, when the image has them: the middle MCU of every
+    // stride x stride cell, with the stride at most ANALYSIS_MAX_STRIDE.
+    enum { ANALYSIS_MIN_MCUS = 32, ANALYSIS_MAX_STRIDE = 4 };
+
+    size_estimate::size_estimate() : sampled_blocks(0), total_blocks(0), header_bytes(0)
+    {
+        memset(bits, 0, sizeof(bits));
+    }
+
+    size_t size_estimate::predict(int quality) const
+    {
+        if (!sampled_blocks) {
+            return header_bytes;
+        }
+        quality = JPGE_MIN(JPGE_MAX(quality, 1), 100);
+        int i = 0;
+        while (i < NUM_QUALITIES - 2 && s_qualities[i + 1] < quality) {
+            i++;
+        }
+        const int q0 = s_qualities[i], q1 = s_qualities[i + 1];
+        const long long step = (long long)bits[i + 1] - (long long)bits[i];
+        const uint64 b = bits[i] + step * (quality - q0) / (q1 - q0);
+        // Sampled bits scaled to every block, plus about one stuffed zero per 256 bytes
+        const uint64 bytes = (b * total_blocks / sampled_blocks + 7) / 8;
+        return header_bytes + bytes + bytes / 256;
+    }
+
+    int size_estimate::quality_for(size_t max_len, uint32 num, uint32 den) const
+    {
+        for (int q = 100; q >= 1; q--) {
+            if ((uint64)predict(q) * num / den <= max_len) {
+                return q;
+            }
         }
+        return 0;
     }
 
     void jpeg_encoder::flush_output_buffer()
@@ -200,19 +373,63 @@ namespace jpge {
         }
     }
 
-    void jpeg_encoder::put_bits(uint bits, uint len)
+    // Four bytes of entropy-coded data, 0xFF-stuffed. Most words have no 0xFF byte (that is, ~w has
+    // no zero byte) and go out with four stores; the window always has room for a stuffed word,
+    // and keeps a free byte after it for emit_byte(), which only flushes once the window is full.
+    void jpeg_encoder::emit_bit_word(uint32 w)
     {
-        uint8 c = 0;
-        m_bit_buffer |= ((uint32)bits << (24 - (m_bits_in += len)));
+        if (m_out_buf_left <= 8) {
+            flush_output_buffer();
+        }
+        uint8 *p = m_pOut_buf;
+        uint n = 4;
+        if (((~w - 0x01010101U) & w & 0x80808080U) == 0) {
+            p[0] = uint8(w >> 24); p[1] = uint8(w >> 16); p[2] = uint8(w >> 8); p[3] = uint8(w);
+        } else {
+            n = 0;
+            for (int s = 24; s >= 0; s -= 8) {
+                const uint8 c = uint8(w >> s);
+                p[n++] = c;
+                if (c == 0xFF) {
+                    p[n++] = 0;
+                }
+            }
+        }
+        m_pOut_buf += n;
+        m_out_buf_left -= n;
+    }
+
+    // Bits collect at the bottom of the 64-bit buffer; at most 31 are pending between calls and
+    // len is at most 32, so whole words are taken off the top.
+    inline void jpeg_encoder::put_bits(uint bits, uint len)
+    {
+        m_bit_buffer = (m_bit_buffer << len) | bits;
+        if ((m_bits_in += len) >= 32) {
+            m_bits_in -= 32;
+            emit_bit_word(uint32(m_bit_buffer >> m_bits_in));
+        }
+    }
+
+    // Huffman code followed by the low nbits of value, in one put_bits() (at most 16 + 11 bits).
+    inline void jpeg_encoder::put_code(uint code, uint code_len, int value, uint nbits)
+    {
+        put_bits((code << nbits) | (value & ((1 << nbits) - 1)), code_len + nbits);
+    }
+
+    // Pad the last byte with 1s and write out the pending whole bytes; the rest of the padding is dropped.
+    void jpeg_encoder::flush_bits()
+    {
+        put_bits(0x7F, 7);
         while (m_bits_in >= 8) {
-            c = (uint8)((m_bit_buffer >> 16) & 0xFF);
+            m_bits_in -= 8;
+            const uint8 c = uint8(m_bit_buffer >> m_bits_in);
             emit_byte(c);
             if (c == 0xFF) {
                 emit_byte(0);
             }
-            m_bit_buffer <<= 8;
-            m_bits_in -= 8;
         }
+        m_bit_buffer = 0;
+        m_bits_in = 0;
     }
 
     void jpeg_encoder::emit_word(uint i)
@@ -251,7 +468,7 @@ namespace jpge {
             emit_word(64 + 1 + 2);
             emit_byte(static_cast<uint8>(i));
             for (int j = 0; j < 64; j++)
-                emit_byte(static_cast<uint8>(m_quantization_tables[i][j]));
+                emit_byte(m_quantization_tables[i][j]);
         }
     }
 
@@ -273,7 +490,7 @@ namespace jpge {
     }
 
     // Emit Huffman table.
-    void jpeg_encoder::emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag)
+    void jpeg_encoder::emit_dht(const uint8 *bits, const uint8 *val, int index, bool ac_flag)
     {
         emit_marker(M_DHT);
 
@@ -294,11 +511,11 @@ namespace jpge {
     // Emit all Huffman tables.
     void jpeg_encoder::emit_dhts()
     {
-        emit_dht(m_huff_bits[0+0], m_huff_val[0+0], 0, false);
-        emit_dht(m_huff_bits[2+0], m_huff_val[2+0], 0, true);
+        emit_dht(m_huff->bits[0+0], m_huff->val[0+0], 0, false);
+        emit_dht(m_huff->bits[2+0], m_huff->val[2+0], 0, true);
         if (m_num_components == 3) {
-            emit_dht(m_huff_bits[0+1], m_huff_val[0+1], 1, false);
-            emit_dht(m_huff_bits[2+1], m_huff_val[2+1], 1, true);
+            emit_dht(m_huff->bits[0+1], m_huff->val[0+1], 1, false);
+            emit_dht(m_huff->bits[2+1], m_huff->val[2+1], 1, true);
         }
     }
 
@@ -321,6 +538,39 @@ namespace jpge {
         emit_byte(0);
     }
 
+    // Emit restart interval, in MCUs
+    void jpeg_encoder::emit_dri()
+    {
+        emit_marker(M_DRI);
+        emit_word(4);
+        emit_word(m_params.m_restart_rows * m_mcus_per_row);
+    }
+
+    // Close the current restart interval: pad to a byte with 1s, RSTn, and the DC predictions start over.
+    // The statistics pass writes nothing but must see the same DC differences.
+    void jpeg_encoder::emit_restart()
+    {
+        if (m_pass_num == 2) {
+            flush_bits();
+            emit_marker(M_RST0 + (m_restart_count++ & 7));
+        }
+        memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+    }
+
+    // Emit all markers at beginning of image file.
+    void jpeg_encoder::emit_headers()
+    {
+        emit_marker(M_SOI);
+        emit_jfif_app0();
+        emit_dqt();
+        emit_sof();
+        emit_dhts();
+        if (m_params.m_restart_rows) {
+            emit_dri();
+        }
+        emit_sos();
+    }
+
     void jpeg_encoder::load_block_8_8_grey(int x)
     {
         uint8 *pSrc;
@@ -381,47 +631,64 @@ namespace jpge {
         }
     }
 
-    void jpeg_encoder::load_quantized_coefficients(int component_num)
+    // Counts the symbols code_coefficients_pass_two() would write.
+    void jpeg_encoder::code_coefficients_pass_one(int component_num)
     {
-        int32 *q = m_quantization_tables[component_num > 0];
-        int16 *pDst = m_coefficient_array;
-        for (int i = 0; i < 64; i++)
+        int i, run_len, nbits, temp1;
+        int16 *pSrc = m_coefficient_array;
+        uint32 *dc_count = m_huff_opt->count[0 + (component_num > 0)];
+        uint32 *ac_count = m_huff_opt->count[2 + (component_num > 0)];
+
+        temp1 = pSrc[0] - m_last_dc_val[component_num];
+        m_last_dc_val[component_num] = pSrc[0];
+        if (temp1 < 0) temp1 = -temp1;
+
+        nbits = 0;
+        while (temp1)
         {
-            sample_array_t j = m_sample_array[s_zag[i]];
-            if (j < 0)
-            {
-                if ((j = -j + (*q >> 1)) < *q)
-                    *pDst++ = 0;
-                else
-                    *pDst++ = static_cast<int16>(-(j / *q));
-            }
+            nbits++; temp1 >>= 1;
+        }
+
+        dc_count[nbits]++;
+        for (run_len = 0, i = 1; i < 64; i++)
+        {
+            if ((temp1 = m_coefficient_array[i]) == 0)
+                run_len++;
             else
             {
-                if ((j = j + (*q >> 1)) < *q)
-                    *pDst++ = 0;
-                else
-                    *pDst++ = static_cast<int16>((j / *q));
+                while (run_len >= 16)
+                {
+                    ac_count[0xF0]++;
+                    run_len -= 16;
+                }
+                if (temp1 < 0) temp1 = -temp1;
+                nbits = 1;
+                while (temp1 >>= 1)
+                    nbits++;
+                ac_count[(run_len << 4) + nbits]++;
+                run_len = 0;
             }
-            q++;
         }
+        if (run_len)
+            ac_count[0]++;
     }
 
     void jpeg_encoder::code_coefficients_pass_two(int component_num)
     {
         int i, j, run_len, nbits, temp1, temp2;
         int16 *pSrc = m_coefficient_array;
-        uint *codes[2];
-        uint8 *code_sizes[2];
+        const uint *codes[2];
+        const uint8 *code_sizes[2];
 
         if (component_num == 0)
         {
-            codes[0] = m_huff_codes[0 + 0]; codes[1] = m_huff_codes[2 + 0];
-            code_sizes[0] = m_huff_code_sizes[0 + 0]; code_sizes[1] = m_huff_code_sizes[2 + 0];
+            codes[0] = m_huff->codes[0 + 0]; codes[1] = m_huff->codes[2 + 0];
+            code_sizes[0] = m_huff->code_sizes[0 + 0]; code_sizes[1] = m_huff->code_sizes[2 + 0];
         }
         else
         {
-            codes[0] = m_huff_codes[0 + 1]; codes[1] = m_huff_codes[2 + 1];
-            code_sizes[0] = m_huff_code_sizes[0 + 1]; code_sizes[1] = m_huff_code_sizes[2 + 1];
+            codes[0] = m_huff->codes[0 + 1]; codes[1] = m_huff->codes[2 + 1];
+            code_sizes[0] = m_huff->code_sizes[0 + 1]; code_sizes[1] = m_huff->code_sizes[2 + 1];
         }
 
         temp1 = temp2 = pSrc[0] - m_last_dc_val[component_num];
@@ -438,8 +705,7 @@ namespace jpge {
             nbits++; temp1 >>= 1;
         }
 
-        put_bits(codes[0][nbits], code_sizes[0][nbits]);
-        if (nbits) put_bits(temp2 & ((1 << nbits) - 1), nbits);
+        put_code(codes[0][nbits], code_sizes[0][nbits], temp2, nbits);
 
         for (run_len = 0, i = 1; i < 64; i++)
         {
@@ -461,8 +727,7 @@ namespace jpge {
                 while (temp1 >>= 1)
                     nbits++;
                 j = (run_len << 4) + nbits;
-                put_bits(codes[1][j], code_sizes[1][j]);
-                put_bits(temp2 & ((1 << nbits) - 1), nbits);
+                put_code(codes[1][j], code_sizes[1][j], temp2, nbits);
                 run_len = 0;
             }
         }
@@ -472,30 +737,79 @@ namespace jpge {
 
     void jpeg_encoder::code_block(int component_num)
     {
-        DCT2D(m_sample_array);
-        load_quantized_coefficients(component_num);
-        code_coefficients_pass_two(component_num);
+        if (m_pEstimate) {
+            estimate_block(component_num);
+            return;
+        }
+        const int t = component_num > 0;
+        m_kernels->fdct_quantize(m_coefficient_array, m_sample_array, m_quant_recip[t], m_quant_bias[t]);
+        if (m_pass_num == 1)
+            code_coefficients_pass_one(component_num);
+        else
+            code_coefficients_pass_two(component_num);
+    }
+
+    // Bits code_coefficients_pass_two() would write for m_coefficient_array.
+    uint jpeg_encoder::count_block_bits(int component_num, int *pLast_dc) const
+    {
+        const int t = component_num > 0;
+        const uint8 *dc_sizes = m_huff->code_sizes[0 + t];
+        const uint8 *ac_sizes = m_huff->code_sizes[2 + t];
+
+        int v = m_coefficient_array[0] - *pLast_dc;
+        *pLast_dc = m_coefficient_array[0];
+        uint nbits = v ? 32 - __builtin_clz((v < 0) ? -v : v) : 0;
+        uint bits = dc_sizes[nbits] + nbits;
+
+        int run_len = 0;
+        for (int i = 1; i < 64; i++) {
+            if ((v = m_coefficient_array[i]) == 0) {
+                run_len++;
+                continue;
+            }
+            nbits = 32 - __builtin_clz((v < 0) ? -v : v);
+            bits += (run_len >> 4) * ac_sizes[0xF0] + ac_sizes[((run_len & 15) << 4) + nbits] + nbits;
+            run_len = 0;
+        }
+        if (run_len) {
+            bits += ac_sizes[0];
+        }
+        return bits;
+    }
+
+    // One DCT, then the block is quantized and counted at every ladder quality.
+    void jpeg_encoder::estimate_block(int component_num)
+    {
+        const int t = component_num > 0;
+        fdct(m_sample_array);
+        for (int k = 0; k < size_estimate::NUM_QUALITIES; k++) {
+            m_kernels->quantize(m_coefficient_array, m_sample_array, m_analysis->recip[k][t], m_analysis->bias[k][t]);
+            m_pEstimate->bits[k] += count_block_bits(component_num, &m_analysis->last_dc[k][component_num]);
+        }
+        m_pEstimate->sampled_blocks++;
     }
 
     void jpeg_encoder::process_mcu_row()
     {
+        const int step = m_pEstimate ? m_sample_stride : 1;
+        const int first = m_pEstimate ? m_sample_stride / 2 : 0;
         if (m_num_components == 1)
         {
-            for (int i = 0; i < m_mcus_per_row; i++)
+            for (int i = first; i < m_mcus_per_row; i += step)
             {
                 load_block_8_8_grey(i); code_block(0);
             }
         }
         else if ((m_comp_h_samp[0] == 1) && (m_comp_v_samp[0] == 1))
         {
-            for (int i = 0; i < m_mcus_per_row; i++)
+            for (int i = first; i < m_mcus_per_row; i += step)
             {
                 load_block_8_8(i, 0, 0); code_block(0); load_block_8_8(i, 0, 1); code_block(1); load_block_8_8(i, 0, 2); code_block(2);
             }
         }
         else if ((m_comp_h_samp[0] == 2) && (m_comp_v_samp[0] == 1))
         {
-            for (int i = 0; i < m_mcus_per_row; i++)
+            for (int i = first; i < m_mcus_per_row; i += step)
             {
                 load_block_8_8(i * 2 + 0, 0, 0); code_block(0); load_block_8_8(i * 2 + 1, 0, 0); code_block(0);
                 load_block_16_8_8(i, 1); code_block(1); load_block_16_8_8(i, 2); code_block(2);
@@ -503,7 +817,7 @@ namespace jpge {
         }
         else if ((m_comp_h_samp[0] == 2) && (m_comp_v_samp[0] == 2))
         {
-            for (int i = 0; i < m_mcus_per_row; i++)
+            for (int i = first; i < m_mcus_per_row; i += step)
             {
                 load_block_8_8(i * 2 + 0, 0, 0); code_block(0); load_block_8_8(i * 2 + 1, 0, 0); code_block(0);
                 load_block_8_8(i * 2 + 0, 1, 0); code_block(0); load_block_8_8(i * 2 + 1, 1, 0); code_block(0);
@@ -519,15 +833,21 @@ namespace jpge {
         uint8* pDst = m_mcu_lines[m_mcu_y_ofs]; // OK to write up to m_image_bpl_xlt bytes to pDst
 
         if (m_num_components == 1) {
-            if (m_image_bpp == 3)
-                RGB_to_Y(pDst, Psrc, m_image_x);
-            else
-                memcpy(pDst, Psrc, m_image_x);
+            switch (m_src_format) {
+                case SRC_RGB:    RGB_to_Y(pDst, Psrc, m_image_x); break;
+                case SRC_YUYV:   YUYV_to_Y(pDst, Psrc, m_image_x); break;
+                case SRC_YUV:    YUV_to_Y(pDst, Psrc, m_image_x); break;
+                case SRC_RGB565: RGB565_to_Y(pDst, Psrc, m_image_x); break;
+                default:         memcpy(pDst, Psrc, m_image_x); break;
+            }
         } else {
-            if (m_image_bpp == 3)
-                RGB_to_YCC(pDst, Psrc, m_image_x);
-            else
-                Y_to_YCC(pDst, Psrc, m_image_x);
+            switch (m_src_format) {
+                case SRC_RGB:    m_kernels->rgb_to_ycc(pDst, Psrc, m_image_x); break;
+                case SRC_YUYV:   YUYV_to_YCC(pDst, Psrc, m_image_x); break;
+                case SRC_YUV:    YUV_to_YCC(pDst, Psrc, m_image_x); break;
+                case SRC_RGB565: RGB565_to_YCC(pDst, Psrc, m_image_x); break;
+                default:         Y_to_YCC(pDst, Psrc, m_image_x); break;
+            }
         }
 
         // Possibly duplicate pixels at end of scanline if not a multiple of 8 or 16
@@ -547,26 +867,97 @@ namespace jpge {
         {
             process_mcu_row();
             m_mcu_y_ofs = 0;
+            ++m_mcu_row;
+            if (m_params.m_restart_rows && (m_mcu_row % m_params.m_restart_rows) == 0 && m_mcu_row < m_mcu_rows)
+                emit_restart();
+        }
+    }
+
+    // Generates an optimized Huffman table from the symbol counts of the first pass.
+    void jpeg_encoder::optimize_huffman_table(int table_num, int table_len)
+    {
+        sym_freq *syms0 = m_huff_opt->syms[0], *syms1 = m_huff_opt->syms[1];
+        syms0[0].m_key = 1; syms0[0].m_sym_index = 0;  // dummy symbol, assures that no valid code contains all 1's
+        int num_used_syms = 1;
+        const uint32 *pSym_count = m_huff_opt->count[table_num];
+        for (int i = 0; i < table_len; i++)
+            if (pSym_count[i]) { syms0[num_used_syms].m_key = pSym_count[i]; syms0[num_used_syms++].m_sym_index = i + 1; }
+        sym_freq* pSyms = radix_sort_syms(num_used_syms, syms0, syms1);
+        calculate_minimum_redundancy(pSyms, num_used_syms);
+
+        // Count the # of symbols of each code size.
+        int num_codes[1 + MAX_HUFF_CODESIZE];
+        memset(num_codes, 0, sizeof(num_codes));
+        for (int i = 0; i < num_used_syms; i++)
+            num_codes[pSyms[i].m_key]++;
+
+        const uint JPGE_CODE_SIZE_LIMIT = 16;
+        huffman_enforce_max_code_size(num_codes, num_used_syms, JPGE_CODE_SIZE_LIMIT);
+
+        // Compute the bits array, which contains the # of symbols per code size.
+        uint8 *bits = m_huff_opt->bits[table_num];
+        memset(bits, 0, sizeof(m_huff_opt->bits[0]));
+        for (int i = 1; i <= (int)JPGE_CODE_SIZE_LIMIT; i++)
+            bits[i] = static_cast<uint8>(num_codes[i]);
+
+        // Remove the dummy symbol added above, which must be in largest bucket.
+        for (int i = JPGE_CODE_SIZE_LIMIT; i >= 1; i--)
+        {
+            if (bits[i]) { bits[i]--; break; }
         }
+
+        // Compute the val array, which contains the symbol indices sorted by code size (smallest to largest).
+        for (int i = num_used_syms - 1; i >= 1; i--)
+            m_huff_opt->val[table_num][num_used_syms - 1 - i] = static_cast<uint8>(pSyms[i].m_sym_index - 1);
+    }
+
+    // End of the statistics pass: code with the optimized tables from the top of the image.
+    bool jpeg_encoder::second_pass_init()
+    {
+        optimize_huffman_table(0 + 0, DC_LUM_CODES);
+        optimize_huffman_table(2 + 0, AC_LUM_CODES);
+        optimize_huffman_table(0 + 1, DC_CHROMA_CODES);
+        optimize_huffman_table(2 + 1, AC_CHROMA_CODES);
+        huffman_tables &tables = m_huff_opt->tables;
+        for (int i = 0; i < 4; i++) {
+            tables.bits[i] = m_huff_opt->bits[i];
+            tables.val[i] = m_huff_opt->val[i];
+        }
+        tables.compute_codes();
+        m_huff = &tables;
+
+        m_mcu_row = 0;
+        m_mcu_y_ofs = 0;
+        m_restart_count = 0;
+        memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+        m_pass_num = 2;
+        emit_headers();
+        return m_all_stream_writes_succeeded;
     }
 
     // Quantization table generation.
-    void jpeg_encoder::compute_quant_table(int32 *pDst, const int16 *pSrc)
+    void jpeg_encoder::compute_quant_table(uint8 *pDst, const int16 *pSrc, int quality)
     {
         int32 q;
-        if (m_params.m_quality < 50)
-            q = 5000 / m_params.m_quality;
+        if (quality < 50)
+            q = 5000 / quality;
         else
-            q = 200 - m_params.m_quality * 2;
+            q = 200 - quality * 2;
         for (int i = 0; i < 64; i++)
         {
             int32 j = *pSrc++; j = (j * q + 50L) / 100L;
-            *pDst++ = JPGE_MIN(JPGE_MAX(j, 1), 255);
+            *pDst++ = static_cast<uint8>(JPGE_MIN(JPGE_MAX(j, 1), 255));
         }
     }
 
     // Higher-level methods.
-    bool jpeg_encoder::jpg_open(int p_x_res, int p_y_res, int src_channels)
+    int jpeg_encoder::mcu_height(subsampling_t subsampling)
+    {
+        return (subsampling == H2V2) ? 16 : 8;
+    }
+
+    // band < 0 encodes the whole image.
+    bool jpeg_encoder::jpg_open(int p_x_res, int p_y_res, source_format_t src_format, int band)
     {
         m_num_components = 3;
         switch (m_params.m_subsampling)
@@ -604,39 +995,72 @@ namespace jpge {
         }
 
         m_image_x        = p_x_res; m_image_y = p_y_res;
-        m_image_bpp      = src_channels;
-        m_image_bpl      = m_image_x * src_channels;
+        m_src_format     = src_format;
+        m_image_bpp      = source_bytes_per_pixel(src_format);
+        m_image_bpl      = m_image_x * m_image_bpp;
         m_image_x_mcu    = (m_image_x + m_mcu_x - 1) & (~(m_mcu_x - 1));
         m_image_y_mcu    = (m_image_y + m_mcu_y - 1) & (~(m_mcu_y - 1));
         m_image_bpl_xlt  = m_image_x * m_num_components;
         m_image_bpl_mcu  = m_image_x_mcu * m_num_components;
         m_mcus_per_row   = m_image_x_mcu / m_mcu_x;
+        m_mcu_rows       = m_image_y_mcu / m_mcu_y;
+
+        // The restart interval is a 16-bit MCU count
+        if (m_params.m_restart_rows * m_mcus_per_row > 0xFFFF) {
+            return false;
+        }
+        if (band < 0) {
+            m_mcu_row = 0;
+            m_restart_count = 0;
+            m_last_band = true;
+        } else {
+            m_mcu_row = band * m_params.m_restart_rows;
+            m_restart_count = band;
+            m_last_band = (m_mcu_row + m_params.m_restart_rows >= m_mcu_rows);
+            if (m_mcu_row >= m_mcu_rows) {
+                return false;
+            }
+        }
 
-        if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL) {
+        // MCU lines and the output window in one block
+        if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y + JPGE_OUT_BUF_SIZE))) == NULL) {
             return false;
         }
         for (int i = 1; i < m_mcu_y; i++)
             m_mcu_lines[i] = m_mcu_lines[i-1] + m_image_bpl_mcu;
+        m_out_buf = m_mcu_lines[0] + m_image_bpl_mcu * m_mcu_y;
 
-        if(m_last_quality != m_params.m_quality){
-            m_last_quality = m_params.m_quality;
-            compute_quant_table(m_quantization_tables[0], s_std_lum_quant);
-            compute_quant_table(m_quantization_tables[1], s_std_croma_quant);
+        compute_quant_table(m_quantization_tables[0], s_std_lum_quant, m_params.m_quality);
+        compute_quant_table(m_quantization_tables[1], s_std_croma_quant, m_params.m_quality);
+        for (int i = 0; i < 2; i++) {
+            compute_quant_reciprocals(m_quant_recip[i], m_quant_bias[i], m_quantization_tables[i]);
         }
-
-        if(!m_huff_initialized){
-            m_huff_initialized = true;
-
-            memcpy(m_huff_bits[0+0], s_dc_lum_bits, 17);    memcpy(m_huff_val[0+0], s_dc_lum_val, DC_LUM_CODES);
-            memcpy(m_huff_bits[2+0], s_ac_lum_bits, 17);    memcpy(m_huff_val[2+0], s_ac_lum_val, AC_LUM_CODES);
-            memcpy(m_huff_bits[0+1], s_dc_chroma_bits, 17); memcpy(m_huff_val[0+1], s_dc_chroma_val, DC_CHROMA_CODES);
-            memcpy(m_huff_bits[2+1], s_ac_chroma_bits, 17); memcpy(m_huff_val[2+1], s_ac_chroma_val, AC_CHROMA_CODES);
-
-            compute_huffman_table(&m_huff_codes[0+0][0], &m_huff_code_sizes[0+0][0], m_huff_bits[0+0], m_huff_val[0+0]);
-            compute_huffman_table(&m_huff_codes[2+0][0], &m_huff_code_sizes[2+0][0], m_huff_bits[2+0], m_huff_val[2+0]);
-            compute_huffman_table(&m_huff_codes[0+1][0], &m_huff_code_sizes[0+1][0], m_huff_bits[0+1], m_huff_val[0+1]);
-            compute_huffman_table(&m_huff_codes[2+1][0], &m_huff_code_sizes[2+1][0], m_huff_bits[2+1], m_huff_val[2+1]);
+        if (m_pEstimate) {
+            if ((m_analysis = static_cast<analysis_tables*>(jpge_malloc(sizeof(analysis_tables)))) == NULL) {
+                return false;
+            }
+            memset(m_analysis->last_dc, 0, sizeof(m_analysis->last_dc));
+            for (int k = 0; k < size_estimate::NUM_QUALITIES; k++) {
+                uint8 q[64];
+                compute_quant_table(q, s_std_lum_quant, size_estimate::s_qualities[k]);
+                compute_quant_reciprocals(m_analysis->recip[k][0], m_analysis->bias[k][0], q);
+                compute_quant_table(q, s_std_croma_quant, size_estimate::s_qualities[k]);
+                compute_quant_reciprocals(m_analysis->recip[k][1], m_analysis->bias[k][1], q);
+            }
+            const int mcus = m_mcus_per_row * m_mcu_rows;
+            m_sample_stride = 1;
+            while (m_sample_stride < ANALYSIS_MAX_STRIDE && m_sample_stride < JPGE_MIN(m_mcus_per_row, m_mcu_rows) &&
+                   mcus / ((m_sample_stride + 1) * (m_sample_stride + 1)) >= ANALYSIS_MIN_MCUS) {
+                m_sample_stride++;
+            }
+            int blocks_per_mcu = 0;
+            for (int c = 0; c < m_num_components; c++) {
+                blocks_per_mcu += m_comp_h_samp[c] * m_comp_v_samp[c];
+            }
+            m_pEstimate->total_blocks = blocks_per_mcu * mcus;
         }
+        m_huff = &std_huffman_tables();
+        m_kernels = &default_kernels();
 
         m_out_buf_left = JPGE_OUT_BUF_SIZE;
         m_pOut_buf = m_out_buf;
@@ -646,19 +1070,42 @@ namespace jpge {
         m_pass_num = 2;
         memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
 
-        // Emit all markers at beginning of image file.
-        emit_marker(M_SOI);
-        emit_jfif_app0();
-        emit_dqt();
-        emit_sof();
-        emit_dhts();
-        emit_sos();
+        // The headers hold the tables, so a two-pass encode writes them after the statistics pass
+        if (m_params.m_two_pass_flag) {
+            if ((m_huff_opt = static_cast<optimized_huffman_tables*>(jpge_malloc(sizeof(optimized_huffman_tables)))) == NULL) {
+                return false;
+            }
+            memset(m_huff_opt->count, 0, sizeof(m_huff_opt->count));
+            m_pass_num = 1;
+            return true;
+        }
+
+        // Later bands continue the first one's scan.
+        if (m_mcu_row == 0) {
+            emit_headers();
+        }
+        // An analysis pass only measures the headers (there is no stream to write them to)
+        if (m_pEstimate) {
+            m_pEstimate->header_bytes = JPGE_OUT_BUF_SIZE - m_out_buf_left + 2;
+            m_pOut_buf = m_out_buf;
+            m_out_buf_left = JPGE_OUT_BUF_SIZE;
+        }
 
         return m_all_stream_writes_succeeded;
     }
 
     bool jpeg_encoder::process_end_of_image()
     {
+        if (m_pEstimate) {
+            if (m_mcu_y_ofs && sampled_row()) {
+                for (int i = m_mcu_y_ofs; i < m_mcu_y; i++) {
+                    memcpy(m_mcu_lines[i], m_mcu_lines[m_mcu_y_ofs - 1], m_image_bpl_mcu);
+                }
+                process_mcu_row();
+            }
+            m_pass_num++;
+            return true;
+        }
         if (m_mcu_y_ofs) {
             if (m_mcu_y_ofs < 16) { // check here just to shut up static analysis
                 for (int i = m_mcu_y_ofs; i < m_mcu_y; i++) {
@@ -667,9 +1114,15 @@ namespace jpge {
             }
             process_mcu_row();
         }
+        if (m_pass_num == 1) {
+            return second_pass_init();
+        }
 
-        put_bits(0x7F, 7);
-        emit_marker(M_EOI);
+        // Any band but the last has already closed its interval with RSTn
+        if (m_last_band) {
+            flush_bits();
+            emit_marker(M_EOI);
+        }
         flush_output_buffer();
         m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(NULL, 0);
         m_pass_num++; // purposely bump up m_pass_num, for debugging
@@ -679,6 +1132,10 @@ namespace jpge {
     void jpeg_encoder::clear()
     {
         m_mcu_lines[0] = NULL;
+        m_out_buf = NULL;
+        m_pEstimate = NULL;
+        m_analysis = NULL;
+        m_huff_opt = NULL;
         m_pass_num = 0;
         m_all_stream_writes_succeeded = true;
     }
@@ -693,18 +1150,71 @@ namespace jpge {
         deinit();
     }
 
+    int jpeg_encoder::source_bytes_per_pixel(source_format_t src_format)
+    {
+        switch (src_format) {
+            case SRC_Y:      return 1;
+            case SRC_RGB:
+            case SRC_YUV:    return 3;
+            case SRC_RGBA:   return 4;
+            case SRC_YUYV:
+            case SRC_RGB565: return 2;
+        }
+        return 0;
+    }
+
     bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    {
+        switch (src_channels) {
+            case 1: return init(pStream, width, height, SRC_Y, comp_params);
+            case 3: return init(pStream, width, height, SRC_RGB, comp_params);
+            case 4: return init(pStream, width, height, SRC_RGBA, comp_params);
+        }
+        deinit();
+        return false;
+    }
+
+    bool jpeg_encoder::init(output_stream *pStream, int width, int height, source_format_t src_format, const params &comp_params)
     {
         deinit();
-        if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
+        if (((!pStream) || (width < 1) || (height < 1)) || (!source_bytes_per_pixel(src_format)) || (!comp_params.check())) return false;
         m_pStream = pStream;
         m_params = comp_params;
-        return jpg_open(width, height, src_channels);
+        return jpg_open(width, height, src_format, -1);
+    }
+
+    bool jpeg_encoder::init_band(output_stream *pStream, int width, int height, source_format_t src_format, const params &comp_params, int band)
+    {
+        deinit();
+        if (((!pStream) || (width < 1) || (height < 1)) || (!source_bytes_per_pixel(src_format)) || (!comp_params.check())) return false;
+        if ((comp_params.m_restart_rows < 1) || (band < 0) || comp_params.m_two_pass_flag) return false;
+        m_pStream = pStream;
+        m_params = comp_params;
+        return jpg_open(width, height, src_format, band);
+    }
+
+    bool jpeg_encoder::init_analysis(size_estimate *pEstimate, int width, int height, source_format_t src_format, const params &comp_params)
+    {
+        deinit();
+        if (((!pEstimate) || (width < 1) || (height < 1)) || (!source_bytes_per_pixel(src_format)) || (!comp_params.check())) return false;
+        *pEstimate = size_estimate();
+        m_pEstimate = pEstimate;
+        m_params = comp_params;
+        m_params.m_restart_rows = 0;
+        m_params.m_two_pass_flag = false;
+        return jpg_open(width, height, src_format, -1);
+    }
+
+    int jpeg_encoder::band_lines(const params &comp_params)
+    {
+        return comp_params.m_restart_rows * mcu_height(comp_params.m_subsampling);
     }
 
     void jpeg_encoder::deinit()
     {
         jpge_free(m_mcu_lines[0]);
+        jpge_free(m_analysis);
+        jpge_free(m_huff_opt);
         clear();
     }
 
@@ -718,6 +1228,12 @@ namespace jpge {
                 if (!process_end_of_image()) {
                     return false;
                 }
+            } else if (m_pEstimate && !sampled_row()) {
+                // Rows the analysis skips are not even converted
+                if (++m_mcu_y_ofs == m_mcu_y) {
+                    m_mcu_y_ofs = 0;
+                    ++m_mcu_row;
+                }
             } else {
                 load_mcu(pScanline);
             }
@@ -0,0 +1,418 @@
+// jpge_kernels.cpp - Forward DCT, colour conversion and quantization kernels for jpge.
+// The scalar kernels are the original jpge loops, with quantization by reciprocal multiply
+// instead of division. The vector kernels do the same arithmetic lane by lane, so every set
+// produces identical output.
+
+#include "jpge_kernels.h"
+
+#include <stdint.h>
+#include <string.h>
+#include "esp_timer.h"
+#if JPGE_SSE41_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace jpge {
+
+    static const uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
+    // Zigzag position of each natural-order coefficient (inverse of s_zag).
+    static const uint8 s_izag[64] = { 0,1,5,6,14,15,27,28,2,4,7,13,16,26,29,42,3,8,12,17,25,30,41,43,9,11,18,24,31,40,44,53,10,19,23,32,39,45,52,54,20,22,33,38,46,51,55,60,21,34,37,47,50,56,59,61,35,36,48,49,57,58,62,63 };
+
+    const int YR = 19595, YG = 38470, YB = 7471, CB_R = -11059, CB_G = -21709, CB_B = 32768, CR_R = 32768, CR_G = -27439, CR_B = -5329;
+
+    static inline uint8 clamp(int i) {
+        if (i < 0) {
+            i = 0;
+        } else if (i > 255){
+            i = 255;
+        }
+        return static_cast<uint8>(i);
+    }
+
+    void compute_quant_reciprocals(uint32 *pRecip, uint16 *pBias, const uint8 *pQ)
+    {
+        for (int i = 0; i < 64; i++) {
+            const uint32 q = pQ[i] ? pQ[i] : 1;
+            pRecip[i] = static_cast<uint32>(((1ULL << 31) + q - 1) / q);
+            pBias[i] = static_cast<uint16>(q >> 1);
+        }
+    }
+
+    static void RGB_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst += 3, pSrc += 3, num_pixels--) {
+            const int r = pSrc[0], g = pSrc[1], b = pSrc[2];
+            pDst[0] = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
+            pDst[1] = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
+            pDst[2] = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
+        }
+    }
+
+    // Forward DCT - DCT derived from jfdctint.
+    enum { CONST_BITS = 13, ROW_BITS = 2 };
+#define DCT_DESCALE(x, n) (((x) + (((int32)1) << ((n) - 1))) >> (n))
+#define DCT_MUL(var, c) (static_cast<int16>(var) * static_cast<int32>(c))
+// One 1-D pass on s0..s7 of type T; MUL is DCT_MUL or its lane-wise form.
+#define DCT1D_T(T, MUL, s0, s1, s2, s3, s4, s5, s6, s7) \
+    T t0 = s0 + s7, t7 = s0 - s7, t1 = s1 + s6, t6 = s1 - s6, t2 = s2 + s5, t5 = s2 - s5, t3 = s3 + s4, t4 = s3 - s4; \
+    T t10 = t0 + t3, t13 = t0 - t3, t11 = t1 + t2, t12 = t1 - t2; \
+    T u1 = MUL(t12 + t13, 4433); \
+    s2 = u1 + MUL(t13, 6270); \
+    s6 = u1 + MUL(t12, -15137); \
+    u1 = t4 + t7; \
+    T u2 = t5 + t6, u3 = t4 + t6, u4 = t5 + t7; \
+    T z5 = MUL(u3 + u4, 9633); \
+    t4 = MUL(t4, 2446); t5 = MUL(t5, 16819); \
+    t6 = MUL(t6, 25172); t7 = MUL(t7, 12299); \
+    u1 = MUL(u1, -7373); u2 = MUL(u2, -20995); \
+    u3 = MUL(u3, -16069); u4 = MUL(u4, -3196); \
+    u3 += z5; u4 += z5; \
+    s0 = t10 + t11; s1 = t7 + u1 + u4; s3 = t6 + u2 + u3; s4 = t10 - t11; s5 = t5 + u2 + u4; s7 = t4 + u1 + u3;
+#define DCT1D(s0, s1, s2, s3, s4, s5, s6, s7) DCT1D_T(int32, DCT_MUL, s0, s1, s2, s3, s4, s5, s6, s7)
+
+    void fdct(int32 *p) {
+        int32 c, *q = p;
+        for (c = 7; c >= 0; c--, q += 8) {
+            int32 s0 = q[0], s1 = q[1], s2 = q[2], s3 = q[3], s4 = q[4], s5 = q[5], s6 = q[6], s7 = q[7];
+            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
+            q[0] = s0 << ROW_BITS; q[1] = DCT_DESCALE(s1, CONST_BITS-ROW_BITS); q[2] = DCT_DESCALE(s2, CONST_BITS-ROW_BITS); q[3] = DCT_DESCALE(s3, CONST_BITS-ROW_BITS);
+            q[4] = s4 << ROW_BITS; q[5] = DCT_DESCALE(s5, CONST_BITS-ROW_BITS); q[6] = DCT_DESCALE(s6, CONST_BITS-ROW_BITS); q[7] = DCT_DESCALE(s7, CONST_BITS-ROW_BITS);
+        }
+        for (q = p, c = 7; c >= 0; c--, q++) {
+            int32 s0 = q[0*8], s1 = q[1*8], s2 = q[2*8], s3 = q[3*8], s4 = q[4*8], s5 = q[5*8], s6 = q[6*8], s7 = q[7*8];
+            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
+            q[0*8] = DCT_DESCALE(s0, ROW_BITS+3); q[1*8] = DCT_DESCALE(s1, CONST_BITS+ROW_BITS+3); q[2*8] = DCT_DESCALE(s2, CONST_BITS+ROW_BITS+3); q[3*8] = DCT_DESCALE(s3, CONST_BITS+ROW_BITS+3);
+            q[4*8] = DCT_DESCALE(s4, ROW_BITS+3); q[5*8] = DCT_DESCALE(s5, CONST_BITS+ROW_BITS+3); q[6*8] = DCT_DESCALE(s6, CONST_BITS+ROW_BITS+3); q[7*8] = DCT_DESCALE(s7, CONST_BITS+ROW_BITS+3);
+        }
+    }
+
+    // sign(j) * ((|j| + q/2) / q), the rounding of the original division loop. On Xtensa the
+    // product's high word is a single muluh.
+    static inline int16 quantize_coefficient(int32 j, uint32 recip, uint16 bias)
+    {
+        const uint32 n = static_cast<uint32>(j < 0 ? -j : j) + bias;
+        const int32 v = static_cast<int32>((static_cast<uint64_t>(n << 1) * recip) >> 32);
+        return static_cast<int16>(j < 0 ? -v : v);
+    }
+
+    static void quantize(int16 *pDst, const int32 *pBlock, const uint32 *pRecip, const uint16 *pBias)
+    {
+        for (int i = 0; i < 64; i++) {
+            pDst[i] = quantize_coefficient(pBlock[s_zag[i]], pRecip[i], pBias[i]);
+        }
+    }
+
+    // Row pass of fdct(), then each column is finished, quantized and stored at its zigzag positions.
+    static void DCT2D_quantize(int16 *pDst, int32 *p, const uint32 *pRecip, const uint16 *pBias) {
+        int32 c, *q = p;
+        for (c = 7; c >= 0; c--, q += 8) {
+            int32 s0 = q[0], s1 = q[1], s2 = q[2], s3 = q[3], s4 = q[4], s5 = q[5], s6 = q[6], s7 = q[7];
+            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
+            q[0] = s0 << ROW_BITS; q[1] = DCT_DESCALE(s1, CONST_BITS-ROW_BITS); q[2] = DCT_DESCALE(s2, CONST_BITS-ROW_BITS); q[3] = DCT_DESCALE(s3, CONST_BITS-ROW_BITS);
+            q[4] = s4 << ROW_BITS; q[5] = DCT_DESCALE(s5, CONST_BITS-ROW_BITS); q[6] = DCT_DESCALE(s6, CONST_BITS-ROW_BITS); q[7] = DCT_DESCALE(s7, CONST_BITS-ROW_BITS);
+        }
+        for (q = p, c = 0; c < 8; c++, q++) {
+            int32 s0 = q[0*8], s1 = q[1*8], s2 = q[2*8], s3 = q[3*8], s4 = q[4*8], s5 = q[5*8], s6 = q[6*8], s7 = q[7*8];
+            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
+            const int32 out[8] = {
+                DCT_DESCALE(s0, ROW_BITS+3), DCT_DESCALE(s1, CONST_BITS+ROW_BITS+3), DCT_DESCALE(s2, CONST_BITS+ROW_BITS+3), DCT_DESCALE(s3, CONST_BITS+ROW_BITS+3),
+                DCT_DESCALE(s4, ROW_BITS+3), DCT_DESCALE(s5, CONST_BITS+ROW_BITS+3), DCT_DESCALE(s6, CONST_BITS+ROW_BITS+3), DCT_DESCALE(s7, CONST_BITS+ROW_BITS+3) };
+            for (int r = 0; r < 8; r++) {
+                const int z = s_izag[r * 8 + c];
+                pDst[z] = quantize_coefficient(out[r], pRecip[z], pBias[z]);
+            }
+        }
+    }
+
+    static const kernels s_scalar_kernels = { "scalar", RGB_to_YCC, quantize, DCT2D_quantize };
+
+#if JPGE_SSE41_KERNELS
+    // pmulld, pmovzx, packusdw and pshufb need SSE4.1; vector_kernels() checks the CPU first.
+#define JPGE_SSE41 __attribute__((target("sse4.1")))
+
+    // 16 pixels per step: byte shuffles split the interleaved RGB into planes, the arithmetic runs
+    // on 32-bit lanes exactly like the scalar loop, and shuffles interleave Y, Cb and Cr again.
+    // Saturating packs clamp Cb and Cr the same way clamp() does; Y never leaves 0..255.
+    static JPGE_SSE41 void RGB_to_YCC_vector(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        // Byte k of each plane comes from source byte 3k + channel of a, b or c; -1 zeroes the lane.
+        const __m128i r_a = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i r_b = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+        const __m128i r_c = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+        const __m128i g_a = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i g_b = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+        const __m128i g_c = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+        const __m128i b_a = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i b_b = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+        const __m128i b_c = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+        // Output byte n is channel n % 3 of pixel n / 3.
+        const __m128i o0_y = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+        const __m128i o0_b = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+        const __m128i o0_r = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+        const __m128i o1_y = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+        const __m128i o1_b = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+        const __m128i o1_r = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+        const __m128i o2_y = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+        const __m128i o2_b = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+        const __m128i o2_r = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+        const __m128i round = _mm_set1_epi32(32768), bias = _mm_set1_epi32(128);
+
+        for ( ; num_pixels >= 16; pDst += 48, pSrc += 48, num_pixels -= 16) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + 16));
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + 32));
+            __m128i r8 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, r_a), _mm_shuffle_epi8(b, r_b)), _mm_shuffle_epi8(c, r_c));
+            __m128i g8 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, g_a), _mm_shuffle_epi8(b, g_b)), _mm_shuffle_epi8(c, g_c));
+            __m128i b8 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, b_a), _mm_shuffle_epi8(b, b_b)), _mm_shuffle_epi8(c, b_c));
+
+            __m128i y[4], cb[4], cr[4];
+            for (int i = 0; i < 4; i++) {
+                const __m128i r = _mm_cvtepu8_epi32(r8), g = _mm_cvtepu8_epi32(g8), bl = _mm_cvtepu8_epi32(b8);
+                r8 = _mm_srli_si128(r8, 4); g8 = _mm_srli_si128(g8, 4); b8 = _mm_srli_si128(b8, 4);
+#define JPGE_DOT(kr, kg, kb) _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(r, _mm_set1_epi32(kr)), _mm_mullo_epi32(g, _mm_set1_epi32(kg))), \
+                                           _mm_add_epi32(_mm_mullo_epi32(bl, _mm_set1_epi32(kb)), round))
+                y[i] = _mm_srai_epi32(JPGE_DOT(YR, YG, YB), 16);
+                cb[i] = _mm_add_epi32(bias, _mm_srai_epi32(JPGE_DOT(CB_R, CB_G, CB_B), 16));
+                cr[i] = _mm_add_epi32(bias, _mm_srai_epi32(JPGE_DOT(CR_R, CR_G, CR_B), 16));
+#undef JPGE_DOT
+            }
+            const __m128i y8 = _mm_packus_epi16(_mm_packs_epi32(y[0], y[1]), _mm_packs_epi32(y[2], y[3]));
+            const __m128i cb8 = _mm_packus_epi16(_mm_packs_epi32(cb[0], cb[1]), _mm_packs_epi32(cb[2], cb[3]));
+            const __m128i cr8 = _mm_packus_epi16(_mm_packs_epi32(cr[0], cr[1]), _mm_packs_epi32(cr[2], cr[3]));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(y8, o0_y), _mm_shuffle_epi8(cb8, o0_b)), _mm_shuffle_epi8(cr8, o0_r)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + 16), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(y8, o1_y), _mm_shuffle_epi8(cb8, o1_b)), _mm_shuffle_epi8(cr8, o1_r)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + 32), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(y8, o2_y), _mm_shuffle_epi8(cb8, o2_b)), _mm_shuffle_epi8(cr8, o2_r)));
+        }
+        RGB_to_YCC(pDst, pSrc, num_pixels);
+    }
+
+    // quantize_coefficient() on four lanes: pmuludq gives the 64-bit products of the even lanes,
+    // the odd lanes are shifted down for a second one, and the high words are blended back.
+    static JPGE_SSE41 void quantize_vector(int16 *pDst, const int32 *pBlock, const uint32 *pRecip, const uint16 *pBias)
+    {
+        int32 zag[64];
+        for (int i = 0; i < 64; i++) {
+            zag[i] = pBlock[s_zag[i]];
+        }
+        for (int i = 0; i < 64; i += 8) {
+            const __m128i bias8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBias + i));
+            __m128i r[2];
+            for (int h = 0; h < 2; h++) {
+                const __m128i j = _mm_loadu_si128(reinterpret_cast<const __m128i*>(zag + i + h * 4));
+                const __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRecip + i + h * 4));
+                const __m128i bias = _mm_cvtepu16_epi32(h ? _mm_srli_si128(bias8, 8) : bias8);
+                const __m128i n = _mm_slli_epi32(_mm_add_epi32(_mm_abs_epi32(j), bias), 1);
+                const __m128i even = _mm_srli_epi64(_mm_mul_epu32(n, m), 32);
+                const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(n, 32), _mm_srli_epi64(m, 32));
+                r[h] = _mm_sign_epi32(_mm_blend_epi16(even, odd, 0xCC), j);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), _mm_packs_epi32(r[0], r[1]));
+        }
+    }
+
+    // The DCT itself stays scalar (compilers already vectorize it for x86); only the
+    // quantization after it uses SSE4.1.
+    static JPGE_SSE41 void DCT2D_quantize_vector(int16 *pDst, int32 *pBlock, const uint32 *pRecip, const uint16 *pBias)
+    {
+        fdct(pBlock);
+        quantize_vector(pDst, pBlock, pRecip, pBias);
+    }
+
+    static const kernels s_sse41_kernels = { "sse4.1", RGB_to_YCC_vector, quantize_vector, DCT2D_quantize_vector };
+#endif // JPGE_SSE41_KERNELS
+
+#if JPGE_GNU_VECTOR_KERNELS
+    // Eight lanes of GCC vector extensions and no target intrinsics, so the same code builds for
+    // Xtensa (ESP32-S3), RISC-V and x86. Where there is no vector unit for these types, GCC splits
+    // every operation into its lanes: both DCT passes become straight-line code over eight rows or
+    // columns at once, and quantization runs eight coefficients per step without the per-coefficient
+    // calls and branches of the scalar set.
+    typedef int32 v8i32 __attribute__((vector_size(32)));
+    typedef uint32 v8u32 __attribute__((vector_size(32)));
+    typedef int16 v8i16 __attribute__((vector_size(16)));
+    typedef uint16 v8u16 __attribute__((vector_size(16)));
+    typedef uint64 v8u64 __attribute__((vector_size(64)));
+
+    // DCT_MUL on every lane: truncated to 16 bits, sign-extended and multiplied.
+#define DCT_MUL_V8(var, c) (__builtin_convertvector(__builtin_convertvector(var, v8i16), v8i32) * static_cast<int32>(c))
+
+    // clamp() on every lane; a comparison is -1 where it holds.
+    static inline void clamp_lanes(v8i32 &v)
+    {
+        v &= ~(v < 0);
+        const v8i32 over = v > 255;
+        v = (v & ~over) | (over & 255);
+    }
+
+    static void RGB_to_YCC_gnu_vector(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels >= 8; pDst += 24, pSrc += 24, num_pixels -= 8) {
+            v8i32 r, g, b;
+            for (int i = 0; i < 8; i++) {
+                r[i] = pSrc[i * 3]; g[i] = pSrc[i * 3 + 1]; b[i] = pSrc[i * 3 + 2];
+            }
+            const v8i32 y = (r * YR + g * YG + b * YB + 32768) >> 16;
+            v8i32 cb = 128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16);
+            v8i32 cr = 128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16);
+            clamp_lanes(cb);
+            clamp_lanes(cr);
+            for (int i = 0; i < 8; i++) {
+                pDst[i * 3] = static_cast<uint8>(y[i]);
+                pDst[i * 3 + 1] = static_cast<uint8>(cb[i]);
+                pDst[i * 3 + 2] = static_cast<uint8>(cr[i]);
+            }
+        }
+        RGB_to_YCC(pDst, pSrc, num_pixels);
+    }
+
+    // fdct() with one row per lane in the first pass and one column per lane in the second.
+    static void fdct_gnu_vector(int32 *p)
+    {
+        v8i32 s[8];
+        for (int k = 0; k < 8; k++) {
+            for (int r = 0; r < 8; r++) {
+                s[k][r] = p[r * 8 + k];
+            }
+        }
+        {
+            DCT1D_T(v8i32, DCT_MUL_V8, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+        }
+        s[0] <<= static_cast<int>(ROW_BITS); s[1] = DCT_DESCALE(s[1], CONST_BITS-ROW_BITS); s[2] = DCT_DESCALE(s[2], CONST_BITS-ROW_BITS); s[3] = DCT_DESCALE(s[3], CONST_BITS-ROW_BITS);
+        s[4] <<= static_cast<int>(ROW_BITS); s[5] = DCT_DESCALE(s[5], CONST_BITS-ROW_BITS); s[6] = DCT_DESCALE(s[6], CONST_BITS-ROW_BITS); s[7] = DCT_DESCALE(s[7], CONST_BITS-ROW_BITS);
+        for (int k = 0; k < 8; k++) {
+            for (int r = 0; r < 8; r++) {
+                p[r * 8 + k] = s[k][r];
+            }
+        }
+
+        for (int r = 0; r < 8; r++) {
+            memcpy(&s[r], p + r * 8, sizeof(s[r]));
+        }
+        {
+            DCT1D_T(v8i32, DCT_MUL_V8, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+        }
+        s[0] = DCT_DESCALE(s[0], ROW_BITS+3); s[1] = DCT_DESCALE(s[1], CONST_BITS+ROW_BITS+3); s[2] = DCT_DESCALE(s[2], CONST_BITS+ROW_BITS+3); s[3] = DCT_DESCALE(s[3], CONST_BITS+ROW_BITS+3);
+        s[4] = DCT_DESCALE(s[4], ROW_BITS+3); s[5] = DCT_DESCALE(s[5], CONST_BITS+ROW_BITS+3); s[6] = DCT_DESCALE(s[6], CONST_BITS+ROW_BITS+3); s[7] = DCT_DESCALE(s[7], CONST_BITS+ROW_BITS+3);
+        for (int r = 0; r < 8; r++) {
+            memcpy(p + r * 8, &s[r], sizeof(s[r]));
+        }
+    }
+
+    // quantize_coefficient() on eight lanes; the sign is taken off and put back with xor and subtract.
+    static void quantize_gnu_vector(int16 *pDst, const int32 *pBlock, const uint32 *pRecip, const uint16 *pBias)
+    {
+        int32 zag[64];
+        for (int i = 0; i < 64; i++) {
+            zag[i] = pBlock[s_zag[i]];
+        }
+        for (int i = 0; i < 64; i += 8) {
+            v8i32 j;
+            v8u32 recip;
+            v8u16 bias;
+            memcpy(&j, zag + i, sizeof(j));
+            memcpy(&recip, pRecip + i, sizeof(recip));
+            memcpy(&bias, pBias + i, sizeof(bias));
+            const v8i32 sign = j >> 31;
+            const v8u32 n = ((v8u32)((j ^ sign) - sign) + __builtin_convertvector(bias, v8u32)) << 1;
+            const v8u64 prod = __builtin_convertvector(n, v8u64) * __builtin_convertvector(recip, v8u64);
+            const v8i32 v = __builtin_convertvector(prod >> 32, v8i32);
+            const v8i16 out = __builtin_convertvector((v ^ sign) - sign, v8i16);
+            memcpy(pDst + i, &out, sizeof(out));
+        }
+    }
+
+    static void DCT2D_quantize_gnu_vector(int16 *pDst, int32 *pBlock, const uint32 *pRecip, const uint16 *pBias)
+    {
+        fdct_gnu_vector(pBlock);
+        quantize_gnu_vector(pDst, pBlock, pRecip, pBias);
+    }
+
+    static const kernels s_gnu_vector_kernels = { "gnuvec", RGB_to_YCC_gnu_vector, quantize_gnu_vector, DCT2D_quantize_gnu_vector };
+#endif // JPGE_GNU_VECTOR_KERNELS
+
+    const kernels &scalar_kernels()
+    {
+        return s_scalar_kernels;
+    }
+
+    const kernels *gnu_vector_kernels()
+    {
+#if JPGE_GNU_VECTOR_KERNELS
+        return &s_gnu_vector_kernels;
+#else
+        return NULL;
+#endif
+    }
+
+    const kernels *vector_kernels()
+    {
+#if JPGE_SSE41_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.1")) {
+            return &s_sse41_kernels;
+        }
+#endif
+        return gnu_vector_kernels();
+    }
+
+    // Blocks (and 64-pixel rows) each set gets when default_kernels() times them.
+    enum { TIMED_BLOCKS = 128 };
+
+    static int64_t time_kernels(const kernels &k)
+    {
+        uint8 q[64], rgb[64 * 3], ycc[64 * 3];
+        uint32 recip[64];
+        uint16 bias[64];
+        int32 block[64];
+        int16 coeffs[64];
+        for (int i = 0; i < 64; i++) {
+            q[i] = static_cast<uint8>(1 + i % 50);
+        }
+        for (int i = 0; i < 64 * 3; i++) {
+            rgb[i] = static_cast<uint8>(i * 37);
+        }
+        compute_quant_reciprocals(recip, bias, q);
+
+        volatile int sink = 0;
+        const int64_t t0 = esp_timer_get_time();
+        for (int n = 0; n < TIMED_BLOCKS; n++) {
+            for (int i = 0; i < 64; i++) {
+                block[i] = ((i * 29 + n * 13) & 255) - 128;
+            }
+            k.fdct_quantize(coeffs, block, recip, bias);
+            rgb[0] = static_cast<uint8>(n);
+            k.rgb_to_ycc(ycc, rgb, 64);
+            sink = sink + coeffs[n & 63] + ycc[n & 63];
+        }
+        return esp_timer_get_time() - t0;
+    }
+
+    // Every set gives the same bits, so the choice is only about speed, and that depends on the CPU
+    // and on how the compiler built the vector code: GCC has no vector unit for these types on the
+    // ESP32-S3 and splits each vector operation into its lanes. Each set is timed twice, the first
+    // run only warms the caches, and the fastest one stays; the scalar set wins ties.
+    static const kernels &fastest_kernels()
+    {
+        const kernels *vec = vector_kernels(), *gnu = gnu_vector_kernels();
+        const kernels *candidates[] = { &s_scalar_kernels, vec, gnu != vec ? gnu : NULL };
+        const kernels *best = NULL;
+        int64_t best_us = 0;
+        for (const kernels *k : candidates) {
+            if (!k) {
+                continue;
+            }
+            time_kernels(*k);
+            const int64_t us = time_kernels(*k);
+            if (!best || us < best_us) {
+                best = k;
+                best_us = us;
+            }
+        }
+        return *best;
+    }
+
+    const kernels &default_kernels()
+    {
+        static const kernels &k = fastest_kernels();
+        return k;
+    }
+
+} // namespace jpge
@@ -4,6 +4,8 @@
 #ifndef JPEG_ENCODER_H
 #define JPEG_ENCODER_H
 
+#include <stddef.h>
+
 namespace jpge
 {
     typedef unsigned char  uint8;
@@ -11,14 +13,20 @@ namespace jpge
     typedef signed int     int32;
     typedef unsigned short uint16;
     typedef unsigned int   uint32;
+    typedef unsigned long long uint64;
     typedef unsigned int   uint;
 
     // JPEG chroma subsampling factors. Y_ONLY (grayscale images) and H2V2 (color images) are the most common.
     enum subsampling_t { Y_ONLY = 0, H1V1 = 1, H2V1 = 2, H2V2 = 3 };
 
+    // Source scanline layouts accepted by jpeg_encoder::init().
+    // SRC_YUYV is the camera's YUV422 (Y0 U Y1 V, BT.601 studio range), SRC_RGB565 is big-endian as the camera sends it.
+    // SRC_YUV has a Y, U, V triplet per pixel in the same studio range, as a scaler averaging YUV422 produces it.
+    enum source_format_t { SRC_Y = 0, SRC_RGB = 1, SRC_RGBA = 2, SRC_YUYV = 3, SRC_RGB565 = 4, SRC_YUV = 5 };
+
     // JPEG compression parameters structure.
     struct params {
-            inline params() : m_quality(85), m_subsampling(H2V2) { }
+            inline params() : m_quality(85), m_subsampling(H2V2), m_restart_rows(0), m_two_pass_flag(false) { }
 
             inline bool check() const {
                 if ((m_quality < 1) || (m_quality > 100)) {
@@ -27,6 +35,9 @@ namespace jpge
                 if ((uint)m_subsampling > (uint)H2V2) {
                     return false;
                 }
+                if (m_restart_rows < 0) {
+                    return false;
+                }
                 return true;
             }
 
@@ -39,18 +50,54 @@ namespace jpge
             // 2 = H2V1 subsampling (YCbCr 2x1x1, 4 blocks per MCU)
             // 3 = H2V2 subsampling (YCbCr 4x1x1, 6 blocks per MCU-- very common)
             subsampling_t m_subsampling;
+
+            // MCU rows per restart interval, 0 = no restart markers.
+            // With restarts every band of m_restart_rows MCU rows is entropy coded on its own (DRI/RSTn),
+            // so bands can be encoded separately with init_band() and concatenated.
+            int m_restart_rows;
+
+            // Disables/enables optimized Huffman tables. Two passes are slower but the output is smaller:
+            // the first pass gathers symbol statistics, the second one writes tables built from them.
+            // The scanlines must then be fed twice, see get_total_passes(). Not with init_band().
+            bool m_two_pass_flag;
     };
     
     // Output stream abstract class - used by the jpeg_encoder class to write to the output stream.
-    // put_buf() is generally called with len==JPGE_OUT_BUF_SIZE bytes, but for headers it'll be called with smaller amounts.
+    // put_buf() is generally called with up to JPGE_OUT_BUF_SIZE bytes (a few less, as entropy-coded words go out whole), but for headers it'll be called with smaller amounts.
     class output_stream {
         public:
             virtual ~output_stream() { };
             virtual bool put_buf(const void* Pbuf, int len) = 0;
-            virtual uint get_size() const = 0;
+            virtual size_t get_size() const = 0;
     };
     
+    // Output size model filled by jpeg_encoder::init_analysis(): what a sample of the blocks costs
+    // with the standard Huffman tables at each quality of a fixed ladder.
+    struct size_estimate {
+            enum { NUM_QUALITIES = 14 };
+            static const uint8 s_qualities[NUM_QUALITIES];
+
+            uint64 bits[NUM_QUALITIES];     // Entropy-coded bits of the sampled blocks at each ladder quality
+            uint32 sampled_blocks;
+            uint32 total_blocks;
+            uint32 header_bytes;            // Markers and tables, EOI included
+
+            size_estimate();
+
+            // Predicted file size in bytes at quality 1-100, interpolated between ladder steps.
+            size_t predict(int quality) const;
+
+            // Highest quality whose predicted size, times num / den, is at most max_len; 0 if not even quality 1.
+            int quality_for(size_t max_len, uint32 num = 1, uint32 den = 1) const;
+    };
+
+    struct huffman_tables;
+    struct optimized_huffman_tables;
+    struct kernels;
+    struct analysis_tables;
+
     // Lower level jpeg_encoder class - useful if more control is needed than the above helper functions.
+    // All mutable state lives in the object, so separate instances may encode concurrently.
     class jpeg_encoder {
         public:
             jpeg_encoder();
@@ -64,12 +111,34 @@ namespace jpge
             // Returns false on out of memory or if a stream write fails.
             bool init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params = params());
 
+            // Same, with the scanline layout given explicitly. YUYV and RGB565 are converted straight into the MCU
+            // lines; with YUYV, H2V1 subsampling keeps the source chroma as is.
+            bool init(output_stream *pStream, int width, int height, source_format_t src_format, const params &comp_params = params());
+
+            // Encodes only restart band number `band` of a width x height image; comp_params.m_restart_rows must be set.
+            // Feed the band's scanlines (band_lines() of them, fewer for the last band), then NULL.
+            // Band 0 writes the headers and the last band the EOI: the outputs of every band, in order,
+            // are byte for byte the output of init() with the same params.
+            bool init_band(output_stream *pStream, int width, int height, source_format_t src_format, const params &comp_params, int band);
+
+            // Scanlines per restart band for these params, 0 without restarts.
+            static int band_lines(const params &comp_params);
+
+            // Analysis pass instead of an encode: feed the scanlines as after init(), then NULL, and *pEstimate
+            // holds the size model. Only every few MCU rows and columns are converted and transformed
+            // (comp_params.m_quality is ignored) and nothing is written.
+            bool init_analysis(size_estimate *pEstimate, int width, int height, source_format_t src_format, const params &comp_params);
+
             // Call this method with each source scanline.
-            // width * src_channels bytes per scanline is expected (RGB or Y format).
+            // width * bytes-per-pixel of the source format is expected (2 for YUYV and RGB565).
             // You must call with NULL after all scanlines are processed to finish compression.
+            // With m_two_pass_flag, feed every scanline and NULL once per pass.
             // Returns false on out of memory or if a stream write fails.
             bool process_scanline(const void* pScanline);
 
+            inline uint get_total_passes() const { return m_params.m_two_pass_flag ? 2 : 1; }
+            inline uint get_cur_pass() const { return m_pass_num; }
+
             // Deinitializes the compressor, freeing any allocated memory. May be called at any time.
             void deinit();
 
@@ -78,10 +147,11 @@ namespace jpge
             jpeg_encoder &operator =(const jpeg_encoder &);
 
             typedef int32 sample_array_t;
-            enum { JPGE_OUT_BUF_SIZE = 512 };
+            enum { JPGE_OUT_BUF_SIZE = 4096 };
 
             output_stream *m_pStream;
             params m_params;
+            source_format_t m_src_format;
             uint8 m_num_components;
             uint8 m_comp_h_samp[3], m_comp_v_samp[3];
             int m_image_x, m_image_y, m_image_bpp, m_image_bpl;
@@ -91,22 +161,40 @@ namespace jpge
             int m_mcu_x, m_mcu_y;
             uint8 *m_mcu_lines[16];
             uint8 m_mcu_y_ofs;
+            int m_mcu_row, m_mcu_rows;
+            bool m_last_band;
+            uint m_restart_count;
             sample_array_t m_sample_array[64];
             int16 m_coefficient_array[64];
 
+            uint8 m_quantization_tables[2][64];
+            uint32 m_quant_recip[2][64];
+            uint16 m_quant_bias[2][64];
+            const huffman_tables *m_huff;
+            optimized_huffman_tables *m_huff_opt;
+            const kernels *m_kernels;
+            size_estimate *m_pEstimate;
+            analysis_tables *m_analysis;
+            int m_sample_stride;
+
             int m_last_dc_val[3];
-            uint8 m_out_buf[JPGE_OUT_BUF_SIZE];
+            uint8 *m_out_buf;
             uint8 *m_pOut_buf;
             uint m_out_buf_left;
-            uint32 m_bit_buffer;
+            uint64 m_bit_buffer;
             uint m_bits_in;
             uint8 m_pass_num;
             bool m_all_stream_writes_succeeded;
 
-            bool jpg_open(int p_x_res, int p_y_res, int src_channels);
+            static int source_bytes_per_pixel(source_format_t src_format);
+            static int mcu_height(subsampling_t subsampling);
+            bool jpg_open(int p_x_res, int p_y_res, source_format_t src_format, int band);
 
             void flush_output_buffer();
+            void emit_bit_word(uint32 w);
             void put_bits(uint bits, uint len);
+            void put_code(uint code, uint code_len, int value, uint nbits);
+            void flush_bits();
 
             void emit_byte(uint8 i);
             void emit_word(uint i);
@@ -115,20 +203,28 @@ namespace jpge
             void emit_jfif_app0();
             void emit_dqt();
             void emit_sof();
-            void emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag);
+            void emit_dht(const uint8 *bits, const uint8 *val, int index, bool ac_flag);
             void emit_dhts();
             void emit_sos();
+            void emit_dri();
+            void emit_restart();
+            void emit_headers();
 
-            void compute_quant_table(int32 *dst, const int16 *src);
-            void load_quantized_coefficients(int component_num);
+            static void compute_quant_table(uint8 *dst, const int16 *src, int quality);
 
             void load_block_8_8_grey(int x);
             void load_block_8_8(int x, int y, int c);
             void load_block_16_8(int x, int c);
             void load_block_16_8_8(int x, int c);
 
+            void code_coefficients_pass_one(int component_num);
             void code_coefficients_pass_two(int component_num);
+            void optimize_huffman_table(int table_num, int table_len);
+            bool second_pass_init();
             void code_block(int component_num);
+            uint count_block_bits(int component_num, int *pLast_dc) const;
+            void estimate_block(int component_num);
+            bool sampled_row() const { return (m_mcu_row % m_sample_stride) == m_sample_stride / 2; }
 
             void process_mcu_row();
             bool process_end_of_image();
@@ -0,0 +1,68 @@
+// jpge_kernels.h - Per-block kernels of the jpge encoder.
+// The scalar set is the reference implementation; every other set must produce the same bits.
+#ifndef JPEG_ENCODER_KERNELS_H
+#define JPEG_ENCODER_KERNELS_H
+
+#include "jpge.h"
+
+// SSE4.1 kernels for x86 hosts, picked at run time.
+#if !defined(JPGE_SSE41_KERNELS)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JPGE_SSE41_KERNELS 1
+#else
+#define JPGE_SSE41_KERNELS 0
+#endif
+#endif
+
+// Kernels written with GCC vector extensions, for any target, the ESP32 family included. There are
+// no PIE kernels.
+#if !defined(JPGE_GNU_VECTOR_KERNELS)
+#if defined(__GNUC__)
+#define JPGE_GNU_VECTOR_KERNELS 1
+#else
+#define JPGE_GNU_VECTOR_KERNELS 0
+#endif
+#endif
+
+namespace jpge
+{
+    struct kernels {
+        const char *name;
+
+        // num_pixels RGB triplets to YCbCr triplets.
+        void (*rgb_to_ycc)(uint8 *pDst, const uint8 *pSrc, int num_pixels);
+
+        // DCT block (natural order) to quantized coefficients in zigzag order.
+        // pRecip and pBias come from compute_quant_reciprocals() and are in zigzag order too.
+        void (*quantize)(int16 *pDst, const int32 *pBlock, const uint32 *pRecip, const uint16 *pBias);
+
+        // fdct and quantize in one pass, no natural-order block in between; what the encoder calls.
+        // pBlock is used as scratch.
+        void (*fdct_quantize)(int16 *pDst, int32 *pBlock, const uint32 *pRecip, const uint16 *pBias);
+    };
+
+    // In-place forward DCT of an 8x8 block of level-shifted samples, natural order. Every kernel
+    // set uses this one.
+    void fdct(int32 *pBlock);
+
+    // Divisors pQ (zigzag order, as in DQT) to the kernels' form: pBias = q / 2 and pRecip = ceil(2^31 / q).
+    // For every n below 2^23, (2n * recip) >> 32 == n / q, so quantizing takes a multiply instead of a division.
+    // DCT outputs stay far below that bound (|coefficient| < 2^12).
+    void compute_quant_reciprocals(uint32 *pRecip, uint16 *pBias, const uint8 *pQ);
+
+    // Plain C++ loops, always available.
+    const kernels &scalar_kernels();
+
+    // The GCC vector extension set, NULL when the compiler has none.
+    const kernels *gnu_vector_kernels();
+
+    // Vector kernels, NULL when this build or the running CPU has none: SSE4.1 when the CPU has
+    // it, otherwise the GCC vector extension set.
+    const kernels *vector_kernels();
+
+    // The fastest set on this CPU, timed once on the first call; what jpeg_encoder uses.
+    const kernels &default_kernels();
+
+} // namespace jpge
+
+#endif // JPEG_ENCODER_KERNELS_H
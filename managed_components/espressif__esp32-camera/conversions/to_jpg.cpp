@@ -13,13 +13,16 @@
 // limitations under the License.
 #include <stddef.h>
 #include <string.h>
+#include <new>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
 #include "esp_attr.h"
 #include "soc/efuse_reg.h"
 #include "esp_heap_caps.h"
 #include "esp_camera.h"
 #include "img_converters.h"
 #include "jpge.h"
-#include "yuv.h"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -43,12 +46,27 @@ static void *_malloc(size_t size)
     return NULL;
 }
 
+// caps == 0: like _malloc(), internal RAM first and PSRAM when that fails;
+// otherwise only the region given by caps
+static void *_realloc(void *ptr, size_t size, uint32_t caps)
+{
+    if(caps) {
+        return heap_caps_realloc(ptr, size, caps);
+    }
+    void * res = realloc(ptr, size);
+    if(res) {
+        return res;
+    }
+#if ((CONFIG_SPIRAM || CONFIG_SPIRAM_SUPPORT) && (CONFIG_SPIRAM_USE_CAPS_ALLOC || CONFIG_SPIRAM_USE_MALLOC))
+    return heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+    return NULL;
+}
+
 static IRAM_ATTR void convert_line_format(uint8_t * src, pixformat_t format, uint8_t * dst, size_t width, size_t in_channels, size_t line)
 {
     int i=0, o=0, l=0;
-    if(format == PIXFORMAT_GRAYSCALE) {
-        memcpy(dst, src + line * width, width);
-    } else if(format == PIXFORMAT_RGB888) {
+    if(format == PIXFORMAT_RGB888) {
         l = width * 3;
         src += l * line;
         for(i=0; i<l; i+=3) {
@@ -56,87 +74,274 @@ static IRAM_ATTR void convert_line_format(uint8_t * src, pixformat_t format, uin
             dst[o++] = src[i+1];
             dst[o++] = src[i];
         }
-    } else if(format == PIXFORMAT_RGB565) {
-        l = width * 2;
-        src += l * line;
-        for(i=0; i<l; i+=2) {
-            dst[o++] = src[i] & 0xF8;
-            dst[o++] = (src[i] & 0x07) << 5 | (src[i+1] & 0xE0) >> 3;
-            dst[o++] = (src[i+1] & 0x1F) << 3;
-        }
-    } else if(format == PIXFORMAT_YUV422) {
-        uint8_t y0, y1, u, v;
-        uint8_t r, g, b;
-        l = width * 2;
-        src += l * line;
-        for(i=0; i<l; i+=4) {
-            y0 = src[i];
-            u = src[i+1];
-            y1 = src[i+2];
-            v = src[i+3];
-
-            yuv2rgb(y0, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
-
-            yuv2rgb(y1, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
-        }
     }
 }
 
-bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpge::output_stream *dst_stream)
+// How each pixel format is fed to jpge: grayscale, RGB565 and YUV422 lines go to the
+// encoder untouched; only RGB888 needs its BGR byte order swapped first
+static void source_layout(pixformat_t format, jpge::params &comp_params, jpge::source_format_t &src_format, int &src_bpp, bool &convert_lines)
 {
-    int num_channels = 3;
-    jpge::subsampling_t subsampling = jpge::H2V2;
+    comp_params.m_subsampling = jpge::H2V2;
+    src_format = jpge::SRC_RGB;
+    src_bpp = 3;
+    convert_lines = true;
 
     if(format == PIXFORMAT_GRAYSCALE) {
-        num_channels = 1;
-        subsampling = jpge::Y_ONLY;
+        src_bpp = 1;
+        comp_params.m_subsampling = jpge::Y_ONLY;
+        src_format = jpge::SRC_Y;
+        convert_lines = false;
+    } else if(format == PIXFORMAT_RGB565) {
+        src_bpp = 2;
+        src_format = jpge::SRC_RGB565;
+        convert_lines = false;
+    } else if(format == PIXFORMAT_YUV422) {
+        src_bpp = 2;
+        comp_params.m_subsampling = jpge::H2V1;
+        src_format = jpge::SRC_YUYV;
+        convert_lines = false;
     }
+}
 
+static uint8_t clamp_quality(uint8_t quality)
+{
     if(!quality) {
-        quality = 1;
+        return 1;
     } else if(quality > 100) {
-        quality = 100;
+        return 100;
     }
+    return quality;
+}
 
+// Feeds source lines [first, last) and finishes the image (or band); *lines_done, if given,
+// is how many of them the encoder took before a failure
+static bool encode_lines(jpge::jpeg_encoder &dst_image, uint8_t *src, uint16_t width, pixformat_t format, int src_bpp, uint8_t *line, int first, int last, int *lines_done = NULL)
+{
+    const size_t src_stride = (size_t)width * src_bpp;
+    for (int i = first; i < last; i++) {
+        if(lines_done) {
+            *lines_done = i - first;
+        }
+        const uint8_t *scanline = src + i * src_stride;
+        if(line) {
+            convert_line_format(src, format, line, width, 3, i);
+            scanline = line;
+        }
+        if (!dst_image.process_scanline(scanline)) {
+            ESP_LOGE(TAG, "JPG process line %u failed", i);
+            return false;
+        }
+    }
+    if(lines_done) {
+        *lines_done = last - first;
+    }
+    if (!dst_image.process_scanline(NULL)) {
+        ESP_LOGE(TAG, "JPG image finish failed");
+        return false;
+    }
+    return true;
+}
+
+// optimize_huffman feeds the image twice: symbol statistics first, then the JPEG with tables built from them
+bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpge::output_stream *dst_stream, bool optimize_huffman = false, int *lines_done = NULL)
+{
     jpge::params comp_params = jpge::params();
-    comp_params.m_subsampling = subsampling;
-    comp_params.m_quality = quality;
+    jpge::source_format_t src_format;
+    int src_bpp;
+    bool convert_lines;
+    source_layout(format, comp_params, src_format, src_bpp, convert_lines);
+    comp_params.m_quality = clamp_quality(quality);
+    comp_params.m_two_pass_flag = optimize_huffman;
 
     jpge::jpeg_encoder dst_image;
 
-    if (!dst_image.init(dst_stream, width, height, num_channels, comp_params)) {
+    if (!dst_image.init(dst_stream, width, height, src_format, comp_params)) {
         ESP_LOGE(TAG, "JPG encoder init failed");
         return false;
     }
 
-    uint8_t* line = (uint8_t*)_malloc(width * num_channels);
-    if(!line) {
-        ESP_LOGE(TAG, "Scan line malloc failed");
+    uint8_t* line = NULL;
+    if(convert_lines) {
+        line = (uint8_t*)_malloc(width * 3);
+        if(!line) {
+            ESP_LOGE(TAG, "Scan line malloc failed");
+            return false;
+        }
+    }
+
+    bool ret = true;
+    for (jpge::uint pass = 0; ret && pass < dst_image.get_total_passes(); pass++) {
+        ret = encode_lines(dst_image, src, width, format, src_bpp, line, 0, height, lines_done);
+    }
+    free(line);
+    dst_image.deinit();
+    return ret;
+}
+
+// Area downscaler fused into the scanline feed: every output pixel is the rounded mean of the
+// source rectangle it covers, with integer edges, so 1/2 and 1/4 are plain 2x2 and 4x4 boxes.
+// Source lines are summed as they are read; only one output line of sums is ever held.
+typedef struct {
+    const uint8_t *src;
+    uint16_t width;
+    pixformat_t format;
+    uint16_t out_width;
+    int channels;
+    uint16_t *x_edge;       // out_width + 1 source column edges
+    uint32_t *sum;          // out_width * channels
+    uint8_t *line;          // out_width * channels, what the encoder gets
+} area_scaler_t;
+
+static void scaler_add_line(area_scaler_t *s, int y)
+{
+    const uint16_t *edge = s->x_edge;
+    uint32_t *sum = s->sum;
+    int ox, x;
+
+    if(s->format == PIXFORMAT_GRAYSCALE) {
+        const uint8_t *p = s->src + (size_t)y * s->width;
+        for(ox = 0; ox < s->out_width; ox++) {
+            uint32_t v = 0;
+            for(x = edge[ox]; x < edge[ox + 1]; x++) {
+                v += p[x];
+            }
+            sum[ox] += v;
+        }
+    } else if(s->format == PIXFORMAT_RGB565) {
+        const uint8_t *p = s->src + (size_t)y * s->width * 2;
+        for(ox = 0; ox < s->out_width; ox++, sum += 3) {
+            uint32_t r = 0, g = 0, b = 0;
+            for(x = edge[ox]; x < edge[ox + 1]; x++) {
+                const uint8_t *px = p + x * 2;
+                r += px[0] & 0xF8;
+                g += ((px[0] & 0x07) << 5) | ((px[1] & 0xE0) >> 3);
+                b += (px[1] & 0x1F) << 3;
+            }
+            sum[0] += r; sum[1] += g; sum[2] += b;
+        }
+    } else if(s->format == PIXFORMAT_YUV422) {
+        // Y0 U Y1 V: both pixels of a pair share U and V
+        const uint8_t *p = s->src + (size_t)y * s->width * 2;
+        for(ox = 0; ox < s->out_width; ox++, sum += 3) {
+            uint32_t l = 0, u = 0, v = 0;
+            for(x = edge[ox]; x < edge[ox + 1]; x++) {
+                const uint8_t *pair = p + (x & ~1) * 2;
+                l += p[x * 2];
+                u += pair[1];
+                v += (x | 1) < s->width ? pair[3] : 128;
+            }
+            sum[0] += l; sum[1] += u; sum[2] += v;
+        }
+    } else {
+        // RGB888 comes from the camera as BGR
+        const uint8_t *p = s->src + (size_t)y * s->width * 3;
+        for(ox = 0; ox < s->out_width; ox++, sum += 3) {
+            uint32_t r = 0, g = 0, b = 0;
+            for(x = edge[ox]; x < edge[ox + 1]; x++) {
+                const uint8_t *px = p + x * 3;
+                r += px[2]; g += px[1]; b += px[0];
+            }
+            sum[0] += r; sum[1] += g; sum[2] += b;
+        }
+    }
+}
+
+// Turns the sums of `rows` source lines into the next output line and clears them
+static void scaler_emit_line(area_scaler_t *s, uint32_t rows)
+{
+    const int channels = s->channels;
+    uint32_t *sum = s->sum;
+    uint8_t *line = s->line;
+
+    for(int ox = 0; ox < s->out_width; ox++) {
+        const uint32_t count = rows * (s->x_edge[ox + 1] - s->x_edge[ox]);
+        for(int c = 0; c < channels; c++) {
+            *line++ = (*sum + count / 2) / count;
+            *sum++ = 0;
+        }
+    }
+}
+
+static bool convert_image_scaled(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint16_t out_width, uint16_t out_height, jpge::output_stream *dst_stream)
+{
+    // The scaler reads every source line, so the buffer must hold the whole frame
+    jpge::params comp_params = jpge::params();
+    jpge::source_format_t src_format;
+    int src_bpp;
+    bool convert_lines;
+    source_layout(format, comp_params, src_format, src_bpp, convert_lines);
+    if(!src || src_len < (size_t)width * height * src_bpp) {
+        ESP_LOGE(TAG, "Source buffer too short: %u < %u", (unsigned)src_len, (unsigned)((size_t)width * height * src_bpp));
+        return false;
+    }
+    if(out_width == width && out_height == height) {
+        return convert_image(src, width, height, format, quality, dst_stream);
+    }
+    if(!out_width || !out_height || out_width > width || out_height > height) {
+        ESP_LOGE(TAG, "Cannot scale %ux%u to %ux%u", width, height, out_width, out_height);
         return false;
     }
 
-    for (int i = 0; i < height; i++) {
-        convert_line_format(src, format, line, width, num_channels, i);
-        if (!dst_image.process_scanline(line)) {
-            ESP_LOGE(TAG, "JPG process line %u failed", i);
-            free(line);
-            return false;
+    // Colour goes in as RGB (or studio-range YUV) triplets, subsampled as at full size
+    src_format = jpge::SRC_RGB;
+    comp_params.m_subsampling = jpge::H2V2;
+    comp_params.m_quality = clamp_quality(quality);
+    area_scaler_t s = {};
+    s.src = src;
+    s.width = width;
+    s.format = format;
+    s.out_width = out_width;
+    s.channels = 3;
+    if(format == PIXFORMAT_GRAYSCALE) {
+        s.channels = 1;
+        comp_params.m_subsampling = jpge::Y_ONLY;
+        src_format = jpge::SRC_Y;
+    } else if(format == PIXFORMAT_YUV422) {
+        comp_params.m_subsampling = jpge::H2V1;
+        src_format = jpge::SRC_YUV;
+    }
+
+    jpge::jpeg_encoder dst_image;
+    if (!dst_image.init(dst_stream, out_width, out_height, src_format, comp_params)) {
+        ESP_LOGE(TAG, "JPG encoder init failed");
+        return false;
+    }
+
+    s.x_edge = (uint16_t*)_malloc((out_width + 1) * sizeof(uint16_t));
+    s.sum = (uint32_t*)_malloc((size_t)out_width * s.channels * sizeof(uint32_t));
+    s.line = (uint8_t*)_malloc((size_t)out_width * s.channels);
+    bool ret = s.x_edge && s.sum && s.line;
+    if(!ret) {
+        ESP_LOGE(TAG, "Scaler malloc failed");
+    } else {
+        memset(s.sum, 0, (size_t)out_width * s.channels * sizeof(uint32_t));
+        for(int ox = 0; ox <= out_width; ox++) {
+            s.x_edge[ox] = (uint32_t)ox * width / out_width;
         }
     }
-    free(line);
 
-    if (!dst_image.process_scanline(NULL)) {
+    for(int oy = 0; ret && oy < out_height; oy++) {
+        const int first = (uint32_t)oy * height / out_height;
+        const int last = (uint32_t)(oy + 1) * height / out_height;
+        for(int y = first; y < last; y++) {
+            scaler_add_line(&s, y);
+        }
+        scaler_emit_line(&s, last - first);
+        if (!dst_image.process_scanline(s.line)) {
+            ESP_LOGE(TAG, "JPG process line %u failed", oy);
+            ret = false;
+        }
+    }
+    if (ret && !dst_image.process_scanline(NULL)) {
         ESP_LOGE(TAG, "JPG image finish failed");
-        return false;
+        ret = false;
     }
+
+    free(s.x_edge);
+    free(s.sum);
+    free(s.line);
     dst_image.deinit();
-    return true;
+    return ret;
 }
 
 class callback_stream : public jpge::output_stream {
@@ -189,42 +394,139 @@ public:
             return true;
         }
         if ((size_t)len > (max_len - index)) {
-            //ESP_LOGW(TAG, "JPG output overflow: %d bytes (%d,%d,%d)", len - (max_len - index), len, index, max_len);
-            len = max_len - index;
+            ESP_LOGE(TAG, "JPG output overflow: %u bytes over %u", (unsigned)(index + len - max_len), (unsigned)max_len);
+            return false;
+        }
+        memcpy(out_buf + index, pBuf, len);
+        index += len;
+        return true;
+    }
+
+    virtual size_t get_size() const
+    {
+        return index;
+    }
+};
+
+// First guess for the output: a quarter byte per pixel holds most frames up to quality 80;
+// bigger ones grow by half at a time and everything is trimmed to size at the end
+#define JPG_OUT_BUF_MIN         4096
+#define JPG_OUT_BUF_PIXEL_DIV   4
+
+// Memory stream that grows geometrically in one memory region instead of truncating
+// limit != 0: writes past limit bytes fail at once instead of growing the buffer
+class growable_stream : public jpge::output_stream {
+protected:
+    uint8_t *out_buf;
+    size_t max_len, index, limit;
+    uint32_t caps;
+    bool ok, over;
+
+public:
+    growable_stream(size_t initial_len = JPG_OUT_BUF_MIN, uint32_t caps = 0, size_t limit = 0) : out_buf(NULL), max_len(initial_len), index(0), limit(limit), caps(caps), ok(true), over(false) { }
+
+    virtual ~growable_stream()
+    {
+        free(out_buf);
+    }
+
+    virtual bool put_buf(const void* pBuf, int len)
+    {
+        if (!pBuf) {
+            //end of image
+            return ok;
+        }
+        if (!ok) {
+            return false;
         }
-        if (len) {
-            memcpy(out_buf + index, pBuf, len);
+        if (limit && index + len > limit) {
+            ESP_LOGD(TAG, "JPG over the %u byte limit", (unsigned)limit);
+            over = true;
             index += len;
+            ok = false;
+            return false;
         }
+        if (!out_buf || index + len > max_len) {
+            size_t new_len = out_buf ? max_len + max_len / 2 : max_len;
+            while (new_len < index + len) {
+                new_len += new_len / 2;
+            }
+            if (limit && new_len > limit) {
+                new_len = limit;
+            }
+            uint8_t *new_buf = (uint8_t *)_realloc(out_buf, new_len, caps);
+            if (!new_buf) {
+                ESP_LOGE(TAG, "JPG buffer realloc to %u bytes failed", (unsigned)new_len);
+                ok = false;
+                return false;
+            }
+            out_buf = new_buf;
+            max_len = new_len;
+        }
+        memcpy(out_buf + index, pBuf, len);
+        index += len;
         return true;
     }
 
+    // Past the limit: what the stream would have held, with nothing stored beyond limit
     virtual size_t get_size() const
     {
         return index;
     }
+
+    const uint8_t *data() const
+    {
+        return out_buf;
+    }
+
+    bool over_limit() const
+    {
+        return over;
+    }
+
+    // Trims the buffer to the bytes written and hands it over to the caller
+    uint8_t *release()
+    {
+        uint8_t *buf = out_buf;
+        if (buf && index && index < max_len) {
+            uint8_t *trimmed = (uint8_t *)_realloc(buf, index, caps);
+            if (trimmed) {
+                buf = trimmed;
+            }
+        }
+        out_buf = NULL;
+        max_len = index = 0;
+        return buf;
+    }
 };
 
-bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
+bool fmt2jpg_caps(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len, uint32_t caps)
 {
-    //todo: allocate proper buffer for holding JPEG data
-    //this should be enough for CIF frame size
-    int jpg_buf_len = 128*1024;
-
+    size_t initial_len = (size_t)width * height / JPG_OUT_BUF_PIXEL_DIV;
+    growable_stream dst_stream(initial_len > JPG_OUT_BUF_MIN ? initial_len : JPG_OUT_BUF_MIN, caps);
 
-    uint8_t * jpg_buf = (uint8_t *)_malloc(jpg_buf_len);
-    if(jpg_buf == NULL) {
-        ESP_LOGE(TAG, "JPG buffer malloc failed");
+    if(!convert_image(src, width, height, format, quality, &dst_stream)) {
         return false;
     }
-    memory_stream dst_stream(jpg_buf, jpg_buf_len);
+
+    *out_len = dst_stream.get_size();
+    *out = dst_stream.release();
+    return true;
+}
+
+bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    return fmt2jpg_caps(src, src_len, width, height, format, quality, out, out_len, 0);
+}
+
+bool fmt2jpg_buf(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t * buf, size_t buf_len, size_t * out_len)
+{
+    memory_stream dst_stream(buf, buf_len);
 
     if(!convert_image(src, width, height, format, quality, &dst_stream)) {
-        free(jpg_buf);
         return false;
     }
 
-    *out = jpg_buf;
     *out_len = dst_stream.get_size();
     return true;
 }
@@ -233,3 +535,325 @@ bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_l
 {
     return fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
 }
+
+// The second pass about doubles the encode time for a few percent of output, so it is opt-in
+#if CONFIG_CAMERA_JPEG_OPTIMIZED_HUFFMAN
+#define JPG_OPTIMIZED_HUFFMAN   true
+#else
+#define JPG_OPTIMIZED_HUFFMAN   false
+#endif
+
+bool fmt2jpg_optimized(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    size_t initial_len = (size_t)width * height / JPG_OUT_BUF_PIXEL_DIV;
+    growable_stream dst_stream(initial_len > JPG_OUT_BUF_MIN ? initial_len : JPG_OUT_BUF_MIN);
+
+    if(!convert_image(src, width, height, format, quality, &dst_stream, JPG_OPTIMIZED_HUFFMAN)) {
+        return false;
+    }
+
+    *out_len = dst_stream.get_size();
+    *out = dst_stream.release();
+    return true;
+}
+
+bool frame2jpg_optimized(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    return fmt2jpg_optimized(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
+}
+
+// Aim this far under the budget, so a slightly optimistic estimate still fits
+#define JPG_TARGET_MARGIN_DIV   32
+// Re-encode at a higher quality when the first JPEG leaves more of the budget unused than this
+#define JPG_TARGET_SLACK_DIV    8
+
+// Size model of the image: the analysis pass sees the same lines an encode would
+static bool analyse_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, jpge::size_estimate &estimate)
+{
+    jpge::params comp_params = jpge::params();
+    jpge::source_format_t src_format;
+    int src_bpp;
+    bool convert_lines;
+    source_layout(format, comp_params, src_format, src_bpp, convert_lines);
+
+    jpge::jpeg_encoder analyser;
+    if (!analyser.init_analysis(&estimate, width, height, src_format, comp_params)) {
+        ESP_LOGE(TAG, "JPG analysis init failed");
+        return false;
+    }
+
+    uint8_t* line = NULL;
+    if(convert_lines) {
+        line = (uint8_t*)_malloc(width * 3);
+        if(!line) {
+            ESP_LOGE(TAG, "Scan line malloc failed");
+            return false;
+        }
+    }
+
+    bool ret = encode_lines(analyser, src, width, format, src_bpp, line, 0, height);
+    free(line);
+    analyser.deinit();
+    return ret;
+}
+
+// Encodes into at most max_len bytes. An attempt that goes over stops at the first write past
+// the budget and returns NULL with *over set; *out_len is then its full size, extrapolated from
+// the bytes produced by the source lines encoded so far.
+static uint8_t *encode_to_buffer(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, size_t max_len, size_t * out_len, bool * over)
+{
+    growable_stream dst_stream(max_len, 0, max_len);
+    int lines_done = 0;
+
+    *over = false;
+    if(!convert_image(src, width, height, format, quality, &dst_stream, false, &lines_done)) {
+        if(!dst_stream.over_limit()) {
+            return NULL;
+        }
+        *over = true;
+        const size_t written = dst_stream.get_size();
+        size_t estimate = lines_done > 0 ? (size_t)((uint64_t)written * height / lines_done) : written * 2;
+        *out_len = estimate > max_len ? estimate : max_len + 1;
+        return NULL;
+    }
+    *out_len = dst_stream.get_size();
+    return dst_stream.release();
+}
+
+bool fmt2jpg_target(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, size_t max_len, uint8_t ** out, size_t * out_len, jpg_target_info_t * info)
+{
+    jpge::size_estimate estimate;
+    if(!analyse_image(src, width, height, format, estimate)) {
+        return false;
+    }
+
+    const size_t aim = max_len - max_len / JPG_TARGET_MARGIN_DIV;
+    int quality = estimate.quality_for(aim);
+    if(!quality) {
+        quality = 1;
+    }
+    size_t len = 0;
+    bool over = false;
+    uint8_t *jpg = encode_to_buffer(src, width, height, format, quality, max_len, &len, &over);
+    if(!jpg && !over) {
+        return false;
+    }
+    size_t predicted = estimate.predict(quality);
+    uint8_t encodes = 1;
+
+    // One correction, with the model scaled by how far off it was for this image
+    if(len > max_len || (len < max_len - max_len / JPG_TARGET_SLACK_DIV && quality < 100)) {
+        int retry = estimate.quality_for(aim, len, predicted);
+        if(!retry) {
+            retry = 1;
+        }
+        if(len > max_len ? retry < quality : retry > quality) {
+            size_t retry_len = 0;
+            bool retry_over = false;
+            uint8_t *retry_jpg = encode_to_buffer(src, width, height, format, retry, max_len, &retry_len, &retry_over);
+            encodes++;
+            if(retry_jpg || (retry_over && len > max_len)) {
+                free(jpg);
+                jpg = retry_jpg;
+                len = retry_len;
+                quality = retry;
+                predicted = estimate.predict(quality);
+            } else {
+                free(retry_jpg);
+            }
+        }
+    }
+
+    if(info) {
+        info->quality = quality;
+        info->predicted_len = predicted;
+        info->actual_len = len;
+        info->encodes = encodes;
+    }
+    if(len > max_len) {
+        ESP_LOGE(TAG, "JPG of about %u bytes at quality %d is over the %u byte budget", (unsigned)len, quality, (unsigned)max_len);
+        free(jpg);
+        return false;
+    }
+    *out = jpg;
+    *out_len = len;
+    return true;
+}
+
+bool frame2jpg_target(camera_fb_t * fb, size_t max_len, uint8_t ** out, size_t * out_len, jpg_target_info_t * info)
+{
+    return fmt2jpg_target(fb->buf, fb->len, fb->width, fb->height, fb->format, max_len, out, out_len, info);
+}
+
+bool fmt2jpg_scaled(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint16_t out_width, uint16_t out_height, uint8_t ** out, size_t * out_len)
+{
+    size_t initial_len = (size_t)out_width * out_height / JPG_OUT_BUF_PIXEL_DIV;
+    growable_stream dst_stream(initial_len > JPG_OUT_BUF_MIN ? initial_len : JPG_OUT_BUF_MIN);
+
+    if(!convert_image_scaled(src, src_len, width, height, format, quality, out_width, out_height, &dst_stream)) {
+        return false;
+    }
+
+    *out_len = dst_stream.get_size();
+    *out = dst_stream.release();
+    return true;
+}
+
+bool frame2jpg_scaled(camera_fb_t * fb, uint8_t quality, uint16_t out_width, uint16_t out_height, uint8_t ** out, size_t * out_len)
+{
+    return fmt2jpg_scaled(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out_width, out_height, out, out_len);
+}
+
+// Bands per encoding task: more, smaller bands even out the load between tasks
+// at the cost of a restart marker (2 bytes plus padding) each
+#define JPG_BANDS_PER_TASK      4
+#define JPG_BAND_TASK_STACK     6144
+
+// Shared by the calling task and its helpers; bands are handed out through `next`
+typedef struct {
+    uint8_t *src;
+    uint16_t width;
+    uint16_t height;
+    pixformat_t format;
+    jpge::params comp_params;
+    jpge::source_format_t src_format;
+    int src_bpp;
+    bool convert_lines;
+    int bands;
+    int band_lines;
+    int next;
+    bool failed;
+    growable_stream *out;
+    QueueHandle_t done;
+} band_job_t;
+
+static void encode_bands(band_job_t *job)
+{
+    jpge::jpeg_encoder dst_image;
+    uint8_t *line = NULL;
+    if (job->convert_lines) {
+        line = (uint8_t*)_malloc(job->width * 3);
+        if (!line) {
+            ESP_LOGE(TAG, "Scan line malloc failed");
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    for (;;) {
+        int band = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (band >= job->bands || __atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+            break;
+        }
+        int first = band * job->band_lines;
+        int last = first + job->band_lines < job->height ? first + job->band_lines : job->height;
+        if (!dst_image.init_band(&job->out[band], job->width, job->height, job->src_format, job->comp_params, band)
+            || !encode_lines(dst_image, job->src, job->width, job->format, job->src_bpp, line, first, last)) {
+            ESP_LOGE(TAG, "JPG band %d failed", band);
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    free(line);
+}
+
+static void band_task(void *arg)
+{
+    band_job_t *job = (band_job_t *)arg;
+    encode_bands(job);
+    uint8_t finished = 1;
+    xQueueSend(job->done, &finished, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+bool fmt2jpg_parallel(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len, int tasks)
+{
+    if (tasks <= 0) {
+        tasks = portNUM_PROCESSORS;
+    }
+
+    band_job_t job = {};
+    job.src = src;
+    job.width = width;
+    job.height = height;
+    job.format = format;
+    source_layout(format, job.comp_params, job.src_format, job.src_bpp, job.convert_lines);
+    job.comp_params.m_quality = clamp_quality(quality);
+
+    // Restart interval in MCU rows: JPG_BANDS_PER_TASK bands per task, within the 16-bit MCU count of DRI
+    const int mcu_w = (job.comp_params.m_subsampling >= jpge::H2V1) ? 16 : 8;
+    const int mcus_per_row = (width + mcu_w - 1) / mcu_w;
+    job.comp_params.m_restart_rows = 1;
+    job.band_lines = jpge::jpeg_encoder::band_lines(job.comp_params);
+    const int mcu_rows = (height + job.band_lines - 1) / job.band_lines;
+    int rows = mcu_rows / (tasks * JPG_BANDS_PER_TASK);
+    if (rows > 0xFFFF / mcus_per_row) {
+        rows = 0xFFFF / mcus_per_row;
+    }
+    if (rows < 1) {
+        rows = 1;
+    }
+    job.comp_params.m_restart_rows = rows;
+    job.band_lines = jpge::jpeg_encoder::band_lines(job.comp_params);
+    job.bands = (height + job.band_lines - 1) / job.band_lines;
+
+    if (tasks == 1 || job.bands < 2) {
+        return fmt2jpg(src, src_len, width, height, format, quality, out, out_len);
+    }
+    if (tasks > job.bands) {
+        tasks = job.bands;
+    }
+
+    job.out = new (std::nothrow) growable_stream[job.bands];
+    job.done = xQueueCreate(tasks, sizeof(uint8_t));
+    if (!job.out || !job.done) {
+        ESP_LOGE(TAG, "JPG band setup failed");
+        delete[] job.out;
+        if (job.done) {
+            vQueueDelete(job.done);
+        }
+        return false;
+    }
+
+    // The calling task encodes bands too; helpers that can't be created just leave it more work
+    int helpers = 0;
+    for (int i = 1; i < tasks; i++) {
+        if (xTaskCreatePinnedToCore(band_task, "jpg_band", JPG_BAND_TASK_STACK, &job,
+                                    uxTaskPriorityGet(NULL), NULL, tskNO_AFFINITY) == pdPASS) {
+            helpers++;
+        }
+    }
+    encode_bands(&job);
+    for (int i = 0; i < helpers; i++) {
+        uint8_t finished;
+        xQueueReceive(job.done, &finished, portMAX_DELAY);
+    }
+    vQueueDelete(job.done);
+
+    bool ret = !__atomic_load_n(&job.failed, __ATOMIC_RELAXED);
+    size_t total = 0;
+    for (int i = 0; ret && i < job.bands; i++) {
+        total += job.out[i].get_size();
+    }
+    uint8_t *jpg_buf = ret ? (uint8_t *)_malloc(total) : NULL;
+    if (ret && !jpg_buf) {
+        ESP_LOGE(TAG, "JPG buffer malloc failed");
+        ret = false;
+    }
+    if (ret) {
+        size_t index = 0;
+        for (int i = 0; i < job.bands; i++) {
+            memcpy(jpg_buf + index, job.out[i].data(), job.out[i].get_size());
+            index += job.out[i].get_size();
+        }
+        *out = jpg_buf;
+        *out_len = total;
+    }
+    delete[] job.out;
+    return ret;
+}
+
+bool frame2jpg_parallel(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len, int tasks)
+{
+    return fmt2jpg_parallel(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len, tasks);
+}
@@ -683,6 +683,27 @@ void cam_start(void)
     ll_cam_vsync_intr_enable(cam_obj, true);
 }
 
+void cam_reset(void)
+{
+    cam_stop();
+#if CONFIG_IDF_TARGET_ESP32S3
+    ll_cam_dma_reset(cam_obj);
+#endif
+    /* cam_task runs at a higher priority, so once VSYNC is masked it has
+     * drained the pending events and is blocked on the empty queue */
+    xQueueReset(cam_obj->event_queue);
+    cam_obj->state = CAM_STATE_IDLE;
+
+    /* frames already handed to the app stay theirs; queued ones go back to DMA */
+    camera_fb_t *fb = NULL;
+    while (xQueueReceive(cam_obj->frame_buffer_queue, (void *)&fb, 0) == pdTRUE) {
+        if (fb) {
+            cam_give(fb);
+        }
+    }
+    cam_start();
+}
+
 camera_fb_t *cam_take(TickType_t timeout)
 {
     camera_fb_t *dma_buffer = NULL;
@@ -0,0 +1,73 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "cam_recover.h"
+
+static const char *TAG = "cam_recover";
+
+static const char *tier_name[CAMERA_RECOVER_TIER_MAX] = {
+    "dma-reset",
+    "sensor-reset",
+    "reinit",
+};
+
+esp_err_t cam_recover_run(const cam_recover_ops_t *ops, camera_recover_stats_t *stats,
+                          camera_fb_t **fb, camera_recover_tier_t *tier)
+{
+    if (fb) {
+        *fb = NULL;
+    }
+
+    for (int t = CAMERA_RECOVER_DMA_RESET; t < CAMERA_RECOVER_TIER_MAX; t++) {
+        int64_t start = esp_timer_get_time();
+        esp_err_t err = ESP_ERR_INVALID_STATE;
+        if (t != CAMERA_RECOVER_REINIT || !ops->quiesce || ops->quiesce(ops->ctx)) {
+            err = ops->run_tier(ops->ctx, (camera_recover_tier_t)t);
+        }
+        camera_fb_t *probe = (err == ESP_OK) ? ops->probe(ops->ctx) : NULL;
+        uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+        stats->attempts[t]++;
+        stats->total_us[t] += elapsed;
+        if (elapsed > stats->max_us[t]) {
+            stats->max_us[t] = elapsed;
+        }
+
+        if (probe) {
+            stats->recovered[t]++;
+            ESP_LOGI(TAG, "Recovered by %s in %lu us", tier_name[t], (unsigned long)elapsed);
+            if (tier) {
+                *tier = (camera_recover_tier_t)t;
+            }
+            if (fb) {
+                *fb = probe;
+            } else {
+                ops->release(ops->ctx, probe);
+            }
+            return ESP_OK;
+        }
+
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "%s failed: 0x%x", tier_name[t], err);
+        } else {
+            ESP_LOGW(TAG, "%s: still no frame", tier_name[t]);
+        }
+    }
+
+    stats->failures++;
+    ESP_LOGE(TAG, "All recovery tiers failed");
+    return ESP_FAIL;
+}
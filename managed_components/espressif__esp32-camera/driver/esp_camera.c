@@ -25,6 +25,7 @@
 #include "sensor.h"
 #include "sccb.h"
 #include "cam_hal.h"
+#include "cam_recover.h"
 #include "esp_camera.h"
 #include "xclk.h"
 #if CONFIG_OV2640_SUPPORT
@@ -96,6 +97,11 @@ static const char *CAMERA_SENSOR_NVS_KEY = "sensor";
 static const char *CAMERA_PIXFORMAT_NVS_KEY = "pixformat";
 static camera_state_t *s_state = NULL;
 static camera_config_t s_saved_config;
+static bool s_config_saved = false;
+static camera_recover_stats_t s_recover_stats;
+static camera_recover_quiesce_cb_t s_recover_quiesce;
+static void *s_recover_quiesce_arg;
+static int s_fb_taken;  // Frames handed out and not yet returned
 
 #if CONFIG_IDF_TARGET_ESP32S3 // LCD_CAM module of ESP32-S3 will generate xclk
 #define CAMERA_ENABLE_OUT_CLOCK(v)
@@ -300,6 +306,7 @@ esp_err_t esp_camera_init(const camera_config_t *config)
 {
     esp_err_t err;
     s_saved_config = *config;
+    s_config_saved = true;
     err = cam_init(config);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Camera init failed with error 0x%x", err);
@@ -373,6 +380,7 @@ fail:
 esp_err_t esp_camera_deinit()
 {
     esp_err_t ret = cam_deinit();
+    __atomic_store_n(&s_fb_taken, 0, __ATOMIC_RELAXED);
     CAMERA_DISABLE_OUT_CLOCK();
     if (s_state) {
         SCCB_Deinit();
@@ -386,26 +394,33 @@ esp_err_t esp_camera_deinit()
 
 #define FB_GET_TIMEOUT (4000 / portTICK_PERIOD_MS)
 
-camera_fb_t *esp_camera_fb_get()
+static camera_fb_t *camera_fb_take(TickType_t timeout)
 {
-    if (s_state == NULL) {
-        return NULL;
-    }
-    camera_fb_t *fb = cam_take(FB_GET_TIMEOUT);
+    camera_fb_t *fb = cam_take(timeout);
     //set the frame properties
     if (fb) {
         fb->width = resolution[s_state->sensor.status.framesize].width;
         fb->height = resolution[s_state->sensor.status.framesize].height;
         fb->format = s_state->sensor.pixformat;
+        __atomic_add_fetch(&s_fb_taken, 1, __ATOMIC_RELAXED);
     }
     return fb;
 }
 
+camera_fb_t *esp_camera_fb_get()
+{
+    if (s_state == NULL) {
+        return NULL;
+    }
+    return camera_fb_take(FB_GET_TIMEOUT);
+}
+
 void esp_camera_fb_return(camera_fb_t *fb)
 {
     if (s_state == NULL) {
         return;
     }
+    __atomic_sub_fetch(&s_fb_taken, 1, __ATOMIC_RELAXED);
     cam_give(fb);
 }
 
@@ -417,6 +432,36 @@ sensor_t *esp_camera_sensor_get()
     return &s_state->sensor;
 }
 
+static void camera_apply_status(sensor_t *s, const camera_status_t *st)
+{
+    s->set_ae_level(s, st->ae_level);
+    s->set_aec2(s, st->aec2);
+    s->set_aec_value(s, st->aec_value);
+    s->set_agc_gain(s, st->agc_gain);
+    s->set_awb_gain(s, st->awb_gain);
+    s->set_bpc(s, st->bpc);
+    s->set_brightness(s, st->brightness);
+    s->set_colorbar(s, st->colorbar);
+    s->set_contrast(s, st->contrast);
+    s->set_dcw(s, st->dcw);
+    s->set_denoise(s, st->denoise);
+    s->set_exposure_ctrl(s, st->aec);
+    s->set_framesize(s, st->framesize);
+    s->set_gain_ctrl(s, st->agc);
+    s->set_gainceiling(s, st->gainceiling);
+    s->set_hmirror(s, st->hmirror);
+    s->set_lenc(s, st->lenc);
+    s->set_quality(s, st->quality);
+    s->set_raw_gma(s, st->raw_gma);
+    s->set_saturation(s, st->saturation);
+    s->set_sharpness(s, st->sharpness);
+    s->set_special_effect(s, st->special_effect);
+    s->set_vflip(s, st->vflip);
+    s->set_wb_mode(s, st->wb_mode);
+    s->set_whitebal(s, st->awb);
+    s->set_wpc(s, st->wpc);
+}
+
 esp_err_t esp_camera_save_to_nvs(const char *key)
 {
 #if ESP_IDF_VERSION_MAJOR > 3
@@ -463,32 +508,7 @@ esp_err_t esp_camera_load_from_nvs(const char *key)
             size_t size = sizeof(camera_status_t);
             ret = nvs_get_blob(handle, CAMERA_SENSOR_NVS_KEY, &st, &size);
             if (ret == ESP_OK) {
-                s->set_ae_level(s, st.ae_level);
-                s->set_aec2(s, st.aec2);
-                s->set_aec_value(s, st.aec_value);
-                s->set_agc_gain(s, st.agc_gain);
-                s->set_awb_gain(s, st.awb_gain);
-                s->set_bpc(s, st.bpc);
-                s->set_brightness(s, st.brightness);
-                s->set_colorbar(s, st.colorbar);
-                s->set_contrast(s, st.contrast);
-                s->set_dcw(s, st.dcw);
-                s->set_denoise(s, st.denoise);
-                s->set_exposure_ctrl(s, st.aec);
-                s->set_framesize(s, st.framesize);
-                s->set_gain_ctrl(s, st.agc);
-                s->set_gainceiling(s, st.gainceiling);
-                s->set_hmirror(s, st.hmirror);
-                s->set_lenc(s, st.lenc);
-                s->set_quality(s, st.quality);
-                s->set_raw_gma(s, st.raw_gma);
-                s->set_saturation(s, st.saturation);
-                s->set_sharpness(s, st.sharpness);
-                s->set_special_effect(s, st.special_effect);
-                s->set_vflip(s, st.vflip);
-                s->set_wb_mode(s, st.wb_mode);
-                s->set_whitebal(s, st.awb);
-                s->set_wpc(s, st.wpc);
+                camera_apply_status(s, &st);
             }
             ret = nvs_get_u8(handle, CAMERA_PIXFORMAT_NVS_KEY, &pf);
             if (ret == ESP_OK) {
@@ -548,3 +568,121 @@ bool esp_camera_get_psram_mode(void)
 {
     return cam_get_psram_mode();
 }
+
+#define RECOVER_PROBE_TIMEOUT (1000 / portTICK_PERIOD_MS)
+
+typedef struct {
+    camera_status_t status;
+    pixformat_t pixformat;
+    bool valid;
+} camera_recover_ctx_t;
+
+static esp_err_t camera_recover_tier(void *arg, camera_recover_tier_t tier)
+{
+    camera_recover_ctx_t *ctx = (camera_recover_ctx_t *)arg;
+
+    switch (tier) {
+    case CAMERA_RECOVER_DMA_RESET:
+        if (s_state == NULL) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        cam_reset();
+        return ESP_OK;
+
+    case CAMERA_RECOVER_SENSOR_RESET: {
+        if (s_state == NULL || !ctx->valid) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        // Same sensor model and SCCB link, only its registers are reloaded
+        sensor_t *s = &s_state->sensor;
+        cam_stop();
+        if (s->reset(s) != 0) {
+            cam_start();
+            return ESP_FAIL;
+        }
+        s->set_pixformat(s, (pixformat_t)s_saved_config.pixel_format);
+        s->pixformat = ctx->pixformat;
+        camera_apply_status(s, &ctx->status);
+        cam_reset();
+        return ESP_OK;
+    }
+
+    case CAMERA_RECOVER_REINIT: {
+        esp_camera_deinit();
+        esp_err_t err = esp_camera_init(&s_saved_config);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (ctx->valid) {
+            camera_apply_status(&s_state->sensor, &ctx->status);
+        }
+        return ESP_OK;
+    }
+
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+}
+
+static camera_fb_t *camera_recover_probe(void *arg)
+{
+    if (s_state == NULL) {
+        return NULL;
+    }
+    return camera_fb_take(RECOVER_PROBE_TIMEOUT);
+}
+
+static void camera_recover_release(void *arg, camera_fb_t *fb)
+{
+    esp_camera_fb_return(fb);
+}
+
+static bool camera_recover_quiesce(void *arg)
+{
+    if (s_recover_quiesce && !s_recover_quiesce(s_recover_quiesce_arg)) {
+        ESP_LOGW(TAG, "Reinit skipped: frames could not be reclaimed");
+        return false;
+    }
+    // cam_deinit() frees every frame buffer, including the ones still being read
+    int taken = __atomic_load_n(&s_fb_taken, __ATOMIC_RELAXED);
+    if (taken) {
+        ESP_LOGW(TAG, "Reinit skipped: %d frame(s) still in use", taken);
+        return false;
+    }
+    return true;
+}
+
+void esp_camera_set_recover_quiesce(camera_recover_quiesce_cb_t cb, void *arg)
+{
+    s_recover_quiesce_arg = arg;
+    s_recover_quiesce = cb;
+}
+
+esp_err_t esp_camera_recover(camera_fb_t **fb, camera_recover_tier_t *tier)
+{
+    if (!s_config_saved) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Snapshot the sensor settings before any tier can wipe them
+    camera_recover_ctx_t ctx = { .valid = false };
+    if (s_state) {
+        ctx.status = s_state->sensor.status;
+        ctx.pixformat = s_state->sensor.pixformat;
+        ctx.valid = true;
+    }
+
+    const cam_recover_ops_t ops = {
+        .run_tier = camera_recover_tier,
+        .probe = camera_recover_probe,
+        .release = camera_recover_release,
+        .quiesce = camera_recover_quiesce,
+        .ctx = &ctx,
+    };
+    return cam_recover_run(&ops, &s_recover_stats, fb, tier);
+}
+
+void esp_camera_get_recover_stats(camera_recover_stats_t *stats)
+{
+    *stats = s_recover_stats;
+}
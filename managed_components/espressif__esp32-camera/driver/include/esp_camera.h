@@ -274,6 +274,72 @@ esp_err_t esp_camera_reconfigure(const camera_config_t *config);
  */
 bool esp_camera_get_psram_mode(void);
 
+/**
+ * @brief Recovery tiers, from cheapest to most disruptive
+ */
+typedef enum {
+    CAMERA_RECOVER_DMA_RESET,       /*!< Stop capture, reset DMA and frame queues, restart. Sensor untouched */
+    CAMERA_RECOVER_SENSOR_RESET,    /*!< Sensor soft reset, then restore the saved sensor status */
+    CAMERA_RECOVER_REINIT,          /*!< Full deinit + init with the last config, then restore the sensor status */
+    CAMERA_RECOVER_TIER_MAX,
+} camera_recover_tier_t;
+
+/**
+ * @brief Per-tier recovery counters
+ */
+typedef struct {
+    uint32_t attempts[CAMERA_RECOVER_TIER_MAX];     /*!< Times each tier was run */
+    uint32_t recovered[CAMERA_RECOVER_TIER_MAX];    /*!< Times each tier produced a valid frame */
+    uint64_t total_us[CAMERA_RECOVER_TIER_MAX];     /*!< Time spent in each tier, including the probe frame */
+    uint32_t max_us[CAMERA_RECOVER_TIER_MAX];       /*!< Slowest run of each tier */
+    uint32_t failures;                              /*!< Recoveries where every tier failed */
+} camera_recover_stats_t;
+
+/**
+ * @brief Recover from a failed capture, escalating one tier at a time.
+ *
+ * Each tier is followed by a probe capture; escalation stops at the first
+ * tier that yields a valid frame. Meant to be called from the capture task
+ * after esp_camera_fb_get() returned NULL.
+ *
+ * CAMERA_RECOVER_REINIT frees the frame buffers. It first calls the hook set with
+ * esp_camera_set_recover_quiesce(), then runs only if every frame taken with
+ * esp_camera_fb_get() has been returned; otherwise it is skipped as failed.
+ *
+ * @param fb    If not NULL, receives the probe frame, which must be returned with
+ *              esp_camera_fb_return(). If NULL, the probe frame is returned to the driver.
+ * @param tier  If not NULL, receives the tier that recovered the camera
+ * @return
+ * - ESP_OK if a tier produced a valid frame
+ * - ESP_ERR_INVALID_STATE if the camera was never initialized
+ * - ESP_FAIL if every tier failed
+ */
+esp_err_t esp_camera_recover(camera_fb_t **fb, camera_recover_tier_t *tier);
+
+/**
+ * @brief Hook that gets every frame back before a full reinit
+ *
+ * Called by esp_camera_recover() from the caller's task. It must make the other
+ * users of the camera return their frames (e.g. drain a pipeline) and return true
+ * once they have, or false to skip the reinit.
+ */
+typedef bool (*camera_recover_quiesce_cb_t)(void *arg);
+
+/**
+ * @brief Set the hook run before CAMERA_RECOVER_REINIT
+ *
+ * @param cb   Hook, NULL to remove it
+ * @param arg  Passed to the hook
+ */
+void esp_camera_set_recover_quiesce(camera_recover_quiesce_cb_t cb, void *arg);
+
+/**
+ * @brief Get the recovery counters accumulated since boot.
+ *
+ * @param stats  Destination for the counters
+ */
+void esp_camera_get_recover_stats(camera_recover_stats_t *stats);
+
 
 #ifdef __cplusplus
 }
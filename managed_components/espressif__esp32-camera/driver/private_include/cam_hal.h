@@ -51,6 +51,13 @@ void cam_stop(void);
 
 void cam_start(void);
 
+/**
+ * @brief Stop capture, reset the DMA channel and frame queues, then restart
+ *
+ * Frames held by the application are left untouched.
+ */
+void cam_reset(void);
+
 camera_fb_t *cam_take(TickType_t timeout);
 
 void cam_give(camera_fb_t *dma_buffer);
@@ -0,0 +1,58 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "esp_camera.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Hardware hooks used by the tier escalation
+ *
+ * Kept apart from esp_camera.c so the escalation and accounting can be
+ * exercised without the camera peripheral.
+ */
+typedef struct {
+    esp_err_t (*run_tier)(void *ctx, camera_recover_tier_t tier);  /*!< Apply one recovery tier */
+    camera_fb_t *(*probe)(void *ctx);                               /*!< Take a frame, NULL on failure */
+    void (*release)(void *ctx, camera_fb_t *fb);                    /*!< Return a probe frame */
+    bool (*quiesce)(void *ctx);                                     /*!< Optional: true once no frame is held, run before REINIT */
+    void *ctx;
+} cam_recover_ops_t;
+
+/**
+ * @brief Run the tiers in order until a probe frame succeeds
+ *
+ * REINIT frees every frame buffer, so it only runs when ops->quiesce (if set)
+ * reports that all frames are back; otherwise the tier fails with
+ * ESP_ERR_INVALID_STATE.
+ *
+ * @param ops    Hardware hooks
+ * @param stats  Counters updated with every tier run
+ * @param fb     Optional destination for the probe frame, released otherwise
+ * @param tier   Optional destination for the tier that recovered the camera
+ *
+ * @return
+ *     - ESP_OK A tier produced a frame
+ *     - ESP_FAIL Every tier failed
+ */
+esp_err_t cam_recover_run(const cam_recover_ops_t *ops, camera_recover_stats_t *stats,
+                          camera_fb_t **fb, camera_recover_tier_t *tier);
+
+#ifdef __cplusplus
+}
+#endif
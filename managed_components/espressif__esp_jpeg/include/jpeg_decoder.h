@@ -55,6 +55,13 @@ typedef struct esp_jpeg_image_cfg_s {
                                          Default size is 3.1kB or 65kB if JD_FASTDECODE == 2 */
     } advanced;
 
+    struct {
+        uint16_t x;         /*!< Left column of the region of interest, in pixels of the scaled output image */
+        uint16_t y;         /*!< Top row of the region of interest, in pixels of the scaled output image */
+        uint16_t width;     /*!< Width of the region of interest. If width or height is 0, the whole image is decoded */
+        uint16_t height;    /*!< Height of the region of interest */
+    } roi;
+
     struct {
         uint32_t read;  /*!< Internal count of read bytes */
     } priv;
@@ -72,6 +79,10 @@ typedef struct esp_jpeg_image_output_s {
 /**
  * @brief Decode JPEG image
  *
+ * With cfg->roi set, only that region is written to cfg->outbuf, as an image of
+ * roi.width x roi.height pixels. MCUs out of the region are only entropy-decoded; restart
+ * intervals out of the region are skipped and decoding stops after the region.
+ *
  * @note This function is blocking.
  *
  * @param[in]  cfg: Configuration structure
@@ -80,15 +91,42 @@ typedef struct esp_jpeg_image_output_s {
  * @return
  *      - ESP_OK            on success
  *      - ESP_ERR_NO_MEM    if there is no memory for allocating main structure
+ *      - ESP_ERR_INVALID_ARG if the output format is not supported or cfg->roi is out of the image
  *      - ESP_FAIL          if there is an error in decoding JPEG
  */
 esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img);
 
+/**
+ * @brief Decode JPEG image on several tasks, split at its restart intervals
+ *
+ * Same as esp_jpeg_decode() for images with restart markers (DRI segment and RSTn, as written
+ * by fmt2jpg_parallel()): the entropy-coded data is scanned for the markers and ranges of
+ * restart intervals are decoded at once into their own part of cfg->outbuf. The calling task
+ * decodes ranges too; tasks - 1 helpers are started for the call, at the caller's priority and
+ * on any core. The helpers use the tables the caller prepared in its working buffer, each with
+ * about 2 kB of its own for input and MCU buffers, heap allocated once and kept for later calls.
+ * Images without restart markers are decoded by the calling task alone.
+ *
+ * @note This function is blocking.
+ *
+ * @param[in]  cfg: Configuration structure
+ * @param[out] img: Output image info
+ * @param[in]  tasks: Tasks decoding at once, the caller included; 0 for one per core
+ *
+ * @return
+ *      - ESP_OK              on success
+ *      - ESP_ERR_NO_MEM      if there is no memory for allocating main structure
+ *      - ESP_ERR_INVALID_ARG if the output format is not supported or cfg->roi is out of the image
+ *      - ESP_FAIL            if there is an error in decoding JPEG
+ */
+esp_err_t esp_jpeg_decode_parallel(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img, int tasks);
+
 /**
  * @brief Get information about the JPEG image
  *
  * Use this function to get the size of the JPEG image without decoding it.
  * Allocate a buffer of size img->output_len to store the decoded image.
+ * With cfg->roi set, the size is the one of the region.
  *
  * @note cfg->outbuf and cfg->outbuf_size are not used in this function.
  * @param[in]  cfg: Configuration structure
@@ -96,11 +134,85 @@ esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *im
  *
  * @return
  *      - ESP_OK              on success
- *      - ESP_ERR_INVALID_ARG if cfg or img is NULL
+ *      - ESP_ERR_INVALID_ARG if cfg or img is NULL, or cfg->roi is out of the image
  *      - ESP_FAIL            if there is an error in decoding JPEG
  */
 esp_err_t esp_jpeg_get_image_info(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img);
 
+/**
+ * @brief Handle of a JPEG decoder that is reused for a stream of images
+ */
+typedef struct esp_jpeg_decoder_s *esp_jpeg_decoder_handle_t;
+
+/**
+ * @brief Counters of a reusable JPEG decoder
+ */
+typedef struct {
+    uint32_t decodes;  /*!< Calls to esp_jpeg_decoder_decode() */
+    uint32_t prepares; /*!< Decodes that had to parse the headers and rebuild the tables */
+} esp_jpeg_decoder_stats_t;
+
+/**
+ * @brief Create a JPEG decoder for repeated decodes
+ *
+ * The decoder owns its working buffer. When the next image has the same frame, Huffman,
+ * quantization, restart and scan segments as the previous one (e.g. MJPEG frames from one
+ * sensor at fixed resolution and quality), the tables already in the working buffer are
+ * reused and only the entropy-coded data is decoded. APPn and COM segments may differ.
+ *
+ * @param[in]  working_buffer_size: Size of the working buffer, 0 for the default of esp_jpeg_decode()
+ * @param[out] ret_decoder: Created decoder
+ *
+ * @return
+ *      - ESP_OK              on success
+ *      - ESP_ERR_INVALID_ARG if ret_decoder is NULL
+ *      - ESP_ERR_NO_MEM      if there is no memory for the decoder
+ */
+esp_err_t esp_jpeg_decoder_create(size_t working_buffer_size, esp_jpeg_decoder_handle_t *ret_decoder);
+
+/**
+ * @brief Decode JPEG image with a reusable decoder
+ *
+ * Same as esp_jpeg_decode(), except that cfg->advanced is ignored: the decoder's working
+ * buffer is used. Output format, scale and flags may change from one call to the next.
+ *
+ * @note This function is blocking. A decoder must not be used from two tasks at once.
+ *
+ * @param[in]  decoder: Decoder from esp_jpeg_decoder_create()
+ * @param[in]  cfg: Configuration structure
+ * @param[out] img: Output image info
+ *
+ * @return
+ *      - ESP_OK              on success
+ *      - ESP_ERR_INVALID_ARG if an argument is NULL or the output format is not supported
+ *      - ESP_ERR_NO_MEM      if the output buffer is too small
+ *      - ESP_FAIL            if there is an error in decoding JPEG
+ */
+esp_err_t esp_jpeg_decoder_decode(esp_jpeg_decoder_handle_t decoder, esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img);
+
+/**
+ * @brief Get the counters of a reusable JPEG decoder
+ *
+ * @param[in]  decoder: Decoder from esp_jpeg_decoder_create()
+ * @param[out] stats: Counters since the decoder was created
+ *
+ * @return
+ *      - ESP_OK              on success
+ *      - ESP_ERR_INVALID_ARG if an argument is NULL
+ */
+esp_err_t esp_jpeg_decoder_get_stats(esp_jpeg_decoder_handle_t decoder, esp_jpeg_decoder_stats_t *stats);
+
+/**
+ * @brief Delete a JPEG decoder and its working buffer
+ *
+ * @param[in] decoder: Decoder from esp_jpeg_decoder_create()
+ *
+ * @return
+ *      - ESP_OK              on success
+ *      - ESP_ERR_INVALID_ARG if decoder is NULL
+ */
+esp_err_t esp_jpeg_decoder_delete(esp_jpeg_decoder_handle_t decoder);
+
 #ifdef __cplusplus
 }
 #endif
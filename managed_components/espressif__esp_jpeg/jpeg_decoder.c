@@ -5,7 +5,11 @@
  */
 
 #include <string.h>
+#include <stdbool.h>
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
 #include "esp_system.h"
 #include "esp_rom_caps.h"
 #include "esp_log.h"
@@ -23,12 +27,14 @@
 
 /* The ROM code of TJPGD is older and has different return type in decode callback */
 typedef unsigned int jpeg_decode_out_t;
+typedef unsigned int jpeg_decode_in_t;
 #else
 /* When Tiny JPG Decoder is not in ROM or selected external code */
 #include "tjpgd.h"
 
 /* The TJPGD outside the ROM code is newer and has different return type in decode callback */
 typedef int jpeg_decode_out_t;
+typedef size_t jpeg_decode_in_t;
 #endif
 
 static const char *TAG = "JPEG";
@@ -57,29 +63,111 @@ static const char *TAG = "JPEG";
 #define ESP_JPEG_COLOR_BYTES    1
 #endif
 
+/* Writes n decoded pixels of one row to dst in the output format */
+typedef void (*jpeg_row_writer_t)(uint8_t *dst, const uint8_t *in, uint32_t n);
+
+/* State of one esp_jpeg_decode() call, passed to TJPGD as device */
+typedef struct {
+    esp_jpeg_image_cfg_t *cfg;
+    uint32_t *read;                 /* Read position in cfg->indata, one per decoding task */
+    jpeg_row_writer_t write_row;    /* Selected once per decode by format and swap_color_bytes */
+    uint8_t *outbuf;
+    uint32_t stride;                /* Bytes per row of the output image */
+    uint8_t out_color_bytes;
+    JRECT roi;                      /* Part of the scaled image written to outbuf */
+} jpeg_decode_ctx_t;
+
+#if !CONFIG_JD_USE_ROM
+/* Restart-interval ranges per decoding task: more, smaller ranges even out the load between tasks */
+#define JPEG_RANGES_PER_TASK    4
+#define JPEG_RANGE_TASK_STACK   4096
+/* Input buffer and MCU work areas of a helper, laid out by jd_prepare_copy() for the largest MCU (4 Y blocks) */
+#define JPEG_RANGE_SCRATCH_SIZE (((JD_SZBUF + 3) & ~3) + (4 * 64 * 2 + 64) + (4 + 2) * 64 * sizeof(jd_yuv_t))
+
+/* Shared by the calling task and its helpers; ranges are handed out through `next` */
+typedef struct {
+    const jpeg_decode_ctx_t *ctx;   /* Output of the image, the same for every task */
+    JDEC prepared;                  /* Copy of the caller's TJPGD before any range, read-only for every task */
+    const JRECT *roi;               /* Region to decode, NULL for the whole image */
+    const uint32_t *offsets;        /* Entropy-coded data of each restart interval */
+    uint32_t intervals_per_range;
+    int ranges;
+    int next;
+    bool failed;
+    uint8_t *scratch;               /* JPEG_RANGE_SCRATCH_SIZE bytes for each helper */
+    int helper;                     /* Next helper's part of scratch */
+    QueueHandle_t done;
+} jpeg_range_job_t;
+
+/* Helper scratch kept between calls; a call while another one holds it allocates its own */
+static portMUX_TYPE s_range_scratch_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t *s_range_scratch;
+static int s_range_scratch_helpers;
+static bool s_range_scratch_busy;
+#endif
+
+/* Decoder that keeps the TJPGD tables of the last image between decodes */
+struct esp_jpeg_decoder_s {
+    JDEC jdec;                      /* Prepared for the cached headers, tables live in workbuf */
+    uint8_t *workbuf;
+    size_t workbuf_size;
+#if !CONFIG_JD_USE_ROM
+    /* The ROM decoder cannot resume at the scan, so it keeps no headers to match against */
+    uint8_t *headers;               /* SOF0, DHT, DQT, DRI and SOS segments the tables were built from */
+    size_t headers_len;
+    size_t headers_cap;
+    bool prepared;
+#endif
+    esp_jpeg_decoder_stats_t stats;
+};
+
 /*******************************************************************************
 * Function definitions
 *******************************************************************************/
 static uint8_t jpeg_get_div_by_scale(esp_jpeg_image_scale_t scale);
 static uint8_t jpeg_get_color_bytes(esp_jpeg_image_format_t format);
+static jpeg_row_writer_t jpeg_get_row_writer(esp_jpeg_image_format_t format, bool swap_color_bytes);
+static esp_err_t jpeg_get_output_size(const esp_jpeg_image_cfg_t *cfg, uint16_t width, uint16_t height, esp_jpeg_image_output_t *img);
 
-static unsigned int jpeg_decode_in_cb(JDEC *jd, uint8_t *buff, unsigned int nbyte);
+static jpeg_decode_in_t jpeg_decode_in_cb(JDEC *jd, uint8_t *buff, jpeg_decode_in_t nbyte);
 static jpeg_decode_out_t jpeg_decode_out_cb(JDEC *jd, void *bitmap, JRECT *rect);
 static inline uint16_t ldb_word(const void *ptr);
+static esp_err_t jpeg_decode_prepared(JDEC *jd, jpeg_decode_ctx_t *ctx, esp_jpeg_image_output_t *img, int tasks);
+static esp_err_t jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img, int tasks);
+#if !CONFIG_JD_USE_ROM
+static uint32_t jpeg_match_headers(esp_jpeg_decoder_handle_t decoder, const esp_jpeg_image_cfg_t *cfg);
+static bool jpeg_store_headers(esp_jpeg_decoder_handle_t decoder, const esp_jpeg_image_cfg_t *cfg);
+static uint32_t jpeg_walk_headers(const esp_jpeg_image_cfg_t *cfg, bool (*visit)(esp_jpeg_decoder_handle_t, const uint8_t *, size_t),
+                                  esp_jpeg_decoder_handle_t decoder);
+#endif
 /*******************************************************************************
 * Public API functions
 *******************************************************************************/
 
 esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img)
+{
+    return jpeg_decode(cfg, img, 1);
+}
+
+esp_err_t esp_jpeg_decode_parallel(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img, int tasks)
+{
+    return jpeg_decode(cfg, img, tasks > 0 ? tasks : portNUM_PROCESSORS);
+}
+
+static esp_err_t jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img, int tasks)
 {
     esp_err_t ret = ESP_OK;
     uint8_t *workbuf = NULL;
     JRESULT res;
     JDEC JDEC;
+    jpeg_decode_ctx_t ctx;
 
     assert(cfg != NULL);
     assert(img != NULL);
 
+    ctx.write_row = jpeg_get_row_writer(cfg->out_format, cfg->flags.swap_color_bytes);
+    ESP_RETURN_ON_FALSE(ctx.write_row, ESP_ERR_INVALID_ARG, TAG, "Selected output format is not supported!");
+
     const bool allocate_buffer = (cfg->advanced.working_buffer == NULL);
     const size_t workbuf_size = allocate_buffer ? JPEG_WORK_BUF_SIZE : cfg->advanced.working_buffer_size;
     if (allocate_buffer) {
@@ -92,26 +180,14 @@ esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *im
 
 
     cfg->priv.read = 0;
+    ctx.cfg = cfg;
+    ctx.read = &cfg->priv.read;
 
     /* Prepare image */
-    res = jd_prepare(&JDEC, jpeg_decode_in_cb, workbuf, workbuf_size, cfg);
+    res = jd_prepare(&JDEC, jpeg_decode_in_cb, workbuf, workbuf_size, &ctx);
     ESP_GOTO_ON_FALSE((res == JDR_OK), ESP_FAIL, err, TAG, "Error in preparing JPEG image! %d", res);
 
-    const uint8_t scale_div       = jpeg_get_div_by_scale(cfg->out_scale);
-    const uint8_t out_color_bytes = jpeg_get_color_bytes(cfg->out_format);
-
-    /* Size of output image */
-    const uint32_t outsize = (JDEC.height / scale_div) * (JDEC.width / scale_div) * out_color_bytes;
-    ESP_GOTO_ON_FALSE((outsize <= cfg->outbuf_size), ESP_ERR_NO_MEM, err, TAG, "Not enough size in output buffer!");
-
-    /* Size of output image */
-    img->height = JDEC.height / scale_div;
-    img->width = JDEC.width / scale_div;
-    img->output_len = outsize;
-
-    /* Decode JPEG */
-    res = jd_decomp(&JDEC, jpeg_decode_out_cb, cfg->out_scale);
-    ESP_GOTO_ON_FALSE((res == JDR_OK), ESP_FAIL, err, TAG, "Error in decoding JPEG image! %d", res);
+    ret = jpeg_decode_prepared(&JDEC, &ctx, img, tasks);
 
 err:
     if (workbuf && allocate_buffer) {
@@ -121,6 +197,80 @@ err:
     return ret;
 }
 
+esp_err_t esp_jpeg_decoder_create(size_t working_buffer_size, esp_jpeg_decoder_handle_t *ret_decoder)
+{
+    ESP_RETURN_ON_FALSE(ret_decoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    esp_jpeg_decoder_handle_t decoder = calloc(1, sizeof(struct esp_jpeg_decoder_s));
+    ESP_RETURN_ON_FALSE(decoder, ESP_ERR_NO_MEM, TAG, "no mem for JPEG decoder");
+    decoder->workbuf_size = working_buffer_size ? working_buffer_size : JPEG_WORK_BUF_SIZE;
+    decoder->workbuf = heap_caps_malloc(decoder->workbuf_size, MALLOC_CAP_DEFAULT);
+    if (!decoder->workbuf) {
+        free(decoder);
+        ESP_LOGE(TAG, "no mem for JPEG work buffer");
+        return ESP_ERR_NO_MEM;
+    }
+    *ret_decoder = decoder;
+    return ESP_OK;
+}
+
+esp_err_t esp_jpeg_decoder_decode(esp_jpeg_decoder_handle_t decoder, esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img)
+{
+    JRESULT res;
+    jpeg_decode_ctx_t ctx;
+
+    ESP_RETURN_ON_FALSE(decoder && cfg && img, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    ctx.write_row = jpeg_get_row_writer(cfg->out_format, cfg->flags.swap_color_bytes);
+    ESP_RETURN_ON_FALSE(ctx.write_row, ESP_ERR_INVALID_ARG, TAG, "Selected output format is not supported!");
+    ctx.cfg = cfg;
+    ctx.read = &cfg->priv.read;
+    decoder->stats.decodes++;
+
+#if !CONFIG_JD_USE_ROM
+    /* Same tables as the last image: only the scan is decoded */
+    const uint32_t scan_ofs = decoder->prepared ? jpeg_match_headers(decoder, cfg) : 0;
+    if (scan_ofs) {
+        cfg->priv.read = scan_ofs;
+        res = jd_prepare_scan(&decoder->jdec, jpeg_decode_in_cb, &ctx, scan_ofs);
+        ESP_RETURN_ON_FALSE((res == JDR_OK), ESP_FAIL, TAG, "Error in preparing JPEG scan! %d", res);
+        return jpeg_decode_prepared(&decoder->jdec, &ctx, img, 1);
+    }
+#endif
+
+    /* The work buffer is rebuilt, whatever was cached is gone */
+#if !CONFIG_JD_USE_ROM
+    decoder->prepared = false;
+#endif
+    decoder->stats.prepares++;
+    cfg->priv.read = 0;
+    res = jd_prepare(&decoder->jdec, jpeg_decode_in_cb, decoder->workbuf, decoder->workbuf_size, &ctx);
+    ESP_RETURN_ON_FALSE((res == JDR_OK), ESP_FAIL, TAG, "Error in preparing JPEG image! %d", res);
+#if !CONFIG_JD_USE_ROM
+    decoder->prepared = jpeg_store_headers(decoder, cfg);
+#endif
+
+    return jpeg_decode_prepared(&decoder->jdec, &ctx, img, 1);
+}
+
+esp_err_t esp_jpeg_decoder_get_stats(esp_jpeg_decoder_handle_t decoder, esp_jpeg_decoder_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(decoder && stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    *stats = decoder->stats;
+    return ESP_OK;
+}
+
+esp_err_t esp_jpeg_decoder_delete(esp_jpeg_decoder_handle_t decoder)
+{
+    ESP_RETURN_ON_FALSE(decoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+#if !CONFIG_JD_USE_ROM
+    free(decoder->headers);
+#endif
+    free(decoder->workbuf);
+    free(decoder);
+    return ESP_OK;
+}
+
 esp_err_t esp_jpeg_get_image_info(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img)
 {
     if (cfg == NULL || img == NULL) {
@@ -152,12 +302,7 @@ esp_err_t esp_jpeg_get_image_info(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_outp
             seg += 4; /* Skip marker and length field */
 
             /* Size of output image */
-            img->height = ldb_word(seg + 1);
-            img->width = ldb_word(seg + 3);
-            const uint8_t scale_div       = jpeg_get_div_by_scale(cfg->out_scale);
-            const uint8_t out_color_bytes = jpeg_get_color_bytes(cfg->out_format);
-            img->output_len = (img->height / scale_div) * (img->width / scale_div) * out_color_bytes;
-            ret = ESP_OK;
+            ret = jpeg_get_output_size(cfg, ldb_word(seg + 3), ldb_word(seg + 1), img);
             break;
         }
     }
@@ -168,25 +313,351 @@ esp_err_t esp_jpeg_get_image_info(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_outp
 * Private API functions
 *******************************************************************************/
 
-static unsigned int jpeg_decode_in_cb(JDEC *dec, uint8_t *buff, unsigned int nbyte)
+#if !CONFIG_JD_USE_ROM
+static bool jpeg_accept_segment(esp_jpeg_decoder_handle_t decoder, const uint8_t *seg, size_t len)
+{
+    return true;
+}
+
+/*
+ * Pre-scan of the entropy-coded data for the RSTn markers. Returns the number of restart
+ * intervals with *ret_offsets set to where each one starts, or 0 if the image has no
+ * restart intervals or the markers are not where DRI says (then it is decoded serially).
+ */
+static uint32_t jpeg_find_intervals(const esp_jpeg_image_cfg_t *cfg, const JDEC *jd, uint32_t **ret_offsets)
+{
+    const uint32_t mcu_w = jd->msx * 8;
+    const uint32_t mcu_h = jd->msy * 8;
+    const uint32_t mcus = ((jd->width + mcu_w - 1) / mcu_w) * ((jd->height + mcu_h - 1) / mcu_h);
+    if (!jd->nrst || mcus <= jd->nrst) {
+        return 0;
+    }
+    const uint32_t intervals = (mcus + jd->nrst - 1) / jd->nrst;
+    const uint32_t scan_ofs = jpeg_walk_headers(cfg, jpeg_accept_segment, NULL);
+    if (!scan_ofs) {
+        return 0;
+    }
+    uint32_t *offsets = malloc(intervals * sizeof(uint32_t));
+    if (!offsets) {
+        return 0;
+    }
+
+    offsets[0] = scan_ofs;
+    uint32_t found = 1;
+    for (uint32_t i = scan_ofs; i + 1 < cfg->indata_size && found < intervals; i++) {
+        if (cfg->indata[i] != 0xFF) {
+            continue;
+        }
+        const uint8_t marker = cfg->indata[i + 1];
+        if (marker >= 0xD0 && marker <= 0xD7) {
+            if ((marker & 7) != ((found - 1) & 7)) {
+                break;  /* Out of sequence */
+            }
+            offsets[found++] = i + 2;
+            i++;
+        } else if (marker == 0xD9) {
+            break;      /* EOI before the last interval */
+        } else if (marker != 0xFF) {
+            i++;        /* Escaped 0xFF data byte; 0xFF fill bytes are looked at again */
+        }
+    }
+    if (found != intervals) {
+        free(offsets);
+        return 0;
+    }
+    *ret_offsets = offsets;
+    return intervals;
+}
+
+static void jpeg_decode_ranges(jpeg_range_job_t *job, JDEC *jd, jpeg_decode_ctx_t *ctx)
+{
+    for (;;) {
+        int range = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (range >= job->ranges || __atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+            break;
+        }
+        const uint32_t first = range * job->intervals_per_range;
+        *ctx->read = job->offsets[first];
+        JRESULT res = jd_prepare_scan(jd, jpeg_decode_in_cb, ctx, job->offsets[first]);
+        if (res == JDR_OK) {
+            res = jd_decomp_range(jd, jpeg_decode_out_cb, ctx->cfg->out_scale, job->roi, first, job->intervals_per_range);
+        }
+        if (res != JDR_OK) {
+            ESP_LOGE(TAG, "Error in decoding JPEG range %d! %d", range, res);
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+}
+
+static void jpeg_range_task(void *arg)
+{
+    jpeg_range_job_t *job = (jpeg_range_job_t *)arg;
+    jpeg_decode_ctx_t ctx = *job->ctx;
+    uint32_t read = 0;
+    ctx.read = &read;
+
+    /* The caller's tables are shared, only the input and MCU buffers are the helper's own.
+     * A helper that cannot set up just leaves its ranges to the other tasks */
+    JDEC jd;
+    const int helper = __atomic_fetch_add(&job->helper, 1, __ATOMIC_RELAXED);
+    if (jd_prepare_copy(&jd, &job->prepared, job->scratch + helper * JPEG_RANGE_SCRATCH_SIZE, JPEG_RANGE_SCRATCH_SIZE) == JDR_OK) {
+        jpeg_decode_ranges(job, &jd, &ctx);
+    } else {
+        ESP_LOGW(TAG, "JPEG range task setup failed");
+    }
+
+    uint8_t finished = 1;
+    xQueueSend(job->done, &finished, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+/* Restart intervals decoded on `tasks` tasks, the calling one included; ESP_ERR_NOT_SUPPORTED to decode serially */
+static esp_err_t jpeg_decode_parallel(JDEC *jd, jpeg_decode_ctx_t *ctx, int tasks)
+{
+    esp_jpeg_image_cfg_t *cfg = ctx->cfg;
+    uint32_t *offsets = NULL;
+    const uint32_t intervals = jpeg_find_intervals(cfg, jd, &offsets);
+    if (!intervals) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    jpeg_range_job_t job = {
+        .ctx = ctx,
+        .prepared = *jd,
+        .roi = (cfg->roi.width && cfg->roi.height) ? &ctx->roi : NULL,
+        .offsets = offsets,
+    };
+    job.ranges = MIN((uint32_t)tasks * JPEG_RANGES_PER_TASK, intervals);
+    job.intervals_per_range = (intervals + job.ranges - 1) / job.ranges;
+    job.ranges = (intervals + job.intervals_per_range - 1) / job.intervals_per_range;
+    tasks = MIN(tasks, job.ranges);
+    if (tasks < 2) {
+        free(offsets);
+        return ESP_ERR_NOT_SUPPORTED;   /* A single range, nothing to share out */
+    }
+
+    /* Helper scratch of the last call, grown if this one has more helpers */
+    portENTER_CRITICAL(&s_range_scratch_lock);
+    const bool cached = !s_range_scratch_busy;
+    s_range_scratch_busy = true;
+    if (cached && s_range_scratch_helpers >= tasks - 1) {
+        job.scratch = s_range_scratch;
+    }
+    portEXIT_CRITICAL(&s_range_scratch_lock);
+    if (!job.scratch) {
+        job.scratch = heap_caps_malloc((tasks - 1) * JPEG_RANGE_SCRATCH_SIZE, MALLOC_CAP_DEFAULT);
+        if (job.scratch && cached) {
+            free(s_range_scratch);
+            s_range_scratch = job.scratch;
+            s_range_scratch_helpers = tasks - 1;
+        }
+    }
+
+    /* Without scratch or queue the image is decoded serially */
+    esp_err_t ret = ESP_ERR_NOT_SUPPORTED;
+    job.done = job.scratch ? xQueueCreate(tasks, sizeof(uint8_t)) : NULL;
+    if (job.done) {
+        /* The calling task decodes ranges too, with the TJPGD it already prepared: its stream state
+         * changes from here on, so the helpers copy job.prepared, taken before they start */
+        int helpers = 0;
+        for (int i = 1; i < tasks; i++) {
+            if (xTaskCreatePinnedToCore(jpeg_range_task, "jpeg_range", JPEG_RANGE_TASK_STACK, &job,
+                                        uxTaskPriorityGet(NULL), NULL, tskNO_AFFINITY) == pdPASS) {
+                helpers++;
+            }
+        }
+        jpeg_decode_ranges(&job, jd, ctx);
+        for (int i = 0; i < helpers; i++) {
+            uint8_t finished;
+            xQueueReceive(job.done, &finished, portMAX_DELAY);
+        }
+        vQueueDelete(job.done);
+        ret = __atomic_load_n(&job.failed, __ATOMIC_RELAXED) ? ESP_FAIL : ESP_OK;
+    }
+
+    if (cached) {
+        portENTER_CRITICAL(&s_range_scratch_lock);
+        s_range_scratch_busy = false;
+        portEXIT_CRITICAL(&s_range_scratch_lock);
+    } else {
+        free(job.scratch);
+    }
+    free(offsets);
+    return ret;
+}
+#endif
+
+/* Output size check and the decode itself, once TJPGD is at the entropy-coded data */
+static esp_err_t jpeg_decode_prepared(JDEC *jd, jpeg_decode_ctx_t *ctx, esp_jpeg_image_output_t *img, int tasks)
+{
+    esp_jpeg_image_cfg_t *cfg = ctx->cfg;
+    const bool roi = cfg->roi.width && cfg->roi.height;
+
+    /* Size of output image */
+    ESP_RETURN_ON_ERROR(jpeg_get_output_size(cfg, jd->width, jd->height, img), TAG, "Region of interest out of the image!");
+    ESP_RETURN_ON_FALSE((img->output_len <= cfg->outbuf_size), ESP_ERR_NO_MEM, TAG, "Not enough size in output buffer!");
+
+    ctx->outbuf = cfg->outbuf;
+    ctx->out_color_bytes = jpeg_get_color_bytes(cfg->out_format);
+    ctx->stride = (uint32_t)img->width * ctx->out_color_bytes;
+    ctx->roi.left = roi ? cfg->roi.x : 0;
+    ctx->roi.top = roi ? cfg->roi.y : 0;
+    ctx->roi.right = ctx->roi.left + img->width - 1;
+    ctx->roi.bottom = ctx->roi.top + img->height - 1;
+
+    /* Decode JPEG */
+#if CONFIG_JD_USE_ROM
+    /* The ROM decoder has no region nor range decode, the output callback crops */
+    JRESULT res = jd_decomp(jd, jpeg_decode_out_cb, cfg->out_scale);
+#else
+    if (tasks > 1) {
+        esp_err_t ret = jpeg_decode_parallel(jd, ctx, tasks);
+        if (ret != ESP_ERR_NOT_SUPPORTED) {
+            return ret;
+        }
+    }
+    JRESULT res = jd_decomp_rect(jd, jpeg_decode_out_cb, cfg->out_scale, roi ? &ctx->roi : NULL);
+#endif
+    ESP_RETURN_ON_FALSE((res == JDR_OK), ESP_FAIL, TAG, "Error in decoding JPEG image! %d", res);
+    return ESP_OK;
+}
+
+/* Output image size for a picture of width x height: the scaled picture, or the region of interest in it */
+static esp_err_t jpeg_get_output_size(const esp_jpeg_image_cfg_t *cfg, uint16_t width, uint16_t height, esp_jpeg_image_output_t *img)
+{
+    const uint8_t scale_div = jpeg_get_div_by_scale(cfg->out_scale);
+    img->width = width / scale_div;
+    img->height = height / scale_div;
+    if (cfg->roi.width && cfg->roi.height) {
+        if ((uint32_t)cfg->roi.x + cfg->roi.width > img->width || (uint32_t)cfg->roi.y + cfg->roi.height > img->height) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        img->width = cfg->roi.width;
+        img->height = cfg->roi.height;
+    }
+    img->output_len = (uint32_t)img->width * img->height * jpeg_get_color_bytes(cfg->out_format);
+    return ESP_OK;
+}
+
+#if !CONFIG_JD_USE_ROM
+/* Segments TJPGD builds its state from; anything else (APPn, COM) may change between frames */
+static bool jpeg_is_table_segment(uint8_t marker)
+{
+    switch (marker) {
+    case 0xC0:  /* SOF0 */
+    case 0xC4:  /* DHT */
+    case 0xDB:  /* DQT */
+    case 0xDD:  /* DRI */
+    case 0xDA:  /* SOS */
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Walks the segments from SOI to SOS the way jd_prepare() reads them and calls visit()
+ * with each table segment (marker and length included). Returns the offset of the
+ * entropy-coded data, or 0 when visit() stops the walk or the headers are not the
+ * plain layout this walk understands (then jd_prepare() decides).
+ */
+static uint32_t jpeg_walk_headers(const esp_jpeg_image_cfg_t *cfg, bool (*visit)(esp_jpeg_decoder_handle_t, const uint8_t *, size_t),
+                                  esp_jpeg_decoder_handle_t decoder)
+{
+    if (cfg->indata == NULL || cfg->indata_size < 4 || ldb_word(cfg->indata) != 0xFFD8) {
+        return 0;
+    }
+    uint32_t ofs = 2;   /* Start after SOI marker */
+    while (ofs + 4 <= cfg->indata_size) {
+        const uint8_t *seg = cfg->indata + ofs;
+        const uint16_t marker = ldb_word(seg);
+        const uint32_t len = ldb_word(seg + 2);
+        if (len <= 2 || (marker >> 8) != 0xFF || marker == 0xFFFF || ofs + 2 + len > cfg->indata_size) {
+            return 0;
+        }
+        ofs += 2 + len;
+        if (jpeg_is_table_segment(marker & 0xFF) && !visit(decoder, seg, 2 + len)) {
+            return 0;
+        }
+        if ((marker & 0xFF) == 0xDA) {
+            return ofs;
+        }
+    }
+    return 0;
+}
+
+/* Compares the next table segment against the cached copy, headers_len is the cursor */
+static bool jpeg_compare_segment(esp_jpeg_decoder_handle_t decoder, const uint8_t *seg, size_t len)
+{
+    if (decoder->headers_len + len > decoder->headers_cap || memcmp(decoder->headers + decoder->headers_len, seg, len) != 0) {
+        return false;
+    }
+    decoder->headers_len += len;
+    return true;
+}
+
+/* Offset of the entropy-coded data when the image has exactly the cached table segments, else 0 */
+static uint32_t jpeg_match_headers(esp_jpeg_decoder_handle_t decoder, const esp_jpeg_image_cfg_t *cfg)
+{
+    const size_t cached_len = decoder->headers_len;
+    decoder->headers_len = 0;
+    uint32_t ofs = jpeg_walk_headers(cfg, jpeg_compare_segment, decoder);
+    if (decoder->headers_len != cached_len) {
+        ofs = 0;    /* A prefix of the cached segments is not a match */
+    }
+    decoder->headers_len = cached_len;
+    return ofs;
+}
+
+static bool jpeg_append_segment(esp_jpeg_decoder_handle_t decoder, const uint8_t *seg, size_t len)
+{
+    if (decoder->headers_len + len > decoder->headers_cap) {
+        const size_t cap = decoder->headers_len + len;
+        uint8_t *headers = realloc(decoder->headers, cap);
+        if (!headers) {
+            return false;
+        }
+        decoder->headers = headers;
+        decoder->headers_cap = cap;
+    }
+    memcpy(decoder->headers + decoder->headers_len, seg, len);
+    decoder->headers_len += len;
+    return true;
+}
+
+/* Keeps the table segments of the image just prepared; false if the next one cannot reuse them */
+static bool jpeg_store_headers(esp_jpeg_decoder_handle_t decoder, const esp_jpeg_image_cfg_t *cfg)
+{
+    decoder->headers_len = 0;
+    if (!jpeg_walk_headers(cfg, jpeg_append_segment, decoder)) {
+        decoder->headers_len = 0;
+        return false;
+    }
+    return true;
+}
+#endif
+
+static jpeg_decode_in_t jpeg_decode_in_cb(JDEC *dec, uint8_t *buff, jpeg_decode_in_t nbyte)
 {
     assert(dec != NULL);
 
     uint32_t to_read = nbyte;
-    esp_jpeg_image_cfg_t *cfg = (esp_jpeg_image_cfg_t *)dec->device;
+    jpeg_decode_ctx_t *ctx = (jpeg_decode_ctx_t *)dec->device;
+    const esp_jpeg_image_cfg_t *cfg = ctx->cfg;
     assert(cfg != NULL);
 
     if (buff) {
-        if (cfg->priv.read + to_read > cfg->indata_size) {
-            to_read = cfg->indata_size - cfg->priv.read;
+        if (*ctx->read + to_read > cfg->indata_size) {
+            to_read = cfg->indata_size - *ctx->read;
         }
 
         /* Copy data from JPEG image */
-        memcpy(buff, &cfg->indata[cfg->priv.read], to_read);
-        cfg->priv.read += to_read;
+        memcpy(buff, &cfg->indata[*ctx->read], to_read);
+        *ctx->read += to_read;
     } else if (buff == NULL) {
         /* Skip data */
-        cfg->priv.read += to_read;
+        *ctx->read += to_read;
     }
 
     return to_read;
@@ -194,58 +665,106 @@ static unsigned int jpeg_decode_in_cb(JDEC *dec, uint8_t *buff, unsigned int nby
 
 static jpeg_decode_out_t jpeg_decode_out_cb(JDEC *dec, void *bitmap, JRECT *rect)
 {
-    uint16_t color = 0;
     assert(dec != NULL);
 
-    esp_jpeg_image_cfg_t *cfg = (esp_jpeg_image_cfg_t *)dec->device;
-    assert(cfg != NULL);
+    jpeg_decode_ctx_t *ctx = (jpeg_decode_ctx_t *)dec->device;
+    assert(ctx != NULL);
     assert(bitmap != NULL);
     assert(rect != NULL);
 
-    uint8_t scale_div = jpeg_get_div_by_scale(cfg->out_scale);
-    uint8_t out_color_bytes = jpeg_get_color_bytes(cfg->out_format);
-
-    /* Copy decoded image data to output buffer */
-    uint8_t *in = (uint8_t *)bitmap;
-    uint32_t line = dec->width / scale_div;
-    uint8_t *dst = (uint8_t *)cfg->outbuf;
-    for (int y = rect->top; y <= rect->bottom; y++) {
-        for (int x = rect->left; x <= rect->right; x++) {
-            if ( (JD_FORMAT == 0 && cfg->out_format == JPEG_IMAGE_FORMAT_RGB888) ||
-                    (JD_FORMAT == 1 && cfg->out_format == JPEG_IMAGE_FORMAT_RGB565) ) {
-                /* Output image format is same as set in TJPGD */
-                for (int b = 0; b < ESP_JPEG_COLOR_BYTES; b++) {
-                    if (cfg->flags.swap_color_bytes) {
-                        dst[(y * line * out_color_bytes) + x * out_color_bytes + b] = in[out_color_bytes - b - 1];
-                    } else {
-                        dst[(y * line * out_color_bytes) + x * out_color_bytes + b] = in[b];
-                    }
-                }
-            } else if (JD_FORMAT == 0 && cfg->out_format == JPEG_IMAGE_FORMAT_RGB565) {
-                /* Output image format is not same as set in TJPGD */
-                /* We need to convert the 3 bytes in `in` to a rgb565 value */
-                color = ((in[0] & 0xF8) << 8);
-                color |= ((in[1] & 0xFC) << 3);
-                color |= (in[2] >> 3);
-
-                if (cfg->flags.swap_color_bytes) {
-                    dst[(y * line * out_color_bytes) + (x * out_color_bytes)] = HIBYTE(color);
-                    dst[(y * line * out_color_bytes) + (x * out_color_bytes) + 1] = LOBYTE(color);
-                } else {
-                    dst[(y * line * out_color_bytes) + (x * out_color_bytes) + 1] = HIBYTE(color);
-                    dst[(y * line * out_color_bytes) + (x * out_color_bytes)] = LOBYTE(color);
-                }
-            } else {
-                ESP_LOGE(TAG, "Selected output format is not supported!");
-                assert(0);
-            }
-            in += ESP_JPEG_COLOR_BYTES;
-        }
+    /* Only the part of the rectangle in the region of interest is written */
+    const JRECT *roi = &ctx->roi;
+    if (rect->right < roi->left || rect->left > roi->right || rect->bottom < roi->top || rect->top > roi->bottom) {
+        return 1;
+    }
+    const uint16_t left = MAX(rect->left, roi->left);
+    const uint16_t top = MAX(rect->top, roi->top);
+    const uint16_t bottom = MIN(rect->bottom, roi->bottom);
+    const uint32_t n = MIN(rect->right, roi->right) - left + 1;
+
+    /* Copy decoded image data to output buffer, a whole row of the rectangle at a time */
+    const uint32_t width = rect->right - rect->left + 1;
+    const uint8_t *in = (const uint8_t *)bitmap + ((top - rect->top) * width + (left - rect->left)) * ESP_JPEG_COLOR_BYTES;
+    uint8_t *dst = ctx->outbuf + (top - roi->top) * ctx->stride + (left - roi->left) * ctx->out_color_bytes;
+    for (int y = top; y <= bottom; y++) {
+        ctx->write_row(dst, in, n);
+        dst += ctx->stride;
+        in += width * ESP_JPEG_COLOR_BYTES;
     }
 
     return 1;
 }
 
+#if (JD_FORMAT==0)
+/* Output image format is same as set in TJPGD */
+static void jpeg_write_rgb888(uint8_t *dst, const uint8_t *in, uint32_t n)
+{
+    memcpy(dst, in, n * 3);
+}
+
+static void jpeg_write_rgb888_swap(uint8_t *dst, const uint8_t *in, uint32_t n)
+{
+    for (; n; n--, dst += 3, in += 3) {
+        dst[0] = in[2];
+        dst[1] = in[1];
+        dst[2] = in[0];
+    }
+}
+
+/* Output image format is not same as set in TJPGD: the 3 bytes in `in` become a rgb565 value */
+static inline uint16_t jpeg_rgb888_to_rgb565(const uint8_t *in)
+{
+    return ((in[0] & 0xF8) << 8) | ((in[1] & 0xFC) << 3) | (in[2] >> 3);
+}
+
+static void jpeg_write_rgb565(uint8_t *dst, const uint8_t *in, uint32_t n)
+{
+    for (; n; n--, dst += 2, in += 3) {
+        const uint16_t color = jpeg_rgb888_to_rgb565(in);
+        dst[0] = LOBYTE(color);
+        dst[1] = HIBYTE(color);
+    }
+}
+
+static void jpeg_write_rgb565_swap(uint8_t *dst, const uint8_t *in, uint32_t n)
+{
+    for (; n; n--, dst += 2, in += 3) {
+        const uint16_t color = jpeg_rgb888_to_rgb565(in);
+        dst[0] = HIBYTE(color);
+        dst[1] = LOBYTE(color);
+    }
+}
+#elif (JD_FORMAT==1)
+/* Output image format is same as set in TJPGD */
+static void jpeg_write_rgb565(uint8_t *dst, const uint8_t *in, uint32_t n)
+{
+    memcpy(dst, in, n * 2);
+}
+
+static void jpeg_write_rgb565_swap(uint8_t *dst, const uint8_t *in, uint32_t n)
+{
+    for (; n; n--, dst += 2, in += 2) {
+        dst[0] = in[1];
+        dst[1] = in[0];
+    }
+}
+#endif
+
+/* NULL when TJPGD output cannot be converted to the format */
+static jpeg_row_writer_t jpeg_get_row_writer(esp_jpeg_image_format_t format, bool swap_color_bytes)
+{
+    switch (format) {
+#if (JD_FORMAT==0)
+    case JPEG_IMAGE_FORMAT_RGB888:
+        return swap_color_bytes ? jpeg_write_rgb888_swap : jpeg_write_rgb888;
+#endif
+    case JPEG_IMAGE_FORMAT_RGB565:
+        return swap_color_bytes ? jpeg_write_rgb565_swap : jpeg_write_rgb565;
+    default:
+        return NULL;
+    }
+}
+
 static uint8_t jpeg_get_div_by_scale(esp_jpeg_image_scale_t scale)
 {
     switch (scale) {
@@ -695,6 +695,68 @@ static JRESULT restart (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Skip a restart interval without decoding it                           */
+/*-----------------------------------------------------------------------*/
+/* Called at the top of an interval. The entropy-coded data is scanned for
+/  the RSTn marker that ends it and the next interval is entered as
+/  restart() would do. */
+
+static JRESULT skip_interval (
+    JDEC *jd,       /* Pointer to the decompressor object */
+    uint16_t rstn   /* Expected restert sequense number at end of the interval */
+)
+{
+    uint8_t *dp = jd->dptr;
+    size_t dc = jd->dctr;
+    unsigned int d, flg = 0;
+
+
+    for (;;) {
+        if (!dc) {  /* No input data is available, re-fill input buffer */
+            dp = jd->inbuf;
+            dc = jd->infunc(jd, dp, JD_SZBUF);
+            if (!dc) {
+                return JDR_INP;
+            }
+#if JD_FASTDECODE == 0
+        } else {
+            dp++;
+        }
+        d = *dp;            /* Get a byte (dp points the last byte read) */
+#else
+        }
+        d = *dp++;          /* Get a byte (dp points the next byte to read) */
+#endif
+        dc--;
+        if (flg) {          /* In flag sequence? */
+            if (d >= 0xD0 && d <= 0xD7) {
+                break;      /* RSTn marker */
+            }
+            if (d != 0xFF) {    /* 0xFF is a fill byte, keep in flag sequence */
+                if (d != 0) {
+                    return JDR_FMT1;    /* Err: other marker in the interval (may be collapted data) */
+                }
+                flg = 0;    /* Escape of 0xFF in the data */
+            }
+        } else {
+            flg = (d == 0xFF);
+        }
+    }
+    jd->dptr = dp; jd->dctr = dc; jd->dbit = 0;
+
+    /* Check the marker */
+    if ((d & 7) != (rstn & 7)) {
+        return JDR_FMT1;    /* Err: expected RSTn marker was not detected (may be collapted data) */
+    }
+
+    jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;   /* Reset DC offset */
+    return JDR_OK;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Apply Inverse-DCT in Arai Algorithm (see also aa_idct.png)            */
 /*-----------------------------------------------------------------------*/
@@ -818,6 +880,115 @@ static void block_idct (
 
 
 
+#if JD_SPARSE_IDCT
+/*-----------------------------------------------------------------------*/
+/* Apply Inverse-DCT to a block with elements only in upper-left 4x4     */
+/*-----------------------------------------------------------------------*/
+/* Same arithmetic as block_idct() with the zero elements removed: only
+/  four columns are processed and the rows have only four inputs. */
+
+static void block_idct_4x4 (
+    int32_t *src,   /* Input block data (elements out of the upper-left 4x4 are zero) */
+    jd_yuv_t *dst   /* Pointer to the destination to store the block as byte array */
+)
+{
+    const int32_t M13 = (int32_t)(1.41421 * 4096), M2 = (int32_t)(1.08239 * 4096), M4 = (int32_t)(2.61313 * 4096), M5 = (int32_t)(1.84776 * 4096);
+    int32_t v0, v1, v2, v3, v4, v5, v6, v7;
+    int32_t t10, t11, t12, t13;
+    int i;
+
+    /* Process columns 0-3, columns 4-7 are zero and stay zero */
+    for (i = 0; i < 4; i++) {
+        v0 = src[8 * 0];    /* Get even elements (8 * 4 and 8 * 6 are zero) */
+        v1 = src[8 * 2];
+
+        t10 = v0;           /* Process the even elements */
+        t11 = (v1 * M13 >> 12) - v1;
+        v3 = t10 - v1;
+        v0 = t10 + v1;
+        v2 = t10 - t11;
+        v1 = t11 + t10;
+
+        v5 = src[8 * 1];    /* Get odd elements (8 * 7 and 8 * 5 are zero) */
+        v7 = src[8 * 3];
+
+        t10 = v5;           /* Process the odd elements */
+        t12 = -v7;
+        v5 = (t10 - v7) * M13 >> 12;
+        v7 += t10;
+        t13 = (t10 + t12) * M5 >> 12;
+        v4 = t13 - (t10 * M2 >> 12);
+        v6 = t13 - (t12 * M4 >> 12) - v7;
+        v5 -= v6;
+        v4 -= v5;
+
+        src[8 * 0] = v0 + v7;   /* Write-back transformed values */
+        src[8 * 7] = v0 - v7;
+        src[8 * 1] = v1 + v6;
+        src[8 * 6] = v1 - v6;
+        src[8 * 2] = v2 + v5;
+        src[8 * 5] = v2 - v5;
+        src[8 * 3] = v3 + v4;
+        src[8 * 4] = v3 - v4;
+
+        src++;  /* Next column */
+    }
+
+    /* Process rows, elements 4-7 of each row are zero */
+    src -= 4;
+    for (i = 0; i < 8; i++) {
+        v0 = src[0] + (128L << 8);  /* Get even elements (remove DC offset (-128) here) */
+        v1 = src[2];
+
+        t10 = v0;                   /* Process the even elements */
+        t11 = (v1 * M13 >> 12) - v1;
+        v3 = t10 - v1;
+        v0 = t10 + v1;
+        v2 = t10 - t11;
+        v1 = t11 + t10;
+
+        v5 = src[1];                /* Get odd elements */
+        v7 = src[3];
+
+        t10 = v5;                   /* Process the odd elements */
+        t12 = -v7;
+        v5 = (t10 - v7) * M13 >> 12;
+        v7 += t10;
+        t13 = (t10 + t12) * M5 >> 12;
+        v4 = t13 - (t10 * M2 >> 12);
+        v6 = t13 - (t12 * M4 >> 12) - v7;
+        v5 -= v6;
+        v4 -= v5;
+
+        /* Descale the transformed values 8 bits and output a row */
+#if JD_FASTDECODE >= 1
+        dst[0] = (int16_t)((v0 + v7) >> 8);
+        dst[7] = (int16_t)((v0 - v7) >> 8);
+        dst[1] = (int16_t)((v1 + v6) >> 8);
+        dst[6] = (int16_t)((v1 - v6) >> 8);
+        dst[2] = (int16_t)((v2 + v5) >> 8);
+        dst[5] = (int16_t)((v2 - v5) >> 8);
+        dst[3] = (int16_t)((v3 + v4) >> 8);
+        dst[4] = (int16_t)((v3 - v4) >> 8);
+#else
+        dst[0] = BYTECLIP((v0 + v7) >> 8);
+        dst[7] = BYTECLIP((v0 - v7) >> 8);
+        dst[1] = BYTECLIP((v1 + v6) >> 8);
+        dst[6] = BYTECLIP((v1 - v6) >> 8);
+        dst[2] = BYTECLIP((v2 + v5) >> 8);
+        dst[5] = BYTECLIP((v2 - v5) >> 8);
+        dst[3] = BYTECLIP((v3 + v4) >> 8);
+        dst[4] = BYTECLIP((v3 - v4) >> 8);
+#endif
+
+        dst += 8; src += 8; /* Next row */
+    }
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Load all blocks in an MCU into working buffer                         */
 /*-----------------------------------------------------------------------*/
@@ -829,6 +1000,9 @@ static JRESULT mcu_load (
     int32_t *tmp = (int32_t *)jd->workbuf;  /* Block working buffer for de-quantize and IDCT */
     int d, e;
     unsigned int blk, nby, i, bc, z, id, cmp;
+#if JD_SPARSE_IDCT
+    unsigned int rm;
+#endif
     jd_yuv_t *bp;
     const int32_t *dqf;
 
@@ -869,6 +1043,9 @@ static JRESULT mcu_load (
 
             /* Extract following 63 AC elements from input stream */
             memset(&tmp[1], 0, 63 * sizeof (int32_t));  /* Initialize all AC elements */
+#if JD_SPARSE_IDCT
+            rm = 0;     /* OR of raster-order indices of the AC elements in the stream */
+#endif
             z = 1;      /* Top of the AC elements (in zigzag-order) */
             do {
                 d = huffext(jd, id, 1);             /* Extract a huffman coded value (zero runs and bit length) */
@@ -894,6 +1071,9 @@ static JRESULT mcu_load (
                     }
                     i = Zig[z];                     /* Get raster-order index */
                     tmp[i] = d * dqf[i] >> 8;       /* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+#if JD_SPARSE_IDCT
+                    rm |= i;
+#endif
                 }
             } while (++z < 64);     /* Next AC element */
 
@@ -905,6 +1085,10 @@ static JRESULT mcu_load (
                     } else {
                         memset(bp, d, 64);
                     }
+#if JD_SPARSE_IDCT
+                } else if (!(rm & 0x24)) {  /* No element in rows 4-7 nor columns 4-7 */
+                    block_idct_4x4(tmp, bp);
+#endif
                 } else {
                     block_idct(tmp, bp);    /* Apply IDCT and store the block to the MCU buffer */
                 }
@@ -920,6 +1104,109 @@ static JRESULT mcu_load (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Walk all blocks in an MCU without de-quantize and IDCT                */
+/*-----------------------------------------------------------------------*/
+/* For MCUs out of the output region. The huffman codes have to be read to
+/  find the next MCU and the DC values are kept for the predictions. */
+
+static JRESULT mcu_skip (
+    JDEC *jd        /* Pointer to the decompressor object */
+)
+{
+    int d, e;
+    unsigned int blk, nby, bc, z, id, cmp;
+
+
+    nby = jd->msx * jd->msy;    /* Number of Y blocks (1, 2 or 4) */
+
+    for (blk = 0; blk < nby + 2; blk++) {   /* Walk nby Y blocks and two C blocks */
+        cmp = (blk < nby) ? 0 : blk - nby + 1;  /* Component number 0:Y, 1:Cb, 2:Cr */
+        if (cmp && jd->ncomp != 3) {
+            continue;   /* No C blocks in the stream (monochrome image) */
+        }
+        id = cmp ? 1 : 0;                       /* Huffman table ID of this component */
+
+        /* Extract a DC element from input stream */
+        d = huffext(jd, id, 0);
+        if (d < 0) {
+            return (JRESULT)(0 - d);    /* Err: invalid code or input */
+        }
+        bc = (unsigned int)d;
+        if (bc) {                               /* If there is any difference from previous block */
+            e = bitext(jd, bc);
+            if (e < 0) {
+                return (JRESULT)(0 - e);    /* Err: input */
+            }
+            bc = 1 << (bc - 1);                 /* MSB position */
+            if (!(e & bc)) {
+                e -= (bc << 1) - 1;    /* Restore negative value if needed */
+            }
+            jd->dcv[cmp] = (int16_t)(jd->dcv[cmp] + e); /* Save current DC value for next block */
+        }
+
+        /* Skip following 63 AC elements */
+        z = 1;
+        do {
+            d = huffext(jd, id, 1);
+            if (d == 0) {
+                break;    /* EOB? */
+            }
+            if (d < 0) {
+                return (JRESULT)(0 - d);    /* Err: invalid code or input error */
+            }
+            bc = (unsigned int)d;
+            z += bc >> 4;                       /* Skip leading zero run */
+            if (z >= 64) {
+                return JDR_FMT1;    /* Too long zero run */
+            }
+            if (bc &= 0x0F) {                   /* Bit length? */
+                d = bitext(jd, bc);             /* Discard data bits */
+                if (d < 0) {
+                    return (JRESULT)(0 - d);    /* Err: input device */
+                }
+            }
+        } while (++z < 64);     /* Next AC element */
+    }
+
+    return JDR_OK;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Check if MCUs overlap the output region                               */
+/*-----------------------------------------------------------------------*/
+
+static int mcu_in_rect (    /* 1:Any of MCUs first to last is in the region, 0:None */
+    JDEC *jd,               /* Pointer to the decompressor object */
+    unsigned int first,     /* MCU index in raster order */
+    unsigned int last,
+    unsigned int nx,        /* Number of MCUs in a row */
+    const JRECT *rect       /* Region in the scaled image */
+)
+{
+    unsigned int mx, my, r, c0, c1, s = jd->scale;
+
+
+    mx = jd->msx * 8; my = jd->msy * 8;
+    for (r = first / nx; r <= last / nx; r++) { /* Each MCU row of the span */
+        if ((r * my) >> s > rect->bottom || ((r + 1) * my >> s) <= rect->top) {
+            continue;
+        }
+        c0 = (r == first / nx) ? first % nx : 0;
+        c1 = (r == last / nx) ? last % nx : nx - 1;
+        if ((c0 * mx) >> s <= rect->right && ((c1 + 1) * mx >> s) > rect->left) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Output an MCU: Convert YCrCb to RGB and output it in RGB form         */
 /*-----------------------------------------------------------------------*/
@@ -1342,6 +1629,99 @@ JRESULT jd_prepare (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Reuse a prepared decompressor for the scan of another JPEG stream     */
+/*-----------------------------------------------------------------------*/
+/* The stream must carry the same SOF0, DHT, DQT, DRI and SOS segments as
+/  the one jd_prepare() parsed, so its tables and work areas still apply.
+/  Only the input state is reset to the first byte of entropy-coded data. */
+
+JRESULT jd_prepare_scan (
+    JDEC *jd,               /* Decompressor object initialized by jd_prepare() */
+    size_t (*infunc)(JDEC *, uint8_t *, size_t), /* JPEG strem input function */
+    void *dev,              /* I/O device identifier for the session */
+    size_t ofs              /* Offset of the entropy-coded data, the stream is already there */
+)
+{
+    if (!jd->inbuf || !jd->mcubuf) {
+        return JDR_PAR;     /* Err: not prepared */
+    }
+    jd->infunc = infunc;
+    jd->device = dev;
+    jd->dctr = 0;
+    jd->dbit = 0;
+#if JD_FASTDECODE >= 1
+    jd->wreg = 0;
+    jd->marker = 0;
+#endif
+
+    /* Align stream read offset to JD_SZBUF as jd_prepare() does */
+    if (ofs %= JD_SZBUF) {
+        jd->dctr = jd->infunc(jd, jd->inbuf + ofs, (size_t)(JD_SZBUF - ofs));
+    }
+    jd->dptr = jd->inbuf + ofs - (JD_FASTDECODE ? 0 : 1);
+
+    return JDR_OK;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Share the tables of a prepared decompressor                           */
+/*-----------------------------------------------------------------------*/
+/* The huffman and dequantizer tables of src are referred to, not copied,
+/  so src and its work memory must be kept as is while jd is in use. Only
+/  the stream input buffer and the MCU work areas are taken from the pool,
+/  the decompressors can then decode scans of the same JPEG at a time.
+/  Call jd_prepare_scan() to set the input of jd. */
+
+JRESULT jd_prepare_copy (
+    JDEC *jd,               /* Blank decompressor object */
+    const JDEC *src,        /* Decompressor object initialized by jd_prepare() */
+    void *pool,             /* Working buffer for the input stream and MCU */
+    size_t sz_pool          /* Size of working buffer */
+)
+{
+    unsigned int n;
+    size_t len;
+
+
+    if (!src->mcubuf) {
+        return JDR_PAR;     /* Err: not prepared */
+    }
+    *jd = *src;             /* Tables and picture parameters */
+    jd->pool = pool;
+    jd->sz_pool = sz_pool;
+    jd->infunc = 0;
+    jd->device = 0;
+
+    jd->inbuf = alloc_pool(jd, JD_SZBUF);       /* Allocate stream input buffer */
+    if (!jd->inbuf) {
+        return JDR_MEM1;
+    }
+
+    /* Same work areas as jd_prepare(), in the same order as the RGB output may run over into the MCU buffer */
+    n = jd->msy * jd->msx;
+    len = n * 64 * 2 + 64;
+    if (len < 256) {
+        len = 256;
+    }
+    jd->workbuf = alloc_pool(jd, len);
+    if (!jd->workbuf) {
+        return JDR_MEM1;
+    }
+    jd->mcubuf = alloc_pool(jd, (n + 2) * 64 * sizeof (jd_yuv_t));
+    if (!jd->mcubuf) {
+        return JDR_MEM1;
+    }
+
+    return JDR_OK;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Start to decompress the JPEG picture                                  */
 /*-----------------------------------------------------------------------*/
@@ -1352,41 +1732,143 @@ JRESULT jd_decomp (
     uint8_t scale                           /* Output de-scaling factor (0 to 3) */
 )
 {
-    unsigned int x, y, mx, my;
-    uint16_t rst, rsc;
-    JRESULT rc;
+    return jd_decomp_rect(jd, outfunc, scale, 0);
+}
 
 
-    if (scale > (JD_USE_SCALE ? 3 : 0)) {
-        return JDR_PAR;
-    }
-    jd->scale = scale;
+
+
+/*-----------------------------------------------------------------------*/
+/* Decompress a span of MCUs                                             */
+/*-----------------------------------------------------------------------*/
+/* MCUs out of the region are not de-quantized, transformed nor output,
+/  only their huffman codes are walked. Restart intervals entirely out of
+/  the region are skipped to the next RSTn marker, and decompression ends
+/  at the last MCU row of the region. */
+
+static JRESULT decomp (
+    JDEC *jd,                               /* Initialized decompression object */
+    int (*outfunc)(JDEC *, void *, JRECT *), /* RGB output function */
+    const JRECT *rect,                      /* Region to output in the scaled image (0:entire picture) */
+    unsigned int n,                         /* First MCU (top of a restart interval if enabled) */
+    unsigned int nend,                      /* End of the MCUs to decompress */
+    uint16_t rsc                            /* Sequense number of the next restart marker */
+)
+{
+    unsigned int x, y, mx, my, nx;
+    uint16_t rst;
+    JRESULT rc;
+
 
     mx = jd->msx * 8; my = jd->msy * 8;         /* Size of the MCU (pixel) */
+    nx = (jd->width + mx - 1) / mx;             /* Number of MCUs in a row */
 
     jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;   /* Initialize DC values */
-    rst = rsc = 0;
+    rst = 0;
 
     rc = JDR_OK;
-    for (y = 0; y < jd->height; y += my) {      /* Vertical loop of MCUs */
-        for (x = 0; x < jd->width; x += mx) {   /* Horizontal loop of MCUs */
-            if (jd->nrst && rst++ == jd->nrst) {    /* Process restart interval if enabled */
-                rc = restart(jd, rsc++);
-                if (rc != JDR_OK) {
-                    return rc;
-                }
-                rst = 1;
+    x = n % nx * mx; y = n / nx * my;
+    while (n < nend) {                          /* MCUs in raster order */
+        if (rect && (y >> jd->scale) > rect->bottom) {
+            break;  /* Below the region, nothing more to output */
+        }
+        if (jd->nrst && rst++ == jd->nrst) {    /* Process restart interval if enabled */
+            rc = restart(jd, rsc++);
+            if (rc != JDR_OK) {
+                return rc;
             }
+            rst = 1;
+        }
+        if (!rect || mcu_in_rect(jd, n, n, nx, rect)) {
             rc = mcu_load(jd);                  /* Load an MCU (decompress huffman coded stream, dequantize and apply IDCT) */
             if (rc != JDR_OK) {
                 return rc;
             }
             rc = mcu_output(jd, outfunc, x, y); /* Output the MCU (YCbCr to RGB, scaling and output) */
+        } else if (rst == 1 && n + jd->nrst < nend && !mcu_in_rect(jd, n, n + jd->nrst - 1, nx, rect)) {
+            rc = skip_interval(jd, rsc++);      /* Go to the next restart interval, its RSTn is taken */
             if (rc != JDR_OK) {
                 return rc;
             }
+            rst = 0;
+            n += jd->nrst;
+            x = n % nx * mx; y = n / nx * my;
+            continue;
+        } else {
+            rc = mcu_skip(jd);                  /* Walk the huffman codes of the MCU */
+        }
+        if (rc != JDR_OK) {
+            return rc;
+        }
+        if (++n % nx) {                         /* Next MCU */
+            x += mx;
+        } else {
+            x = 0; y += my;
         }
     }
 
     return rc;
 }
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Decompress the MCUs overlapping a region of the JPEG picture          */
+/*-----------------------------------------------------------------------*/
+
+JRESULT jd_decomp_rect (
+    JDEC *jd,                               /* Initialized decompression object */
+    int (*outfunc)(JDEC *, void *, JRECT *), /* RGB output function */
+    uint8_t scale,                          /* Output de-scaling factor (0 to 3) */
+    const JRECT *rect                       /* Region to output in the scaled image (0:entire picture) */
+)
+{
+    unsigned int mx, my;
+
+
+    if (scale > (JD_USE_SCALE ? 3 : 0)) {
+        return JDR_PAR;
+    }
+    jd->scale = scale;
+
+    mx = jd->msx * 8; my = jd->msy * 8;
+    return decomp(jd, outfunc, rect, 0, ((jd->width + mx - 1) / mx) * ((jd->height + my - 1) / my), 0);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Decompress a range of restart intervals                               */
+/*-----------------------------------------------------------------------*/
+/* The stream has to be at the entropy-coded data of the first interval,
+/  just after its RSTn marker (see jd_prepare_scan()). Ranges of the same
+/  picture can be decompressed by separate decompression objects. */
+
+JRESULT jd_decomp_range (
+    JDEC *jd,                               /* Initialized decompression object */
+    int (*outfunc)(JDEC *, void *, JRECT *), /* RGB output function */
+    uint8_t scale,                          /* Output de-scaling factor (0 to 3) */
+    const JRECT *rect,                      /* Region to output in the scaled image (0:entire picture) */
+    unsigned int first,                     /* First restart interval */
+    unsigned int count                      /* Number of restart intervals */
+)
+{
+    unsigned int mx, my, nmcu, n, nend;
+
+
+    if (scale > (JD_USE_SCALE ? 3 : 0) || !jd->nrst) {
+        return JDR_PAR;
+    }
+    jd->scale = scale;
+
+    mx = jd->msx * 8; my = jd->msy * 8;
+    nmcu = ((jd->width + mx - 1) / mx) * ((jd->height + my - 1) / my);
+    n = first * jd->nrst;
+    if (n >= nmcu) {
+        return JDR_PAR;
+    }
+    nend = (count < (nmcu - n + jd->nrst - 1) / jd->nrst) ? n + count * jd->nrst : nmcu;
+    return decomp(jd, outfunc, rect, n, nend, (uint16_t)first);
+}
@@ -92,7 +92,11 @@ struct JDEC {
 
 /* TJpgDec API functions */
 JRESULT jd_prepare (JDEC *jd, size_t (*infunc)(JDEC *, uint8_t *, size_t), void *pool, size_t sz_pool, void *dev);
+JRESULT jd_prepare_scan (JDEC *jd, size_t (*infunc)(JDEC *, uint8_t *, size_t), void *dev, size_t ofs);
+JRESULT jd_prepare_copy (JDEC *jd, const JDEC *src, void *pool, size_t sz_pool);
 JRESULT jd_decomp (JDEC *jd, int (*outfunc)(JDEC *, void *, JRECT *), uint8_t scale);
+JRESULT jd_decomp_rect (JDEC *jd, int (*outfunc)(JDEC *, void *, JRECT *), uint8_t scale, const JRECT *rect);
+JRESULT jd_decomp_range (JDEC *jd, int (*outfunc)(JDEC *, void *, JRECT *), uint8_t scale, const JRECT *rect, unsigned int first, unsigned int count);
 
 
 #ifdef __cplusplus
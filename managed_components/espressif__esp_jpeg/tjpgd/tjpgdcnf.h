@@ -41,6 +41,18 @@
 /  2: + Table conversion for huffman decoding (wants 6 << HUFF_BIT bytes of RAM)
 */
 
+#if defined(CONFIG_JD_SPARSE_IDCT)
+#define JD_SPARSE_IDCT  CONFIG_JD_SPARSE_IDCT
+#else
+#define JD_SPARSE_IDCT  0
+#endif
+/* Reduced IDCT for sparse blocks. Blocks with elements only in the upper-left 4x4 skip
+/  the zero rows and columns (blocks with only a DC element are always filled without IDCT).
+/  The output is identical to the full IDCT, code size increases by about 0.5 KB.
+/  0: Disable
+/  1: Enable
+*/
+
 #if defined(CONFIG_JD_DEFAULT_HUFFMAN)
 #define JD_DEFAULT_HUFFMAN CONFIG_JD_DEFAULT_HUFFMAN
 #else
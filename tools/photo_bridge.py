@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+"""Puente de fotos binarias/troceadas -> JSON de DeepStack.
+
+Decodifica los mensajes publicados por la cámara en `iot/telemetry/bin`
+(cabecera fija little-endian + JPEG crudo, ver main/photo_stream.h) y los
+vuelve a publicar en `iot/telemetry` con la forma JSON que espera DeepStack:
+
+    {"device_id": "...", "access_method": "camera", "img": "<base64>"}
+
+También reensambla los frames enviados por trozos en `iot/telemetry/chunk`
+(PHOTO_CHUNKED_TRANSFER) y los publica igual, sea cual sea su contenido.
+
+Uso:
+    python3 tools/photo_bridge.py --broker 172.20.10.8
+    python3 tools/photo_bridge.py --decode captura.bin   # decodifica un fichero
+"""
+
+import argparse
+import base64
+import json
+import struct
+import sys
+import time
+import zlib
+
+MAGIC = b"TP"
+VERSION = 1
+DEVICE_ID_LEN = 32
+# magic, versión, formato, tamaño cabecera, ancho, alto, flags, secuencia,
+# timestamp (us), tamaño payload, device_id
+HEADER = struct.Struct("<2sBBHHHHIQI%ds" % DEVICE_ID_LEN)
+assert HEADER.size == 28 + DEVICE_ID_LEN
+
+CHUNK_MAGIC = b"TC"
+CHUNK_VERSION = 2
+CHUNK_CONTENT_JSON = 0
+CHUNK_CONTENT_BINARY = 1
+# magic, versión, contenido, id de arranque, id de frame, índice, total,
+# tamaño frame, offset, crc32
+CHUNK_HEADER = struct.Struct("<2sBBIIHHIII")
+assert CHUNK_HEADER.size == 28
+
+
+class FrameError(ValueError):
+    pass
+
+
+def decode_frame(data):
+    """Devuelve un dict con los campos de la cabecera y los bytes del frame."""
+    if len(data) < HEADER.size:
+        raise FrameError("mensaje demasiado corto (%d bytes)" % len(data))
+    (magic, version, fmt, header_len, width, height, flags, seq,
+     timestamp_us, payload_len, device_id) = HEADER.unpack_from(data)
+    if magic != MAGIC:
+        raise FrameError("magic inválido: %r" % magic)
+    if version != VERSION:
+        raise FrameError("versión no soportada: %d" % version)
+    if header_len < HEADER.size or len(data) != header_len + payload_len:
+        raise FrameError("tamaño inconsistente: cabecera %d + payload %d != %d"
+                         % (header_len, payload_len, len(data)))
+    return {
+        "device_id": device_id.rstrip(b"\0").decode("ascii", "replace"),
+        "seq": seq,
+        "timestamp_us": timestamp_us,
+        "width": width,
+        "height": height,
+        "format": fmt,
+        "flags": flags,
+        "frame": bytes(data[header_len:]),
+    }
+
+
+def to_deepstack_json(frame):
+    """Convierte un frame decodificado al JSON que generaba el modo compatible."""
+    return json.dumps({
+        "device_id": frame["device_id"],
+        "access_method": "camera",
+        "img": base64.b64encode(frame["frame"]).decode("ascii"),
+    }, separators=(",", ":"))
+
+
+class ChunkAssembler:
+    """Reconstruye frames a partir de sus trozos.
+
+    Los trozos pueden llegar duplicados o desordenados. Cada frame se
+    identifica por (topic, id de arranque, id de frame): el id de arranque
+    cambia en cada arranque de la cámara, así que dos cámaras en el mismo
+    topic o una que se reinicia y vuelve a numerar desde cero no mezclan sus
+    trozos. Un frame incompleto se descarta tras `timeout` segundos o cuando
+    hay demasiados pendientes.
+    """
+
+    def __init__(self, timeout=30.0, max_pending=8):
+        self.timeout = timeout
+        self.max_pending = max_pending
+        self.pending = {}
+        self.dropped = 0
+
+    def add(self, data, source=None, now=None):
+        """Añade un trozo; devuelve (contenido, id, payload) al completar un frame."""
+        now = time.monotonic() if now is None else now
+        if len(data) < CHUNK_HEADER.size:
+            raise FrameError("trozo demasiado corto (%d bytes)" % len(data))
+        (magic, version, content, boot_id, frame_id, index, count, frame_len,
+         offset, crc) = CHUNK_HEADER.unpack_from(data)
+        chunk = bytes(data[CHUNK_HEADER.size:])
+        if magic != CHUNK_MAGIC:
+            raise FrameError("magic inválido: %r" % magic)
+        if version != CHUNK_VERSION:
+            raise FrameError("versión no soportada: %d" % version)
+        if index >= count or offset + len(chunk) > frame_len:
+            raise FrameError("trozo %d/%d fuera de rango" % (index, count))
+        if zlib.crc32(chunk) != crc:
+            raise FrameError("CRC incorrecto en el trozo %d/%d del frame %d" % (index, count, frame_id))
+
+        self._expire(now)
+        key = (source, boot_id, frame_id)
+        frame = self.pending.get(key)
+        # El mismo id con otra forma es un reenvío nuevo (p.ej. desde el diario)
+        if frame is None or frame["count"] != count or frame["len"] != frame_len:
+            if frame is not None:
+                self.dropped += 1
+            else:
+                self._evict()
+            frame = {"count": count, "len": frame_len, "content": content,
+                     "parts": {}, "first_seen": now}
+            self.pending[key] = frame
+        frame["parts"][index] = (offset, chunk)
+        if len(frame["parts"]) < count:
+            return None
+
+        del self.pending[key]
+        payload = bytearray(frame_len)
+        for off, part in frame["parts"].values():
+            payload[off:off + len(part)] = part
+        return content, frame_id, bytes(payload)
+
+    def _expire(self, now):
+        for key in [k for k, f in self.pending.items() if now - f["first_seen"] > self.timeout]:
+            del self.pending[key]
+            self.dropped += 1
+
+    def _evict(self):
+        """Hace sitio para un frame nuevo; los que ya tienen trozos no se tocan al recibir otro."""
+        while len(self.pending) >= self.max_pending:
+            oldest = min(self.pending, key=lambda k: self.pending[k]["first_seen"])
+            del self.pending[oldest]
+            self.dropped += 1
+
+
+def run_bridge(args):
+    import paho.mqtt.client as mqtt
+
+    assembler = ChunkAssembler()
+
+    def on_connect(client, userdata, flags, rc, *extra):
+        print("Conectado al broker (rc=%s), suscrito a %s y %s" % (rc, args.in_topic, args.chunk_topic))
+        client.subscribe(args.in_topic)
+        client.subscribe(args.chunk_topic)
+
+    def forward_binary(client, data):
+        frame = decode_frame(data)
+        client.publish(args.out_topic, to_deepstack_json(frame))
+        print("Frame %d de %s (%dx%d, %d bytes) -> %s"
+              % (frame["seq"], frame["device_id"], frame["width"], frame["height"],
+                 len(frame["frame"]), args.out_topic))
+
+    def on_message(client, userdata, msg):
+        try:
+            if msg.topic != args.chunk_topic:
+                forward_binary(client, msg.payload)
+                return
+            done = assembler.add(msg.payload, source=msg.topic)
+            if done is None:
+                return
+            content, frame_id, payload = done
+            if content == CHUNK_CONTENT_BINARY:
+                forward_binary(client, payload)
+            else:
+                client.publish(args.out_topic, payload)
+                print("Frame %d reensamblado (%d bytes JSON) -> %s"
+                      % (frame_id, len(payload), args.out_topic))
+        except FrameError as e:
+            print("Mensaje descartado: %s" % e, file=sys.stderr)
+
+    client = mqtt.Client()
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.broker, args.port)
+    client.loop_forever()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--broker", default="172.20.10.8")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--in-topic", default="iot/telemetry/bin")
+    parser.add_argument("--chunk-topic", default="iot/telemetry/chunk")
+    parser.add_argument("--out-topic", default="iot/telemetry")
+    parser.add_argument("--decode", metavar="FICHERO",
+                        help="decodifica un mensaje binario guardado e imprime el JSON")
+    args = parser.parse_args()
+
+    if args.decode:
+        with open(args.decode, "rb") as f:
+            print(to_deepstack_json(decode_frame(f.read())))
+        return
+    run_bridge(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Pruebas del reensamblado de trozos de tools/photo_bridge.py (sin broker).
+
+    python3 tools/test_photo_bridge.py
+"""
+
+import os
+import sys
+import unittest
+import zlib
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import photo_bridge as pb  # noqa: E402
+
+CHUNK_BYTES = 3072
+
+
+def make_chunks(payload, boot_id, frame_id, content=pb.CHUNK_CONTENT_JSON, chunk_bytes=CHUNK_BYTES):
+    """Trocea un payload igual que photo_chunker en main/photo_stream.c."""
+    count = max(1, (len(payload) + chunk_bytes - 1) // chunk_bytes)
+    msgs = []
+    for index in range(count):
+        offset = index * chunk_bytes
+        part = payload[offset:offset + chunk_bytes]
+        hdr = pb.CHUNK_HEADER.pack(pb.CHUNK_MAGIC, pb.CHUNK_VERSION, content, boot_id, frame_id,
+                                   index, count, len(payload), offset, zlib.crc32(part))
+        msgs.append(hdr + part)
+    return msgs
+
+
+def frame_bytes(seed, length):
+    return bytes((seed * 31 + i * 7) & 0xFF for i in range(length))
+
+
+class ChunkAssemblerTest(unittest.TestCase):
+
+    def test_in_order(self):
+        asm = pb.ChunkAssembler()
+        payload = frame_bytes(1, 10000)
+        msgs = make_chunks(payload, 0x1234, 7)
+        for m in msgs[:-1]:
+            self.assertIsNone(asm.add(m, source="t", now=0))
+        self.assertEqual(asm.add(msgs[-1], source="t", now=0), (pb.CHUNK_CONTENT_JSON, 7, payload))
+        self.assertEqual(asm.pending, {})
+
+    def test_duplicates_and_disorder(self):
+        asm = pb.ChunkAssembler()
+        payload = frame_bytes(2, 4 * CHUNK_BYTES + 5)
+        msgs = make_chunks(payload, 0x1234, 8)
+        order = [3, 0, 3, 1, 0, 4]
+        for i in order:
+            self.assertIsNone(asm.add(msgs[i], source="t", now=0))
+        self.assertEqual(asm.add(msgs[2], source="t", now=0)[2], payload)
+
+    def test_two_devices_same_frame_id(self):
+        """Dos cámaras en el mismo topic con el mismo id de frame y trozos intercalados."""
+        asm = pb.ChunkAssembler()
+        a = frame_bytes(3, 3 * CHUNK_BYTES)
+        b = frame_bytes(4, 3 * CHUNK_BYTES)
+        ma = make_chunks(a, 0xAAAA0001, 5)
+        mb = make_chunks(b, 0xBBBB0002, 5)
+        done = []
+        for x, y in zip(ma, mb):
+            for m in (x, y):
+                r = asm.add(m, source="t", now=0)
+                if r is not None:
+                    done.append(r[2])
+        self.assertEqual(done, [a, b])
+        self.assertEqual(asm.dropped, 0)
+
+    def test_reboot_restarts_frame_ids(self):
+        """Tras un reinicio los ids vuelven a empezar: el frame a medias de antes no se mezcla."""
+        asm = pb.ChunkAssembler()
+        before = frame_bytes(5, 3 * CHUNK_BYTES)
+        after = frame_bytes(6, 3 * CHUNK_BYTES)
+        old = make_chunks(before, 0x00000001, 0)
+        new = make_chunks(after, 0x00000002, 0)
+        # Corte a mitad del frame 0 del arranque anterior
+        self.assertIsNone(asm.add(old[0], source="t", now=0))
+        self.assertIsNone(asm.add(old[1], source="t", now=0))
+        self.assertIsNone(asm.add(new[0], source="t", now=1))
+        self.assertIsNone(asm.add(new[1], source="t", now=1))
+        # Un trozo rezagado del arranque anterior no completa ni corrompe el nuevo
+        self.assertEqual(asm.add(old[2], source="t", now=1)[2], before)
+        self.assertEqual(asm.add(new[2], source="t", now=1)[2], after)
+
+    def test_incomplete_expires(self):
+        asm = pb.ChunkAssembler(timeout=30)
+        msgs = make_chunks(frame_bytes(7, 2 * CHUNK_BYTES), 9, 1)
+        self.assertIsNone(asm.add(msgs[0], source="t", now=0))
+        other = make_chunks(b"x", 9, 2)
+        self.assertIsNotNone(asm.add(other[0], source="t", now=31))
+        self.assertEqual(asm.pending, {})
+        self.assertEqual(asm.dropped, 1)
+
+    def test_full_keeps_own_frame(self):
+        """Con el máximo de pendientes, un trozo de un frame ya pendiente no lo desaloja."""
+        asm = pb.ChunkAssembler(max_pending=2)
+        a = frame_bytes(9, 3 * CHUNK_BYTES)
+        ma = make_chunks(a, 1, 1)
+        mb = make_chunks(frame_bytes(10, 2 * CHUNK_BYTES), 1, 2)
+        self.assertIsNone(asm.add(ma[0], source="t", now=0))
+        self.assertIsNone(asm.add(mb[0], source="t", now=1))
+        self.assertIsNone(asm.add(ma[1], source="t", now=2))
+        self.assertEqual(asm.add(ma[2], source="t", now=2)[2], a)
+        self.assertEqual(asm.dropped, 0)
+        # Un frame nuevo sí desaloja al más antiguo
+        mc = make_chunks(frame_bytes(11, 2 * CHUNK_BYTES), 1, 3)
+        md = make_chunks(frame_bytes(12, 2 * CHUNK_BYTES), 1, 4)
+        self.assertIsNone(asm.add(mc[0], source="t", now=3))
+        self.assertIsNone(asm.add(md[0], source="t", now=4))
+        self.assertEqual(asm.dropped, 1)
+        self.assertNotIn(("t", 1, 2), asm.pending)
+
+    def test_bad_chunks(self):
+        asm = pb.ChunkAssembler()
+        msg = bytearray(make_chunks(frame_bytes(8, 100), 1, 1)[0])
+        msg[-1] ^= 0x01
+        with self.assertRaises(pb.FrameError):
+            asm.add(bytes(msg), source="t")
+        old = pb.CHUNK_HEADER.pack(pb.CHUNK_MAGIC, 1, 0, 1, 1, 0, 1, 0, 0, zlib.crc32(b""))
+        with self.assertRaises(pb.FrameError):
+            asm.add(old, source="t")
+        with self.assertRaises(pb.FrameError):
+            asm.add(b"TC", source="t")
+
+
+if __name__ == "__main__":
+    unittest.main()